@@ -0,0 +1,299 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "BenchClient.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <pthread.h>
+
+#include <QDebug>
+
+#include <freerdp/channels/rdpgfx.h>
+#include <freerdp/client.h>
+#include <freerdp/client/rdpgfx.h>
+#include <freerdp/event.h>
+#include <freerdp/freerdp.h>
+#include <freerdp/gdi/gdi.h>
+#include <freerdp/input.h>
+
+#include <QRgb>
+
+namespace clk = std::chrono;
+
+namespace
+{
+// Left shift, harmless if the session forwards it to a real desktop.
+constexpr UINT8 InputScanCode = 0x2a;
+// Where the synthetic session draws its input marker.
+constexpr int MarkerX = 16;
+constexpr int MarkerY = 16;
+// Give the stream time to settle before the first key press.
+constexpr auto FirstInputDelay = clk::seconds(1);
+}
+
+struct BenchClient::Context {
+    rdpClientContext common;
+    BenchClient *client;
+    pcRdpgfxEndFrame gdiEndFrame;
+
+    static BOOL clientNew(freerdp *instance, rdpContext *context);
+    static BOOL preConnect(freerdp *instance);
+    static BOOL postConnect(freerdp *instance);
+    static void postDisconnect(freerdp *instance);
+    static void channelConnected(void *context, const ChannelConnectedEventArgs *event);
+    static void channelDisconnected(void *context, const ChannelDisconnectedEventArgs *event);
+    static UINT endFrame(RdpgfxClientContext *gfx, const RDPGFX_END_FRAME_PDU *endFrame);
+};
+
+BOOL BenchClient::Context::clientNew(freerdp *instance, rdpContext *)
+{
+    instance->PreConnect = preConnect;
+    instance->PostConnect = postConnect;
+    instance->PostDisconnect = postDisconnect;
+    instance->LoadChannels = freerdp_client_load_channels;
+    return TRUE;
+}
+
+BOOL BenchClient::Context::preConnect(freerdp *instance)
+{
+    PubSub_SubscribeChannelConnected(instance->context->pubSub, channelConnected);
+    PubSub_SubscribeChannelDisconnected(instance->context->pubSub, channelDisconnected);
+    return TRUE;
+}
+
+BOOL BenchClient::Context::postConnect(freerdp *instance)
+{
+    // Decode into memory, nothing is displayed.
+    return gdi_init(instance, PIXEL_FORMAT_BGRX32);
+}
+
+void BenchClient::Context::postDisconnect(freerdp *instance)
+{
+    PubSub_UnsubscribeChannelConnected(instance->context->pubSub, channelConnected);
+    PubSub_UnsubscribeChannelDisconnected(instance->context->pubSub, channelDisconnected);
+    gdi_free(instance);
+}
+
+void BenchClient::Context::channelConnected(void *context, const ChannelConnectedEventArgs *event)
+{
+    // Lets the GDI implementation take over the graphics pipeline.
+    freerdp_client_OnChannelConnectedEventHandler(context, event);
+
+    if (strcmp(event->name, RDPGFX_DVC_CHANNEL_NAME) == 0) {
+        auto benchContext = static_cast<Context *>(context);
+        auto gfx = static_cast<RdpgfxClientContext *>(event->pInterface);
+        benchContext->gdiEndFrame = gfx->EndFrame;
+        gfx->EndFrame = endFrame;
+        benchContext->client->m_connected = true;
+    }
+}
+
+void BenchClient::Context::channelDisconnected(void *context, const ChannelDisconnectedEventArgs *event)
+{
+    if (strcmp(event->name, RDPGFX_DVC_CHANNEL_NAME) == 0) {
+        static_cast<Context *>(context)->client->m_connected = false;
+    }
+    freerdp_client_OnChannelDisconnectedEventHandler(context, event);
+}
+
+UINT BenchClient::Context::endFrame(RdpgfxClientContext *gfx, const RDPGFX_END_FRAME_PDU *endFrame)
+{
+    auto benchContext = reinterpret_cast<Context *>(gfx->rdpcontext);
+    const auto result = benchContext->gdiEndFrame ? benchContext->gdiEndFrame(gfx, endFrame) : CHANNEL_RC_OK;
+    benchContext->client->frameDecoded(gfx->rdpcontext);
+    return result;
+}
+
+BenchClient::BenchClient(const Options &options)
+    : m_options(options)
+{
+}
+
+BenchClient::~BenchClient()
+{
+    stop();
+}
+
+void BenchClient::start()
+{
+    m_thread = std::jthread([this](std::stop_token token) {
+        run(token);
+    });
+    pthread_setname_np(m_thread.native_handle(), "bench_client");
+}
+
+void BenchClient::stop()
+{
+    if (m_thread.joinable()) {
+        m_thread.request_stop();
+        m_thread.join();
+    }
+}
+
+bool BenchClient::connected() const
+{
+    return m_connected;
+}
+
+bool BenchClient::failed() const
+{
+    return m_failed;
+}
+
+quint64 BenchClient::framesDecoded() const
+{
+    return m_framesDecoded;
+}
+
+const KRdp::LatencyHistogram &BenchClient::inputLatency() const
+{
+    return m_inputLatency;
+}
+
+quint64 BenchClient::inputTimeouts() const
+{
+    return m_inputTimeouts;
+}
+
+void BenchClient::resetInputLatency()
+{
+    m_inputLatency.reset();
+    m_inputTimeouts = 0;
+}
+
+void BenchClient::run(std::stop_token token)
+{
+    RDP_CLIENT_ENTRY_POINTS entryPoints = {};
+    entryPoints.Version = RDP_CLIENT_INTERFACE_VERSION;
+    entryPoints.Size = sizeof(RDP_CLIENT_ENTRY_POINTS_V1);
+    entryPoints.ContextSize = sizeof(Context);
+    entryPoints.ClientNew = Context::clientNew;
+
+    auto context = freerdp_client_context_new(&entryPoints);
+    if (!context) {
+        qWarning() << "Could not create FreeRDP client context";
+        m_failed = true;
+        return;
+    }
+    reinterpret_cast<Context *>(context)->client = this;
+
+    auto settings = context->settings;
+    freerdp_settings_set_string(settings, FreeRDP_ServerHostname, m_options.host.toUtf8().constData());
+    freerdp_settings_set_uint32(settings, FreeRDP_ServerPort, m_options.port);
+    freerdp_settings_set_string(settings, FreeRDP_Username, m_options.userName.toUtf8().constData());
+    freerdp_settings_set_string(settings, FreeRDP_Password, m_options.password.toUtf8().constData());
+    freerdp_settings_set_uint32(settings, FreeRDP_DesktopWidth, m_options.size.width());
+    freerdp_settings_set_uint32(settings, FreeRDP_DesktopHeight, m_options.size.height());
+    freerdp_settings_set_uint32(settings, FreeRDP_ColorDepth, 32);
+    freerdp_settings_set_bool(settings, FreeRDP_IgnoreCertificate, TRUE);
+    freerdp_settings_set_bool(settings, FreeRDP_SupportGraphicsPipeline, TRUE);
+    freerdp_settings_set_bool(settings, FreeRDP_SupportDynamicChannels, TRUE);
+    freerdp_settings_set_bool(settings, FreeRDP_GfxH264, TRUE);
+    freerdp_settings_set_bool(settings, FreeRDP_GfxAVC444, FALSE);
+    freerdp_settings_set_bool(settings, FreeRDP_GfxAVC444v2, FALSE);
+    freerdp_settings_set_bool(settings, FreeRDP_RemoteFxCodec, FALSE);
+    freerdp_settings_set_bool(settings, FreeRDP_NetworkAutoDetect, TRUE);
+    freerdp_settings_set_bool(settings, FreeRDP_RedirectClipboard, FALSE);
+    freerdp_settings_set_bool(settings, FreeRDP_AudioPlayback, FALSE);
+
+    auto instance = context->instance;
+    if (!freerdp_connect(instance)) {
+        qWarning() << "Benchmark client could not connect:" << freerdp_get_last_error_string(freerdp_get_last_error(context));
+        m_failed = true;
+        freerdp_client_context_free(context);
+        return;
+    }
+
+    while (!token.stop_requested() && !freerdp_shall_disconnect_context(context)) {
+        HANDLE handles[MAXIMUM_WAIT_OBJECTS] = {};
+        const auto count = freerdp_get_event_handles(context, handles, ARRAYSIZE(handles));
+        if (count == 0) {
+            qWarning() << "Benchmark client could not get event handles";
+            m_failed = true;
+            break;
+        }
+
+        // Wake up regularly to notice stop requests, and in time for input.
+        auto wait = clk::milliseconds(100);
+        if (m_options.inputInterval.count() > 0 && m_markerOn && !m_inputPending) {
+            wait = std::clamp(clk::ceil<clk::milliseconds>(m_nextInput - clk::steady_clock::now()), clk::milliseconds(0), wait);
+        }
+        WaitForMultipleObjects(count, handles, FALSE, DWORD(wait.count()));
+        if (!freerdp_check_event_handles(context)) {
+            if (!token.stop_requested()) {
+                m_failed = true;
+            }
+            break;
+        }
+        sendInput(context);
+    }
+
+    if (!token.stop_requested() && freerdp_shall_disconnect_context(context)) {
+        m_failed = true;
+    }
+
+    m_connected = false;
+    freerdp_disconnect(instance);
+    freerdp_client_context_free(context);
+}
+
+void BenchClient::frameDecoded(rdpContext *context)
+{
+    const auto gdi = context->gdi;
+    if (m_options.frameDecoded && gdi) {
+        m_options.frameDecoded(gdi->primary_buffer, int(gdi->stride), QSize(gdi->width, gdi->height));
+    }
+
+    if (m_options.inputInterval.count() > 0 && gdi && gdi->width > MarkerX && gdi->height > MarkerY) {
+        const auto now = clk::steady_clock::now();
+        const auto pixel = reinterpret_cast<const QRgb *>(gdi->primary_buffer + qsizetype(gdi->stride) * MarkerY)[MarkerX];
+        const bool markerOn = qGray(pixel) >= 128;
+        if (!m_markerOn) {
+            scheduleInput(now + FirstInputDelay);
+        } else if (m_inputPending && markerOn != m_markerBeforeInput) {
+            m_inputLatency.record(clk::duration_cast<clk::microseconds>(now - m_inputSentAt));
+            m_inputPending = false;
+            scheduleInput(now);
+        }
+        m_markerOn = markerOn;
+    }
+
+    m_framesDecoded.fetch_add(1, std::memory_order_relaxed);
+}
+
+void BenchClient::sendInput(rdpContext *context)
+{
+    if (m_options.inputInterval.count() <= 0 || !m_markerOn) {
+        return;
+    }
+
+    const auto now = clk::steady_clock::now();
+    if (m_inputPending) {
+        if (now - m_inputSentAt > InputTimeout) {
+            m_inputTimeouts.fetch_add(1, std::memory_order_relaxed);
+            m_inputPending = false;
+            scheduleInput(now);
+        }
+        return;
+    }
+    if (now < m_nextInput) {
+        return;
+    }
+
+    // The session reacts to the press, the release keeps the key state sane.
+    m_markerBeforeInput = *m_markerOn;
+    m_inputSentAt = clk::steady_clock::now();
+    m_inputPending = true;
+    freerdp_input_send_keyboard_event(context->input, KBD_FLAGS_DOWN, InputScanCode);
+    freerdp_input_send_keyboard_event(context->input, KBD_FLAGS_RELEASE, InputScanCode);
+}
+
+void BenchClient::scheduleInput(clk::steady_clock::time_point after)
+{
+    const auto interval = m_options.inputInterval;
+    std::uniform_int_distribution<qint64> delay(interval.count() / 2, interval.count() * 3 / 2);
+    m_nextInput = after + clk::milliseconds(delay(m_random));
+}
@@ -0,0 +1,121 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <random>
+#include <thread>
+
+#include <QSize>
+#include <QString>
+
+#include "LatencyHistogram.h"
+
+struct rdp_context;
+
+/**
+ * A headless FreeRDP client for benchmarks.
+ *
+ * The client negotiates RDPGFX with AVC420, decodes every frame into an
+ * in-memory GDI surface with FreeRDP's software path and acknowledges frames
+ * like a regular client does. It runs on its own thread, named
+ * "bench_client", so its CPU time can be told apart from the server's.
+ *
+ * Optionally it measures input latency against a KRdp::SyntheticSession:
+ * it sends a key press, notes the time and waits for the session's input
+ * marker to change in a decoded frame. Only one key press is in flight at a
+ * time, the next follows after a random delay around Options::inputInterval
+ * so presses do not line up with the frame clock.
+ */
+class BenchClient
+{
+public:
+    /**
+     * Called on the client thread with the decoded desktop after every
+     * frame, as BGRX pixels.
+     */
+    using FrameCallback = std::function<void(const uchar *data, int stride, const QSize &size)>;
+
+    struct Options {
+        QString host = QStringLiteral("127.0.0.1");
+        quint16 port = 3389;
+        QString userName;
+        QString password;
+        QSize size = QSize(1920, 1080);
+        FrameCallback frameDecoded;
+        /// Average time between key presses, zero to send no input.
+        std::chrono::milliseconds inputInterval{0};
+    };
+
+    explicit BenchClient(const Options &options);
+    ~BenchClient();
+
+    /**
+     * Connect and start processing on the client thread.
+     */
+    void start();
+    /**
+     * Disconnect and wait for the client thread to finish.
+     */
+    void stop();
+
+    /**
+     * Whether the connection is up and the graphics pipeline was opened.
+     */
+    bool connected() const;
+    /**
+     * Whether the connection failed or was closed by the server.
+     */
+    bool failed() const;
+
+    /**
+     * Number of frames decoded so far.
+     */
+    quint64 framesDecoded() const;
+
+    /**
+     * Time from sending a key press to having decoded the frame that shows
+     * the response.
+     */
+    const KRdp::LatencyHistogram &inputLatency() const;
+    /**
+     * Number of key presses without a visible response within InputTimeout.
+     */
+    quint64 inputTimeouts() const;
+    /**
+     * Forget input latency recorded so far, for example after a warmup.
+     */
+    void resetInputLatency();
+
+    static constexpr auto InputTimeout = std::chrono::seconds(2);
+
+private:
+    struct Context;
+    friend struct Context;
+
+    void run(std::stop_token token);
+    void frameDecoded(rdp_context *context);
+    void sendInput(rdp_context *context);
+    void scheduleInput(std::chrono::steady_clock::time_point after);
+
+    Options m_options;
+    std::jthread m_thread;
+    std::atomic_bool m_connected = false;
+    std::atomic_bool m_failed = false;
+    std::atomic<quint64> m_framesDecoded = 0;
+
+    KRdp::LatencyHistogram m_inputLatency;
+    std::atomic<quint64> m_inputTimeouts = 0;
+    // Only used on the client thread.
+    std::optional<bool> m_markerOn;
+    bool m_inputPending = false;
+    bool m_markerBeforeInput = false;
+    std::chrono::steady_clock::time_point m_inputSentAt;
+    std::chrono::steady_clock::time_point m_nextInput;
+    std::mt19937 m_random{0x6b726470};
+};
@@ -0,0 +1,80 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "BenchServer.h"
+
+#include <QDebug>
+#include <QFileInfo>
+#include <QProcess>
+
+#include "Metrics.h"
+
+using namespace Qt::StringLiterals;
+
+const QString BenchServer::userName = u"bench"_s;
+const QString BenchServer::password = u"bench"_s;
+
+bool BenchServer::start()
+{
+    const auto certificate = m_directory.filePath(u"bench.crt"_s);
+    const auto certificateKey = m_directory.filePath(u"bench.key"_s);
+
+    QProcess openssl;
+    openssl.start(
+        u"openssl"_s,
+        {u"req"_s, u"-nodes"_s, u"-new"_s, u"-x509"_s, u"-keyout"_s, certificateKey, u"-out"_s, certificate, u"-days"_s, u"1"_s, u"-batch"_s, u"-subj"_s, u"/CN=localhost"_s});
+    openssl.waitForFinished();
+    if (!m_directory.isValid() || openssl.exitCode() != 0 || !QFileInfo::exists(certificate) || !QFileInfo::exists(certificateKey)) {
+        qWarning() << "Could not generate a TLS certificate, is openssl installed?";
+        return false;
+    }
+
+    m_server.setAddress(QHostAddress::LocalHost);
+    m_server.setPort(0);
+    m_server.setTlsCertificate(certificate.toStdString());
+    m_server.setTlsCertificateKey(certificateKey.toStdString());
+    m_server.addUser(KRdp::User{.name = userName, .password = password});
+    return m_server.start();
+}
+
+void BenchServer::stop()
+{
+    m_server.stop();
+}
+
+KRdp::Server *BenchServer::server()
+{
+    return &m_server;
+}
+
+quint16 BenchServer::port() const
+{
+    return m_server.serverPort();
+}
+
+QHash<QString, double> BenchServer::metric(const QString &name)
+{
+    KRdp::MetricsWriter writer;
+    KRdp::MetricsRegistry::instance()->collect(writer);
+    const auto metrics = writer.toVariantMap();
+
+    QHash<QString, double> result;
+    const auto prefix = name + u'{';
+    for (auto itr = metrics.cbegin(); itr != metrics.cend(); ++itr) {
+        if (itr.key().startsWith(prefix)) {
+            result.insert(itr.key().mid(prefix.size()).chopped(1), itr.value().toDouble());
+        }
+    }
+    return result;
+}
+
+double BenchServer::metricSum(const QString &name)
+{
+    const auto values = metric(name);
+    double total = 0.0;
+    for (const auto value : values) {
+        total += value;
+    }
+    return total;
+}
@@ -0,0 +1,45 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#pragma once
+
+#include <QHash>
+#include <QString>
+#include <QTemporaryDir>
+
+#include "Server.h"
+
+/**
+ * A KRdp::Server listening on an ephemeral localhost port.
+ *
+ * It uses a throwaway certificate generated with openssl and accepts a
+ * single user, userName with password.
+ */
+class BenchServer
+{
+public:
+    static const QString userName;
+    static const QString password;
+
+    bool start();
+    void stop();
+
+    KRdp::Server *server();
+    quint16 port() const;
+
+    /**
+     * Current values of the metric \p name, by label set.
+     *
+     * For "krdp_frames_sent_total" the keys are like `session="3"`.
+     */
+    static QHash<QString, double> metric(const QString &name);
+    /**
+     * Sum of the metric \p name over all label sets.
+     */
+    static double metricSum(const QString &name);
+
+private:
+    QTemporaryDir m_directory;
+    KRdp::Server m_server;
+};
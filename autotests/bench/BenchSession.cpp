@@ -0,0 +1,89 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "BenchSession.h"
+
+#include <algorithm>
+
+#include "InputHandler.h"
+#include "RdpConnection.h"
+#include "VideoStream.h"
+
+BenchSession::BenchSession(KRdp::RdpConnection *connection, std::unique_ptr<KRdp::AbstractSession> &&session, int maxFrameRate)
+    : m_connection(connection)
+    , m_session(std::move(session))
+    , m_maxFrameRate(maxFrameRate)
+{
+    auto stream = connection->videoStream();
+
+    connect(m_session.get(), &KRdp::AbstractSession::frameReceived, stream, stream->frameSink(), Qt::DirectConnection);
+    connect(m_session.get(), &KRdp::AbstractSession::frameReceived, this, [this]() {
+        m_framesProduced.fetch_add(1, std::memory_order_relaxed);
+    }, Qt::DirectConnection);
+    connect(m_session.get(), &KRdp::AbstractSession::error, this, [this]() {
+        m_failed = true;
+    });
+    connect(connection->inputHandler(), &KRdp::InputHandler::inputEvents, m_session.get(), &KRdp::AbstractSession::sendInputEvents);
+
+    connect(stream, &KRdp::VideoStream::enabledChanged, this, [this]() {
+        if (m_connection && m_connection->videoStream()->enabled()) {
+            m_session->requestStreamingEnable(this);
+        } else {
+            m_session->requestStreamingDisable(this);
+        }
+    }, Qt::QueuedConnection);
+    connect(stream, &KRdp::VideoStream::requestedFrameRateChanged, this, &BenchSession::updateFrameRate, Qt::QueuedConnection);
+
+    // Direct, so the session is stopped before the server deletes the connection.
+    connect(connection, &KRdp::RdpConnection::stateChanged, this, [this](KRdp::RdpConnection::State state) {
+        if (state == KRdp::RdpConnection::State::Closed) {
+            stop();
+        }
+    }, Qt::DirectConnection);
+
+    updateFrameRate();
+}
+
+BenchSession::~BenchSession()
+{
+    stop();
+}
+
+void BenchSession::stop()
+{
+    m_session->requestStreamingDisable(this);
+    if (m_connection) {
+        disconnect(m_session.get(), nullptr, m_connection->videoStream(), nullptr);
+    }
+}
+
+KRdp::RdpConnection *BenchSession::connection() const
+{
+    return m_connection;
+}
+
+KRdp::AbstractSession *BenchSession::session() const
+{
+    return m_session.get();
+}
+
+quint64 BenchSession::framesProduced() const
+{
+    return m_framesProduced;
+}
+
+bool BenchSession::failed() const
+{
+    return m_failed;
+}
+
+void BenchSession::updateFrameRate()
+{
+    if (!m_connection) {
+        return;
+    }
+    m_session->setVideoFrameRate(std::min(m_connection->videoStream()->requestedFrameRate(), uint32_t(m_maxFrameRate)));
+}
+
+#include "moc_BenchSession.cpp"
@@ -0,0 +1,54 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include <QObject>
+#include <QPointer>
+
+#include "AbstractSession.h"
+
+namespace KRdp
+{
+class RdpConnection;
+}
+
+/**
+ * Connects a synthetic or replay session to a server connection.
+ *
+ * This is what the server's session controller does for a real session:
+ * frames go straight to the video stream, streaming follows the client and
+ * input goes to the session. The frame rate is capped to \p maxFrameRate on
+ * top of what the client asks for.
+ */
+class BenchSession : public QObject
+{
+    Q_OBJECT
+
+public:
+    BenchSession(KRdp::RdpConnection *connection, std::unique_ptr<KRdp::AbstractSession> &&session, int maxFrameRate);
+    ~BenchSession() override;
+
+    /**
+     * Stop producing frames. Once this returns the connection is no longer used.
+     */
+    void stop();
+
+    KRdp::RdpConnection *connection() const;
+    KRdp::AbstractSession *session() const;
+    quint64 framesProduced() const;
+    bool failed() const;
+
+private:
+    void updateFrameRate();
+
+    QPointer<KRdp::RdpConnection> m_connection;
+    std::unique_ptr<KRdp::AbstractSession> m_session;
+    int m_maxFrameRate;
+    std::atomic<quint64> m_framesProduced = 0;
+    std::atomic_bool m_failed = false;
+};
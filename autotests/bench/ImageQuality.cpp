@@ -0,0 +1,166 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "ImageQuality.h"
+
+#include <cmath>
+#include <cstdlib>
+
+namespace
+{
+constexpr int Window = 8;
+// For 8 bit values, as in the SSIM paper.
+constexpr double C1 = (0.01 * 255) * (0.01 * 255);
+constexpr double C2 = (0.03 * 255) * (0.03 * 255);
+// Mean absolute difference between neighbouring pixels above which a static
+// block counts as text, and mean absolute change above which it moved.
+constexpr int TextEdgeThreshold = 12;
+constexpr int MotionThreshold = 2;
+// Reported when a region has no error at all.
+constexpr double MaximumPsnr = 100.0;
+
+using Block = ImageQuality::BlockMap::Block;
+
+inline int luma(QRgb pixel)
+{
+    return (77 * qRed(pixel) + 150 * qGreen(pixel) + 29 * qBlue(pixel)) >> 8;
+}
+
+inline int lumaAt(const QImage &image, int x, int y)
+{
+    return luma(reinterpret_cast<const QRgb *>(image.constScanLine(y))[x]);
+}
+
+double windowSsim(const QImage &source, const QImage &decoded, int left, int top)
+{
+    double sumA = 0.0;
+    double sumB = 0.0;
+    double sumAA = 0.0;
+    double sumBB = 0.0;
+    double sumAB = 0.0;
+    for (int y = top; y < top + Window; ++y) {
+        const auto a = reinterpret_cast<const QRgb *>(source.constScanLine(y));
+        const auto b = reinterpret_cast<const QRgb *>(decoded.constScanLine(y));
+        for (int x = left; x < left + Window; ++x) {
+            const double la = luma(a[x]);
+            const double lb = luma(b[x]);
+            sumA += la;
+            sumB += lb;
+            sumAA += la * la;
+            sumBB += lb * lb;
+            sumAB += la * lb;
+        }
+    }
+
+    constexpr double count = Window * Window;
+    const double meanA = sumA / count;
+    const double meanB = sumB / count;
+    const double varianceA = sumAA / count - meanA * meanA;
+    const double varianceB = sumBB / count - meanB * meanB;
+    const double covariance = sumAB / count - meanA * meanB;
+    return ((2 * meanA * meanB + C1) * (2 * covariance + C2)) / ((meanA * meanA + meanB * meanB + C1) * (varianceA + varianceB + C2));
+}
+}
+
+ImageQuality::BlockMap ImageQuality::classify(const QImage &source, const QImage &previous, int skipRows)
+{
+    BlockMap map;
+    map.columns = source.width() / BlockSize;
+    map.rows = source.height() / BlockSize;
+    map.blocks.resize(map.columns * map.rows, Block::Flat);
+
+    const bool hasPrevious = !previous.isNull() && previous.size() == source.size();
+    for (int row = 0; row < map.rows; ++row) {
+        for (int column = 0; column < map.columns; ++column) {
+            auto &block = map.blocks[row * map.columns + column];
+            const int top = row * BlockSize;
+            const int left = column * BlockSize;
+            if (top < skipRows) {
+                block = Block::Skipped;
+                continue;
+            }
+
+            int change = 0;
+            int edges = 0;
+            for (int y = top; y < top + BlockSize; ++y) {
+                for (int x = left; x < left + BlockSize; ++x) {
+                    const int value = lumaAt(source, x, y);
+                    if (hasPrevious) {
+                        change += std::abs(value - lumaAt(previous, x, y));
+                    }
+                    if (x + 1 < left + BlockSize) {
+                        edges += std::abs(value - lumaAt(source, x + 1, y));
+                    }
+                }
+            }
+
+            constexpr int pixels = BlockSize * BlockSize;
+            if (change > MotionThreshold * pixels) {
+                block = Block::Motion;
+            } else if (edges > TextEdgeThreshold * (BlockSize - 1) * BlockSize) {
+                block = Block::Text;
+            }
+        }
+    }
+    return map;
+}
+
+std::array<ImageQuality::Score, ImageQuality::RegionCount> ImageQuality::compare(const QImage &source, const QImage &decoded, const BlockMap &map)
+{
+    std::array<double, RegionCount> squaredError = {};
+    std::array<double, RegionCount> ssim = {};
+    std::array<Score, RegionCount> scores;
+
+    for (int row = 0; row < map.rows; ++row) {
+        for (int column = 0; column < map.columns; ++column) {
+            const auto block = map.blocks[row * map.columns + column];
+            if (block == Block::Skipped) {
+                continue;
+            }
+
+            const int top = row * BlockSize;
+            const int left = column * BlockSize;
+            double blockError = 0.0;
+            for (int y = top; y < top + BlockSize; ++y) {
+                const auto a = reinterpret_cast<const QRgb *>(source.constScanLine(y));
+                const auto b = reinterpret_cast<const QRgb *>(decoded.constScanLine(y));
+                for (int x = left; x < left + BlockSize; ++x) {
+                    const int difference = luma(a[x]) - luma(b[x]);
+                    blockError += difference * difference;
+                }
+            }
+            double blockSsim = 0.0;
+            for (int y = top; y < top + BlockSize; y += Window) {
+                for (int x = left; x < left + BlockSize; x += Window) {
+                    blockSsim += windowSsim(source, decoded, x, y);
+                }
+            }
+            blockSsim /= (BlockSize / Window) * (BlockSize / Window);
+
+            auto add = [&](Region region) {
+                const auto index = int(region);
+                squaredError[index] += blockError;
+                ssim[index] += blockSsim;
+                ++scores[index].blocks;
+            };
+            add(Region::All);
+            if (block == Block::Text) {
+                add(Region::Text);
+            } else if (block == Block::Motion) {
+                add(Region::Motion);
+            }
+        }
+    }
+
+    for (int index = 0; index < RegionCount; ++index) {
+        auto &score = scores[index];
+        if (score.blocks == 0) {
+            continue;
+        }
+        const double meanSquaredError = squaredError[index] / (double(score.blocks) * BlockSize * BlockSize);
+        score.psnr = meanSquaredError > 0.0 ? std::min(10.0 * std::log10(255.0 * 255.0 / meanSquaredError), MaximumPsnr) : MaximumPsnr;
+        score.ssim = ssim[index] / score.blocks;
+    }
+    return scores;
+}
@@ -0,0 +1,68 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include <QImage>
+
+/**
+ * Objective image quality of a decoded frame against its source.
+ *
+ * Both images are compared on luma (BT.601) in blocks of BlockSize pixels.
+ * Every block of the source is classified as text (static with sharp edges),
+ * motion (changed since the previous source frame) or flat, so the quality
+ * of the areas that matter can be reported separately. SSIM is computed over
+ * 8x8 windows without overlap, which is the usual fast variant.
+ */
+class ImageQuality
+{
+public:
+    static constexpr int BlockSize = 16;
+
+    enum class Region {
+        All,
+        Text,
+        Motion,
+    };
+    static constexpr int RegionCount = 3;
+
+    struct Score {
+        double psnr = 0.0;
+        double ssim = 0.0;
+        /// Number of blocks the score covers.
+        int blocks = 0;
+    };
+
+    /**
+     * Classification of the blocks of a source frame.
+     */
+    struct BlockMap {
+        enum class Block : quint8 {
+            Skipped,
+            Flat,
+            Text,
+            Motion,
+        };
+
+        int columns = 0;
+        int rows = 0;
+        std::vector<Block> blocks;
+    };
+
+    /**
+     * Classify the blocks of \p source, \p previous is the source frame before
+     * it or a null image. Blocks in the first \p skipRows rows of pixels are
+     * left out of every region.
+     */
+    static BlockMap classify(const QImage &source, const QImage &previous, int skipRows = 0);
+
+    /**
+     * Compare \p decoded to \p source, returning a score for every Region.
+     * Both must have the same size and be 32 bit RGB.
+     */
+    static std::array<Score, RegionCount> compare(const QImage &source, const QImage &decoded, const BlockMap &map);
+};
@@ -0,0 +1,351 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "ImpairedLink.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <random>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <QDebug>
+
+using namespace Qt::StringLiterals;
+namespace clk = std::chrono;
+
+namespace
+{
+constexpr std::size_t ReadSize = 16 * 1024;
+// Roughly what a home router buffers before the sender notices.
+constexpr std::size_t QueueLimit = 256 * 1024;
+constexpr auto MinimumRetransmitTimeout = clk::milliseconds(200);
+constexpr auto MaximumPollInterval = clk::milliseconds(50);
+
+struct Segment {
+    std::vector<char> data;
+    std::size_t written = 0;
+    clk::steady_clock::time_point release;
+};
+
+struct Direction {
+    int from = -1;
+    int to = -1;
+    std::deque<Segment> queue;
+    std::size_t queuedBytes = 0;
+    clk::steady_clock::time_point transmitFree;
+    clk::steady_clock::time_point lastRelease;
+    int lossRemaining = 0;
+    bool readClosed = false;
+    bool writeClosed = false;
+};
+
+struct Connection {
+    int client = -1;
+    int server = -1;
+    Direction downstream;
+    Direction upstream;
+    bool failed = false;
+};
+
+void setNonBlocking(int socket)
+{
+    fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) | O_NONBLOCK);
+    const int one = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+int connectTo(quint16 port)
+{
+    const int socket = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(socket, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        ::close(socket);
+        return -1;
+    }
+    return socket;
+}
+}
+
+std::optional<ImpairedLink::Profile> ImpairedLink::Profile::fromName(const QString &name)
+{
+    using namespace std::chrono_literals;
+    static const QList<Profile> profiles = {
+        {.name = u"loopback"_s},
+        {.name = u"lan"_s, .latency = 250us, .jitter = 50us, .downstreamBitsPerSecond = 1'000'000'000, .upstreamBitsPerSecond = 1'000'000'000},
+        {.name = u"broadband"_s, .latency = 10ms, .jitter = 2ms, .downstreamBitsPerSecond = 50'000'000, .upstreamBitsPerSecond = 10'000'000},
+        {.name = u"wan"_s,
+         .latency = 40ms,
+         .jitter = 5ms,
+         .downstreamBitsPerSecond = 20'000'000,
+         .upstreamBitsPerSecond = 5'000'000,
+         .lossRate = 0.001},
+        {.name = u"lte"_s,
+         .latency = 30ms,
+         .jitter = 15ms,
+         .downstreamBitsPerSecond = 10'000'000,
+         .upstreamBitsPerSecond = 3'000'000,
+         .lossRate = 0.005},
+        {.name = u"congested"_s,
+         .latency = 60ms,
+         .jitter = 20ms,
+         .downstreamBitsPerSecond = 3'000'000,
+         .upstreamBitsPerSecond = 1'000'000,
+         .lossRate = 0.01,
+         .lossBurst = 3},
+    };
+
+    for (const auto &profile : profiles) {
+        if (profile.name == name) {
+            return profile;
+        }
+    }
+    return std::nullopt;
+}
+
+QStringList ImpairedLink::Profile::names()
+{
+    return {u"loopback"_s, u"lan"_s, u"broadband"_s, u"wan"_s, u"lte"_s, u"congested"_s};
+}
+
+ImpairedLink::ImpairedLink(quint16 serverPort, const Profile &profile)
+    : m_serverPort(serverPort)
+    , m_profile(profile)
+{
+}
+
+ImpairedLink::~ImpairedLink()
+{
+    stop();
+}
+
+bool ImpairedLink::start()
+{
+    m_listenSocket = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (m_listenSocket < 0 || ::bind(m_listenSocket, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || ::listen(m_listenSocket, 64) != 0
+        || ::getsockname(m_listenSocket, reinterpret_cast<sockaddr *>(&address), &length) != 0) {
+        qWarning() << "Could not listen for the impaired link:" << strerror(errno);
+        return false;
+    }
+    m_port = ntohs(address.sin_port);
+
+    m_thread = std::jthread([this](std::stop_token token) {
+        run(token);
+    });
+    pthread_setname_np(m_thread.native_handle(), "bench_link");
+    return true;
+}
+
+void ImpairedLink::stop()
+{
+    if (m_thread.joinable()) {
+        m_thread.request_stop();
+        m_thread.join();
+    }
+    if (m_listenSocket >= 0) {
+        ::close(m_listenSocket);
+        m_listenSocket = -1;
+    }
+}
+
+quint16 ImpairedLink::port() const
+{
+    return m_port;
+}
+
+void ImpairedLink::setProfile(const Profile &profile)
+{
+    std::lock_guard lock(m_profileMutex);
+    m_profile = profile;
+}
+
+ImpairedLink::Profile ImpairedLink::profile() const
+{
+    std::lock_guard lock(m_profileMutex);
+    return m_profile;
+}
+
+quint64 ImpairedLink::segmentsLost() const
+{
+    return m_segmentsLost;
+}
+
+void ImpairedLink::run(std::stop_token token)
+{
+    std::mt19937 random(0x6b726470);
+    std::list<Connection> connections;
+
+    auto readInto = [&](Direction &direction, bool downstream, const Profile &profile) {
+        Segment segment;
+        segment.data.resize(ReadSize);
+        const auto count = ::read(direction.from, segment.data.data(), segment.data.size());
+        if (count == 0) {
+            direction.readClosed = true;
+            return true;
+        }
+        if (count < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        segment.data.resize(count);
+
+        const auto now = clk::steady_clock::now();
+        const auto bitsPerSecond = downstream ? profile.downstreamBitsPerSecond : profile.upstreamBitsPerSecond;
+        direction.transmitFree = std::max(direction.transmitFree, now);
+        if (bitsPerSecond > 0) {
+            direction.transmitFree += clk::microseconds(quint64(count) * 8 * 1'000'000 / bitsPerSecond);
+        }
+
+        auto delay = clk::duration_cast<clk::steady_clock::duration>(profile.latency);
+        if (profile.jitter.count() > 0) {
+            std::uniform_int_distribution<qint64> jitter(-profile.jitter.count(), profile.jitter.count());
+            delay = std::max(delay + clk::microseconds(jitter(random)), clk::steady_clock::duration::zero());
+        }
+
+        bool lost = false;
+        if (direction.lossRemaining > 0) {
+            lost = true;
+            --direction.lossRemaining;
+        } else if (profile.lossRate > 0.0 && std::uniform_real_distribution<double>(0.0, 1.0)(random) < profile.lossRate) {
+            lost = true;
+            direction.lossRemaining = std::max(profile.lossBurst, 1) - 1;
+        }
+        if (lost) {
+            delay += MinimumRetransmitTimeout + 2 * profile.latency;
+            m_segmentsLost.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // TCP delivers in order, a delayed segment holds up the ones behind it.
+        segment.release = std::max(direction.transmitFree + delay, direction.lastRelease);
+        direction.lastRelease = segment.release;
+        direction.queuedBytes += segment.data.size();
+        direction.queue.push_back(std::move(segment));
+        return true;
+    };
+
+    auto writeFrom = [](Direction &direction) {
+        const auto now = clk::steady_clock::now();
+        while (!direction.queue.empty() && direction.queue.front().release <= now) {
+            auto &segment = direction.queue.front();
+            const auto count = ::send(direction.to, segment.data.data() + segment.written, segment.data.size() - segment.written, MSG_NOSIGNAL);
+            if (count < 0) {
+                return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            }
+            segment.written += count;
+            if (segment.written < segment.data.size()) {
+                return true;
+            }
+            direction.queuedBytes -= segment.data.size();
+            direction.queue.pop_front();
+        }
+        if (direction.queue.empty() && direction.readClosed && !direction.writeClosed) {
+            ::shutdown(direction.to, SHUT_WR);
+            direction.writeClosed = true;
+        }
+        return true;
+    };
+
+    std::vector<pollfd> descriptors;
+    while (!token.stop_requested()) {
+        const auto profile = this->profile();
+
+        descriptors.clear();
+        descriptors.push_back({m_listenSocket, POLLIN, 0});
+        auto timeout = MaximumPollInterval;
+        const auto now = clk::steady_clock::now();
+        for (auto &connection : connections) {
+            for (auto direction : {&connection.downstream, &connection.upstream}) {
+                short events = 0;
+                if (!direction->readClosed && direction->queuedBytes < QueueLimit) {
+                    events |= POLLIN;
+                }
+                if (!direction->queue.empty()) {
+                    const auto release = direction->queue.front().release;
+                    if (release <= now) {
+                        events |= POLLOUT;
+                    } else {
+                        timeout = std::min(timeout, clk::ceil<clk::milliseconds>(release - now));
+                    }
+                }
+                descriptors.push_back({direction->from, short(events & POLLIN), 0});
+                descriptors.push_back({direction->to, short(events & POLLOUT), 0});
+            }
+        }
+
+        if (::poll(descriptors.data(), descriptors.size(), int(timeout.count())) < 0 && errno != EINTR) {
+            qWarning() << "Impaired link failed:" << strerror(errno);
+            break;
+        }
+
+        if (descriptors.front().revents & POLLIN) {
+            const int client = ::accept4(m_listenSocket, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client >= 0) {
+                const int server = connectTo(m_serverPort);
+                if (server < 0) {
+                    ::close(client);
+                } else {
+                    setNonBlocking(client);
+                    setNonBlocking(server);
+                    auto &connection = connections.emplace_back();
+                    connection.client = client;
+                    connection.server = server;
+                    connection.downstream.from = server;
+                    connection.downstream.to = client;
+                    connection.upstream.from = client;
+                    connection.upstream.to = server;
+                }
+            }
+        }
+
+        std::size_t index = 1;
+        for (auto &connection : connections) {
+            const bool counted = index + 4 <= descriptors.size();
+            const auto events = [&](std::size_t offset) {
+                return counted ? descriptors[index + offset].revents : short(0);
+            };
+            // Per connection: server in, client out, client in, server out.
+            if (events(0) & (POLLIN | POLLHUP | POLLERR)) {
+                connection.failed |= !readInto(connection.downstream, true, profile);
+            }
+            if (events(2) & (POLLIN | POLLHUP | POLLERR)) {
+                connection.failed |= !readInto(connection.upstream, false, profile);
+            }
+            connection.failed |= !writeFrom(connection.downstream);
+            connection.failed |= !writeFrom(connection.upstream);
+            index += counted ? 4 : 0;
+        }
+
+        connections.remove_if([](const Connection &connection) {
+            const bool done = connection.downstream.writeClosed && connection.upstream.writeClosed;
+            if (connection.failed || done) {
+                ::close(connection.client);
+                ::close(connection.server);
+                return true;
+            }
+            return false;
+        });
+    }
+
+    for (const auto &connection : connections) {
+        ::close(connection.client);
+        ::close(connection.server);
+    }
+}
@@ -0,0 +1,87 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+#include <QString>
+#include <QStringList>
+
+/**
+ * A TCP relay on localhost that makes the link to a server behave like a
+ * slower network.
+ *
+ * Clients connect to port() instead of the server. Data is forwarded in both
+ * directions with added latency and jitter, limited bandwidth and segment
+ * loss. TCP hides loss from the endpoints, so a lost segment shows up the
+ * way it would on a real link: it and everything behind it arrive a
+ * retransmission timeout later. Data waiting to be sent is capped like a
+ * router buffer, beyond that the sender is blocked.
+ *
+ * Impairments are pseudo-random with a fixed seed so runs are repeatable.
+ * Forwarding happens on a thread named "bench_link".
+ */
+class ImpairedLink
+{
+public:
+    struct Profile {
+        QString name;
+        /// Added one way, so the round trip grows by twice this.
+        std::chrono::microseconds latency{0};
+        /// Latency varies randomly by up to this much, without reordering.
+        std::chrono::microseconds jitter{0};
+        /// Server to client bandwidth in bits per second, 0 for no limit.
+        quint64 downstreamBitsPerSecond = 0;
+        /// Client to server bandwidth in bits per second, 0 for no limit.
+        quint64 upstreamBitsPerSecond = 0;
+        /// Chance for a segment to be lost, from 0 to 1.
+        double lossRate = 0.0;
+        /// Number of consecutive segments lost once a loss happens.
+        int lossBurst = 1;
+
+        /**
+         * One of the predefined profiles, see names().
+         */
+        static std::optional<Profile> fromName(const QString &name);
+        static QStringList names();
+    };
+
+    ImpairedLink(quint16 serverPort, const Profile &profile);
+    ~ImpairedLink();
+
+    bool start();
+    void stop();
+
+    /**
+     * The port clients should connect to.
+     */
+    quint16 port() const;
+
+    /**
+     * Change the impairments, for example to simulate a link getting worse.
+     * Only data read after this uses the new profile.
+     */
+    void setProfile(const Profile &profile);
+    Profile profile() const;
+
+    quint64 segmentsLost() const;
+
+private:
+    void run(std::stop_token token);
+
+    quint16 m_serverPort;
+    int m_listenSocket = -1;
+    quint16 m_port = 0;
+
+    mutable std::mutex m_profileMutex;
+    Profile m_profile;
+
+    std::jthread m_thread;
+    std::atomic<quint64> m_segmentsLost = 0;
+};
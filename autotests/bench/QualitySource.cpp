@@ -0,0 +1,319 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "QualitySource.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <mutex>
+
+#include <QDebug>
+#include <QFont>
+#include <QLinearGradient>
+#include <QPainter>
+#include <QRadialGradient>
+#include <QRegion>
+
+#include "FrameGenerator.h"
+
+using namespace Qt::StringLiterals;
+namespace clk = std::chrono;
+
+namespace
+{
+constexpr int BarcodeBits = 32;
+// The low bits are the frame number, the high bits a check value so a badly
+// decoded barcode is not mistaken for another frame.
+constexpr int NumberBits = 24;
+constexpr quint32 NumberMask = (1u << NumberBits) - 1;
+constexpr std::size_t KeptFrames = 64;
+constexpr double TypingRate = 20.0;
+constexpr int TextMargin = 24;
+
+const QString Paragraph =
+    u"The quick brown fox jumps over the lazy dog. Pack my box with five dozen liquor jugs. "
+    "Sphinx of black quartz, judge my vow! 0123456789 (){}[]<>;:,./?|\\-_=+*&^%$#@! "_s;
+
+quint32 checkOf(quint32 number)
+{
+    number ^= number >> 13;
+    number *= 0x5bd1e995;
+    number ^= number >> 15;
+    return number & 0xff;
+}
+
+quint32 barcodeOf(quint32 number)
+{
+    number &= NumberMask;
+    return number | (checkOf(number) << NumberBits);
+}
+}
+
+class QualitySource::Private
+{
+public:
+    KRdp::FrameGenerator::Image renderFrame(bool restarted);
+    QImage render(clk::steady_clock::duration elapsed);
+    void drawTestCard(QPainter &painter, clk::steady_clock::duration elapsed);
+    void drawBarcode(QImage &image, quint32 number);
+    QRegion changedSince(const QImage &image, const QImage &before) const;
+
+    QualitySource *q = nullptr;
+    QSize size;
+    QStringList imageFiles;
+    bool started = false;
+
+    std::unique_ptr<KRdp::FrameGenerator> generator;
+
+    mutable std::mutex framesMutex;
+    std::deque<std::pair<quint32, Frame>> frames;
+
+    // Everything below is only used by the generator thread.
+    QList<QImage> images;
+    clk::steady_clock::time_point startedAt;
+    QImage previous;
+    quint32 frameNumber = 0;
+};
+
+QualitySource::QualitySource(const QSize &size, const QStringList &images)
+    : d(std::make_unique<Private>())
+{
+    d->q = this;
+    // YUV420 subsamples chroma 2x2, so the encoder needs even dimensions.
+    d->size = QSize(size.width() & ~1, size.height() & ~1);
+    d->imageFiles = images;
+    d->generator = std::make_unique<KRdp::FrameGenerator>(this, "krdp_quality_source", [this](clk::steady_clock::duration, bool restarted) {
+        return d->renderFrame(restarted);
+    });
+    d->generator->setSize(d->size);
+    d->generator->setFrameRate(30);
+    d->generator->setBitrate(2'000'000);
+}
+
+QualitySource::~QualitySource()
+{
+    d->generator->stop();
+}
+
+void QualitySource::start()
+{
+    for (const auto &file : std::as_const(d->imageFiles)) {
+        QImage image(file);
+        if (image.isNull()) {
+            qWarning() << "Could not load" << file;
+            continue;
+        }
+        d->images.append(image.scaled(d->size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation).convertToFormat(QImage::Format_RGB32));
+    }
+
+    setSize(d->size);
+    setLogicalSize(d->size);
+    d->started = true;
+    setStarted(true);
+}
+
+void QualitySource::setStreamingEnabled(bool enable)
+{
+    AbstractSession::setStreamingEnabled(enable);
+
+    if (enable && d->started) {
+        d->generator->start();
+    } else if (!enable) {
+        d->generator->stop();
+    }
+}
+
+void QualitySource::setVideoFrameRate(quint32 framerate)
+{
+    AbstractSession::setVideoFrameRate(framerate);
+    d->generator->setFrameRate(framerate);
+}
+
+void QualitySource::sendInputEvents(const KRdp::InputEvents &events)
+{
+    Q_UNUSED(events);
+}
+
+void QualitySource::setClipboardData(std::unique_ptr<QMimeData> data)
+{
+    Q_UNUSED(data);
+}
+
+void QualitySource::setBitrate(quint32 bitsPerSecond)
+{
+    d->generator->setBitrate(bitsPerSecond);
+}
+
+std::optional<quint32> QualitySource::readBarcode(const uchar *pixels, int stride, const QSize &size)
+{
+    const int cellWidth = size.width() / BarcodeBits;
+    if (cellWidth < 2 || size.height() < BarcodeHeight) {
+        return std::nullopt;
+    }
+
+    quint32 barcode = 0;
+    const auto row = reinterpret_cast<const QRgb *>(pixels + qsizetype(stride) * (BarcodeHeight / 2));
+    for (int bit = 0; bit < BarcodeBits; ++bit) {
+        if (qGray(row[bit * cellWidth + cellWidth / 2]) >= 128) {
+            barcode |= 1u << bit;
+        }
+    }
+
+    const auto number = barcode & NumberMask;
+    if (barcodeOf(number) != barcode) {
+        return std::nullopt;
+    }
+    return number;
+}
+
+std::optional<QualitySource::Frame> QualitySource::frame(quint32 number) const
+{
+    std::lock_guard lock(d->framesMutex);
+    for (const auto &[kept, frame] : d->frames) {
+        if (kept == (number & NumberMask)) {
+            return frame;
+        }
+    }
+    return std::nullopt;
+}
+
+KRdp::FrameGenerator::Image QualitySource::Private::renderFrame(bool restarted)
+{
+    const auto now = clk::steady_clock::now();
+    if (restarted) {
+        startedAt = now;
+        previous = QImage();
+    }
+
+    auto image = render(now - startedAt);
+    const auto number = frameNumber++ & NumberMask;
+    drawBarcode(image, number);
+
+    {
+        Frame frame{image, ImageQuality::classify(image, previous, BarcodeHeight)};
+        std::lock_guard lock(framesMutex);
+        frames.emplace_back(number, std::move(frame));
+        while (frames.size() > KeptFrames) {
+            frames.pop_front();
+        }
+    }
+    const auto damage = changedSince(image, previous);
+    previous = image;
+
+    // Format_RGB32 is BGRX in memory on little endian.
+    return KRdp::FrameGenerator::Image{
+        .pixels = previous.constBits(),
+        .stride = int(previous.bytesPerLine()),
+        .damage = damage,
+    };
+}
+
+QImage QualitySource::Private::render(clk::steady_clock::duration elapsed)
+{
+    if (!images.isEmpty()) {
+        // Copied, so the barcode does not end up in the next round.
+        return images.at(frameNumber % images.size()).copy();
+    }
+
+    QImage image(size, QImage::Format_RGB32);
+    QPainter painter(&image);
+    drawTestCard(painter, elapsed);
+    return image;
+}
+
+void QualitySource::Private::drawTestCard(QPainter &painter, clk::steady_clock::duration elapsed)
+{
+    const double seconds = clk::duration<double>(elapsed).count();
+    const QRect textArea(0, BarcodeHeight, size.width() / 2, size.height() - BarcodeHeight);
+    const QRect motionArea(textArea.right() + 1, BarcodeHeight, size.width() - textArea.width(), textArea.height());
+
+    // Dark text on a light page, typed at a steady rate.
+    painter.fillRect(textArea, QColor(0xfa, 0xfa, 0xf8));
+    QFont font;
+    font.setPixelSize(14);
+    painter.setFont(font);
+    painter.setPen(QColor(0x20, 0x20, 0x24));
+    const auto typed = qsizetype(seconds * TypingRate);
+    const int lineHeight = painter.fontMetrics().lineSpacing();
+    const int charactersPerLine = std::max(1, (textArea.width() - 2 * TextMargin) / std::max(1, painter.fontMetrics().averageCharWidth()));
+    const int linesPerPage = std::max(1, (textArea.height() - 2 * TextMargin) / lineHeight);
+    const auto onPage = typed % (qsizetype(charactersPerLine) * linesPerPage);
+    for (int line = 0; line * charactersPerLine < onPage; ++line) {
+        QString text;
+        for (qsizetype i = line * charactersPerLine; i < std::min(onPage, qsizetype(line + 1) * charactersPerLine); ++i) {
+            text.append(Paragraph.at(i % Paragraph.size()));
+        }
+        painter.drawText(textArea.left() + TextMargin, textArea.top() + TextMargin + (line + 1) * lineHeight, text);
+    }
+
+    // Smooth gradients and shapes that keep moving, like video or animations.
+    QLinearGradient background(motionArea.topLeft(), motionArea.bottomRight());
+    const double phase = std::fmod(seconds * 0.1, 1.0);
+    background.setColorAt(0.0, QColor::fromHsvF(phase, 0.6, 0.9));
+    background.setColorAt(0.5, QColor::fromHsvF(std::fmod(phase + 0.3, 1.0), 0.7, 0.5));
+    background.setColorAt(1.0, QColor::fromHsvF(std::fmod(phase + 0.6, 1.0), 0.5, 0.8));
+    background.setSpread(QGradient::ReflectSpread);
+    background.setStart(motionArea.topLeft() + QPointF(seconds * 120.0, 0.0));
+    background.setFinalStop(motionArea.topLeft() + QPointF(seconds * 120.0 + motionArea.width() / 2.0, motionArea.height() / 2.0));
+    painter.fillRect(motionArea, background);
+
+    painter.setClipRect(motionArea);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setPen(Qt::NoPen);
+    for (int i = 0; i < 3; ++i) {
+        const double radius = motionArea.height() / (5.0 + i);
+        const QPointF center(motionArea.center().x() + std::sin(seconds * (0.7 + i * 0.3)) * (motionArea.width() / 2.0 - radius),
+                             motionArea.center().y() + std::cos(seconds * (0.5 + i * 0.4)) * (motionArea.height() / 2.0 - radius));
+        QRadialGradient ball(center, radius, center - QPointF(radius / 3.0, radius / 3.0));
+        ball.setColorAt(0.0, Qt::white);
+        ball.setColorAt(1.0, QColor::fromHsvF(std::fmod(phase + i / 3.0, 1.0), 0.9, 0.6));
+        painter.setBrush(ball);
+        painter.drawEllipse(center, radius, radius);
+    }
+}
+
+void QualitySource::Private::drawBarcode(QImage &image, quint32 number)
+{
+    const auto barcode = barcodeOf(number);
+    const int cellWidth = size.width() / BarcodeBits;
+    for (int y = 0; y < BarcodeHeight; ++y) {
+        auto row = reinterpret_cast<QRgb *>(image.scanLine(y));
+        std::fill(row, row + size.width(), 0xff000000);
+        for (int bit = 0; bit < BarcodeBits; ++bit) {
+            if (barcode & (1u << bit)) {
+                std::fill(row + bit * cellWidth, row + (bit + 1) * cellWidth, 0xffffffff);
+            }
+        }
+    }
+}
+
+QRegion QualitySource::Private::changedSince(const QImage &image, const QImage &before) const
+{
+    const QRect frameRect(QPoint(0, 0), size);
+    if (before.isNull()) {
+        return frameRect;
+    }
+
+    // Per block, like a compositor reports damage in tiles.
+    constexpr int block = ImageQuality::BlockSize;
+    QRegion damage;
+    for (int top = 0; top < size.height(); top += block) {
+        for (int left = 0; left < size.width(); left += block) {
+            const QRect rect = QRect(left, top, block, block).intersected(frameRect);
+            for (int y = rect.top(); y <= rect.bottom(); ++y) {
+                const auto offset = rect.left() * sizeof(QRgb);
+                if (std::memcmp(image.constScanLine(y) + offset, before.constScanLine(y) + offset, rect.width() * sizeof(QRgb)) != 0) {
+                    damage += rect;
+                    break;
+                }
+            }
+        }
+    }
+    return damage;
+}
+
+#include "moc_QualitySource.cpp"
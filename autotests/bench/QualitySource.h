@@ -0,0 +1,76 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#pragma once
+
+#include <memory>
+#include <optional>
+
+#include <QImage>
+#include <QSize>
+#include <QStringList>
+
+#include "AbstractSession.h"
+
+#include "ImageQuality.h"
+
+/**
+ * A session producing known frames whose decoded result can be compared to
+ * what was encoded.
+ *
+ * By default this draws a test card: text being typed on the left half and
+ * smoothly moving gradients on the right half, so both text and motion
+ * regions are present. Alternatively a list of images is shown one per frame.
+ * Frames are encoded with FreeRDP's H.264 encoder at a fixed bitrate.
+ *
+ * Every frame carries its number as a barcode in the top BarcodeHeight rows,
+ * which frame(number) uses to return the source a decoded frame came from.
+ * The most recent frames are kept for that. Rendering and encoding happen on
+ * a thread named "krdp_quality_source". QPainter is used for rendering, which
+ * needs a QGuiApplication.
+ */
+class QualitySource : public KRdp::AbstractSession
+{
+    Q_OBJECT
+
+public:
+    static constexpr int BarcodeHeight = ImageQuality::BlockSize;
+
+    struct Frame {
+        QImage image;
+        ImageQuality::BlockMap blocks;
+    };
+
+    explicit QualitySource(const QSize &size, const QStringList &images = {});
+    ~QualitySource() override;
+
+    void start() override;
+    void setStreamingEnabled(bool enable) override;
+    void setVideoFrameRate(quint32 framerate) override;
+
+    void sendInputEvents(const KRdp::InputEvents &events) override;
+    void setClipboardData(std::unique_ptr<QMimeData> data) override;
+
+    /**
+     * Target bitrate of the encoder in bits per second. Changing it starts
+     * over with a key frame.
+     */
+    void setBitrate(quint32 bitsPerSecond);
+
+    /**
+     * The frame number encoded in the barcode of \p pixels, a BGRX image of
+     * \p size with \p stride bytes per row. Empty if it cannot be read.
+     */
+    static std::optional<quint32> readBarcode(const uchar *pixels, int stride, const QSize &size);
+
+    /**
+     * The source of frame \p number, if it is recent enough to still be kept.
+     * Can be called from any thread.
+     */
+    std::optional<Frame> frame(quint32 number) const;
+
+private:
+    class Private;
+    const std::unique_ptr<Private> d;
+};
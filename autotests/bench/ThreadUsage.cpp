@@ -0,0 +1,66 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "ThreadUsage.h"
+
+#include <unistd.h>
+
+#include <QDir>
+#include <QFile>
+
+ThreadUsage ThreadUsage::sample()
+{
+    static const auto ticksPerSecond = sysconf(_SC_CLK_TCK);
+
+    ThreadUsage usage;
+    const auto tasks = QDir(QStringLiteral("/proc/self/task")).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const auto &task : tasks) {
+        QFile file(QStringLiteral("/proc/self/task/%1/stat").arg(task));
+        if (!file.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+
+        // "tid (name) state ppid ...", the name may contain spaces.
+        const auto stat = QString::fromUtf8(file.readAll());
+        const auto nameStart = stat.indexOf(u'(');
+        const auto nameEnd = stat.lastIndexOf(u')');
+        if (nameStart < 0 || nameEnd < nameStart) {
+            continue;
+        }
+        const auto name = stat.mid(nameStart + 1, nameEnd - nameStart - 1);
+        const auto fields = QStringView(stat).mid(nameEnd + 2).split(u' ');
+        // utime and stime are fields 14 and 15, counting from the tid.
+        if (fields.size() < 13) {
+            continue;
+        }
+        const auto ticks = fields.at(11).toLongLong() + fields.at(12).toLongLong();
+
+        usage.cpuTime[name] += std::chrono::microseconds(ticks * 1'000'000 / ticksPerSecond);
+        ++usage.threadCount;
+    }
+
+    QFile status(QStringLiteral("/proc/self/status"));
+    if (status.open(QIODevice::ReadOnly)) {
+        // "VmRSS:     123456 kB"
+        for (const auto &line : status.readAll().split('\n')) {
+            if (line.startsWith("VmRSS:")) {
+                usage.residentBytes = line.mid(6).trimmed().split(' ').value(0).toLongLong() * 1024;
+                break;
+            }
+        }
+    }
+
+    return usage;
+}
+
+std::chrono::microseconds ThreadUsage::cpuTimeOf(const QString &prefix) const
+{
+    std::chrono::microseconds total{0};
+    for (auto itr = cpuTime.cbegin(); itr != cpuTime.cend(); ++itr) {
+        if (itr.key().startsWith(prefix)) {
+            total += itr.value();
+        }
+    }
+    return total;
+}
@@ -0,0 +1,31 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#pragma once
+
+#include <chrono>
+
+#include <QHash>
+#include <QString>
+
+/**
+ * CPU time used by the threads of this process, by thread name, and the
+ * process' resident memory.
+ *
+ * New threads inherit the name of the thread that created them, so the
+ * threads FreeRDP starts for a connection are accounted to "krdp_session"
+ * on the server side and to "bench_client" on the client side.
+ */
+struct ThreadUsage {
+    QHash<QString, std::chrono::microseconds> cpuTime;
+    int threadCount = 0;
+    qint64 residentBytes = 0;
+
+    static ThreadUsage sample();
+
+    /**
+     * CPU time of threads whose name starts with \p prefix.
+     */
+    std::chrono::microseconds cpuTimeOf(const QString &prefix) const;
+};
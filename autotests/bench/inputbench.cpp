@@ -0,0 +1,434 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+// Compares the two ways PortalSession can send input: one DBus Notify* call
+// per event, or libei device frames over the socket ConnectToEIS returns.
+// Both receivers run in this process on their own thread: a libeis server
+// for EIS and an object implementing NotifyPointerMotionAbsolute for DBus.
+// The portal itself is left out. It relays DBus calls from its frontend to
+// its backend and on to the compositor, while EIS connects the compositor
+// directly, so the DBus numbers here are a lower bound.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include <poll.h>
+#include <pthread.h>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDBusConnection>
+#include <QDBusError>
+#include <QDBusObjectPath>
+#include <QDBusServer>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QThread>
+#include <QTimer>
+
+#include <libeis.h>
+
+#include "EisSender.h"
+#include "LatencyHistogram.h"
+
+#include "inputbench_remotedesktop_interface.h"
+
+using namespace Qt::StringLiterals;
+namespace clk = std::chrono;
+
+namespace
+{
+// Events carry their sequence number as x position, in a region this wide
+// and one pixel high, so the receiver can find when each was sent.
+constexpr int SequenceRange = 4096;
+const QSize InputSize(SequenceRange, 1);
+
+const auto PortalPath = u"/org/freedesktop/portal/desktop"_s;
+const auto BenchService = u"org.kde.krdp.InputBench"_s;
+
+qint64 nowNs()
+{
+    return clk::duration_cast<clk::nanoseconds>(clk::steady_clock::now().time_since_epoch()).count();
+}
+
+// Shared between the sending main thread and a receiver thread.
+struct Probe {
+    void markSent(int sequence)
+    {
+        sent[sequence % SequenceRange].store(nowNs(), std::memory_order_relaxed);
+    }
+
+    void markReceived(double x)
+    {
+        const auto sequence = std::clamp(qRound(x), 0, SequenceRange - 1);
+        latency.record(clk::duration_cast<clk::microseconds>(clk::nanoseconds(nowNs() - sent[sequence].load(std::memory_order_relaxed))));
+        received.fetch_add(1, std::memory_order_release);
+    }
+
+    std::array<std::atomic<qint64>, SequenceRange> sent = {};
+    std::atomic<quint64> received = 0;
+    KRdp::LatencyHistogram latency;
+};
+
+/**
+ * A minimal EIS implementation: one seat with one absolute pointer device
+ * covering the sequence region, running on its own thread.
+ */
+class EisReceiver
+{
+public:
+    explicit EisReceiver(Probe &probe)
+        : m_probe(probe)
+    {
+        m_eis = eis_new(nullptr);
+        eis_setup_backend_fd(m_eis);
+    }
+
+    ~EisReceiver()
+    {
+        m_thread = {};
+        if (m_device) {
+            eis_device_unref(m_device);
+        }
+        if (m_seat) {
+            eis_seat_unref(m_seat);
+        }
+        eis_unref(m_eis);
+    }
+
+    /**
+     * A socket for a libei sender to connect with. Must be called before
+     * start().
+     */
+    int addClient()
+    {
+        return eis_backend_fd_add_client(m_eis);
+    }
+
+    void start()
+    {
+        m_thread = std::jthread([this](std::stop_token token) {
+            run(token);
+        });
+        pthread_setname_np(m_thread.native_handle(), "bench_eis");
+    }
+
+private:
+    void run(std::stop_token token)
+    {
+        pollfd fd{.fd = eis_get_fd(m_eis), .events = POLLIN, .revents = 0};
+        while (!token.stop_requested()) {
+            if (poll(&fd, 1, 100) <= 0) {
+                continue;
+            }
+            eis_dispatch(m_eis);
+            while (auto event = eis_get_event(m_eis)) {
+                handleEvent(event);
+                eis_event_unref(event);
+            }
+        }
+    }
+
+    void handleEvent(eis_event *event)
+    {
+        switch (eis_event_get_type(event)) {
+        case EIS_EVENT_CLIENT_CONNECT: {
+            auto client = eis_event_get_client(event);
+            eis_client_connect(client);
+            m_seat = eis_client_new_seat(client, "krdp-bench");
+            eis_seat_configure_capability(m_seat, EIS_DEVICE_CAP_POINTER_ABSOLUTE);
+            eis_seat_configure_capability(m_seat, EIS_DEVICE_CAP_BUTTON);
+            eis_seat_add(m_seat);
+            break;
+        }
+        case EIS_EVENT_CLIENT_DISCONNECT:
+            eis_client_disconnect(eis_event_get_client(event));
+            break;
+        case EIS_EVENT_SEAT_BIND: {
+            if (m_device || !eis_event_seat_has_capability(event, EIS_DEVICE_CAP_POINTER_ABSOLUTE)) {
+                break;
+            }
+            m_device = eis_seat_new_device(eis_event_get_seat(event));
+            eis_device_configure_name(m_device, "krdp-bench pointer");
+            eis_device_configure_capability(m_device, EIS_DEVICE_CAP_POINTER_ABSOLUTE);
+            eis_device_configure_capability(m_device, EIS_DEVICE_CAP_BUTTON);
+            auto region = eis_device_new_region(m_device);
+            eis_region_set_offset(region, 0, 0);
+            eis_region_set_size(region, InputSize.width(), InputSize.height());
+            eis_region_add(region);
+            eis_region_unref(region);
+            eis_device_add(m_device);
+            eis_device_resume(m_device);
+            break;
+        }
+        case EIS_EVENT_POINTER_MOTION_ABSOLUTE:
+            m_lastX = eis_event_pointer_get_absolute_x(event);
+            break;
+        case EIS_EVENT_FRAME:
+            // What a compositor acts on.
+            m_probe.markReceived(m_lastX);
+            break;
+        default:
+            break;
+        }
+    }
+
+    Probe &m_probe;
+    eis *m_eis = nullptr;
+    eis_seat *m_seat = nullptr;
+    eis_device *m_device = nullptr;
+    double m_lastX = 0.0;
+    std::jthread m_thread;
+};
+
+/**
+ * The receiving end of the portal's NotifyPointerMotionAbsolute.
+ */
+class DBusReceiver : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.freedesktop.portal.RemoteDesktop")
+
+public:
+    explicit DBusReceiver(Probe &probe)
+        : m_probe(probe)
+    {
+    }
+
+public Q_SLOTS:
+    void NotifyPointerMotionAbsolute(const QDBusObjectPath &session, const QVariantMap &options, uint stream, double x, double y)
+    {
+        Q_UNUSED(session);
+        Q_UNUSED(options);
+        Q_UNUSED(stream);
+        Q_UNUSED(y);
+        m_probe.markReceived(x);
+    }
+
+private:
+    Probe &m_probe;
+};
+
+struct Result {
+    bool ok = false;
+    // Time spent in the sending call, per event.
+    double sendMicroseconds = 0.0;
+};
+
+/**
+ * Send \p count motion events in batches of \p batchSize through \p send,
+ * waiting for each batch to arrive before sending the next.
+ */
+template<typename SendFunction>
+Result measure(Probe &probe, int count, int batchSize, clk::milliseconds interval, SendFunction send)
+{
+    KRdp::InputEvents batch;
+    batch.reserve(batchSize);
+    clk::nanoseconds sendTime{0};
+
+    for (int sequence = 0; sequence < count;) {
+        batch.clear();
+        for (int i = 0; i < batchSize && sequence < count; ++i, ++sequence) {
+            batch.append(KRdp::InputEvent{.type = KRdp::InputEvent::Type::PointerMotion, .x = uint16_t(sequence % SequenceRange)});
+        }
+
+        const auto expected = probe.received.load(std::memory_order_acquire) + batch.size();
+        const auto start = clk::steady_clock::now();
+        for (const auto &event : batch) {
+            probe.markSent(event.x);
+        }
+        send(batch);
+        sendTime += clk::steady_clock::now() - start;
+
+        while (probe.received.load(std::memory_order_acquire) < expected) {
+            if (clk::steady_clock::now() - start > clk::seconds(5)) {
+                qWarning() << "Input events did not arrive within 5 seconds";
+                return {};
+            }
+            std::this_thread::yield();
+        }
+        std::this_thread::sleep_for(interval);
+    }
+
+    return Result{.ok = true, .sendMicroseconds = clk::duration<double, std::micro>(sendTime).count() / count};
+}
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication application{argc, argv};
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(u"Compares input latency of portal sessions over DBus and over EIS."_s);
+    parser.addHelpOption();
+    parser.addOptions({
+        {u"count"_s, u"Number of events to send per transport."_s, u"count"_s, u"5000"_s},
+        {u"batch"_s, u"Events sent together, as InputHandler would dispatch them."_s, u"events"_s, u"1"_s},
+        {u"interval"_s, u"Milliseconds to wait between batches."_s, u"milliseconds"_s, u"2"_s},
+        {u"transports"_s, u"Transports to measure: eis, dbus or both."_s, u"list"_s, u"eis,dbus"_s},
+        {u"session-bus"_s, u"Send DBus calls through the session bus instead of a direct connection, adding the bus daemon hop."_s},
+        {u"json"_s, u"Print the results as JSON."_s},
+    });
+    parser.process(application);
+
+    const int count = parser.value(u"count"_s).toInt();
+    const int batchSize = parser.value(u"batch"_s).toInt();
+    const auto interval = clk::milliseconds(parser.value(u"interval"_s).toInt());
+    const auto transports = parser.value(u"transports"_s).split(u',', Qt::SkipEmptyParts);
+    if (count <= 0 || batchSize <= 0 || transports.isEmpty()) {
+        qWarning() << "Invalid count, batch size or transports";
+        return 1;
+    }
+
+    QJsonObject results{
+        {u"count"_s, count},
+        {u"batch"_s, batchSize},
+        {u"interval_ms"_s, qint64(interval.count())},
+        {u"dbus_connection"_s, parser.isSet(u"session-bus"_s) ? u"session bus"_s : u"direct"_s},
+    };
+    const auto addResult = [&results](const QString &name, const Probe &probe, const Result &result) {
+        const auto milliseconds = [](clk::microseconds value) {
+            return value.count() / 1000.0;
+        };
+        results[name] = QJsonObject{
+            {u"received"_s, qint64(probe.latency.count())},
+            {u"latency_p50_ms"_s, milliseconds(probe.latency.percentile(50.0))},
+            {u"latency_p95_ms"_s, milliseconds(probe.latency.percentile(95.0))},
+            {u"latency_p99_ms"_s, milliseconds(probe.latency.percentile(99.0))},
+            {u"latency_max_ms"_s, milliseconds(probe.latency.max())},
+            {u"send_us_per_event"_s, result.sendMicroseconds},
+        };
+    };
+
+    for (const auto &transport : transports) {
+        if (transport == u"eis"_s) {
+            Probe probe;
+            EisReceiver receiver(probe);
+            const int fd = receiver.addClient();
+            if (fd < 0) {
+                qWarning() << "Could not set up the EIS server";
+                return 1;
+            }
+            receiver.start();
+
+            KRdp::EisSender sender;
+            if (!sender.connectToFd(fd)) {
+                return 1;
+            }
+            if (!sender.isReady()) {
+                QEventLoop loop;
+                QObject::connect(&sender, &KRdp::EisSender::ready, &loop, &QEventLoop::quit);
+                QTimer::singleShot(clk::seconds(5), &loop, &QEventLoop::quit);
+                loop.exec();
+            }
+            if (!sender.isReady()) {
+                qWarning() << "The EIS device was not resumed";
+                return 1;
+            }
+
+            const auto result = measure(probe, count, batchSize, interval, [&sender](const KRdp::InputEvents &events) {
+                sender.send(events, InputSize);
+            });
+            if (!result.ok) {
+                return 1;
+            }
+            addResult(u"eis"_s, probe, result);
+        } else if (transport == u"dbus"_s) {
+            Probe probe;
+            QThread thread;
+            thread.setObjectName(u"bench_dbus"_s);
+            thread.start();
+
+            // Set up on the receiving thread, so calls are delivered there.
+            QObject context;
+            context.moveToThread(&thread);
+            std::unique_ptr<DBusReceiver> receiver;
+            std::unique_ptr<QDBusServer> server;
+            QString address;
+            QMetaObject::invokeMethod(
+                &context,
+                [&]() {
+                    receiver = std::make_unique<DBusReceiver>(probe);
+                    if (parser.isSet(u"session-bus"_s)) {
+                        auto connection = QDBusConnection::connectToBus(QDBusConnection::SessionBus, u"krdp_input_bench_receiver"_s);
+                        connection.registerService(BenchService);
+                        connection.registerObject(PortalPath, receiver.get(), QDBusConnection::ExportAllSlots);
+                    } else {
+                        server = std::make_unique<QDBusServer>();
+                        QObject::connect(server.get(), &QDBusServer::newConnection, receiver.get(), [&receiver](const QDBusConnection &connection) {
+                            QDBusConnection(connection).registerObject(PortalPath, receiver.get(), QDBusConnection::ExportAllSlots);
+                        });
+                        address = server->address();
+                    }
+                },
+                Qt::BlockingQueuedConnection);
+
+            auto connection = parser.isSet(u"session-bus"_s) ? QDBusConnection::sessionBus()
+                                                               : QDBusConnection::connectToPeer(address, u"krdp_input_bench_sender"_s);
+            if (!connection.isConnected()) {
+                qWarning() << "Could not connect to DBus:" << connection.lastError().message();
+                return 1;
+            }
+            OrgFreedesktopPortalRemoteDesktopInterface interface(parser.isSet(u"session-bus"_s) ? BenchService : QString(), PortalPath, connection);
+            const QDBusObjectPath session(u"/org/kde/krdp/bench"_s);
+
+            // One call per event, as PortalSession does without EIS.
+            const auto result = measure(probe, count, batchSize, interval, [&](const KRdp::InputEvents &events) {
+                for (const auto &event : events) {
+                    interface.NotifyPointerMotionAbsolute(session, QVariantMap{}, 0, event.x, event.y);
+                }
+            });
+
+            QMetaObject::invokeMethod(
+                &context,
+                [&]() {
+                    server.reset();
+                    receiver.reset();
+                    QDBusConnection::disconnectFromBus(u"krdp_input_bench_receiver"_s);
+                },
+                Qt::BlockingQueuedConnection);
+            thread.quit();
+            thread.wait();
+
+            if (!result.ok) {
+                return 1;
+            }
+            addResult(u"dbus"_s, probe, result);
+        } else {
+            qWarning() << "Unknown transport" << transport;
+            return 1;
+        }
+    }
+
+    QTextStream out(stdout);
+    if (parser.isSet(u"json"_s)) {
+        out << QJsonDocument(results).toJson(QJsonDocument::Indented);
+        return 0;
+    }
+
+    out << "Portal input transports, " << count << " events in batches of " << batchSize << " every " << interval.count() << " ms\n";
+    out << Qt::fixed << qSetRealNumberPrecision(3);
+    for (const auto &transport : transports) {
+        const auto result = results[transport].toObject();
+        out << "  " << qSetFieldWidth(5) << Qt::left << transport << qSetFieldWidth(0) << "p50=" << result[u"latency_p50_ms"_s].toDouble()
+            << " ms p95=" << result[u"latency_p95_ms"_s].toDouble() << " ms p99=" << result[u"latency_p99_ms"_s].toDouble()
+            << " ms max=" << result[u"latency_max_ms"_s].toDouble() << " ms, " << qSetRealNumberPrecision(1) << result[u"send_us_per_event"_s].toDouble()
+            << " µs/event to send" << qSetRealNumberPrecision(3) << "\n";
+    }
+    if (!parser.isSet(u"session-bus"_s)) {
+        out << "  DBus over a direct connection, --session-bus adds the bus daemon\n";
+    }
+
+    return 0;
+}
+
+#include "inputbench.moc"
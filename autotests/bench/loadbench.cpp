@@ -0,0 +1,622 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+// Connects an increasing number of concurrent headless FreeRDP clients to
+// KRdp::Server and reports how CPU, memory, threads, frame rate and frame
+// acknowledge latency scale with the number of sessions.
+//
+// The clients run in a child process, started from this same executable with
+// --client-worker, so memory and threads of this process are the server's.
+// The impaired links of the sessions run there as well.
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+#include <unistd.h>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+#include <QSocketNotifier>
+#include <QTextStream>
+#include <QTimer>
+
+#include "LatencyHistogram.h"
+#include "RdpConnection.h"
+#include "SyntheticSession.h"
+#include "VideoStream.h"
+
+#include "BenchClient.h"
+#include "BenchServer.h"
+#include "BenchSession.h"
+#include "ImpairedLink.h"
+#include "ThreadUsage.h"
+
+using namespace Qt::StringLiterals;
+namespace clk = std::chrono;
+
+namespace
+{
+// Connecting all clients at the same time makes the first frames time out.
+constexpr auto ClientStagger = clk::milliseconds(100);
+constexpr auto StatusInterval = clk::milliseconds(250);
+constexpr auto TeardownTimeout = clk::seconds(15);
+
+QSize parseSize(const QString &text)
+{
+    const auto parts = text.split(u'x');
+    return parts.size() == 2 ? QSize(parts.at(0).toInt(), parts.at(1).toInt()) : QSize();
+}
+
+// Runs in the child process: connects the clients, each through a link with
+// the next network profile from the list, and prints a status line with the
+// number of failed clients and the frames decoded per client. With --input it
+// also prints the input latency per client as count/p50/p95/p99/timeouts in
+// microseconds, and starts that over when "reset" is read from stdin.
+int runClientWorker(QCoreApplication &application, const QCommandLineParser &parser)
+{
+    signal(SIGTERM, [](int) {
+        QCoreApplication::exit(0);
+    });
+
+    const int count = parser.value(u"clients"_s).toInt();
+    const auto serverPort = quint16(parser.value(u"port"_s).toUInt());
+    const auto networks = parser.value(u"network"_s).split(u',', Qt::SkipEmptyParts);
+    const auto inputInterval = clk::milliseconds(parser.value(u"input"_s).toInt());
+
+    std::vector<std::unique_ptr<ImpairedLink>> links;
+    std::vector<std::unique_ptr<BenchClient>> clients;
+    QTimer connectTimer;
+    connectTimer.setInterval(ClientStagger);
+    QObject::connect(&connectTimer, &QTimer::timeout, &application, [&]() {
+        const auto profile = ImpairedLink::Profile::fromName(networks.at(clients.size() % networks.size()).trimmed());
+        links.push_back(std::make_unique<ImpairedLink>(serverPort, profile.value_or(ImpairedLink::Profile{})));
+        links.back()->start();
+        clients.push_back(std::make_unique<BenchClient>(BenchClient::Options{
+            .port = links.back()->port(),
+            .userName = BenchServer::userName,
+            .password = BenchServer::password,
+            .size = parseSize(parser.value(u"size"_s)),
+            .inputInterval = inputInterval,
+        }));
+        clients.back()->start();
+        if (int(clients.size()) >= count) {
+            connectTimer.stop();
+        }
+    });
+    connectTimer.start();
+
+    QSocketNotifier commands(STDIN_FILENO, QSocketNotifier::Read);
+    QObject::connect(&commands, &QSocketNotifier::activated, &application, [&]() {
+        char buffer[64];
+        const auto count = ::read(STDIN_FILENO, buffer, sizeof(buffer));
+        if (count <= 0) {
+            commands.setEnabled(false);
+            return;
+        }
+        if (QByteArray(buffer, count).contains("reset")) {
+            for (const auto &client : clients) {
+                client->resetInputLatency();
+            }
+        }
+    });
+
+    QTextStream out(stdout);
+    QTimer statusTimer;
+    statusTimer.setInterval(StatusInterval);
+    QObject::connect(&statusTimer, &QTimer::timeout, &application, [&]() {
+        const auto failed = std::count_if(clients.cbegin(), clients.cend(), [](const auto &client) {
+            return client->failed();
+        });
+        out << "status " << failed;
+        for (const auto &client : clients) {
+            out << ' ' << client->framesDecoded();
+        }
+        out << Qt::endl;
+
+        if (inputInterval.count() > 0) {
+            out << "input";
+            for (const auto &client : clients) {
+                const auto &latency = client->inputLatency();
+                out << ' ' << latency.count() << '/' << latency.percentile(50.0).count() << '/' << latency.percentile(95.0).count() << '/'
+                    << latency.percentile(99.0).count() << '/' << client->inputTimeouts();
+            }
+            out << Qt::endl;
+        }
+    });
+    statusTimer.start();
+
+    application.exec();
+
+    for (const auto &client : clients) {
+        client->stop();
+    }
+    for (const auto &link : links) {
+        link->stop();
+    }
+    return 0;
+}
+
+struct InputStatus {
+    quint64 count = 0;
+    clk::microseconds p50{0};
+    clk::microseconds p95{0};
+    clk::microseconds p99{0};
+    quint64 timeouts = 0;
+};
+
+struct Snapshot {
+    QElapsedTimer::Duration time;
+    QHash<QString, double> framesSent;
+    std::vector<quint64> framesDecoded;
+    ThreadUsage usage;
+};
+
+class LoadGenerator : public QObject
+{
+public:
+    struct Options {
+        std::vector<int> steps;
+        std::vector<KRdp::SyntheticSession::Content> contents;
+        QStringList networks;
+        QSize size;
+        int frameRate = 30;
+        clk::milliseconds inputInterval{0};
+        clk::seconds warmup;
+        clk::seconds duration;
+        clk::seconds timeout;
+    };
+
+    explicit LoadGenerator(const Options &options)
+        : m_options(options)
+    {
+        QObject::connect(m_server.server(), &KRdp::Server::newConnectionCreated, this, &LoadGenerator::onNewConnection);
+        QObject::connect(&m_clients, &QProcess::readyReadStandardOutput, this, &LoadGenerator::readClientStatus);
+        m_clients.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+
+        m_poll.setInterval(clk::milliseconds(100));
+        QObject::connect(&m_poll, &QTimer::timeout, this, &LoadGenerator::poll);
+    }
+
+    bool start()
+    {
+        if (!m_server.start()) {
+            return false;
+        }
+        m_idle = ThreadUsage::sample();
+        m_timer.start();
+        startStep();
+        m_poll.start();
+        return true;
+    }
+
+    const QJsonArray &results() const
+    {
+        return m_results;
+    }
+
+    bool failed() const
+    {
+        return m_failed;
+    }
+
+    void stop()
+    {
+        m_poll.stop();
+        stopClients();
+        m_sessions.clear();
+        m_server.stop();
+    }
+
+private:
+    enum class Phase { Connecting, Warmup, Measuring, TearingDown };
+
+    int sessionCount() const
+    {
+        return m_options.steps.at(m_step);
+    }
+
+    void startStep()
+    {
+        qInfo() << "Connecting" << sessionCount() << "sessions";
+        m_phase = Phase::Connecting;
+        m_phaseTimer.start();
+        m_clientStatus.clear();
+        m_inputStatus.clear();
+        m_clientsFailed = 0;
+        m_clients.start(QCoreApplication::applicationFilePath(),
+                        {u"--client-worker"_s,
+                         u"--port"_s,
+                         QString::number(m_server.port()),
+                         u"--clients"_s,
+                         QString::number(sessionCount()),
+                         u"--size"_s,
+                         u"%1x%2"_s.arg(m_options.size.width()).arg(m_options.size.height()),
+                         u"--network"_s,
+                         m_options.networks.join(u','),
+                         u"--input"_s,
+                         QString::number(m_options.inputInterval.count())});
+    }
+
+    void stopClients()
+    {
+        if (m_clients.state() != QProcess::NotRunning) {
+            m_clients.terminate();
+            if (!m_clients.waitForFinished(5000)) {
+                m_clients.kill();
+                m_clients.waitForFinished();
+            }
+        }
+    }
+
+    void onNewConnection(KRdp::RdpConnection *connection)
+    {
+        const auto content = m_options.contents.at(m_sessions.size() % m_options.contents.size());
+        m_sessions.push_back(std::make_unique<BenchSession>(connection, std::make_unique<KRdp::SyntheticSession>(content, m_options.size), m_options.frameRate));
+    }
+
+    void readClientStatus()
+    {
+        while (m_clients.canReadLine()) {
+            const auto fields = QString::fromUtf8(m_clients.readLine()).trimmed().split(u' ');
+            if (fields.first() == u"input"_s) {
+                m_inputStatus.clear();
+                for (qsizetype i = 1; i < fields.size(); ++i) {
+                    const auto values = fields.at(i).split(u'/');
+                    if (values.size() == 5) {
+                        m_inputStatus.push_back(InputStatus{
+                            .count = values.at(0).toULongLong(),
+                            .p50 = clk::microseconds(values.at(1).toLongLong()),
+                            .p95 = clk::microseconds(values.at(2).toLongLong()),
+                            .p99 = clk::microseconds(values.at(3).toLongLong()),
+                            .timeouts = values.at(4).toULongLong(),
+                        });
+                    }
+                }
+                continue;
+            }
+            if (fields.size() < 2 || fields.at(0) != u"status"_s) {
+                continue;
+            }
+            m_clientsFailed = fields.at(1).toInt();
+            m_clientStatus.clear();
+            for (qsizetype i = 2; i < fields.size(); ++i) {
+                m_clientStatus.push_back(fields.at(i).toULongLong());
+            }
+        }
+    }
+
+    Snapshot takeSnapshot() const
+    {
+        return Snapshot{
+            .time = m_timer.durationElapsed(),
+            .framesSent = BenchServer::metric(u"krdp_frames_sent_total"_s),
+            .framesDecoded = m_clientStatus,
+            .usage = ThreadUsage::sample(),
+        };
+    }
+
+    void fail(const QString &reason)
+    {
+        qWarning().noquote() << reason << "with" << sessionCount() << "sessions";
+        m_failed = true;
+        QCoreApplication::quit();
+    }
+
+    void poll()
+    {
+        if (m_phase != Phase::TearingDown) {
+            if (m_clientsFailed > 0 || (m_phase != Phase::Connecting && m_clients.state() == QProcess::NotRunning)) {
+                fail(u"Client connections failed"_s);
+                return;
+            }
+            const bool sessionFailed = std::any_of(m_sessions.cbegin(), m_sessions.cend(), [](const auto &session) {
+                return session->failed() || !session->connection();
+            });
+            if (sessionFailed) {
+                fail(u"Server sessions failed"_s);
+                return;
+            }
+        }
+
+        switch (m_phase) {
+        case Phase::Connecting: {
+            const bool allDecoding = int(m_clientStatus.size()) == sessionCount() && std::ranges::all_of(m_clientStatus, [](quint64 frames) {
+                                         return frames > 0;
+                                     });
+            if (allDecoding && int(m_sessions.size()) == sessionCount()) {
+                m_phase = Phase::Warmup;
+                m_phaseTimer.restart();
+            } else if (m_phaseTimer.durationElapsed() > m_options.timeout) {
+                fail(u"Not all sessions decoded a frame within %1 seconds"_s.arg(m_options.timeout.count()));
+            }
+            break;
+        }
+        case Phase::Warmup:
+            if (m_phaseTimer.durationElapsed() >= m_options.warmup) {
+                m_start = takeSnapshot();
+                m_clients.write("reset\n");
+                m_phase = Phase::Measuring;
+                m_phaseTimer.restart();
+            }
+            break;
+        case Phase::Measuring:
+            if (m_phaseTimer.durationElapsed() >= m_options.duration) {
+                m_results.append(report(takeSnapshot()));
+                stopClients();
+                m_phase = Phase::TearingDown;
+                m_phaseTimer.restart();
+            }
+            break;
+        case Phase::TearingDown: {
+            const bool allClosed = std::ranges::all_of(m_sessions, [](const auto &session) {
+                return !session->connection();
+            });
+            if (!allClosed && m_phaseTimer.durationElapsed() < TeardownTimeout) {
+                break;
+            }
+            m_sessions.clear();
+            if (++m_step >= int(m_options.steps.size())) {
+                QCoreApplication::quit();
+            } else {
+                startStep();
+            }
+            break;
+        }
+        }
+    }
+
+    QJsonObject report(const Snapshot &end) const
+    {
+        const int sessions = sessionCount();
+        const auto seconds = clk::duration<double>(end.time - m_start.time).count();
+        const auto cpuPercent = [&](const QString &prefix) {
+            const auto cpu = end.usage.cpuTimeOf(prefix) - m_start.usage.cpuTimeOf(prefix);
+            return clk::duration<double>(cpu).count() / seconds * 100.0;
+        };
+        const auto megabytes = [](qint64 bytes) {
+            return double(bytes) / (1024.0 * 1024.0);
+        };
+        const auto milliseconds = [](clk::microseconds value) {
+            return value.count() / 1000.0;
+        };
+        const auto mean = [](const std::vector<double> &values) {
+            return values.empty() ? 0.0 : std::accumulate(values.cbegin(), values.cend(), 0.0) / double(values.size());
+        };
+        const auto minimum = [](const std::vector<double> &values) {
+            return values.empty() ? 0.0 : *std::ranges::min_element(values);
+        };
+        const auto maximum = [](const std::vector<double> &values) {
+            return values.empty() ? 0.0 : *std::ranges::max_element(values);
+        };
+
+        std::vector<double> fpsSent;
+        for (auto itr = end.framesSent.cbegin(); itr != end.framesSent.cend(); ++itr) {
+            if (m_start.framesSent.contains(itr.key())) {
+                fpsSent.push_back((itr.value() - m_start.framesSent.value(itr.key())) / seconds);
+            }
+        }
+        std::vector<double> fpsDecoded;
+        for (std::size_t i = 0; i < std::min(end.framesDecoded.size(), m_start.framesDecoded.size()); ++i) {
+            fpsDecoded.push_back(double(end.framesDecoded.at(i) - m_start.framesDecoded.at(i)) / seconds);
+        }
+        // Acknowledge latency is over the whole connection, including warmup.
+        std::vector<double> ackP50;
+        std::vector<double> ackP95;
+        std::vector<double> ackP99;
+        for (const auto &session : m_sessions) {
+            const auto &latency = session->connection()->videoStream()->latency(KRdp::VideoStream::LatencyStage::Acknowledge);
+            ackP50.push_back(milliseconds(latency.percentile(50.0)));
+            ackP95.push_back(milliseconds(latency.percentile(95.0)));
+            ackP99.push_back(milliseconds(latency.percentile(99.0)));
+        }
+
+        const auto serverCpu = cpuPercent(u"krdp"_s) - cpuPercent(u"krdp_synthetic"_s);
+        QJsonObject result{
+            {u"sessions"_s, sessions},
+            {u"duration_s"_s, seconds},
+            {u"server_cpu_percent"_s, serverCpu},
+            {u"server_cpu_percent_per_session"_s, serverCpu / sessions},
+            {u"content_cpu_percent"_s, cpuPercent(u"krdp_synthetic"_s)},
+            {u"rss_mb"_s, megabytes(end.usage.residentBytes)},
+            {u"rss_mb_per_session"_s, megabytes(end.usage.residentBytes - m_idle.residentBytes) / sessions},
+            {u"threads"_s, end.usage.threadCount},
+            {u"threads_per_session"_s, double(end.usage.threadCount - m_idle.threadCount) / sessions},
+            {u"fps_sent_mean"_s, mean(fpsSent)},
+            {u"fps_sent_min"_s, minimum(fpsSent)},
+            {u"fps_decoded_mean"_s, mean(fpsDecoded)},
+            {u"fps_decoded_min"_s, minimum(fpsDecoded)},
+            {u"ack_latency_p50_ms"_s, mean(ackP50)},
+            {u"ack_latency_p95_ms"_s, mean(ackP95)},
+            {u"ack_latency_p99_ms_worst"_s, maximum(ackP99)},
+        };
+
+        if (m_options.inputInterval.count() > 0) {
+            // Input latency is from the start of measuring, see "reset".
+            std::vector<double> inputP50;
+            std::vector<double> inputP95;
+            std::vector<double> inputP99;
+            quint64 inputCount = 0;
+            quint64 inputTimeouts = 0;
+            for (const auto &input : m_inputStatus) {
+                inputCount += input.count;
+                inputTimeouts += input.timeouts;
+                if (input.count > 0) {
+                    inputP50.push_back(milliseconds(input.p50));
+                    inputP95.push_back(milliseconds(input.p95));
+                    inputP99.push_back(milliseconds(input.p99));
+                }
+            }
+            result[u"input_count"_s] = qint64(inputCount);
+            result[u"input_timeouts"_s] = qint64(inputTimeouts);
+            result[u"input_latency_p50_ms"_s] = mean(inputP50);
+            result[u"input_latency_p95_ms"_s] = mean(inputP95);
+            result[u"input_latency_p99_ms_worst"_s] = maximum(inputP99);
+        }
+        return result;
+    }
+
+    Options m_options;
+    BenchServer m_server;
+    QProcess m_clients;
+    QTimer m_poll;
+    QElapsedTimer m_timer;
+    QElapsedTimer m_phaseTimer;
+
+    Phase m_phase = Phase::Connecting;
+    int m_step = 0;
+    std::vector<std::unique_ptr<BenchSession>> m_sessions;
+    std::vector<quint64> m_clientStatus;
+    std::vector<InputStatus> m_inputStatus;
+    int m_clientsFailed = 0;
+    ThreadUsage m_idle;
+    Snapshot m_start;
+    QJsonArray m_results;
+    bool m_failed = false;
+};
+
+void printTable(const QJsonArray &results)
+{
+    QTextStream out(stdout);
+    const bool withInput = !results.isEmpty() && results.first().toObject().contains(u"input_count"_s);
+    out << qSetFieldWidth(0) << "sessions  server CPU %  per session  content CPU %  RSS MB  per session  threads  fps sent (min)  fps decoded (min)  ack p50/p95/p99 ms";
+    out << (withInput ? "  input p50/p95/p99 ms (timeouts)\n" : "\n");
+    out << Qt::fixed << qSetRealNumberPrecision(1);
+    for (const auto &value : results) {
+        const auto result = value.toObject();
+        const auto number = [&](const QString &key, int width) {
+            out << qSetFieldWidth(width) << result[key].toDouble() << qSetFieldWidth(0);
+        };
+        out << qSetFieldWidth(8) << result[u"sessions"_s].toInt() << qSetFieldWidth(0);
+        number(u"server_cpu_percent"_s, 14);
+        number(u"server_cpu_percent_per_session"_s, 13);
+        number(u"content_cpu_percent"_s, 15);
+        number(u"rss_mb"_s, 8);
+        number(u"rss_mb_per_session"_s, 13);
+        out << qSetFieldWidth(9) << result[u"threads"_s].toInt() << qSetFieldWidth(0);
+        number(u"fps_sent_mean"_s, 10);
+        out << " (";
+        number(u"fps_sent_min"_s, 0);
+        out << ')';
+        number(u"fps_decoded_mean"_s, 12);
+        out << " (";
+        number(u"fps_decoded_min"_s, 0);
+        out << ")  ";
+        number(u"ack_latency_p50_ms"_s, 0);
+        out << '/';
+        number(u"ack_latency_p95_ms"_s, 0);
+        out << '/';
+        number(u"ack_latency_p99_ms_worst"_s, 0);
+        if (withInput) {
+            out << "  ";
+            number(u"input_latency_p50_ms"_s, 0);
+            out << '/';
+            number(u"input_latency_p95_ms"_s, 0);
+            out << '/';
+            number(u"input_latency_p99_ms_worst"_s, 0);
+            out << " (" << result[u"input_timeouts"_s].toInteger() << ')';
+        }
+        out << '\n';
+    }
+}
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication application{argc, argv};
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(u"Measures how KRdp scales with the number of concurrent sessions."_s);
+    parser.addHelpOption();
+    parser.addOptions({
+        {u"sessions"_s, u"Comma separated numbers of concurrent sessions to measure."_s, u"list"_s, u"1,2,4,8,16,32"_s},
+        {u"content"_s,
+         u"Comma separated synthetic content, assigned to sessions in turn: idle, typing, scrolling or video."_s,
+         u"list"_s,
+         u"typing,scrolling,video,idle"_s},
+        {u"network"_s,
+         u"Comma separated network profiles, assigned to sessions in turn: %1."_s.arg(ImpairedLink::Profile::names().join(u", "_s)),
+         u"list"_s,
+         u"loopback"_s},
+        {u"duration"_s, u"Seconds to measure each step for."_s, u"seconds"_s, u"10"_s},
+        {u"warmup"_s, u"Seconds to run after all sessions decoded a frame before measuring."_s, u"seconds"_s, u"3"_s},
+        {u"timeout"_s, u"Seconds to wait for all sessions to decode a frame."_s, u"seconds"_s, u"60"_s},
+        {u"size"_s, u"Frame size of every session."_s, u"WIDTHxHEIGHT"_s, u"1280x720"_s},
+        {u"fps"_s, u"Frame rate of the generated content."_s, u"fps"_s, u"30"_s},
+        {u"input"_s,
+         u"Send a key press from every client about every this many milliseconds and report the time until its response is decoded."_s,
+         u"milliseconds"_s,
+         u"0"_s},
+        {u"json"_s, u"Print the results as JSON."_s},
+    });
+    QCommandLineOption workerOption(u"client-worker"_s);
+    workerOption.setFlags(QCommandLineOption::HiddenFromHelp);
+    QCommandLineOption portOption(u"port"_s, {}, u"port"_s);
+    portOption.setFlags(QCommandLineOption::HiddenFromHelp);
+    QCommandLineOption clientsOption(u"clients"_s, {}, u"count"_s);
+    clientsOption.setFlags(QCommandLineOption::HiddenFromHelp);
+    parser.addOptions({workerOption, portOption, clientsOption});
+    parser.process(application);
+
+    if (parser.isSet(workerOption)) {
+        return runClientWorker(application, parser);
+    }
+
+    LoadGenerator::Options options{
+        .size = parseSize(parser.value(u"size"_s)),
+        .frameRate = parser.value(u"fps"_s).toInt(),
+        .inputInterval = clk::milliseconds(parser.value(u"input"_s).toInt()),
+        .warmup = clk::seconds(parser.value(u"warmup"_s).toInt()),
+        .duration = clk::seconds(std::max(parser.value(u"duration"_s).toInt(), 1)),
+        .timeout = clk::seconds(parser.value(u"timeout"_s).toInt()),
+    };
+    for (const auto &step : parser.value(u"sessions"_s).split(u',', Qt::SkipEmptyParts)) {
+        if (step.toInt() > 0) {
+            options.steps.push_back(step.toInt());
+        }
+    }
+    for (const auto &name : parser.value(u"content"_s).split(u',', Qt::SkipEmptyParts)) {
+        const auto content = KRdp::SyntheticSession::contentFromString(name.trimmed());
+        if (!content) {
+            qWarning() << "Unknown content" << name;
+            return 1;
+        }
+        options.contents.push_back(*content);
+    }
+    for (const auto &name : parser.value(u"network"_s).split(u',', Qt::SkipEmptyParts)) {
+        if (!ImpairedLink::Profile::fromName(name.trimmed())) {
+            qWarning() << "Unknown network profile" << name;
+            return 1;
+        }
+        options.networks.append(name.trimmed());
+    }
+    if (options.steps.empty() || options.contents.empty() || options.networks.isEmpty() || options.size.isEmpty() || options.frameRate <= 0) {
+        qWarning() << "Invalid session counts, content, size or frame rate";
+        return 1;
+    }
+
+    LoadGenerator generator(options);
+    if (!generator.start()) {
+        return 1;
+    }
+    application.exec();
+    generator.stop();
+
+    if (parser.isSet(u"json"_s)) {
+        QTextStream(stdout) << QJsonDocument(generator.results()).toJson(QJsonDocument::Indented);
+    } else {
+        printTable(generator.results());
+    }
+
+    return generator.failed() ? 1 : 0;
+}
@@ -0,0 +1,346 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+// Runs KRdp::Server on localhost against an in-process headless FreeRDP
+// client and reports what a single session sustains. Needs neither a GPU nor
+// a compositor: content comes from a SyntheticSession or a ReplaySession.
+
+#include <chrono>
+#include <memory>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPointer>
+#include <QTextStream>
+#include <QTimer>
+
+#include "LatencyHistogram.h"
+#include "RdpConnection.h"
+#include "ReplaySession.h"
+#include "SyntheticSession.h"
+#include "VideoStream.h"
+
+#include "BenchClient.h"
+#include "BenchServer.h"
+#include "BenchSession.h"
+#include "ImpairedLink.h"
+#include "ThreadUsage.h"
+
+using namespace Qt::StringLiterals;
+namespace clk = std::chrono;
+
+namespace
+{
+struct Snapshot {
+    QElapsedTimer::Duration time;
+    quint64 framesSent = 0;
+    quint64 bytesSent = 0;
+    quint64 framesDecoded = 0;
+    quint64 framesProduced = 0;
+    ThreadUsage usage;
+};
+
+// What --baseline compares, and whether a higher value is better.
+const QList<std::pair<QString, bool>> ComparedMetrics = {
+    {u"fps_decoded"_s, true},
+    {u"server_cpu_percent"_s, false},
+    {u"ack_latency_p50_ms"_s, false},
+    {u"ack_latency_p95_ms"_s, false},
+    {u"ack_latency_p99_ms"_s, false},
+    {u"input_latency_p50_ms"_s, false},
+    {u"input_latency_p95_ms"_s, false},
+    {u"input_latency_p99_ms"_s, false},
+};
+
+// How libKRdp was built, from KRDP_PGO.
+QString buildType()
+{
+    const auto pgo = QString::fromLatin1(KRDP_BENCH_PGO);
+    if (pgo == u"GENERATE"_s) {
+        return u"instrumented"_s;
+    } else if (pgo == u"USE"_s) {
+        return u"pgo"_s;
+    }
+    return u"default"_s;
+}
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication application{argc, argv};
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(u"Measures a single KRdp session over loopback with a headless FreeRDP client."_s);
+    parser.addHelpOption();
+    parser.addOptions({
+        {u"duration"_s, u"Seconds to measure for."_s, u"seconds"_s, u"10"_s},
+        {u"warmup"_s, u"Seconds to run after the first decoded frame before measuring."_s, u"seconds"_s, u"2"_s},
+        {u"timeout"_s, u"Seconds to wait for the first decoded frame."_s, u"seconds"_s, u"30"_s},
+        {u"size"_s, u"Frame size."_s, u"WIDTHxHEIGHT"_s, u"1920x1080"_s},
+        {u"fps"_s, u"Frame rate of the generated content."_s, u"fps"_s, u"60"_s},
+        {u"content"_s, u"What the session shows: idle, typing, scrolling or video."_s, u"content"_s, u"video"_s},
+        {u"replay"_s, u"Replay a recording made with krdpstreamer instead of generating content. --size should match it."_s, u"file"_s},
+        {u"unpaced"_s, u"Replay the recording as fast as possible instead of in real time."_s},
+        {u"network"_s, u"Network between server and client: %1."_s.arg(ImpairedLink::Profile::names().join(u", "_s)), u"profile"_s, u"loopback"_s},
+        {u"input"_s,
+         u"Send a key press about every this many milliseconds and report the time until its response is decoded. Needs generated content."_s,
+         u"milliseconds"_s},
+        {u"baseline"_s, u"Results of an earlier run saved with --json, for example on a build without PGO, to report the speedup against."_s, u"file"_s},
+        {u"json"_s, u"Print the results as JSON."_s},
+    });
+    parser.process(application);
+
+    const auto sizeParts = parser.value(u"size"_s).split(u'x');
+    const QSize size = sizeParts.size() == 2 ? QSize(sizeParts.at(0).toInt(), sizeParts.at(1).toInt()) : QSize();
+    const int frameRate = parser.value(u"fps"_s).toInt();
+    const auto warmup = clk::seconds(parser.value(u"warmup"_s).toInt());
+    const auto duration = clk::seconds(std::max(parser.value(u"duration"_s).toInt(), 1));
+    const auto timeout = clk::seconds(parser.value(u"timeout"_s).toInt());
+    const auto content = KRdp::SyntheticSession::contentFromString(parser.value(u"content"_s));
+    if (size.isEmpty() || frameRate <= 0 || !content) {
+        qWarning() << "Invalid size, frame rate or content";
+        return 1;
+    }
+
+    const auto inputInterval = clk::milliseconds(parser.value(u"input"_s).toInt());
+    if (parser.isSet(u"input"_s) && (inputInterval.count() <= 0 || parser.isSet(u"replay"_s))) {
+        qWarning() << "--input needs a positive interval and generated content";
+        return 1;
+    }
+
+    QJsonObject baseline;
+    if (parser.isSet(u"baseline"_s)) {
+        QFile file(parser.value(u"baseline"_s));
+        if (file.open(QIODevice::ReadOnly)) {
+            baseline = QJsonDocument::fromJson(file.readAll()).object();
+        }
+        if (baseline.isEmpty()) {
+            qWarning() << "Could not read baseline results from" << file.fileName();
+            return 1;
+        }
+    }
+
+    if (buildType() == u"instrumented"_s) {
+        qWarning() << "libKRdp is instrumented for PGO (KRDP_PGO=GENERATE), results are not representative";
+    }
+
+    const auto network = ImpairedLink::Profile::fromName(parser.value(u"network"_s));
+    if (!network) {
+        qWarning() << "Unknown network profile" << parser.value(u"network"_s);
+        return 1;
+    }
+
+    BenchServer server;
+    if (!server.start()) {
+        return 1;
+    }
+
+    ImpairedLink link(server.port(), *network);
+    if (!link.start()) {
+        return 1;
+    }
+
+    std::unique_ptr<BenchSession> source;
+    QPointer<KRdp::RdpConnection> connection;
+    QObject::connect(server.server(), &KRdp::Server::newConnectionCreated, server.server(), [&](KRdp::RdpConnection *newConnection) {
+        if (connection) {
+            return;
+        }
+        connection = newConnection;
+        std::unique_ptr<KRdp::AbstractSession> session;
+        if (parser.isSet(u"replay"_s)) {
+            session = std::make_unique<KRdp::ReplaySession>(parser.value(u"replay"_s),
+                                                            parser.isSet(u"unpaced"_s) ? KRdp::ReplaySession::Pacing::AsFastAsPossible
+                                                                                       : KRdp::ReplaySession::Pacing::RealTime);
+        } else {
+            session = std::make_unique<KRdp::SyntheticSession>(*content, size);
+        }
+        source = std::make_unique<BenchSession>(newConnection, std::move(session), frameRate);
+    });
+
+    BenchClient client({
+        .port = link.port(),
+        .userName = BenchServer::userName,
+        .password = BenchServer::password,
+        .size = size,
+        .inputInterval = inputInterval,
+    });
+    client.start();
+
+    auto takeSnapshot = [&](const QElapsedTimer &timer) {
+        Snapshot snapshot;
+        snapshot.time = timer.durationElapsed();
+        snapshot.framesSent = quint64(BenchServer::metricSum(u"krdp_frames_sent_total"_s));
+        snapshot.bytesSent = quint64(BenchServer::metricSum(u"krdp_bytes_sent_total"_s));
+        snapshot.framesDecoded = client.framesDecoded();
+        snapshot.framesProduced = source ? source->framesProduced() : 0;
+        snapshot.usage = ThreadUsage::sample();
+        return snapshot;
+    };
+
+    enum class Phase { Connecting, Warmup, Measuring };
+    Phase phase = Phase::Connecting;
+    QElapsedTimer timer;
+    timer.start();
+    QElapsedTimer phaseTimer;
+    phaseTimer.start();
+    Snapshot start;
+    int result = 0;
+
+    const auto sourceThread = parser.isSet(u"replay"_s) ? u"krdp_replay"_s : u"krdp_synthetic"_s;
+    auto report = [&](const Snapshot &end) {
+        const auto seconds = clk::duration<double>(end.time - start.time).count();
+        const auto framesSent = end.framesSent - start.framesSent;
+        const auto cpuPercent = [&](const QString &prefix) {
+            const auto cpu = end.usage.cpuTimeOf(prefix) - start.usage.cpuTimeOf(prefix);
+            return clk::duration<double>(cpu).count() / seconds * 100.0;
+        };
+        const auto &acknowledge = connection->videoStream()->latency(KRdp::VideoStream::LatencyStage::Acknowledge);
+        const auto milliseconds = [](clk::microseconds value) {
+            return value.count() / 1000.0;
+        };
+
+        QJsonObject results{
+            {u"size"_s, u"%1x%2"_s.arg(size.width()).arg(size.height())},
+            {u"target_fps"_s, frameRate},
+            {u"network"_s, network->name},
+            {u"content"_s, parser.isSet(u"replay"_s) ? QFileInfo(parser.value(u"replay"_s)).fileName() : parser.value(u"content"_s)},
+            {u"duration_s"_s, seconds},
+            {u"fps_produced"_s, (end.framesProduced - start.framesProduced) / seconds},
+            {u"fps_sent"_s, framesSent / seconds},
+            {u"fps_decoded"_s, (end.framesDecoded - start.framesDecoded) / seconds},
+            {u"fps_requested"_s, int(connection->videoStream()->requestedFrameRate())},
+            {u"bytes_per_frame"_s, framesSent > 0 ? double(end.bytesSent - start.bytesSent) / framesSent : 0.0},
+            {u"ack_latency_p50_ms"_s, milliseconds(acknowledge.percentile(50.0))},
+            {u"ack_latency_p95_ms"_s, milliseconds(acknowledge.percentile(95.0))},
+            {u"ack_latency_p99_ms"_s, milliseconds(acknowledge.percentile(99.0))},
+            {u"server_cpu_percent"_s, cpuPercent(u"krdp"_s) - cpuPercent(sourceThread)},
+            {u"client_cpu_percent"_s, cpuPercent(u"bench_client"_s)},
+            {u"source_cpu_percent"_s, cpuPercent(sourceThread)},
+            {u"threads"_s, end.usage.threadCount},
+            {u"build"_s, buildType()},
+        };
+        if (inputInterval.count() > 0) {
+            const auto &input = client.inputLatency();
+            results[u"input_count"_s] = qint64(input.count());
+            results[u"input_timeouts"_s] = qint64(client.inputTimeouts());
+            results[u"input_latency_p50_ms"_s] = milliseconds(input.percentile(50.0));
+            results[u"input_latency_p95_ms"_s] = milliseconds(input.percentile(95.0));
+            results[u"input_latency_p99_ms"_s] = milliseconds(input.percentile(99.0));
+            // The server's share: from the input reaching the session to the frame showing it.
+            if (const auto synthetic = qobject_cast<KRdp::SyntheticSession *>(source->session())) {
+                results[u"input_to_frame_p50_ms"_s] = milliseconds(synthetic->inputToFrameLatency().percentile(50.0));
+                results[u"input_to_frame_p95_ms"_s] = milliseconds(synthetic->inputToFrameLatency().percentile(95.0));
+            }
+        }
+
+        QJsonObject speedup;
+        if (!baseline.isEmpty()) {
+            for (const auto &key : {u"size"_s, u"target_fps"_s, u"network"_s, u"content"_s}) {
+                if (baseline.value(key) != results.value(key)) {
+                    qWarning() << "Baseline was measured with a different" << key << baseline.value(key) << "instead of" << results.value(key);
+                }
+            }
+            for (const auto &[key, higherIsBetter] : ComparedMetrics) {
+                const auto before = baseline.value(key).toDouble();
+                const auto after = results.value(key).toDouble();
+                if (before > 0.0 && after > 0.0) {
+                    // Above 1 when this run did better.
+                    speedup[key] = higherIsBetter ? after / before : before / after;
+                }
+            }
+            results[u"baseline_build"_s] = baseline.value(u"build"_s).toString(u"default"_s);
+            results[u"speedup"_s] = speedup;
+        }
+
+        QTextStream out(stdout);
+        if (parser.isSet(u"json"_s)) {
+            out << QJsonDocument(results).toJson(QJsonDocument::Indented);
+            return;
+        }
+        out << "Loopback session, " << results[u"content"_s].toString() << u' ' << results[u"size"_s].toString() << " at " << frameRate << " fps over " << network->name << " for " << Qt::fixed << qSetRealNumberPrecision(1)
+            << seconds << " s, " << results[u"build"_s].toString() << " build\n";
+        out << "  produced    " << results[u"fps_produced"_s].toDouble() << " fps\n";
+        out << "  sent        " << results[u"fps_sent"_s].toDouble() << " fps, " << qSetRealNumberPrecision(0) << results[u"bytes_per_frame"_s].toDouble()
+            << " bytes/frame\n";
+        out << qSetRealNumberPrecision(1);
+        out << "  decoded     " << results[u"fps_decoded"_s].toDouble() << " fps, " << results[u"fps_requested"_s].toInt() << " fps requested\n";
+        out << "  ack latency p50=" << results[u"ack_latency_p50_ms"_s].toDouble() << " ms p95=" << results[u"ack_latency_p95_ms"_s].toDouble()
+            << " ms p99=" << results[u"ack_latency_p99_ms"_s].toDouble() << " ms\n";
+        out << "  server CPU  " << results[u"server_cpu_percent"_s].toDouble() << " % of a core\n";
+        out << "  client CPU  " << results[u"client_cpu_percent"_s].toDouble() << " % of a core (decode)\n";
+        out << "  source CPU  " << results[u"source_cpu_percent"_s].toDouble() << " % of a core (synthetic or replayed content)\n";
+        if (inputInterval.count() > 0) {
+            out << "  input       p50=" << results[u"input_latency_p50_ms"_s].toDouble() << " ms p95=" << results[u"input_latency_p95_ms"_s].toDouble()
+                << " ms p99=" << results[u"input_latency_p99_ms"_s].toDouble() << " ms, " << results[u"input_count"_s].toInteger() << " presses, "
+                << results[u"input_timeouts"_s].toInteger() << " without response\n";
+            out << "  in server   p50=" << results[u"input_to_frame_p50_ms"_s].toDouble() << " ms p95=" << results[u"input_to_frame_p95_ms"_s].toDouble()
+                << " ms (input arriving at the session to its frame)\n";
+        }
+        if (!baseline.isEmpty()) {
+            out << "  speedup over the " << results[u"baseline_build"_s].toString() << " build baseline, above 1 is better:\n" << qSetRealNumberPrecision(2);
+            for (const auto &metric : ComparedMetrics) {
+                if (speedup.contains(metric.first)) {
+                    out << "    " << qSetFieldWidth(22) << Qt::left << metric.first << qSetFieldWidth(0) << speedup.value(metric.first).toDouble() << "x\n";
+                }
+            }
+        }
+    };
+
+    QTimer poll;
+    poll.setInterval(std::chrono::milliseconds(100));
+    QObject::connect(&poll, &QTimer::timeout, &application, [&]() {
+        if (client.failed() || (source && source->failed()) || (phase != Phase::Connecting && !connection)) {
+            qWarning() << "Benchmark session failed";
+            result = 1;
+            application.quit();
+            return;
+        }
+
+        switch (phase) {
+        case Phase::Connecting:
+            if (client.framesDecoded() > 0) {
+                phase = Phase::Warmup;
+                phaseTimer.restart();
+            } else if (phaseTimer.durationElapsed() > timeout) {
+                qWarning() << "No frame was decoded within" << timeout.count() << "seconds";
+                result = 1;
+                application.quit();
+            }
+            break;
+        case Phase::Warmup:
+            if (phaseTimer.durationElapsed() >= warmup) {
+                start = takeSnapshot(timer);
+                client.resetInputLatency();
+                phase = Phase::Measuring;
+                phaseTimer.restart();
+            }
+            break;
+        case Phase::Measuring:
+            if (phaseTimer.durationElapsed() >= duration) {
+                report(takeSnapshot(timer));
+                application.quit();
+            }
+            break;
+        }
+    });
+    poll.start();
+
+    application.exec();
+
+    if (source) {
+        source->stop();
+    }
+    client.stop();
+    link.stop();
+    server.stop();
+
+    return result;
+}
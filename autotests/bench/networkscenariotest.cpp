@@ -0,0 +1,232 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+// End to end checks of how the video path reacts to network conditions: a
+// synthetic session is streamed to a headless client through an impaired
+// link and the frame rate and latency the server settles on are checked.
+// Encoding and decoding run in process without a GPU, so frame rates are
+// compared to what the same machine reaches on an unimpaired link instead of
+// absolute numbers.
+
+#include <chrono>
+#include <memory>
+
+#include <QTest>
+
+#include "LatencyHistogram.h"
+#include "RdpConnection.h"
+#include "SyntheticSession.h"
+#include "VideoStream.h"
+
+#include "BenchClient.h"
+#include "BenchServer.h"
+#include "BenchSession.h"
+#include "ImpairedLink.h"
+
+using namespace Qt::StringLiterals;
+using namespace std::chrono_literals;
+namespace clk = std::chrono;
+
+namespace
+{
+constexpr QSize FrameSize = QSize(1280, 720);
+constexpr int FrameRate = 60;
+
+class Loopback
+{
+public:
+    bool start(const ImpairedLink::Profile &profile, KRdp::SyntheticSession::Content content)
+    {
+        if (!server.start()) {
+            return false;
+        }
+
+        QObject::connect(server.server(), &KRdp::Server::newConnectionCreated, server.server(), [this, content](KRdp::RdpConnection *connection) {
+            if (!session) {
+                session = std::make_unique<BenchSession>(connection, std::make_unique<KRdp::SyntheticSession>(content, FrameSize), FrameRate);
+            }
+        });
+
+        link = std::make_unique<ImpairedLink>(server.port(), profile);
+        if (!link->start()) {
+            return false;
+        }
+
+        client = std::make_unique<BenchClient>(BenchClient::Options{
+            .port = link->port(),
+            .userName = BenchServer::userName,
+            .password = BenchServer::password,
+            .size = FrameSize,
+        });
+        client->start();
+        return true;
+    }
+
+    bool decoding(clk::milliseconds timeout)
+    {
+        return QTest::qWaitFor(
+            [this]() {
+                return client->failed() || (session && session->failed()) || client->framesDecoded() > 0;
+            },
+            timeout.count())
+            && client->framesDecoded() > 0;
+    }
+
+    KRdp::VideoStream *videoStream() const
+    {
+        return session && session->connection() ? session->connection()->videoStream() : nullptr;
+    }
+
+    uint32_t requestedFrameRate() const
+    {
+        const auto stream = videoStream();
+        return stream ? stream->requestedFrameRate() : 0;
+    }
+
+    /**
+     * Frames decoded by the client during \p duration, per second.
+     */
+    double decodedFrameRate(clk::milliseconds duration)
+    {
+        const auto before = client->framesDecoded();
+        QTest::qWait(duration.count());
+        return double(client->framesDecoded() - before) / clk::duration<double>(duration).count();
+    }
+
+    /**
+     * Share of the frames the session produced during \p duration that the
+     * client decoded.
+     */
+    double deliveredShare(clk::milliseconds duration)
+    {
+        const auto producedBefore = session->framesProduced();
+        const auto decodedBefore = client->framesDecoded();
+        QTest::qWait(duration.count());
+        const auto produced = session->framesProduced() - producedBefore;
+        return produced > 0 ? double(client->framesDecoded() - decodedBefore) / double(produced) : 0.0;
+    }
+
+    /**
+     * The frame rate the server settled on for this link and machine.
+     */
+    uint32_t settledFrameRate()
+    {
+        QTest::qWait(3000);
+        return requestedFrameRate();
+    }
+
+    BenchServer server;
+    std::unique_ptr<BenchSession> session;
+    std::unique_ptr<ImpairedLink> link;
+    std::unique_ptr<BenchClient> client;
+};
+
+ImpairedLink::Profile profileWith(clk::microseconds latency, quint64 downstreamBitsPerSecond = 0)
+{
+    return ImpairedLink::Profile{.name = u"custom"_s, .latency = latency, .downstreamBitsPerSecond = downstreamBitsPerSecond};
+}
+}
+
+class NetworkScenarioTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testLoopbackRunsAtFullRate();
+    void testLatencyLowersFrameRate();
+    void testRecoversAfterCongestion();
+    void testLossyLinkKeepsStreaming();
+
+private:
+    void startOrSkip(Loopback &loopback, const ImpairedLink::Profile &profile, KRdp::SyntheticSession::Content content);
+};
+
+void NetworkScenarioTest::startOrSkip(Loopback &loopback, const ImpairedLink::Profile &profile, KRdp::SyntheticSession::Content content)
+{
+    if (!loopback.start(profile, content)) {
+        QSKIP("Could not start the server, is openssl installed?");
+    }
+    if (!loopback.decoding(30s)) {
+        if (loopback.session && loopback.session->failed()) {
+            QSKIP("FreeRDP has no H.264 encoder");
+        }
+        QFAIL("No frame was decoded");
+    }
+}
+
+void NetworkScenarioTest::testLoopbackRunsAtFullRate()
+{
+    Loopback loopback;
+    startOrSkip(loopback, *ImpairedLink::Profile::fromName(u"loopback"_s), KRdp::SyntheticSession::Content::Video);
+    if (QTest::currentTestResolved()) {
+        return;
+    }
+
+    // The server does not throttle a fast link, and the client keeps up with
+    // whatever rate this machine manages to encode at.
+    QTRY_VERIFY_WITH_TIMEOUT(loopback.requestedFrameRate() >= 30, 10'000);
+    QCOMPARE_GE(loopback.deliveredShare(3s), 0.5);
+}
+
+void NetworkScenarioTest::testLatencyLowersFrameRate()
+{
+    Loopback loopback;
+    // 50 ms each way, so about 100 ms round trip.
+    startOrSkip(loopback, profileWith(50ms), KRdp::SyntheticSession::Content::Video);
+    if (QTest::currentTestResolved()) {
+        return;
+    }
+
+    QTRY_VERIFY_WITH_TIMEOUT(BenchServer::metricSum(u"krdp_rtt_seconds"_s) >= 0.08, 15'000);
+    // The frame rate follows the round trip time, one frame in flight.
+    QTRY_VERIFY_WITH_TIMEOUT(loopback.requestedFrameRate() <= 20, 15'000);
+    QCOMPARE_GT(loopback.decodedFrameRate(3s), 1.0);
+}
+
+void NetworkScenarioTest::testRecoversAfterCongestion()
+{
+    Loopback loopback;
+    startOrSkip(loopback, *ImpairedLink::Profile::fromName(u"loopback"_s), KRdp::SyntheticSession::Content::Video);
+    if (QTest::currentTestResolved()) {
+        return;
+    }
+    const auto baseline = loopback.settledFrameRate();
+    QCOMPARE_GT(baseline, 0u);
+
+    // Far less than the video content needs, the link buffer fills up and
+    // the round trip time grows with it.
+    loopback.link->setProfile(profileWith(10ms, 1'000'000));
+    QTRY_VERIFY_WITH_TIMEOUT(loopback.requestedFrameRate() < baseline * 3 / 4, 20'000);
+
+    loopback.link->setProfile(*ImpairedLink::Profile::fromName(u"loopback"_s));
+    QTRY_VERIFY_WITH_TIMEOUT(loopback.requestedFrameRate() >= baseline * 3 / 4, 30'000);
+    QCOMPARE_GE(loopback.deliveredShare(3s), 0.5);
+    QVERIFY(!loopback.client->failed());
+}
+
+void NetworkScenarioTest::testLossyLinkKeepsStreaming()
+{
+    Loopback loopback;
+    auto lossy = *ImpairedLink::Profile::fromName(u"congested"_s);
+    // Often enough that losses happen for sure during the test.
+    lossy.lossRate = 0.05;
+    startOrSkip(loopback, lossy, KRdp::SyntheticSession::Content::Typing);
+    if (QTest::currentTestResolved()) {
+        return;
+    }
+
+    QCOMPARE_GT(loopback.decodedFrameRate(10s), 1.0);
+    QVERIFY(!loopback.client->failed());
+    QCOMPARE_GT(loopback.link->segmentsLost(), quint64(0));
+
+    const auto stream = loopback.videoStream();
+    QVERIFY(stream);
+    const auto &acknowledge = stream->latency(KRdp::VideoStream::LatencyStage::Acknowledge);
+    QCOMPARE_GT(acknowledge.count(), quint64(0));
+    QCOMPARE_LT(acknowledge.percentile(95.0).count(), clk::microseconds(2s).count());
+}
+
+QTEST_GUILESS_MAIN(NetworkScenarioTest)
+
+#include "networkscenariotest.moc"
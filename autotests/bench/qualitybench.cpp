@@ -0,0 +1,351 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+// Measures image quality against bitrate. Known frames are encoded, sent
+// through KRdp's video stream to a headless FreeRDP client over loopback and
+// the decoded desktop is compared to the source with PSNR and SSIM, for the
+// whole frame and separately for text and motion regions.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <vector>
+
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPointer>
+#include <QTextStream>
+#include <QTimer>
+
+#include "RdpConnection.h"
+
+#include "BenchClient.h"
+#include "BenchServer.h"
+#include "BenchSession.h"
+#include "ImageQuality.h"
+#include "ImpairedLink.h"
+#include "QualitySource.h"
+
+using namespace Qt::StringLiterals;
+namespace clk = std::chrono;
+
+namespace
+{
+/**
+ * Scores of the frames decoded during one step, filled on the client thread.
+ */
+struct Samples {
+    void add(const std::array<ImageQuality::Score, ImageQuality::RegionCount> &scores)
+    {
+        std::lock_guard lock(mutex);
+        for (int region = 0; region < ImageQuality::RegionCount; ++region) {
+            if (scores[region].blocks > 0) {
+                psnr[region].push_back(scores[region].psnr);
+                ssim[region].push_back(scores[region].ssim);
+            }
+        }
+        ++matched;
+    }
+
+    void unmatchedFrame()
+    {
+        std::lock_guard lock(mutex);
+        ++unmatched;
+    }
+
+    void clear()
+    {
+        std::lock_guard lock(mutex);
+        psnr = {};
+        ssim = {};
+        matched = 0;
+        unmatched = 0;
+    }
+
+    std::mutex mutex;
+    std::array<std::vector<double>, ImageQuality::RegionCount> psnr;
+    std::array<std::vector<double>, ImageQuality::RegionCount> ssim;
+    quint64 matched = 0;
+    quint64 unmatched = 0;
+};
+
+double mean(const std::vector<double> &values)
+{
+    return values.empty() ? 0.0 : std::accumulate(values.cbegin(), values.cend(), 0.0) / values.size();
+}
+
+// The worst frames matter more than the average, a few blurry frames are
+// what people notice.
+double lowPercentile(std::vector<double> values, double percentile)
+{
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[std::size_t(percentile / 100.0 * (values.size() - 1))];
+}
+
+QList<quint32> parseBitrates(const QString &value)
+{
+    QList<quint32> bitrates;
+    for (const auto &part : value.split(u',', Qt::SkipEmptyParts)) {
+        bool ok = false;
+        const auto kilobits = part.trimmed().toUInt(&ok);
+        if (!ok || kilobits == 0) {
+            return {};
+        }
+        bitrates.append(kilobits * 1000);
+    }
+    return bitrates;
+}
+}
+
+int main(int argc, char **argv)
+{
+    // Rendering the test card needs fonts, but no display.
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication application{argc, argv};
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(u"Measures PSNR and SSIM of decoded frames against their source at different bitrates."_s);
+    parser.addHelpOption();
+    parser.addOptions({
+        {u"bitrates"_s, u"Comma separated encoder bitrates to measure, in kbit/s."_s, u"list"_s, u"500,1000,2000,4000,8000"_s},
+        {u"duration"_s, u"Seconds to measure for at every bitrate."_s, u"seconds"_s, u"5"_s},
+        {u"warmup"_s, u"Seconds to let the encoder settle after changing the bitrate."_s, u"seconds"_s, u"2"_s},
+        {u"timeout"_s, u"Seconds to wait for the first decoded frame."_s, u"seconds"_s, u"30"_s},
+        {u"size"_s, u"Frame size."_s, u"WIDTHxHEIGHT"_s, u"1280x720"_s},
+        {u"fps"_s, u"Frame rate of the source."_s, u"fps"_s, u"30"_s},
+        {u"source"_s, u"Directory of images to show one per frame instead of the test card."_s, u"directory"_s},
+        {u"network"_s, u"Network between server and client: %1."_s.arg(ImpairedLink::Profile::names().join(u", "_s)), u"profile"_s, u"loopback"_s},
+        {u"json"_s, u"Print the results as JSON."_s},
+    });
+    parser.process(application);
+
+    const auto sizeParts = parser.value(u"size"_s).split(u'x');
+    const QSize size = sizeParts.size() == 2 ? QSize(sizeParts.at(0).toInt() & ~1, sizeParts.at(1).toInt() & ~1) : QSize();
+    const int frameRate = parser.value(u"fps"_s).toInt();
+    const auto bitrates = parseBitrates(parser.value(u"bitrates"_s));
+    const auto warmup = clk::seconds(parser.value(u"warmup"_s).toInt());
+    const auto duration = clk::seconds(std::max(parser.value(u"duration"_s).toInt(), 1));
+    const auto timeout = clk::seconds(parser.value(u"timeout"_s).toInt());
+    if (size.isEmpty() || frameRate <= 0 || bitrates.isEmpty()) {
+        qWarning() << "Invalid size, frame rate or bitrates";
+        return 1;
+    }
+
+    QStringList images;
+    if (parser.isSet(u"source"_s)) {
+        QDir directory(parser.value(u"source"_s));
+        for (const auto &name : directory.entryList({u"*.png"_s, u"*.jpg"_s, u"*.jpeg"_s, u"*.webp"_s}, QDir::Files, QDir::Name)) {
+            images.append(directory.filePath(name));
+        }
+        if (images.isEmpty()) {
+            qWarning() << "No images found in" << directory.path();
+            return 1;
+        }
+    }
+
+    const auto network = ImpairedLink::Profile::fromName(parser.value(u"network"_s));
+    if (!network) {
+        qWarning() << "Unknown network profile" << parser.value(u"network"_s);
+        return 1;
+    }
+
+    BenchServer server;
+    if (!server.start()) {
+        return 1;
+    }
+
+    ImpairedLink link(server.port(), *network);
+    if (!link.start()) {
+        return 1;
+    }
+
+    std::unique_ptr<BenchSession> session;
+    std::atomic<QualitySource *> source = nullptr;
+    QPointer<KRdp::RdpConnection> connection;
+    QObject::connect(server.server(), &KRdp::Server::newConnectionCreated, server.server(), [&](KRdp::RdpConnection *newConnection) {
+        if (connection) {
+            return;
+        }
+        connection = newConnection;
+        auto qualitySource = std::make_unique<QualitySource>(size, images);
+        qualitySource->setBitrate(bitrates.first());
+        source = qualitySource.get();
+        session = std::make_unique<BenchSession>(newConnection, std::move(qualitySource), frameRate);
+    });
+
+    Samples samples;
+    std::optional<quint32> lastScored;
+    BenchClient client({
+        .port = link.port(),
+        .userName = BenchServer::userName,
+        .password = BenchServer::password,
+        .size = size,
+        .frameDecoded =
+            [&](const uchar *data, int stride, const QSize &decodedSize) {
+                const auto qualitySource = source.load();
+                if (!qualitySource || decodedSize != size) {
+                    return;
+                }
+                const auto number = QualitySource::readBarcode(data, stride, decodedSize);
+                if (!number) {
+                    samples.unmatchedFrame();
+                    return;
+                }
+                if (number == lastScored) {
+                    return;
+                }
+                lastScored = number;
+
+                const auto frame = qualitySource->frame(*number);
+                if (!frame) {
+                    samples.unmatchedFrame();
+                    return;
+                }
+                const QImage decoded(data, decodedSize.width(), decodedSize.height(), stride, QImage::Format_RGB32);
+                samples.add(ImageQuality::compare(frame->image, decoded, frame->blocks));
+            },
+    });
+    client.start();
+
+    enum class Phase { Connecting, Warmup, Measuring };
+    Phase phase = Phase::Connecting;
+    QElapsedTimer phaseTimer;
+    phaseTimer.start();
+    qsizetype step = 0;
+    double bytesAtStart = 0.0;
+    QJsonArray results;
+    int result = 0;
+
+    auto startStep = [&]() {
+        source.load()->setBitrate(bitrates.at(step));
+        phase = Phase::Warmup;
+        phaseTimer.restart();
+    };
+
+    auto finishStep = [&]() {
+        const auto seconds = clk::duration<double>(phaseTimer.durationElapsed()).count();
+        const auto bytes = BenchServer::metricSum(u"krdp_bytes_sent_total"_s) - bytesAtStart;
+
+        std::lock_guard lock(samples.mutex);
+        QJsonObject stepResult{
+            {u"target_kbps"_s, int(bitrates.at(step) / 1000)},
+            {u"actual_kbps"_s, bytes * 8.0 / 1000.0 / seconds},
+            {u"frames_scored"_s, qint64(samples.matched)},
+            {u"frames_unmatched"_s, qint64(samples.unmatched)},
+        };
+        const std::array<QString, ImageQuality::RegionCount> regionNames = {u"all"_s, u"text"_s, u"motion"_s};
+        for (int region = 0; region < ImageQuality::RegionCount; ++region) {
+            stepResult[regionNames[region]] = QJsonObject{
+                {u"psnr_mean_db"_s, mean(samples.psnr[region])},
+                {u"psnr_p5_db"_s, lowPercentile(samples.psnr[region], 5.0)},
+                {u"ssim_mean"_s, mean(samples.ssim[region])},
+                {u"ssim_p5"_s, lowPercentile(samples.ssim[region], 5.0)},
+            };
+        }
+        results.append(stepResult);
+    };
+
+    auto report = [&]() {
+        QTextStream out(stdout);
+        if (parser.isSet(u"json"_s)) {
+            out << QJsonDocument(QJsonObject{
+                                     {u"size"_s, u"%1x%2"_s.arg(size.width()).arg(size.height())},
+                                     {u"fps"_s, frameRate},
+                                     {u"network"_s, network->name},
+                                     {u"source"_s, images.isEmpty() ? u"testcard"_s : parser.value(u"source"_s)},
+                                     {u"steps"_s, results},
+                                 })
+                       .toJson(QJsonDocument::Indented);
+            return;
+        }
+
+        out << "Image quality, " << (images.isEmpty() ? u"test card"_s : parser.value(u"source"_s)) << u' ' << size.width() << u'x' << size.height() << " at "
+            << frameRate << " fps over " << network->name << "\n";
+        out << "  target   actual  frames |   all PSNR/p5     SSIM/p5   |  text PSNR/p5     SSIM/p5   | motion PSNR/p5    SSIM/p5\n";
+        for (const auto &value : std::as_const(results)) {
+            const auto stepResult = value.toObject();
+            out << qSetFieldWidth(8) << Qt::right << stepResult[u"target_kbps"_s].toInt() << qSetFieldWidth(8) << Qt::fixed << qSetRealNumberPrecision(0)
+                << stepResult[u"actual_kbps"_s].toDouble() << qSetFieldWidth(8) << stepResult[u"frames_scored"_s].toInteger() << qSetFieldWidth(0) << " |";
+            for (const auto &region : {u"all"_s, u"text"_s, u"motion"_s}) {
+                const auto scores = stepResult[region].toObject();
+                out << qSetRealNumberPrecision(1) << qSetFieldWidth(7) << scores[u"psnr_mean_db"_s].toDouble() << qSetFieldWidth(0) << u'/'
+                    << qSetFieldWidth(5) << Qt::left << scores[u"psnr_p5_db"_s].toDouble() << Qt::right << qSetRealNumberPrecision(3) << qSetFieldWidth(7)
+                    << scores[u"ssim_mean"_s].toDouble() << qSetFieldWidth(0) << u'/' << qSetFieldWidth(6) << Qt::left << scores[u"ssim_p5"_s].toDouble()
+                    << Qt::right << qSetFieldWidth(0) << " |";
+            }
+            out << "\n";
+        }
+        out << "  (kbit/s, PSNR in dB; p5 is the worst 5 % of frames)\n";
+    };
+
+    QTimer poll;
+    poll.setInterval(std::chrono::milliseconds(100));
+    QObject::connect(&poll, &QTimer::timeout, &application, [&]() {
+        if (client.failed() || (session && session->failed()) || (phase != Phase::Connecting && !connection)) {
+            qWarning() << "Benchmark session failed";
+            result = 1;
+            application.quit();
+            return;
+        }
+
+        switch (phase) {
+        case Phase::Connecting:
+            if (client.framesDecoded() > 0) {
+                startStep();
+            } else if (phaseTimer.durationElapsed() > timeout) {
+                qWarning() << "No frame was decoded within" << timeout.count() << "seconds";
+                result = 1;
+                application.quit();
+            }
+            break;
+        case Phase::Warmup:
+            if (phaseTimer.durationElapsed() >= warmup) {
+                samples.clear();
+                bytesAtStart = BenchServer::metricSum(u"krdp_bytes_sent_total"_s);
+                phase = Phase::Measuring;
+                phaseTimer.restart();
+            }
+            break;
+        case Phase::Measuring:
+            if (phaseTimer.durationElapsed() >= duration) {
+                finishStep();
+                if (++step < bitrates.size()) {
+                    startStep();
+                } else {
+                    report();
+                    application.quit();
+                }
+            }
+            break;
+        }
+    });
+    poll.start();
+
+    application.exec();
+
+    client.stop();
+    if (session) {
+        session->stop();
+    }
+    link.stop();
+    server.stop();
+
+    return result;
+}
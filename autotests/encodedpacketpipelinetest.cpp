@@ -0,0 +1,153 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+// Checks that encoded packets get the damage of their own frame, also when
+// the encoder drops a frame after its metadata was reported.
+
+#include <mutex>
+
+#include <QTest>
+
+#include "EncodedPacketPipeline.h"
+
+using namespace KRdp;
+using namespace std::chrono_literals;
+
+namespace
+{
+const QSize FrameSize(640, 480);
+
+// Damage that is distinct for every frame, so a mismatched pairing shows.
+QRect damageOf(int frame)
+{
+    return QRect(16 + frame * 24, 16 + frame * 16, 8, 8);
+}
+
+EncodedPacketPipeline::FrameMetadata metadataOf(int frame)
+{
+    return EncodedPacketPipeline::FrameMetadata{
+        .sequence = quint64(frame),
+        .size = FrameSize,
+        .damage = QRegion(damageOf(frame)),
+        .presentationTimeStamp = std::nullopt,
+    };
+}
+
+PipeWireEncodedStream::Packet packetOf(int frame)
+{
+    return PipeWireEncodedStream::Packet(false, QByteArray::number(frame));
+}
+
+bool covers(const QRegion &damage, const QRect &rect)
+{
+    return damage.intersected(rect) == QRegion(rect);
+}
+
+// Frames are emitted from the pipeline thread.
+class FrameCollector
+{
+public:
+    explicit FrameCollector(EncodedPacketPipeline &pipeline)
+    {
+        QObject::connect(&pipeline, &EncodedPacketPipeline::frameReady, [this](const VideoFrame &frame) {
+            std::lock_guard lock(m_mutex);
+            m_frames.append(frame);
+        });
+    }
+
+    qsizetype count() const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_frames.size();
+    }
+
+    VideoFrame at(qsizetype index) const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_frames.at(index);
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    QList<VideoFrame> m_frames;
+};
+}
+
+class EncodedPacketPipelineTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testPairsInOrder();
+    void testFrameDroppedAfterMetadata();
+};
+
+void EncodedPacketPipelineTest::testPairsInOrder()
+{
+    EncodedPacketPipeline pipeline;
+    pipeline.setFrameSize(FrameSize);
+    pipeline.setEncoderQueueBound(2);
+    FrameCollector frames(pipeline);
+
+    for (int frame = 1; frame <= 3; ++frame) {
+        pipeline.addFrameMetadata(metadataOf(frame));
+        pipeline.addPacket(packetOf(frame));
+    }
+
+    QTRY_COMPARE(frames.count(), 3);
+    for (int frame = 1; frame <= 3; ++frame) {
+        const auto emitted = frames.at(frame - 1);
+        QCOMPARE(emitted.data, QByteArray::number(frame));
+        QCOMPARE(emitted.damage, QRegion(damageOf(frame)));
+    }
+}
+
+void EncodedPacketPipelineTest::testFrameDroppedAfterMetadata()
+{
+    EncodedPacketPipeline pipeline;
+    pipeline.setFrameSize(FrameSize);
+    pipeline.setEncoderQueueBound(2);
+    FrameCollector frames(pipeline);
+
+    // Frame 4 is reported, then dropped by the encoder input queue while
+    // frames 1 to 3 are still being encoded.
+    for (int frame = 1; frame <= 4; ++frame) {
+        pipeline.addFrameMetadata(metadataOf(frame));
+    }
+    for (int frame = 1; frame <= 3; ++frame) {
+        pipeline.addPacket(packetOf(frame));
+    }
+    pipeline.addFrameMetadata(metadataOf(5));
+    pipeline.addPacket(packetOf(5));
+    pipeline.addFrameMetadata(metadataOf(6));
+    pipeline.addPacket(packetOf(6));
+
+    QTRY_COMPARE(frames.count(), 5);
+    const int emittedFrames[] = {1, 2, 3, 5, 6};
+    for (qsizetype index = 0; index < 5; ++index) {
+        const auto emitted = frames.at(index);
+        const int frame = emittedFrames[index];
+        QCOMPARE(emitted.data, QByteArray::number(frame));
+        QVERIFY(covers(emitted.damage, damageOf(frame)));
+    }
+    // The packet of frame 5 also has to repaint what changed in frame 4.
+    QVERIFY(covers(frames.at(3).damage, damageOf(4)));
+
+    // Once the orphaned metadata has aged out, packets get exactly the
+    // damage of their own frame again.
+    QTest::qWait(1100);
+    pipeline.addFrameMetadata(metadataOf(7));
+    pipeline.addPacket(packetOf(7));
+    pipeline.addFrameMetadata(metadataOf(8));
+    pipeline.addPacket(packetOf(8));
+
+    QTRY_COMPARE(frames.count(), 7);
+    QVERIFY(covers(frames.at(5).damage, damageOf(7)));
+    QCOMPARE(frames.at(6).data, QByteArray::number(8));
+    QCOMPARE(frames.at(6).damage, QRegion(damageOf(8)));
+}
+
+QTEST_GUILESS_MAIN(EncodedPacketPipelineTest)
+
+#include "encodedpacketpipelinetest.moc"
@@ -0,0 +1,211 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+// Benchmarks keysym to keycode lookups for Unicode input, as sessions do for
+// every character of pasted text or IME input, against the keymap scan the
+// index replaced.
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include <QTest>
+
+#include <xkbcommon/xkbcommon.h>
+
+#include "KeysymIndex.h"
+
+using namespace Qt::StringLiterals;
+
+namespace
+{
+using ScopedContext = std::unique_ptr<xkb_context, decltype(&xkb_context_unref)>;
+using ScopedKeymap = std::unique_ptr<xkb_keymap, decltype(&xkb_keymap_unref)>;
+
+// A burst of typed or pasted text, mostly on the base level with some shifted
+// and AltGr characters and a few the layouts do not have.
+const auto Burst = u"The quick brown fox jumps over the lazy dog. Grüße aus Köln, Ça coûte 12,50 € (100% sûr)! "
+                   u"Pasted text arrives one UnicodeKeyboardEvent per character: {key: \"value\"}, [1, 2, 3] ~ ^ @ #\n"_s;
+
+std::vector<xkb_keysym_t> burstKeysyms()
+{
+    std::vector<xkb_keysym_t> keysyms;
+    for (const auto codepoint : Burst.toUcs4()) {
+        keysyms.push_back(xkb_utf32_to_keysym(codepoint));
+    }
+    return keysyms;
+}
+
+// The lookup as it was before KeysymIndex: a scan over every key and level.
+std::optional<KRdp::KeysymIndex::Code> scanKeymap(xkb_keymap *keymap, xkb_keysym_t keysym)
+{
+    const auto max = xkb_keymap_max_keycode(keymap);
+    for (auto keycode = xkb_keymap_min_keycode(keymap); keycode <= max; keycode++) {
+        if (keycode < 8) {
+            continue;
+        }
+        const auto levelCount = xkb_keymap_num_levels_for_key(keymap, keycode, 0);
+        for (xkb_level_index_t level = 0; level < levelCount; level++) {
+            const xkb_keysym_t *syms;
+            const auto count = xkb_keymap_key_get_syms_by_level(keymap, keycode, 0, level, &syms);
+            for (int i = 0; i < count; i++) {
+                if (syms[i] == keysym) {
+                    return KRdp::KeysymIndex::Code{.level = level, .code = keycode - 8};
+                }
+            }
+        }
+    }
+    return std::nullopt;
+}
+}
+
+class KeysymIndexBenchmark : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void testMatchesScan_data();
+    void testMatchesScan();
+    void benchmarkScan_data();
+    void benchmarkScan();
+    void benchmarkLookup_data();
+    void benchmarkLookup();
+    void benchmarkRebuild_data();
+    void benchmarkRebuild();
+
+private:
+    void addLayoutRows();
+    xkb_keymap *keymap(const QByteArray &layout);
+
+    ScopedContext m_context{nullptr, xkb_context_unref};
+    std::vector<std::pair<QByteArray, ScopedKeymap>> m_keymaps;
+    std::vector<xkb_keysym_t> m_burst;
+};
+
+void KeysymIndexBenchmark::initTestCase()
+{
+    m_context.reset(xkb_context_new(XKB_CONTEXT_NO_FLAGS));
+    if (!m_context) {
+        QSKIP("No xkb context");
+    }
+    for (const auto layout : {"us", "de", "fr"}) {
+        const xkb_rule_names names{.rules = nullptr, .model = nullptr, .layout = layout, .variant = nullptr, .options = nullptr};
+        ScopedKeymap keymap(xkb_keymap_new_from_names(m_context.get(), &names, XKB_KEYMAP_COMPILE_NO_FLAGS), xkb_keymap_unref);
+        if (keymap) {
+            m_keymaps.emplace_back(layout, std::move(keymap));
+        }
+    }
+    if (m_keymaps.empty()) {
+        QSKIP("No XKB keymaps available");
+    }
+    m_burst = burstKeysyms();
+}
+
+void KeysymIndexBenchmark::addLayoutRows()
+{
+    QTest::addColumn<QByteArray>("layout");
+    for (const auto &[layout, keymap] : m_keymaps) {
+        QTest::newRow(layout.constData()) << layout;
+    }
+}
+
+xkb_keymap *KeysymIndexBenchmark::keymap(const QByteArray &layout)
+{
+    for (const auto &[name, keymap] : m_keymaps) {
+        if (name == layout) {
+            return keymap.get();
+        }
+    }
+    return nullptr;
+}
+
+void KeysymIndexBenchmark::testMatchesScan_data()
+{
+    addLayoutRows();
+}
+
+void KeysymIndexBenchmark::testMatchesScan()
+{
+    QFETCH(QByteArray, layout);
+    auto keymap = this->keymap(layout);
+
+    KRdp::KeysymIndex index;
+    index.rebuild(keymap);
+    QVERIFY(!index.isEmpty());
+
+    for (const auto keysym : m_burst) {
+        const auto expected = scanKeymap(keymap, keysym);
+        const auto actual = index.find(keysym);
+        QCOMPARE(actual.has_value(), expected.has_value());
+        if (expected) {
+            QCOMPARE(actual->code, expected->code);
+            QCOMPARE(actual->level, expected->level);
+        }
+    }
+}
+
+void KeysymIndexBenchmark::benchmarkScan_data()
+{
+    addLayoutRows();
+}
+
+void KeysymIndexBenchmark::benchmarkScan()
+{
+    QFETCH(QByteArray, layout);
+    auto keymap = this->keymap(layout);
+
+    quint32 checksum = 0;
+    QBENCHMARK {
+        for (const auto keysym : m_burst) {
+            if (const auto code = scanKeymap(keymap, keysym)) {
+                checksum += code->code;
+            }
+        }
+    }
+    QVERIFY(checksum > 0);
+}
+
+void KeysymIndexBenchmark::benchmarkLookup_data()
+{
+    addLayoutRows();
+}
+
+void KeysymIndexBenchmark::benchmarkLookup()
+{
+    QFETCH(QByteArray, layout);
+    KRdp::KeysymIndex index;
+    index.rebuild(keymap(layout));
+
+    quint32 checksum = 0;
+    QBENCHMARK {
+        for (const auto keysym : m_burst) {
+            if (const auto code = index.find(keysym)) {
+                checksum += code->code;
+            }
+        }
+    }
+    QVERIFY(checksum > 0);
+}
+
+void KeysymIndexBenchmark::benchmarkRebuild_data()
+{
+    addLayoutRows();
+}
+
+void KeysymIndexBenchmark::benchmarkRebuild()
+{
+    QFETCH(QByteArray, layout);
+    auto keymap = this->keymap(layout);
+    KRdp::KeysymIndex index;
+
+    QBENCHMARK {
+        index.rebuild(keymap);
+    }
+    QVERIFY(!index.isEmpty());
+}
+
+QTEST_GUILESS_MAIN(KeysymIndexBenchmark)
+
+#include "keysymindexbenchmark.moc"
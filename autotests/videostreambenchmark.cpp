@@ -0,0 +1,244 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+// Benchmarks for the helpers VideoStream runs on every frame it sends. Run
+// with -tickcounter or -perf for steadier numbers than wall time.
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include <QTest>
+
+#include "VideoStream_p.h"
+
+using namespace Qt::StringLiterals;
+
+namespace
+{
+const QList<std::pair<QString, QSize>> FrameSizes = {
+    {u"1080p"_s, QSize(1920, 1080)},
+    {u"1440p"_s, QSize(2560, 1440)},
+    {u"4k"_s, QSize(3840, 2160)},
+    {u"8k"_s, QSize(7680, 4320)},
+};
+const QList<int> RectCounts = {1, 8, 32, 64, 128};
+
+// Damage as a desktop produces it: separate rects of UI element size, like
+// a blinking cursor, changed widgets and lines of text.
+QRegion desktopDamage(const QSize &frameSize, int count)
+{
+    std::mt19937 random(count * 7919 + frameSize.width());
+    // A grid of cells, each holding at most one rect, keeps the rects apart so
+    // QRegion does not merge them.
+    constexpr int Cell = 96;
+    const int columns = frameSize.width() / Cell;
+    const int rows = frameSize.height() / Cell;
+    std::vector<int> cells(columns * rows);
+    std::iota(cells.begin(), cells.end(), 0);
+    std::shuffle(cells.begin(), cells.end(), random);
+
+    std::uniform_int_distribution<int> extent(8, Cell - 16);
+    QRegion damage;
+    for (int i = 0; i < std::min<int>(count, cells.size()); ++i) {
+        const QPoint origin((cells[i] % columns) * Cell + 4, (cells[i] / columns) * Cell + 4);
+        damage += QRect(origin, QSize(extent(random), extent(random) / 4 + 8));
+    }
+    return damage;
+}
+
+KRdp::VideoFrame frameWithDamage(const QSize &frameSize, int rectCount)
+{
+    KRdp::VideoFrame frame;
+    frame.size = frameSize;
+    frame.isKeyFrame = false;
+    frame.damage = desktopDamage(frameSize, rectCount);
+    frame.monitors = {KRdp::VideoMonitor{.geometry = QRect(QPoint(0, 0), frameSize), .primary = true}};
+    return frame;
+}
+
+void addSizeAndRectRows()
+{
+    QTest::addColumn<QSize>("frameSize");
+    QTest::addColumn<int>("rectCount");
+    for (const auto &[name, size] : FrameSizes) {
+        for (const auto count : RectCounts) {
+            QTest::addRow("%s/%d", qPrintable(name), count) << size << count;
+        }
+    }
+}
+}
+
+class VideoStreamBenchmark : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void benchmarkToRdpRect_data();
+    void benchmarkToRdpRect();
+    void benchmarkToDamageRects_data();
+    void benchmarkToDamageRects();
+    void benchmarkQualityForDamageRect_data();
+    void benchmarkQualityForDamageRect();
+    void benchmarkMonitorLayoutForReset_data();
+    void benchmarkMonitorLayoutForReset();
+    void benchmarkActivityGrid_data();
+    void benchmarkActivityGrid();
+    void benchmarkFrameHelpers_data();
+    void benchmarkFrameHelpers();
+};
+
+void VideoStreamBenchmark::benchmarkToRdpRect_data()
+{
+    addSizeAndRectRows();
+}
+
+void VideoStreamBenchmark::benchmarkToRdpRect()
+{
+    QFETCH(QSize, frameSize);
+    QFETCH(int, rectCount);
+
+    const auto rects = frameWithDamage(frameSize, rectCount).damage;
+    quint32 checksum = 0;
+    QBENCHMARK {
+        for (const auto &rect : rects) {
+            const auto rdpRect = KRdp::toRdpRect(rect);
+            checksum += rdpRect.right - rdpRect.left;
+        }
+    }
+    QVERIFY(checksum > 0);
+}
+
+void VideoStreamBenchmark::benchmarkToDamageRects_data()
+{
+    addSizeAndRectRows();
+}
+
+void VideoStreamBenchmark::benchmarkToDamageRects()
+{
+    QFETCH(QSize, frameSize);
+    QFETCH(int, rectCount);
+
+    const auto frame = frameWithDamage(frameSize, rectCount);
+    std::vector<RECTANGLE_16> rects;
+    QBENCHMARK {
+        rects = KRdp::toDamageRects(frame);
+    }
+    QVERIFY(!rects.empty());
+    QCOMPARE_LE(rects.size(), std::size_t(KRdp::MaxDamageRectCount));
+}
+
+void VideoStreamBenchmark::benchmarkQualityForDamageRect_data()
+{
+    addSizeAndRectRows();
+}
+
+void VideoStreamBenchmark::benchmarkQualityForDamageRect()
+{
+    QFETCH(QSize, frameSize);
+    QFETCH(int, rectCount);
+
+    const auto rects = KRdp::toDamageRects(frameWithDamage(frameSize, rectCount));
+    int activity = 0;
+    quint32 checksum = 0;
+    QBENCHMARK {
+        for (const auto &rect : rects) {
+            const auto quality = KRdp::qualityForDamageRect(rect, frameSize, false, false, true, activity, 2);
+            checksum += quality.qp;
+            activity = (activity + 3) % 20;
+        }
+    }
+    QVERIFY(checksum > 0);
+}
+
+void VideoStreamBenchmark::benchmarkMonitorLayoutForReset_data()
+{
+    QTest::addColumn<QSize>("frameSize");
+    QTest::addColumn<int>("monitorCount");
+    for (const auto &[name, size] : FrameSizes) {
+        for (const auto count : {1, 2, 4, 16}) {
+            QTest::addRow("%s/%d", qPrintable(name), count) << size << count;
+        }
+    }
+}
+
+void VideoStreamBenchmark::benchmarkMonitorLayoutForReset()
+{
+    QFETCH(QSize, frameSize);
+    QFETCH(int, monitorCount);
+
+    // Side by side, the last one reaching past the frame so clipping happens.
+    KRdp::VideoFrame frame;
+    frame.size = frameSize;
+    frame.isKeyFrame = false;
+    const int width = frameSize.width() / monitorCount;
+    for (int i = 0; i < monitorCount; ++i) {
+        frame.monitors.append(KRdp::VideoMonitor{.geometry = QRect(i * width, 0, width + (i == monitorCount - 1 ? 64 : 0), frameSize.height()),
+                                                 .primary = i == monitorCount / 2});
+    }
+
+    QVector<KRdp::VideoMonitor> layout;
+    QBENCHMARK {
+        layout = KRdp::monitorLayoutForReset(frame);
+    }
+    QCOMPARE(layout.size(), monitorCount);
+}
+
+void VideoStreamBenchmark::benchmarkActivityGrid_data()
+{
+    addSizeAndRectRows();
+}
+
+void VideoStreamBenchmark::benchmarkActivityGrid()
+{
+    QFETCH(QSize, frameSize);
+    QFETCH(int, rectCount);
+
+    // What sendFrame does with the grid for every frame.
+    const auto rects = KRdp::toDamageRects(frameWithDamage(frameSize, rectCount));
+    KRdp::ActivityGrid grid;
+    int checksum = 0;
+    QBENCHMARK {
+        grid.reset(frameSize);
+        grid.decay();
+        for (const auto &rect : rects) {
+            checksum += grid.activityForRect(rect);
+        }
+        grid.markDamage(rects);
+    }
+    QVERIFY(checksum >= 0);
+}
+
+void VideoStreamBenchmark::benchmarkFrameHelpers_data()
+{
+    addSizeAndRectRows();
+}
+
+void VideoStreamBenchmark::benchmarkFrameHelpers()
+{
+    QFETCH(QSize, frameSize);
+    QFETCH(int, rectCount);
+
+    // All helpers in the order sendFrame calls them, as a per-frame total.
+    const auto frame = frameWithDamage(frameSize, rectCount);
+    KRdp::ActivityGrid grid;
+    quint32 checksum = 0;
+    QBENCHMARK {
+        const auto layout = KRdp::monitorLayoutForReset(frame);
+        const auto rects = KRdp::toDamageRects(frame);
+        grid.reset(frame.size);
+        grid.decay();
+        for (const auto &rect : rects) {
+            checksum += KRdp::qualityForDamageRect(rect, frame.size, false, false, false, grid.activityForRect(rect), 0).qp;
+        }
+        grid.markDamage(rects);
+        checksum += layout.size();
+    }
+    QVERIFY(checksum > 0);
+}
+
+QTEST_GUILESS_MAIN(VideoStreamBenchmark)
+
+#include "videostreambenchmark.moc"
@@ -0,0 +1,129 @@
+# SPDX-FileCopyrightText: 2026 KDE Contributors
+# SPDX-License-Identifier: BSD-2-Clause
+
+# Profile guided optimization for libKRdp and krdpserver. A PGO build takes
+# two passes over the same build directory:
+#
+#   KRDP_PGO=GENERATE  Build instrumented binaries, then build the
+#                      krdp_pgo_training target to run the training workload.
+#   KRDP_PGO=USE       Rebuild with the collected profiles and LTO.
+#
+# GCC finds the profile of an object file by the object's path, so both
+# passes have to use the same build directory.
+
+set(KRDP_PGO "OFF" CACHE STRING "Profile guided optimization of KRdp and krdpserver: OFF, GENERATE or USE")
+set_property(CACHE KRDP_PGO PROPERTY STRINGS OFF GENERATE USE)
+set(KRDP_PGO_PROFILE_DIR "${CMAKE_BINARY_DIR}/pgo-profiles" CACHE PATH "Where KRDP_PGO=GENERATE writes profiles and KRDP_PGO=USE reads them")
+set(KRDP_PGO_TRAINING_REPLAY "" CACHE FILEPATH "A krdpstreamer recording to replay as part of the PGO training workload")
+
+# Instrument or optimize ${target} according to KRDP_PGO.
+function(krdp_enable_pgo target)
+    if (KRDP_PGO STREQUAL "OFF")
+        return()
+    endif()
+
+    set_property(TARGET ${target} PROPERTY INTERPROCEDURAL_OPTIMIZATION ${KRDP_PGO_LTO})
+
+    if (KRDP_PGO STREQUAL "GENERATE")
+        target_compile_options(${target} PRIVATE -fprofile-generate=${KRDP_PGO_PROFILE_DIR})
+        target_link_options(${target} PRIVATE -fprofile-generate=${KRDP_PGO_PROFILE_DIR})
+        # Counters are updated from the media, submission and FreeRDP threads.
+        if (KRDP_HAVE_PROFILE_UPDATE_ATOMIC)
+            target_compile_options(${target} PRIVATE -fprofile-update=atomic)
+        endif()
+    elseif (CMAKE_CXX_COMPILER_ID STREQUAL "GNU")
+        # Code the workload never reaches (portal setup, the KCM facing parts
+        # of krdpserver) keeps its normal optimization instead of being
+        # treated as cold. Profiles older than the sources only warn.
+        target_compile_options(${target} PRIVATE -fprofile-use=${KRDP_PGO_PROFILE_DIR} -fprofile-partial-training -Wno-missing-profile -Wno-error=coverage-mismatch)
+    else()
+        target_compile_options(${target} PRIVATE -fprofile-use=${KRDP_PGO_PROFILE_DATA} -Wno-profile-instr-unprofiled -Wno-profile-instr-out-of-date)
+    endif()
+endfunction()
+
+# The krdp_pgo_training target: runs the benchmarks against the instrumented
+# library so its hot paths (rect coalescing, the activity grid, RDPGFX PDU
+# encoding, TLS) are profiled the way a desktop session exercises them.
+function(krdp_add_pgo_training_target)
+    if (NOT KRDP_PGO STREQUAL "GENERATE")
+        return()
+    endif()
+
+    if (NOT TARGET krdp_loopback_bench OR NOT TARGET videostreambenchmark)
+        message(FATAL_ERROR "KRDP_PGO=GENERATE needs BUILD_TESTING and FreeRDP's client library for the training workload")
+    endif()
+
+    set(_bench $<TARGET_FILE:krdp_loopback_bench>)
+    set(_bench_args --duration 5 --warmup 1 --size 1920x1080 --fps 60)
+    set(_commands
+        COMMAND ${CMAKE_COMMAND} -E remove_directory ${KRDP_PGO_PROFILE_DIR}
+        COMMAND ${CMAKE_COMMAND} -E make_directory ${KRDP_PGO_PROFILE_DIR}
+        COMMAND ${_bench} ${_bench_args} --content typing --input 100
+        COMMAND ${_bench} ${_bench_args} --content scrolling
+        COMMAND ${_bench} ${_bench_args} --content video
+        COMMAND ${_bench} ${_bench_args} --content video --network broadband
+        COMMAND ${_bench} ${_bench_args} --content idle --size 3840x2160
+    )
+    if (KRDP_PGO_TRAINING_REPLAY)
+        list(APPEND _commands COMMAND ${_bench} --replay ${KRDP_PGO_TRAINING_REPLAY} --unpaced --duration 10 --warmup 1)
+    endif()
+    list(APPEND _commands COMMAND $<TARGET_FILE:videostreambenchmark> -silent)
+    if (CMAKE_CXX_COMPILER_ID MATCHES "Clang")
+        list(APPEND _commands COMMAND ${LLVM_PROFDATA} merge -output=${KRDP_PGO_PROFILE_DATA} ${KRDP_PGO_PROFILE_DIR})
+    endif()
+
+    add_custom_target(krdp_pgo_training
+        ${_commands}
+        DEPENDS KRdp krdpserver krdp_loopback_bench videostreambenchmark
+        COMMENT "Collecting profiles for KRDP_PGO=USE in ${KRDP_PGO_PROFILE_DIR}"
+        VERBATIM
+    )
+endfunction()
+
+if (KRDP_PGO STREQUAL "OFF")
+    return()
+endif()
+
+if (NOT KRDP_PGO STREQUAL "GENERATE" AND NOT KRDP_PGO STREQUAL "USE")
+    message(FATAL_ERROR "KRDP_PGO must be OFF, GENERATE or USE, not ${KRDP_PGO}")
+endif()
+
+if (NOT CMAKE_CXX_COMPILER_ID STREQUAL "GNU" AND NOT CMAKE_CXX_COMPILER_ID MATCHES "Clang")
+    message(FATAL_ERROR "KRDP_PGO needs GCC or Clang")
+endif()
+
+# Clang writes one raw profile per process, which are merged into this file.
+set(KRDP_PGO_PROFILE_DATA "${KRDP_PGO_PROFILE_DIR}/krdp.profdata")
+
+if (CMAKE_CXX_COMPILER_ID MATCHES "Clang")
+    string(REGEX MATCH "^[0-9]+" _krdp_clang_major "${CMAKE_CXX_COMPILER_VERSION}")
+    get_filename_component(_krdp_compiler_dir "${CMAKE_CXX_COMPILER}" DIRECTORY)
+    find_program(LLVM_PROFDATA NAMES llvm-profdata-${_krdp_clang_major} llvm-profdata HINTS "${_krdp_compiler_dir}")
+    if (KRDP_PGO STREQUAL "GENERATE" AND NOT LLVM_PROFDATA)
+        message(FATAL_ERROR "KRDP_PGO=GENERATE with Clang needs llvm-profdata to merge the profiles")
+    endif()
+endif()
+
+if (KRDP_PGO STREQUAL "USE")
+    if (CMAKE_CXX_COMPILER_ID STREQUAL "GNU")
+        file(GLOB_RECURSE _krdp_profiles "${KRDP_PGO_PROFILE_DIR}/*.gcda")
+    elseif (EXISTS "${KRDP_PGO_PROFILE_DATA}")
+        set(_krdp_profiles "${KRDP_PGO_PROFILE_DATA}")
+    endif()
+    if (NOT _krdp_profiles)
+        message(FATAL_ERROR "No profiles in ${KRDP_PGO_PROFILE_DIR}. Configure with KRDP_PGO=GENERATE and build the krdp_pgo_training target first.")
+    endif()
+endif()
+
+# LTO is used in both passes, so the instrumented code is the code the
+# profiles are applied to.
+include(CheckIPOSupported)
+check_ipo_supported(RESULT KRDP_PGO_LTO OUTPUT _krdp_lto_error LANGUAGES CXX)
+if (NOT KRDP_PGO_LTO)
+    message(WARNING "LTO is not supported, KRDP_PGO builds without it: ${_krdp_lto_error}")
+endif()
+
+include(CheckCXXCompilerFlag)
+check_cxx_compiler_flag(-fprofile-update=atomic KRDP_HAVE_PROFILE_UPDATE_ATOMIC)
+
+add_feature_info(PGO ON "Profile guided optimization (KRDP_PGO=${KRDP_PGO}, profiles in ${KRDP_PGO_PROFILE_DIR})")
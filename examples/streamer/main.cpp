@@ -12,6 +12,7 @@
 #include <QUrl>
 
 #include "PortalSession.h"
+#include "StreamRecording.h"
 #include "VideoStream.h"
 
 using namespace Qt::StringLiterals;
@@ -26,6 +27,8 @@ int main(int argc, char **argv)
         {u"quit-after"_s, u"Quit after running for this amount of seconds"_s, u"seconds"_s},
         {u"monitor"_s, u"Index of the monitor to display."_s, u"monitor"_s, u"-1"_s},
         {u"quality"_s, u"Encoding quality of the stream, from 0 (lowest) to 100 (highest)"_s, u"quality"_s},
+        {u"output"_s, u"File to record to."_s, u"file"_s, u"stream.krdprec"_s},
+        {u"raw"_s, u"Only write the raw H.264 stream, without frame boundaries, damage and timestamps."_s},
     });
     parser.process(application);
 
@@ -44,14 +47,22 @@ int main(int argc, char **argv)
         QCoreApplication::exit(0);
     });
 
-    QFile file{u"stream.raw"_s};
-    if (!file.open(QFile::WriteOnly)) {
-        qDebug() << "Failed opening stream.raw";
+    const auto output = parser.value(u"output"_s);
+    const bool raw = parser.isSet(u"raw"_s);
+
+    QFile file{output};
+    KRdp::StreamRecorder recorder{output};
+    if (raw ? !file.open(QFile::WriteOnly) : !recorder.open()) {
+        qDebug() << "Failed opening" << output;
         return -1;
     }
 
-    QObject::connect(&session, &KRdp::PortalSession::frameReceived, &session, [&file](const KRdp::VideoFrame &frame) {
-        file.write(frame.data);
+    QObject::connect(&session, &KRdp::PortalSession::frameReceived, &session, [&file, &recorder, raw](const KRdp::VideoFrame &frame) {
+        if (raw) {
+            file.write(frame.data);
+        } else {
+            recorder.write(frame);
+        }
     });
 
     QTimer timer;
@@ -64,7 +75,12 @@ int main(int argc, char **argv)
     session.start();
     auto result = application.exec();
 
-    file.close();
+    if (raw) {
+        file.close();
+    } else {
+        recorder.finish();
+        qDebug() << "Recorded" << recorder.frameCount() << "frames to" << output;
+    }
 
     return result;
 }
@@ -0,0 +1,129 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "MetricsExporter.h"
+
+#include <memory>
+
+#include <QDBusConnection>
+#include <QDBusError>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QStandardPaths>
+#include <QTimer>
+
+#include <Metrics.h>
+
+using namespace Qt::StringLiterals;
+
+namespace
+{
+constexpr auto DBusService = "org.kde.krdpserver";
+constexpr auto DBusPath = "/org/kde/krdpserver/Metrics";
+constexpr int RequestTimeoutMs = 5000;
+constexpr qsizetype MaxRequestSize = 8192;
+
+KRdp::MetricsWriter collectMetrics()
+{
+    KRdp::MetricsWriter writer;
+    KRdp::MetricsRegistry::instance()->collect(writer);
+    return writer;
+}
+}
+
+MetricsExporter::MetricsExporter(QObject *parent)
+    : QObject(parent)
+{
+}
+
+MetricsExporter::~MetricsExporter()
+{
+    if (m_server) {
+        m_server->close();
+    }
+    QDBusConnection::sessionBus().unregisterObject(QString::fromLatin1(DBusPath));
+}
+
+QString MetricsExporter::socketPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation) + u"/krdp/metrics.sock"_s;
+}
+
+bool MetricsExporter::start()
+{
+    auto bus = QDBusConnection::sessionBus();
+    if (!bus.registerObject(QString::fromLatin1(DBusPath), this, QDBusConnection::ExportScriptableSlots)) {
+        qWarning() << "Could not register metrics on DBus:" << bus.lastError().message();
+    } else if (!bus.registerService(QString::fromLatin1(DBusService))) {
+        qWarning() << "Could not register DBus service" << DBusService << bus.lastError().message();
+    }
+
+    const auto path = socketPath();
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QLocalServer::removeServer(path);
+
+    m_server = new QLocalServer(this);
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    if (!m_server->listen(path)) {
+        qWarning() << "Could not listen for metrics requests on" << path << m_server->errorString();
+        return false;
+    }
+
+    connect(m_server, &QLocalServer::newConnection, this, [this]() {
+        while (auto socket = m_server->nextPendingConnection()) {
+            handleConnection(socket);
+        }
+    });
+
+    qInfo().noquote() << u"Serving metrics on %1"_s.arg(path);
+    return true;
+}
+
+QString MetricsExporter::Prometheus() const
+{
+    return collectMetrics().toPrometheusText();
+}
+
+QVariantMap MetricsExporter::Values() const
+{
+    return collectMetrics().toVariantMap();
+}
+
+void MetricsExporter::handleConnection(QLocalSocket *socket)
+{
+    connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+    QTimer::singleShot(RequestTimeoutMs, socket, [socket]() {
+        socket->abort();
+        socket->deleteLater();
+    });
+
+    // Answer once the HTTP request headers are complete, whatever was asked
+    // for. This is all curl --unix-socket and Prometheus need.
+    auto request = std::make_shared<QByteArray>();
+    connect(socket, &QLocalSocket::readyRead, socket, [this, socket, request]() {
+        request->append(socket->readAll());
+        if (!request->contains("\r\n\r\n") && !request->contains("\n\n")) {
+            if (request->size() > MaxRequestSize) {
+                socket->abort();
+            }
+            return;
+        }
+        if (socket->property("_krdpAnswered").toBool()) {
+            return;
+        }
+        socket->setProperty("_krdpAnswered", true);
+
+        const auto body = Prometheus().toUtf8();
+        QByteArray response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\nContent-Length: ";
+        response += QByteArray::number(body.size());
+        response += "\r\nConnection: close\r\n\r\n";
+        response += body;
+        socket->write(response);
+        socket->disconnectFromServer();
+    });
+}
+
+#include "moc_MetricsExporter.cpp"
@@ -0,0 +1,45 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QVariantMap>
+
+class QLocalServer;
+class QLocalSocket;
+
+/**
+ * Exports the metrics of KRdp::MetricsRegistry.
+ *
+ * Metrics are served in the Prometheus text format over HTTP on a Unix
+ * socket in the runtime directory, and over DBus on the session bus.
+ */
+class MetricsExporter : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.kde.krdpserver.Metrics")
+
+public:
+    explicit MetricsExporter(QObject *parent = nullptr);
+    ~MetricsExporter() override;
+
+    bool start();
+
+    static QString socketPath();
+
+    /**
+     * All metrics in the Prometheus text format.
+     */
+    Q_SCRIPTABLE QString Prometheus() const;
+    /**
+     * All metrics as a map from sample name, including labels, to value.
+     */
+    Q_SCRIPTABLE QVariantMap Values() const;
+
+private:
+    void handleConnection(QLocalSocket *socket);
+
+    QLocalServer *m_server = nullptr;
+};
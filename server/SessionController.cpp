@@ -3,11 +3,15 @@
 
 #include "SessionController.h"
 
+#include <atomic>
+
 #include <QAction>
 #include <QCoreApplication>
 #include <QDBusInterface>
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QMenu>
+#include <QTimer>
 
 #include <KLocalizedString>
 
@@ -16,6 +20,7 @@
 #include <InputHandler.h>
 #include <PortalSession.h>
 #include <RdpConnection.h>
+#include <ReplaySession.h>
 #include <Server.h>
 
 #ifdef WITH_PLASMA_SESSION
@@ -30,25 +35,74 @@ class SessionWrapper : public QObject
 {
     Q_OBJECT
 public:
-    SessionWrapper(KRdp::RdpConnection *conn, std::unique_ptr<KRdp::AbstractSession> &&sess, KStatusNotifierItem *sni)
-        : session(std::move(sess))
-        , connection(conn)
+    SessionWrapper(KRdp::RdpConnection *conn, KStatusNotifierItem *sni)
+        : connection(conn)
     {
         m_sni = sni;
+        m_connectionTimer.start();
+
+        connect(connection->videoStream(), &KRdp::VideoStream::enabledChanged, this, &SessionWrapper::onVideoStreamEnabledChanged, Qt::QueuedConnection);
+        connect(connection->videoStream(), &KRdp::VideoStream::requestedFrameRateChanged, this, &SessionWrapper::onRequestedFrameRateChanged, Qt::QueuedConnection);
+
+        connect(connection, &QObject::destroyed, this, &SessionWrapper::onConnectionDestroyed);
+    }
 
-        connect(session.get(), &KRdp::AbstractSession::frameReceived, connection->videoStream(), &KRdp::VideoStream::queueFrame);
+    void attachSession(std::unique_ptr<KRdp::AbstractSession> &&sess, const QString &origin)
+    {
+        session = std::move(sess);
+        if (!session || !connection) {
+            return;
+        }
+        connection->markSetupStage("session_attached");
+
+        // Frames are emitted from the session's media thread, queueFrame() is
+        // thread safe so hand them over without a detour through the main thread.
+        // The sink, as the session may outlive the connection and its stream.
+        connect(session.get(), &KRdp::AbstractSession::frameReceived, connection->videoStream(), connection->videoStream()->frameSink(), Qt::DirectConnection);
+        connect(session.get(), &KRdp::AbstractSession::started, connection, [connection = connection.data()]() {
+            connection->markSetupStage("session_started");
+        });
+        connect(session.get(), &KRdp::AbstractSession::frameReceived, this, [this, origin]() {
+            if (m_firstFrameLogged.exchange(true)) {
+                return;
+            }
+            QMetaObject::invokeMethod(this, [this, origin]() {
+                if (connection) {
+                    connection->markSetupStage("first_packet");
+                }
+                qInfo().noquote() << QStringLiteral("Time to first frame: %1 ms (session: %2)").arg(m_connectionTimer.elapsed()).arg(origin);
+            });
+        }, Qt::DirectConnection);
         connect(session.get(), &KRdp::AbstractSession::cursorUpdate, this, &SessionWrapper::onCursorUpdate);
         connect(session.get(), &KRdp::AbstractSession::error, this, &SessionWrapper::sessionError);
         connect(session.get(), &KRdp::AbstractSession::clipboardDataChanged, connection->clipboard(), &KRdp::Clipboard::setServerData);
 
-        connect(connection->videoStream(), &KRdp::VideoStream::enabledChanged, this, &SessionWrapper::onVideoStreamEnabledChanged, Qt::QueuedConnection);
-        connect(connection->videoStream(), &KRdp::VideoStream::requestedFrameRateChanged, this, &SessionWrapper::onRequestedFrameRateChanged, Qt::QueuedConnection);
-        connect(connection->inputHandler(), &KRdp::InputHandler::inputEvent, session.get(), &KRdp::AbstractSession::sendEvent);
+        connect(connection->inputHandler(), &KRdp::InputHandler::inputEvents, session.get(), &KRdp::AbstractSession::sendInputEvents);
         connect(connection->clipboard(), &KRdp::Clipboard::clientDataChanged, session.get(), [clipboard = connection->clipboard(), this]() {
             session->setClipboardData(clipboard->getClipboard());
         }, Qt::QueuedConnection);
 
-        connect(connection, &QObject::destroyed, this, &SessionWrapper::onConnectionDestroyed);
+        // A reused session may still be throttled to the rate of its previous
+        // connection.
+        session->setVideoFrameRate(connection->videoStream()->requestedFrameRate());
+    }
+
+    std::unique_ptr<KRdp::AbstractSession> detachSession()
+    {
+        if (!session) {
+            return {};
+        }
+
+        disconnect(session.get(), nullptr, this, nullptr);
+        if (connection) {
+            disconnect(session.get(), nullptr, connection.data(), nullptr);
+            disconnect(session.get(), nullptr, connection->videoStream(), nullptr);
+            disconnect(session.get(), nullptr, connection->clipboard(), nullptr);
+            disconnect(connection->inputHandler(), nullptr, session.get(), nullptr);
+            disconnect(connection->clipboard(), nullptr, session.get(), nullptr);
+            session->requestStreamingDisable(connection->videoStream());
+        }
+        return std::move(session);
     }
 
     void onCursorUpdate(const PipeWireCursor &cursor)
@@ -65,15 +119,30 @@ public:
 
     void onVideoStreamEnabledChanged()
     {
+        if (!connection) {
+            return;
+        }
+
         if (connection->videoStream()->enabled()) {
-            session->requestStreamingEnable(connection->videoStream());
-        } else {
+            if (!session) {
+                // The session is only picked once the client has authenticated,
+                // so a reconnecting user can be handed their previous session.
+                userName = connection->userName();
+                Q_EMIT sessionRequired(this);
+            }
+            if (session) {
+                session->requestStreamingEnable(connection->videoStream());
+            }
+        } else if (session) {
             session->requestStreamingDisable(connection->videoStream());
         }
     }
 
     void onRequestedFrameRateChanged()
     {
+        if (!session || !connection) {
+            return;
+        }
         session->setVideoFrameRate(connection->videoStream()->requestedFrameRate());
     }
 
@@ -82,12 +151,18 @@ public:
         Q_EMIT connectionDestroyed(this);
     }
 
+    Q_SIGNAL void sessionRequired(SessionWrapper *wrapper);
     Q_SIGNAL void sessionError();
     Q_SIGNAL void connectionDestroyed(SessionWrapper *wrapper);
 
     std::unique_ptr<KRdp::AbstractSession> session;
     QPointer<KRdp::RdpConnection> connection;
+    QString userName;
     KStatusNotifierItem *m_sni;
+
+private:
+    QElapsedTimer m_connectionTimer;
+    std::atomic_bool m_firstFrameLogged = false;
 };
 
 SessionController::SessionController(KRdp::Server *server, SessionType sessionType)
@@ -138,10 +213,26 @@ void SessionController::setQuality(const std::optional<int> &quality)
         }
         wrapper->session->setVideoQuality(m_quality.value());
     }
+    for (const auto &lingering : m_lingeringSessions) {
+        lingering.session->setVideoQuality(m_quality.value());
+    }
+    if (m_initializationSession) {
+        m_initializationSession->setVideoQuality(m_quality.value());
+    }
 
     qInfo() << "Applied runtime quality update:" << m_quality.value() << "active sessions:" << m_wrappers.size();
 }
 
+void SessionController::setSyntheticContent(KRdp::SyntheticSession::Content content)
+{
+    m_syntheticContent = content;
+}
+
+void SessionController::setReplayFile(const QString &fileName)
+{
+    m_replayFile = fileName;
+}
+
 void SessionController::refreshDisplayConfiguration()
 {
     if (m_virtualMonitor.has_value()) {
@@ -156,27 +247,37 @@ void SessionController::refreshDisplayConfiguration()
         wrapper->session->setActiveStream(m_monitorIndex.value_or(-1));
         wrapper->session->refreshDisplayConfiguration();
     }
+    for (const auto &lingering : m_lingeringSessions) {
+        lingering.session->setActiveStream(m_monitorIndex.value_or(-1));
+        lingering.session->refreshDisplayConfiguration();
+    }
+    if (m_initializationSession) {
+        m_initializationSession->setActiveStream(m_monitorIndex.value_or(-1));
+        m_initializationSession->refreshDisplayConfiguration();
+    }
 }
 
-void SessionController::onNewConnection(KRdp::RdpConnection *newConnection)
+void SessionController::setSessionLinger(std::chrono::seconds linger)
 {
-    auto wrapper = std::make_unique<SessionWrapper>(newConnection, makeSession(), m_sni);
-    if (m_virtualMonitor) {
-        wrapper->session->setVirtualMonitor(*m_virtualMonitor);
-    } else {
-        wrapper->session->setActiveStream(m_monitorIndex.value_or(-1));
+    m_sessionLinger = std::max(linger, std::chrono::seconds(0));
+    if (m_sessionLinger.count() == 0 && !m_lingeringSessions.empty()) {
+        qInfo() << "Session lingering disabled, discarding" << m_lingeringSessions.size() << "lingering sessions";
+        m_lingeringSessions.clear();
     }
-    wrapper->session->setVideoQuality(m_quality.value());
+}
+
+void SessionController::onNewConnection(KRdp::RdpConnection *newConnection)
+{
+    auto wrapper = std::make_unique<SessionWrapper>(newConnection, m_sni);
 
-    connect(wrapper.get(), &SessionWrapper::connectionDestroyed, this, [this](SessionWrapper *wrapper) {
-        m_wrappers.erase(std::remove_if(m_wrappers.begin(),
-                                        m_wrappers.end(),
-                                        [wrapper](std::unique_ptr<SessionWrapper> &entry) {
-                                            return entry.get() == wrapper;
-                                        }),
-                         m_wrappers.end());
+    connect(wrapper.get(), &SessionWrapper::sessionRequired, this, [this](SessionWrapper *wrapper) {
+        QString origin;
+        auto session = acquireSession(wrapper->userName, origin);
+        wrapper->attachSession(std::move(session), origin);
     });
 
+    connect(wrapper.get(), &SessionWrapper::connectionDestroyed, this, &SessionController::onConnectionDestroyed);
+
     connect(wrapper.get(), &SessionWrapper::sessionError, this, [newConnection] {
         newConnection->close(KRdp::RdpConnection::CloseReason::None);
     });
@@ -184,6 +285,129 @@ void SessionController::onNewConnection(KRdp::RdpConnection *newConnection)
     m_wrappers.push_back(std::move(wrapper));
 }
 
+void SessionController::onConnectionDestroyed(SessionWrapper *wrapper)
+{
+    auto itr = std::find_if(m_wrappers.begin(), m_wrappers.end(), [wrapper](const std::unique_ptr<SessionWrapper> &entry) {
+        return entry.get() == wrapper;
+    });
+    if (itr == m_wrappers.end()) {
+        return;
+    }
+
+    if (m_sessionLinger.count() > 0 && !wrapper->userName.isEmpty()) {
+        if (auto session = wrapper->detachSession()) {
+            lingerSession(wrapper->userName, std::move(session));
+        }
+    }
+
+    m_wrappers.erase(itr);
+}
+
+std::unique_ptr<KRdp::AbstractSession> SessionController::acquireSession(const QString &userName, QString &origin)
+{
+    auto itr = std::find_if(m_lingeringSessions.begin(), m_lingeringSessions.end(), [&userName](const LingeringSession &entry) {
+        return entry.userName == userName;
+    });
+    if (itr != m_lingeringSessions.end()) {
+        auto session = std::move(itr->session);
+        m_lingeringSessions.erase(itr);
+        disconnect(session.get(), nullptr, this, nullptr);
+        qInfo() << "Reattaching lingering capture session for user" << userName;
+        origin = u"lingering"_s;
+        return session;
+    }
+
+    if (m_initializationSession) {
+        auto session = std::move(m_initializationSession);
+        disconnect(session.get(), nullptr, this, nullptr);
+        // End the warm-up run if the first frame has not arrived yet. This is
+        // queued so the connection's own enable request lands first and the
+        // encoder keeps running.
+        QMetaObject::invokeMethod(session.get(), [this, session = session.get()]() {
+            session->requestStreamingDisable(this);
+        }, Qt::QueuedConnection);
+        qInfo() << "Adopting pre-warmed capture session for user" << userName;
+        origin = u"prewarmed"_s;
+        return session;
+    }
+
+    origin = u"cold"_s;
+    return makeConfiguredSession();
+}
+
+void SessionController::prewarmSession()
+{
+    if (m_initializationSession) {
+        return;
+    }
+
+    if (m_sessionType == SessionType::Portal && !KRdp::PortalSession::hasRestoreToken()) {
+        // Without a token the portal would show a permission dialog with
+        // nobody around to answer it. The first regular session stores one.
+        qInfo() << "Not pre-warming capture session: no portal restore token stored yet";
+        return;
+    }
+
+    m_initializationSession = makeConfiguredSession();
+    auto session = m_initializationSession.get();
+
+    auto timer = std::make_shared<QElapsedTimer>();
+    timer->start();
+    connect(session, &KRdp::AbstractSession::started, this, [timer]() {
+        qInfo() << "Pre-warmed capture session started after" << timer->elapsed() << "ms";
+    });
+    // Run the encoder until it produced a frame so PipeWire negotiation and
+    // encoder initialization are done before anyone connects.
+    connect(session, &KRdp::AbstractSession::frameReceived, this, [this, session, timer]() {
+        disconnect(session, &KRdp::AbstractSession::frameReceived, this, nullptr);
+        qInfo() << "Pre-warmed capture session produced its first frame after" << timer->elapsed() << "ms, pausing it";
+        QMetaObject::invokeMethod(session, [this, session]() {
+            session->requestStreamingDisable(this);
+        });
+    }, Qt::DirectConnection);
+    connect(session, &KRdp::AbstractSession::error, this, [this, session]() {
+        if (m_initializationSession.get() != session) {
+            return;
+        }
+        qWarning() << "Pre-warmed capture session failed, new connections will create their own";
+        m_initializationSession.reset();
+    }, Qt::QueuedConnection);
+
+    session->requestStreamingEnable(this);
+}
+
+void SessionController::lingerSession(const QString &userName, std::unique_ptr<KRdp::AbstractSession> &&session)
+{
+    // Only the most recent session of a user is worth keeping around.
+    std::erase_if(m_lingeringSessions, [&userName](const LingeringSession &entry) {
+        return entry.userName == userName;
+    });
+
+    const auto generation = ++m_lingerGeneration;
+    auto sessionPtr = session.get();
+    connect(sessionPtr, &KRdp::AbstractSession::error, this, [this, sessionPtr, generation]() {
+        qInfo() << "Lingering capture session failed, discarding it";
+        dropLingeringSession(sessionPtr, generation);
+    }, Qt::QueuedConnection);
+    QTimer::singleShot(m_sessionLinger, this, [this, sessionPtr, generation]() {
+        dropLingeringSession(sessionPtr, generation);
+    });
+
+    qInfo() << "Keeping capture session of user" << userName << "alive for" << m_sessionLinger.count() << "seconds";
+    m_lingeringSessions.push_back(LingeringSession{
+        .userName = userName,
+        .session = std::move(session),
+        .generation = generation,
+    });
+}
+
+void SessionController::dropLingeringSession(KRdp::AbstractSession *session, quint64 generation)
+{
+    std::erase_if(m_lingeringSessions, [session, generation](const LingeringSession &entry) {
+        return entry.session.get() == session && entry.generation == generation;
+    });
+}
+
 void SessionController::stopFromSNI()
 {
     // Uses dbus to stop the server service, like in the KCM
@@ -196,8 +420,27 @@ void SessionController::stopFromSNI()
     QCoreApplication::quit();
 }
 
+std::unique_ptr<KRdp::AbstractSession> SessionController::makeConfiguredSession()
+{
+    auto session = makeSession();
+    if (m_virtualMonitor) {
+        session->setVirtualMonitor(*m_virtualMonitor);
+    } else {
+        session->setActiveStream(m_monitorIndex.value_or(-1));
+    }
+    session->setVideoQuality(m_quality.value());
+    return session;
+}
+
 std::unique_ptr<KRdp::AbstractSession> SessionController::makeSession()
 {
+    if (m_sessionType == SessionType::Synthetic) {
+        return std::make_unique<KRdp::SyntheticSession>(m_syntheticContent);
+    }
+    if (m_sessionType == SessionType::Replay) {
+        return std::make_unique<KRdp::ReplaySession>(m_replayFile);
+    }
+
 #ifdef WITH_PLASMA_SESSION
     if (m_sessionType == SessionType::Plasma) {
         return std::make_unique<KRdp::PlasmaScreencastV1Session>();
@@ -5,7 +5,9 @@
 
 #include "RdpConnection.h"
 #include <AbstractSession.h>
+#include <SyntheticSession.h>
 #include <KStatusNotifierItem>
+#include <chrono>
 #include <vector>
 
 #include <QObject>
@@ -26,6 +28,8 @@ public:
     enum class SessionType {
         Portal,
         Plasma,
+        Synthetic,
+        Replay,
     };
 
     SessionController(KRdp::Server *server, SessionType sessionType);
@@ -34,23 +38,65 @@ public:
     void setVirtualMonitor(const KRdp::VirtualMonitor &vm);
     void setMonitorIndex(const std::optional<int> &index);
     void setQuality(const std::optional<int> &quality);
+    /**
+     * What synthetic sessions render, only used with SessionType::Synthetic.
+     */
+    void setSyntheticContent(KRdp::SyntheticSession::Content content);
+    /**
+     * The recording replay sessions play, only used with SessionType::Replay.
+     */
+    void setReplayFile(const QString &fileName);
+    /**
+     * How long the capture session of a disconnected client is kept alive.
+     *
+     * A client of the same user that reconnects within this period reuses the
+     * existing capture session instead of negotiating a new one. Zero disables
+     * lingering.
+     */
+    void setSessionLinger(std::chrono::seconds linger);
+    /**
+     * Start a standby capture session before any client connects.
+     *
+     * The session performs the portal or compositor negotiation and runs the
+     * encoder until it produced a frame, then stays paused until the first
+     * client connection adopts it.
+     */
+    void prewarmSession();
     void refreshDisplayConfiguration();
     void setSNIStatus(const KRdp::RdpConnection::State state);
     void stopFromSNI();
 
 private:
+    struct LingeringSession {
+        QString userName;
+        std::unique_ptr<KRdp::AbstractSession> session;
+        quint64 generation = 0;
+    };
+
     void onNewConnection(KRdp::RdpConnection *newConnection);
+    void onConnectionDestroyed(SessionWrapper *wrapper);
+    std::unique_ptr<KRdp::AbstractSession> acquireSession(const QString &userName, QString &origin);
+    void lingerSession(const QString &userName, std::unique_ptr<KRdp::AbstractSession> &&session);
+    void dropLingeringSession(KRdp::AbstractSession *session, quint64 generation);
     std::unique_ptr<KRdp::AbstractSession> makeSession();
+    std::unique_ptr<KRdp::AbstractSession> makeConfiguredSession();
 
     KRdp::Server *m_server = nullptr;
     SessionType m_sessionType;
     std::optional<int> m_monitorIndex;
     std::optional<int> m_quality;
     std::optional<KRdp::VirtualMonitor> m_virtualMonitor;
+    KRdp::SyntheticSession::Content m_syntheticContent = KRdp::SyntheticSession::Content::Typing;
+    QString m_replayFile;
 
+    // Standby session created by prewarmSession(), adopted by the first connection.
     std::unique_ptr<KRdp::AbstractSession> m_initializationSession;
 
     std::vector<std::unique_ptr<SessionWrapper>> m_wrappers;
 
+    std::chrono::seconds m_sessionLinger = std::chrono::seconds(0);
+    std::vector<LingeringSession> m_lingeringSessions;
+    quint64 m_lingerGeneration = 0;
+
     KStatusNotifierItem *m_sni;
 };
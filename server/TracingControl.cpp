@@ -0,0 +1,70 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "TracingControl.h"
+
+#include <QDBusConnection>
+#include <QDBusError>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QStandardPaths>
+
+#include <Tracing.h>
+
+using namespace Qt::StringLiterals;
+
+namespace
+{
+constexpr auto DBusPath = "/org/kde/krdpserver/Tracing";
+}
+
+TracingControl::TracingControl(QObject *parent)
+    : QObject(parent)
+{
+}
+
+TracingControl::~TracingControl()
+{
+    QDBusConnection::sessionBus().unregisterObject(QString::fromLatin1(DBusPath));
+}
+
+bool TracingControl::start()
+{
+    auto bus = QDBusConnection::sessionBus();
+    if (!bus.registerObject(QString::fromLatin1(DBusPath), this, QDBusConnection::ExportScriptableSlots)) {
+        qWarning() << "Could not register tracing control on DBus:" << bus.lastError().message();
+        return false;
+    }
+
+    if (qEnvironmentVariableIntValue("KRDP_TRACE") > 0) {
+        Start();
+    }
+    return true;
+}
+
+void TracingControl::Start()
+{
+    KRdp::Tracing::setEnabled(true);
+}
+
+QString TracingControl::Stop(const QString &path)
+{
+    KRdp::Tracing::setEnabled(false);
+
+    auto target = path;
+    if (target.isEmpty()) {
+        const auto directory = QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation) + u"/krdp"_s;
+        QDir().mkpath(directory);
+        target = directory + u"/trace-%1.json"_s.arg(QDateTime::currentDateTime().toString(u"yyyyMMdd-hhmmss"_s));
+    }
+
+    return KRdp::Tracing::write(target) ? target : QString();
+}
+
+bool TracingControl::IsRunning() const
+{
+    return KRdp::Tracing::enabled();
+}
+
+#include "moc_TracingControl.cpp"
@@ -0,0 +1,36 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#pragma once
+
+#include <QObject>
+#include <QString>
+
+/**
+ * Switches KRdp::Tracing on and off over DBus.
+ */
+class TracingControl : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.kde.krdpserver.Tracing")
+
+public:
+    explicit TracingControl(QObject *parent = nullptr);
+    ~TracingControl() override;
+
+    bool start();
+
+    /**
+     * Start recording, discarding anything recorded before.
+     */
+    Q_SCRIPTABLE void Start();
+    /**
+     * Stop recording and write the trace.
+     *
+     * \param path Where to write the trace, a file in the runtime directory
+     *             is used when empty. See KRdp::Tracing::write().
+     * \return The path the trace was written to, or an empty string on failure.
+     */
+    Q_SCRIPTABLE QString Stop(const QString &path);
+    Q_SCRIPTABLE bool IsRunning() const;
+};
@@ -22,8 +22,12 @@
 
 #include <qt6keychain/keychain.h>
 
+#include <FlightRecorder.h>
+
+#include "MetricsExporter.h"
 #include "Server.h"
 #include "SessionController.h"
+#include "TracingControl.h"
 #include "krdp_version.h"
 #include "krdpserversettings.h"
 
@@ -153,6 +157,14 @@ int main(int argc, char **argv)
          u"data"_s,
          u"1920x1080@1"_s},
         {u"quality"_s, u"Encoding quality of the stream, from 0 (lowest) to 100 (highest)"_s, u"quality"_s},
+        {u"session-linger"_s,
+         u"Keep the capture session of a disconnected client alive for this many seconds so a reconnect can reuse it. 0 disables."_s,
+         u"seconds"_s},
+        {u"prewarm"_s, u"Start a paused capture session at startup that the first connection adopts."_s},
+        {u"synthetic"_s,
+         u"Stream a generated test pattern instead of the screen, for testing without a compositor. One of idle, typing, scrolling or video."_s,
+         u"content"_s},
+        {u"replay"_s, u"Stream a recording made with krdpstreamer instead of the screen, looping at the end."_s, u"file"_s},
 #ifdef WITH_PLASMA_SESSION
         {u"plasma"_s, u"Use Plasma protocols instead of XDP"_s},
 #endif
@@ -169,6 +181,10 @@ int main(int argc, char **argv)
         QCoreApplication::exit(0);
     });
 
+    signal(SIGUSR2, [](int) {
+        KRdp::FlightRecorder::requestDump();
+    });
+
     auto config = ServerConfig::self();
     const auto vaapiDriverMode = normalizedVaapiDriverMode(config->vaapiDriverMode());
     applyVaapiDriverMode(vaapiDriverMode);
@@ -231,10 +247,30 @@ int main(int argc, char **argv)
         }
     }
 
-    SessionController controller(&server, parser.isSet(u"plasma"_s) ? SessionController::SessionType::Plasma : SessionController::SessionType::Portal);
+    auto sessionType = parser.isSet(u"plasma"_s) ? SessionController::SessionType::Plasma : SessionController::SessionType::Portal;
+    std::optional<KRdp::SyntheticSession::Content> syntheticContent;
+    if (parser.isSet(u"synthetic"_s)) {
+        syntheticContent = KRdp::SyntheticSession::contentFromString(parser.value(u"synthetic"_s));
+        if (!syntheticContent) {
+            qWarning() << "Unknown synthetic content" << parser.value(u"synthetic"_s) << ", should be idle, typing, scrolling or video";
+            return 1;
+        }
+        sessionType = SessionController::SessionType::Synthetic;
+    } else if (parser.isSet(u"replay"_s)) {
+        sessionType = SessionController::SessionType::Replay;
+    }
+
+    SessionController controller(&server, sessionType);
+    if (syntheticContent) {
+        controller.setSyntheticContent(*syntheticContent);
+    }
+    if (sessionType == SessionController::SessionType::Replay) {
+        controller.setReplayFile(parser.value(u"replay"_s));
+    }
     QString streamTarget = u"workspace-default"_s;
     const bool monitorPinnedByCli = parser.isSet(u"monitor"_s) || parser.isSet(u"virtual-monitor"_s);
     const bool qualityPinnedByCli = parser.isSet(u"quality"_s);
+    const bool lingerPinnedByCli = parser.isSet(u"session-linger"_s);
     if (parser.isSet(u"virtual-monitor"_s)) {
         const QString vmData = parser.value(u"virtual-monitor"_s);
         const QRegularExpression rx(uR"((\d+)x(\d+)@([\d.]+))"_s);
@@ -260,9 +296,12 @@ int main(int argc, char **argv)
     }
     const auto quality = parserValueWithDefault(u"quality", config->quality());
     controller.setQuality(quality);
+    const auto sessionLinger = parserValueWithDefault(u"session-linger", config->sessionLingerTime());
+    controller.setSessionLinger(std::chrono::seconds(sessionLinger));
+    const bool prewarm = parser.isSet(u"prewarm"_s) || config->prewarmSession();
 
     auto runtimeConfig = KSharedConfig::openConfig(QStringLiteral("krdpserverrc"));
-    auto applyRuntimeConfig = [config, &controller, monitorPinnedByCli, qualityPinnedByCli]() {
+    auto applyRuntimeConfig = [config, &controller, monitorPinnedByCli, qualityPinnedByCli, lingerPinnedByCli]() {
         config->read();
 
         if (!qualityPinnedByCli) {
@@ -278,6 +317,10 @@ int main(int argc, char **argv)
                     << (updatedMonitorIndex.has_value() ? QStringLiteral("monitor:%1").arg(updatedMonitorIndex.value()) : QStringLiteral("workspace"));
         }
 
+        if (!lingerPinnedByCli) {
+            controller.setSessionLinger(std::chrono::seconds(config->sessionLingerTime()));
+        }
+
         applyVaapiDriverMode(config->vaapiDriverMode());
 
         if (monitorPinnedByCli) {
@@ -350,13 +393,16 @@ int main(int argc, char **argv)
 
     const bool experimentalAvc444 = qEnvironmentVariableIntValue("KRDP_EXPERIMENTAL_AVC444") > 0;
     const bool experimentalAvc444v2 = qEnvironmentVariableIntValue("KRDP_EXPERIMENTAL_AVC444V2") > 0;
-#ifdef WITH_PLASMA_SESSION
-    const auto sessionType = parser.isSet(u"plasma"_s) ? u"plasma"_s : u"portal"_s;
-#else
-    const auto sessionType = u"portal"_s;
-#endif
-    qInfo().noquote() << QStringLiteral("KRDP startup summary: session=%1 stream=%2 port=%3 quality=%4 vaapiMode=%5 KRDP_FORCE_VAAPI_DRIVER=%6 KRDP_AUTO_VAAPI_DRIVER=%7 expAvc444=%8 expAvc444v2=%9")
-                             .arg(sessionType,
+    QString sessionTypeName = u"portal"_s;
+    if (sessionType == SessionController::SessionType::Synthetic) {
+        sessionTypeName = u"synthetic:%1"_s.arg(parser.value(u"synthetic"_s).toLower());
+    } else if (sessionType == SessionController::SessionType::Replay) {
+        sessionTypeName = u"replay:%1"_s.arg(parser.value(u"replay"_s));
+    } else if (sessionType == SessionController::SessionType::Plasma) {
+        sessionTypeName = u"plasma"_s;
+    }
+    qInfo().noquote() << QStringLiteral("KRDP startup summary: session=%1 stream=%2 port=%3 quality=%4 vaapiMode=%5 KRDP_FORCE_VAAPI_DRIVER=%6 KRDP_AUTO_VAAPI_DRIVER=%7 expAvc444=%8 expAvc444v2=%9 linger=%10s prewarm=%11")
+                             .arg(sessionTypeName,
                                   streamTarget,
                                   QString::number(port),
                                   QString::number(quality),
@@ -364,11 +410,23 @@ int main(int argc, char **argv)
                                   envValueOrUnset("KRDP_FORCE_VAAPI_DRIVER"),
                                   envValueOrUnset("KRDP_AUTO_VAAPI_DRIVER"),
                                   experimentalAvc444 ? u"1"_s : u"0"_s,
-                                  experimentalAvc444v2 ? u"1"_s : u"0"_s);
+                                  experimentalAvc444v2 ? u"1"_s : u"0"_s,
+                                  QString::number(sessionLinger),
+                                  prewarm ? u"1"_s : u"0"_s);
 
     if (!server.start()) {
         return -1;
     }
 
+    if (prewarm) {
+        controller.prewarmSession();
+    }
+
+    TracingControl tracingControl;
+    tracingControl.start();
+
+    MetricsExporter metricsExporter;
+    metricsExporter.start();
+
     return application.exec();
 }
@@ -8,6 +8,14 @@
 #include <QSet>
 #include <QTimer>
 
+#include <algorithm>
+#include <chrono>
+
+#include "EncodedPacketPipeline.h"
+#include "FlightRecorder.h"
+#include "LatencyHistogram.h"
+#include "Metrics.h"
+#include "VideoFrame.h"
 #include "krdp_logging.h"
 
 namespace KRdp
@@ -19,6 +27,17 @@ bool stallWatchdogFallbackEnabled()
     static const bool enabled = qEnvironmentVariableIntValue("KRDP_ENABLE_STALL_WATCHDOG") == 1;
     return enabled;
 }
+
+// How much latency frames may pick up while waiting for the encoder.
+std::chrono::milliseconds encoderQueueLatencyBudget()
+{
+    static const auto budget = [] {
+        bool ok = false;
+        const int value = qEnvironmentVariableIntValue("KRDP_ENCODER_QUEUE_BUDGET_MS", &ok);
+        return std::chrono::milliseconds(ok && value > 0 ? value : 100);
+    }();
+    return budget;
+}
 }
 
 class KRDP_NO_EXPORT AbstractSession::Private
@@ -30,6 +49,7 @@ public:
     static constexpr int MaxHardwareRetryAttempts = 3;
 
     std::unique_ptr<PipeWireEncodedStream> encodedStream;
+    std::unique_ptr<EncodedPacketPipeline> packetPipeline;
 
     std::optional<int> activeStream;
     std::optional<VirtualMonitor> virtualMonitor;
@@ -38,6 +58,7 @@ public:
     QSize size;
     QSize logicalSize;
     std::optional<quint32> frameRate = 60;
+    int maxPendingFrames = 0;
     std::optional<quint8> quality;
     QSet<QObject *> enableRequests;
     bool softwareFallbackRetryPending = false;
@@ -57,16 +78,27 @@ public:
     bool temporarySoftwareEncoderOverride = false;
     bool hadPreviousForcedEncoder = false;
     QByteArray previousForcedEncoder;
+    quint64 metricsId = 0;
+    quint64 metricsCollector = 0;
 };
 
 AbstractSession::AbstractSession()
     : QObject()
     , d(std::make_unique<Private>())
 {
+    static quint64 nextMetricsId = 1;
+    d->metricsId = nextMetricsId++;
+    d->metricsCollector = MetricsRegistry::instance()->addCollector([this](MetricsWriter &writer) {
+        collectMetrics(writer);
+    });
 }
 
 AbstractSession::~AbstractSession()
 {
+    MetricsRegistry::instance()->removeCollector(d->metricsCollector);
+    // Stop the pipeline thread first so no frames are emitted while the
+    // session is going away.
+    d->packetPipeline.reset();
     if (d->encodedStream) {
         d->encodedStream->stop();
     }
@@ -174,8 +206,78 @@ void AbstractSession::setVideoFrameRate(quint32 framerate)
     d->frameRate = framerate;
     if (d->encodedStream) {
         d->encodedStream->setMaxFramerate({framerate, 1});
-        // this buffers 1 second of frames and drops after that
-        d->encodedStream->setMaxPendingFrames(framerate);
+        updateEncoderQueueBound();
+    }
+}
+
+const LatencyHistogram *AbstractSession::inputDeliveryLatency() const
+{
+    return nullptr;
+}
+
+void AbstractSession::collectMetrics(MetricsWriter &writer) const
+{
+    const MetricsWriter::Labels labels = {{QStringLiteral("capture_session"), QString::number(d->metricsId)}};
+
+    // KPipeWire does not tell which encoder it picked, only a forced or
+    // fallback software encoder is known for sure.
+    QString backend = QString::fromLatin1(qgetenv("KPIPEWIRE_FORCE_ENCODER").trimmed().toLower());
+    if (d->softwareFallbackActive) {
+        backend = QStringLiteral("libx264");
+    } else if (backend.isEmpty()) {
+        backend = QStringLiteral("auto");
+    }
+    auto backendLabels = labels;
+    backendLabels.append({QStringLiteral("backend"), backend});
+    writer.gauge(QStringLiteral("krdp_encoder_info"), QStringLiteral("Encoder backend used by the capture session."), 1.0, backendLabels);
+
+    writer.gauge(QStringLiteral("krdp_capture_session_streaming"), QStringLiteral("Whether the capture session is streaming."), d->enabled ? 1.0 : 0.0, labels);
+    if (d->packetPipeline) {
+        writer.gauge(QStringLiteral("krdp_encode_time_seconds"),
+                     QStringLiteral("Average time the encoder spends on a frame."),
+                     double(d->packetPipeline->encodeTime().count()) / 1'000'000.0,
+                     labels);
+        writer.counter(QStringLiteral("krdp_encoder_input_dropped_frames_total"),
+                       QStringLiteral("Captured frames that never came out of the encoder."),
+                       double(d->packetPipeline->droppedEncoderInputFrames()),
+                       labels);
+    }
+    writer.gauge(QStringLiteral("krdp_encoder_max_pending_frames"), QStringLiteral("Bound of the encoder input queue."), double(d->maxPendingFrames), labels);
+    if (const auto latency = inputDeliveryLatency()) {
+        writer.histogram(QStringLiteral("krdp_input_delivery_seconds"),
+                         QStringLiteral("Time from sending a batch of input events until the compositor handled it."),
+                         *latency,
+                         labels);
+    }
+}
+
+void AbstractSession::updateEncoderQueueBound()
+{
+    using namespace std::chrono;
+
+    if (!d->encodedStream || !d->frameRate) {
+        return;
+    }
+
+    // Only queue as many frames as the encoder gets through within the
+    // latency budget. Anything beyond that is dropped by the encoder input
+    // queue; the frames that do get through are handled newest first further
+    // down the line.
+    const auto frameRate = std::max(d->frameRate.value(), quint32(1));
+    const auto frameInterval = microseconds(1'000'000 / frameRate);
+    const auto encodeTime = d->packetPipeline ? d->packetPipeline->encodeTime() : microseconds(0);
+    const auto timePerFrame = std::max(frameInterval, encodeTime);
+    const int maxPendingFrames = std::clamp(int(duration_cast<microseconds>(encoderQueueLatencyBudget()) / timePerFrame), 2, std::max(int(frameRate), 2));
+
+    if (maxPendingFrames == d->maxPendingFrames) {
+        return;
+    }
+
+    qCDebug(KRDP) << "Encoder input queue bound" << maxPendingFrames << "frames, frame rate" << frameRate << "encode time" << encodeTime.count() << "us";
+    d->maxPendingFrames = maxPendingFrames;
+    d->encodedStream->setMaxPendingFrames(maxPendingFrames);
+    if (d->packetPipeline) {
+        d->packetPipeline->setEncoderQueueBound(maxPendingFrames);
     }
 }
 
@@ -201,12 +303,18 @@ PipeWireEncodedStream *AbstractSession::stream()
         connect(d->encodedStream.get(), &PipeWireBaseEncodedStream::errorFound, this, &AbstractSession::handleStreamError);
         connect(d->encodedStream.get(), &PipeWireBaseEncodedStream::stateChanged, this, &AbstractSession::handleStreamStateChanged);
         connect(d->encodedStream.get(), &PipeWireBaseEncodedStream::activeChanged, this, &AbstractSession::handleStreamActiveChanged);
-        connect(d->encodedStream.get(), &PipeWireEncodedStream::newPacket, this, [this](const PipeWireEncodedStream::Packet &) {
-            handleEncodedPacket();
-        });
+        // Packets are handled by the packet pipeline, only the stall watchdog
+        // needs to see them on the main thread.
+        if (stallWatchdogFallbackEnabled()) {
+            connect(d->encodedStream.get(), &PipeWireEncodedStream::newPacket, this, [this](const PipeWireEncodedStream::Packet &) {
+                handleEncodedPacket();
+            });
+        }
         if (d->frameRate) {
             d->encodedStream->setMaxFramerate({d->frameRate.value(), 1});
         }
+        d->maxPendingFrames = 0;
+        updateEncoderQueueBound();
         if (d->quality) {
             d->encodedStream->setQuality(d->quality.value());
         }
@@ -214,6 +322,19 @@ PipeWireEncodedStream *AbstractSession::stream()
     return d->encodedStream.get();
 }
 
+EncodedPacketPipeline *AbstractSession::packetPipeline()
+{
+    if (!d->packetPipeline) {
+        d->packetPipeline = std::make_unique<EncodedPacketPipeline>();
+        connect(d->packetPipeline.get(), &EncodedPacketPipeline::frameReady, this, &AbstractSession::frameReceived, Qt::DirectConnection);
+        connect(d->packetPipeline.get(), &EncodedPacketPipeline::encodeTimeChanged, this, &AbstractSession::updateEncoderQueueBound, Qt::QueuedConnection);
+        if (d->maxPendingFrames > 0) {
+            d->packetPipeline->setEncoderQueueBound(d->maxPendingFrames);
+        }
+    }
+    return d->packetPipeline.get();
+}
+
 bool AbstractSession::requestSoftwareFallback(const QString &reason, const QString &context, int hardwareRetryDelayMs, bool allowHardwareRetry)
 {
     d->autoHardwareRetryAllowed = d->autoHardwareRetryAllowed && allowHardwareRetry && !d->suppressHardwareRetryForSession;
@@ -250,6 +371,7 @@ bool AbstractSession::requestSoftwareFallback(const QString &reason, const QStri
     }
     qputenv("KPIPEWIRE_FORCE_ENCODER", "libx264");
     qCWarning(KRDP) << context << reason;
+    FlightRecorder::record(FlightRecorder::Event::EncoderFallback, quint32(d->metricsId), 1);
 
     if (d->encodedStream && d->encodedStream->state() == PipeWireBaseEncodedStream::Idle) {
         handleStreamStateChanged();
@@ -278,6 +400,7 @@ void AbstractSession::restoreForcedEncoderOverride()
 
 void AbstractSession::handleStreamError(const QString &errorMessage)
 {
+    FlightRecorder::record(FlightRecorder::Event::EncoderError, quint32(d->metricsId));
     if (!requestSoftwareFallback(errorMessage, QStringLiteral("PipeWire encoder initialization failed; forcing software fallback to libx264:"))) {
         qCWarning(KRDP) << "PipeWire encoder failed and no additional fallback is available:" << errorMessage;
         restoreForcedEncoderOverride();
@@ -290,6 +413,7 @@ void AbstractSession::handleStreamStateChanged()
     if (!d->encodedStream) {
         return;
     }
+    FlightRecorder::record(FlightRecorder::Event::EncoderState, quint32(d->metricsId), d->encodedStream->state(), d->encodedStream->isActive());
     if (d->encodedStream->state() != PipeWireBaseEncodedStream::Idle || !d->enabled) {
         return;
     }
@@ -306,12 +430,16 @@ void AbstractSession::handleStreamStateChanged()
         d->hardwareRetryPending = false;
         d->hardwareRetryInProgress = true;
         qCInfo(KRDP) << "Retrying PipeWire stream with hardware encoder";
+        FlightRecorder::record(FlightRecorder::Event::EncoderFallback, quint32(d->metricsId), 0);
         d->encodedStream->start();
     }
 }
 
 void AbstractSession::handleStreamActiveChanged(bool active)
 {
+    if (d->encodedStream) {
+        FlightRecorder::record(FlightRecorder::Event::EncoderState, quint32(d->metricsId), d->encodedStream->state(), active);
+    }
     if (!active) {
         d->receivedPacketSinceActivation = false;
         return;
@@ -467,7 +595,7 @@ void AbstractSession::setStarted(bool s)
 {
     d->started = s;
     if (s) {
-        if (d->enabled) {
+        if (d->enabled && d->encodedStream) {
             d->encodedStream->start();
         }
         Q_EMIT started();
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include "InputEvent.h"
 #include "krdp_export.h"
 
 #include <PipeWireEncodedStream>
@@ -15,6 +16,9 @@ class QMimeData;
 namespace KRdp
 {
 struct VideoFrame;
+class EncodedPacketPipeline;
+class LatencyHistogram;
+class MetricsWriter;
 class Server;
 
 struct VirtualMonitor {
@@ -36,11 +40,15 @@ public:
     virtual void start() = 0;
 
     bool streamingEnabled() const;
-    void setStreamingEnabled(bool enable);
-    void setVideoFrameRate(quint32 framerate);
+    /**
+     * Sessions that do not encode through a PipeWire stream override these
+     * to drive their own encoder, calling the base implementation first.
+     */
+    virtual void setStreamingEnabled(bool enable);
+    virtual void setVideoFrameRate(quint32 framerate);
     void setActiveStream(int stream);
     void setVirtualMonitor(const VirtualMonitor &vm);
-    void setVideoQuality(quint8 quality);
+    virtual void setVideoQuality(quint8 quality);
     virtual void refreshDisplayConfiguration();
 
     void requestStreamingEnable(QObject *requester);
@@ -54,11 +62,17 @@ public:
     virtual void setClipboardData(std::unique_ptr<QMimeData> data) = 0;
 
     /**
-     * Send a new event to the portal.
+     * Send input events from the client to the session.
      *
-     * \param event The new event to send.
+     * \param events The events to send, in the order they happened.
+     */
+    virtual void sendInputEvents(const InputEvents &events) = 0;
+
+    /**
+     * Time from sending a batch of input events until the compositor handled
+     * it, for sessions that measure it. Reported with the session's metrics.
      */
-    virtual void sendEvent(const std::shared_ptr<QEvent> &event) = 0;
+    virtual const LatencyHistogram *inputDeliveryLatency() const;
 
 Q_SIGNALS:
     void started();
@@ -69,6 +83,10 @@ Q_SIGNALS:
      *
      * Received in this case means that the portal has sent the data and it has
      * been encoded by libav.
+     *
+     * This is emitted from the session's media thread rather than the main
+     * thread. Receivers that can handle frames on any thread should connect
+     * with Qt::DirectConnection.
      */
     void frameReceived(const VideoFrame &frame);
 
@@ -98,11 +116,14 @@ protected:
     void setSize(QSize size);
     void setLogicalSize(QSize size);
     PipeWireEncodedStream *stream();
+    EncodedPacketPipeline *packetPipeline();
 
 private:
     void schedulePacketStallWatchdog();
     void scheduleHardwareEncoderRetry(bool forceReschedule = false);
     void restoreForcedEncoderOverride();
+    void updateEncoderQueueBound();
+    void collectMetrics(MetricsWriter &writer) const;
     bool requestSoftwareFallback(const QString &reason, const QString &context, int hardwareRetryDelayMs = -1, bool allowHardwareRetry = true);
     void handleStreamError(const QString &errorMessage);
     void handleStreamStateChanged();
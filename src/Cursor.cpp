@@ -9,6 +9,7 @@
 #include <freerdp/freerdp.h>
 #include <freerdp/peer.h>
 
+#include "Probes_p.h"
 #include "RdpConnection.h"
 
 using namespace KRdp;
@@ -60,6 +61,8 @@ void Cursor::update(const Cursor::CursorUpdate &update)
         return;
     }
 
+    KRDP_PROBE4(cursor_update, update.image.width(), update.image.height(), update.hotspot.x(), update.hotspot.y());
+
     auto image = update.image;
     // RDP cannot handle cursor images larger than 384x384 px. If we get such an
     // image, discard it and use the system default cursor instead.
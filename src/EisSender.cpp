@@ -0,0 +1,360 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "EisSender.h"
+
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <vector>
+
+#include <linux/input-event-codes.h>
+#include <sys/mman.h>
+
+#include <QPointF>
+#include <QSocketNotifier>
+
+#include <libei.h>
+#include <xkbcommon/xkbcommon.h>
+
+#include "KeysymIndex.h"
+#include "krdp_logging.h"
+
+namespace KRdp
+{
+
+namespace
+{
+using ScopedKeymap = std::unique_ptr<xkb_keymap, decltype(&xkb_keymap_unref)>;
+using ScopedContext = std::unique_ptr<xkb_context, decltype(&xkb_context_unref)>;
+
+uint32_t evdevButton(Qt::MouseButton button)
+{
+    switch (button) {
+    case Qt::LeftButton:
+        return BTN_LEFT;
+    case Qt::MiddleButton:
+        return BTN_MIDDLE;
+    case Qt::RightButton:
+        return BTN_RIGHT;
+    default:
+        return 0;
+    }
+}
+}
+
+class KRDP_NO_EXPORT EisSender::Private
+{
+public:
+    struct Device {
+        ei_device *device = nullptr;
+        bool emulating = false;
+    };
+
+    void dispatch();
+    void handleEvent(ei_event *event);
+    ei_device *deviceWith(ei_device_capability capability) const;
+    std::optional<QPointF> position(ei_device *device, const InputEvent &event, const QSize &inputSize) const;
+    void loadKeymap(ei_device *device);
+    std::optional<KeysymIndex::Code> keycodeFromKeysym(xkb_keysym_t keysym);
+
+    EisSender *q = nullptr;
+    ei *context = nullptr;
+    std::unique_ptr<QSocketNotifier> notifier;
+    std::vector<Device> devices;
+    uint32_t sequence = 0;
+    QString mappingId;
+    bool ready = false;
+
+    ScopedContext xkbContext{nullptr, xkb_context_unref};
+    ScopedKeymap keymap{nullptr, xkb_keymap_unref};
+    // The first layout, EIS does not tell which one is active.
+    KeysymIndex keysyms;
+};
+
+EisSender::EisSender()
+    : QObject(nullptr)
+    , d(std::make_unique<Private>())
+{
+    d->q = this;
+}
+
+EisSender::~EisSender()
+{
+    d->notifier.reset();
+    for (const auto &device : d->devices) {
+        if (device.emulating) {
+            ei_device_stop_emulating(device.device);
+        }
+        ei_device_unref(device.device);
+    }
+    if (d->context) {
+        ei_unref(d->context);
+    }
+}
+
+bool EisSender::connectToFd(int fd)
+{
+    d->context = ei_new_sender(nullptr);
+    if (!d->context) {
+        qCWarning(KRDP) << "Could not create a libei context";
+        return false;
+    }
+    ei_configure_name(d->context, "krdp");
+
+    if (const auto result = ei_setup_backend_fd(d->context, fd); result != 0) {
+        qCWarning(KRDP) << "Could not connect to EIS:" << strerror(-result);
+        return false;
+    }
+
+    d->notifier = std::make_unique<QSocketNotifier>(ei_get_fd(d->context), QSocketNotifier::Read);
+    connect(d->notifier.get(), &QSocketNotifier::activated, this, [this]() {
+        d->dispatch();
+    });
+    d->dispatch();
+
+    return true;
+}
+
+void EisSender::setMappingId(const QString &mappingId)
+{
+    d->mappingId = mappingId;
+}
+
+bool EisSender::isReady() const
+{
+    return d->ready;
+}
+
+void EisSender::send(const InputEvents &events, const QSize &inputSize)
+{
+    if (!d->context) {
+        return;
+    }
+
+    const auto time = ei_now(d->context);
+    for (const auto &event : events) {
+        ei_device *device = nullptr;
+
+        switch (event.type) {
+        case InputEvent::Type::PointerMotion:
+            device = d->deviceWith(EI_DEVICE_CAP_POINTER_ABSOLUTE);
+            if (const auto position = device ? d->position(device, event, inputSize) : std::nullopt) {
+                ei_device_pointer_motion_absolute(device, position->x(), position->y());
+            } else {
+                device = nullptr;
+            }
+            break;
+        case InputEvent::Type::PointerButton:
+            device = d->deviceWith(EI_DEVICE_CAP_BUTTON);
+            if (const auto button = evdevButton(event.button()); device && button) {
+                ei_device_button_button(device, button, event.pressed);
+            } else if (device) {
+                qCWarning(KRDP) << "Unsupported mouse button" << event.button();
+                continue;
+            }
+            break;
+        case InputEvent::Type::PointerAxis:
+            device = d->deviceWith(EI_DEVICE_CAP_SCROLL);
+            if (device) {
+                ei_device_scroll_discrete(device, event.deltaX, event.deltaY);
+            }
+            break;
+        case InputEvent::Type::Key:
+            device = d->deviceWith(EI_DEVICE_CAP_KEYBOARD);
+            if (device) {
+                ei_device_keyboard_key(device, event.code, event.pressed);
+            }
+            break;
+        case InputEvent::Type::KeySym: {
+            device = d->deviceWith(EI_DEVICE_CAP_KEYBOARD);
+            if (!device) {
+                break;
+            }
+            const auto keycode = d->keycodeFromKeysym(event.code);
+            if (!keycode) {
+                qCWarning(KRDP) << "Failed to convert keysym into keycode" << event.code;
+                continue;
+            }
+            // Same as the Plasma session: shift for level 1, AltGr for level 2.
+            if (keycode->level == 1 || keycode->level == 2) {
+                ei_device_keyboard_key(device, keycode->level == 1 ? KEY_LEFTSHIFT : KEY_RIGHTALT, event.pressed);
+                ei_device_frame(device, time);
+            } else if (keycode->level > 2) {
+                qCWarning(KRDP) << "Unsupported key level" << keycode->level;
+            }
+            ei_device_keyboard_key(device, keycode->code, event.pressed);
+            break;
+        }
+        }
+
+        if (!device) {
+            qCDebug(KRDP) << "No EIS device to send input event to, dropping it";
+            continue;
+        }
+        ei_device_frame(device, time);
+    }
+}
+
+void EisSender::Private::dispatch()
+{
+    ei_dispatch(context);
+    while (auto event = ei_get_event(context)) {
+        handleEvent(event);
+        ei_event_unref(event);
+    }
+}
+
+void EisSender::Private::handleEvent(ei_event *event)
+{
+    switch (ei_event_get_type(event)) {
+    case EI_EVENT_CONNECT:
+        qCDebug(KRDP) << "Connected to EIS";
+        break;
+    case EI_EVENT_DISCONNECT:
+        qCWarning(KRDP) << "EIS implementation disconnected";
+        notifier->setEnabled(false);
+        // Queued, receivers may delete the sender.
+        QMetaObject::invokeMethod(q, &EisSender::disconnected, Qt::QueuedConnection);
+        break;
+    case EI_EVENT_SEAT_ADDED:
+        ei_seat_bind_capabilities(ei_event_get_seat(event),
+                                  EI_DEVICE_CAP_POINTER_ABSOLUTE,
+                                  EI_DEVICE_CAP_BUTTON,
+                                  EI_DEVICE_CAP_SCROLL,
+                                  EI_DEVICE_CAP_KEYBOARD,
+                                  nullptr);
+        break;
+    case EI_EVENT_DEVICE_ADDED: {
+        auto device = ei_event_get_device(event);
+        devices.push_back(Device{.device = ei_device_ref(device), .emulating = false});
+        if (ei_device_has_capability(device, EI_DEVICE_CAP_KEYBOARD)) {
+            loadKeymap(device);
+        }
+        break;
+    }
+    case EI_EVENT_DEVICE_REMOVED: {
+        auto device = ei_event_get_device(event);
+        auto it = std::find_if(devices.begin(), devices.end(), [device](const Device &entry) {
+            return entry.device == device;
+        });
+        if (it != devices.end()) {
+            ei_device_unref(it->device);
+            devices.erase(it);
+        }
+        break;
+    }
+    case EI_EVENT_DEVICE_RESUMED: {
+        auto device = ei_event_get_device(event);
+        for (auto &entry : devices) {
+            if (entry.device == device) {
+                ei_device_start_emulating(device, ++sequence);
+                entry.emulating = true;
+            }
+        }
+        if (!ready) {
+            ready = true;
+            Q_EMIT q->ready();
+        }
+        break;
+    }
+    case EI_EVENT_DEVICE_PAUSED: {
+        auto device = ei_event_get_device(event);
+        for (auto &entry : devices) {
+            if (entry.device == device) {
+                entry.emulating = false;
+            }
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+ei_device *EisSender::Private::deviceWith(ei_device_capability capability) const
+{
+    for (const auto &entry : devices) {
+        if (entry.emulating && ei_device_has_capability(entry.device, capability)) {
+            return entry.device;
+        }
+    }
+    return nullptr;
+}
+
+std::optional<QPointF> EisSender::Private::position(ei_device *device, const InputEvent &event, const QSize &inputSize) const
+{
+    if (inputSize.isEmpty()) {
+        return std::nullopt;
+    }
+
+    ei_region *region = nullptr;
+    for (size_t index = 0; auto candidate = ei_device_get_region(device, index); ++index) {
+        if (!region) {
+            region = candidate;
+        }
+        const auto candidateId = ei_region_get_mapping_id(candidate);
+        if (!mappingId.isEmpty() && candidateId && mappingId == QLatin1StringView(candidateId)) {
+            region = candidate;
+            break;
+        }
+    }
+    if (!region) {
+        return std::nullopt;
+    }
+
+    // Regions are in logical coordinates, like the portal's logical size.
+    const auto x = std::clamp(event.x / double(inputSize.width()), 0.0, 1.0) * ei_region_get_width(region);
+    const auto y = std::clamp(event.y / double(inputSize.height()), 0.0, 1.0) * ei_region_get_height(region);
+    return QPointF(ei_region_get_x(region) + x, ei_region_get_y(region) + y);
+}
+
+void EisSender::Private::loadKeymap(ei_device *device)
+{
+    if (!xkbContext) {
+        xkbContext.reset(xkb_context_new(XKB_CONTEXT_NO_FLAGS));
+        if (!xkbContext) {
+            qCWarning(KRDP) << "Failed to create xkb context";
+            return;
+        }
+    }
+
+    auto eiKeymap = ei_device_keyboard_get_keymap(device);
+    if (!eiKeymap || ei_keymap_get_type(eiKeymap) != EI_KEYMAP_TYPE_XKB) {
+        return;
+    }
+
+    const auto size = ei_keymap_get_size(eiKeymap);
+    auto mapped = static_cast<char *>(mmap(nullptr, size, PROT_READ, MAP_PRIVATE, ei_keymap_get_fd(eiKeymap), 0));
+    if (mapped == MAP_FAILED) {
+        qCWarning(KRDP) << "Could not map the EIS keymap";
+        return;
+    }
+    keymap.reset(xkb_keymap_new_from_buffer(xkbContext.get(), mapped, strnlen(mapped, size), XKB_KEYMAP_FORMAT_TEXT_V1, XKB_KEYMAP_COMPILE_NO_FLAGS));
+    munmap(mapped, size);
+    keysyms.rebuild(keymap.get());
+}
+
+std::optional<KeysymIndex::Code> EisSender::Private::keycodeFromKeysym(xkb_keysym_t keysym)
+{
+    if (!keymap) {
+        // The EIS implementation did not send a keymap, assume the default one.
+        if (!xkbContext) {
+            xkbContext.reset(xkb_context_new(XKB_CONTEXT_NO_FLAGS));
+        }
+        if (xkbContext) {
+            keymap.reset(xkb_keymap_new_from_names(xkbContext.get(), nullptr, XKB_KEYMAP_COMPILE_NO_FLAGS));
+        }
+        if (!keymap) {
+            return std::nullopt;
+        }
+        keysyms.rebuild(keymap.get());
+    }
+
+    return keysyms.find(keysym);
+}
+
+}
+
+#include "moc_EisSender.cpp"
@@ -0,0 +1,74 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#pragma once
+
+#include <memory>
+
+#include <QObject>
+#include <QSize>
+#include <QString>
+
+#include "InputEvent.h"
+#include "TestsExport_p.h"
+
+namespace KRdp
+{
+
+/**
+ * Sends input events to an EIS implementation through a libei sender
+ * context, as provided by the remote desktop portal's ConnectToEIS.
+ *
+ * Compared to one DBus call per event, events go straight over a socket to
+ * the compositor and each batch is written in one go, one device frame per
+ * event. The context is dispatched on the thread this object lives on.
+ */
+class KRDP_TESTS_EXPORT EisSender : public QObject
+{
+    Q_OBJECT
+
+public:
+    EisSender();
+    ~EisSender() override;
+
+    /**
+     * Connect to the EIS implementation at the other end of \p fd, which is
+     * owned by the sender afterwards.
+     */
+    bool connectToFd(int fd);
+
+    /**
+     * Use the device region with this mapping ID for absolute pointer motion,
+     * as given by the portal for the PipeWire stream. Without one, or if no
+     * region matches, the first region is used.
+     */
+    void setMappingId(const QString &mappingId);
+
+    /**
+     * Whether the EIS implementation resumed a device events can be sent to.
+     */
+    bool isReady() const;
+
+    /**
+     * Send \p events, with pointer positions relative to \p inputSize.
+     * Events without a device to send them to are dropped.
+     */
+    void send(const InputEvents &events, const QSize &inputSize);
+
+Q_SIGNALS:
+    /**
+     * Emitted when the first device was resumed.
+     */
+    void ready();
+    /**
+     * Emitted when the EIS implementation closed the connection.
+     */
+    void disconnected();
+
+private:
+    class Private;
+    const std::unique_ptr<Private> d;
+};
+
+}
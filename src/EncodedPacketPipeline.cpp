@@ -0,0 +1,669 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "EncodedPacketPipeline.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <optional>
+
+#include <QQueue>
+#include <QRect>
+#include <QRegion>
+#include <QThread>
+#include <QTimer>
+
+#include <PipeWireEncodedStream>
+
+#include "FlightRecorder.h"
+#include "Tracing.h"
+#include "krdp_logging.h"
+
+namespace KRdp
+{
+
+namespace
+{
+struct EncodedPacketMetadata {
+    QSize size;
+    QRegion damage;
+    std::chrono::system_clock::time_point presentationTimeStamp;
+    bool hasSize = false;
+    bool hasDamage = false;
+    bool hasPresentationTimeStamp = false;
+    std::chrono::steady_clock::time_point receivedAt;
+    // Number of frames that were waiting for the encoder when this arrived.
+    int framesAhead = 0;
+};
+
+struct PendingEncodedPacket {
+    PipeWireEncodedStream::Packet packet;
+    std::chrono::steady_clock::time_point queuedAt;
+    std::optional<quint64> sequence;
+};
+
+constexpr int MaxPendingFrameMetadata = 128;
+constexpr int MaxPendingPacketsWithoutMetadata = 8;
+// How long a packet may wait for its metadata. The budget starts at the
+// default and then follows the observed metadata delay.
+constexpr auto DefaultMetadataPairWaitBudget = std::chrono::milliseconds(12);
+constexpr auto MinimumMetadataPairWaitBudget = std::chrono::milliseconds(2);
+constexpr auto MaximumMetadataPairWaitBudget = std::chrono::milliseconds(16);
+constexpr auto EncoderDropReportInterval = std::chrono::seconds(5);
+// A frame the encoder silently dropped also leaves the encoder waiting, so
+// it only counts as stalled while new frames keep coming in.
+constexpr auto EncoderStallInputWindow = std::chrono::seconds(1);
+// Without packet sequence numbers, metadata still waiting this long when a
+// packet arrives belongs to a frame the encoder dropped.
+constexpr auto OrphanedMetadataAge = std::chrono::seconds(1);
+std::atomic<quint32> s_nextRecorderId = 1;
+
+qint64 steadyNs(std::chrono::steady_clock::time_point time)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+QRegion fullFrameDamage(const QSize &size)
+{
+    if (size.isEmpty()) {
+        return {};
+    }
+    return QRegion(QRect(QPoint(0, 0), size));
+}
+
+QRegion clippedDamage(const QRegion &damage, const QSize &size)
+{
+    if (size.isEmpty()) {
+        return {};
+    }
+    auto clipped = damage.intersected(QRect(QPoint(0, 0), size));
+    return clipped.isEmpty() ? fullFrameDamage(size) : clipped;
+}
+
+// KPipeWire packets do not carry the sequence number of their source frame
+// yet. Once they do, packets are paired with exactly their own metadata.
+template<typename Packet>
+std::optional<quint64> packetSequence(const Packet &packet)
+{
+    if constexpr (requires(const Packet &p) {
+                      p.sequence();
+                  }) {
+        return packet.sequence();
+    }
+    return std::nullopt;
+}
+
+template<typename Stream, typename Receiver, typename Callback>
+bool connectFrameMetadataIfSupported(Stream *stream, Receiver *receiver, Callback &&callback)
+{
+    if constexpr (requires {
+                      &Stream::frameMetadata;
+                  }) {
+        const auto connection = QObject::connect(stream, &Stream::frameMetadata, receiver, std::forward<Callback>(callback));
+        return static_cast<bool>(connection);
+    }
+    return false;
+}
+}
+
+class KRDP_NO_EXPORT EncodedPacketPipeline::Private
+{
+public:
+    void enqueueFrameMetadata(const FrameMetadata &metadata);
+    void enqueueMetadata(quint64 sequence, const EncodedPacketMetadata &metadata);
+    void enqueuePacket(const PipeWireEncodedStream::Packet &packet);
+    void processPendingPackets();
+    void discardMetadata(std::map<quint64, EncodedPacketMetadata>::iterator itr);
+    void discardOrphanedMetadata(std::chrono::steady_clock::time_point packetArrival);
+    void scheduleFlush(std::chrono::steady_clock::time_point deadline);
+    void updateWaitBudget(std::chrono::steady_clock::duration metadataDelay);
+    void updateEncodeTime(const EncodedPacketMetadata &metadata, std::chrono::steady_clock::time_point packetArrival);
+    void reportEncoderDrops(std::chrono::steady_clock::time_point now);
+    void emitFrame(const PendingEncodedPacket &pendingPacket, const EncodedPacketMetadata *metadata);
+
+    EncodedPacketPipeline *q = nullptr;
+
+    QThread thread;
+    // Lives on the pipeline thread, used as context for everything that
+    // needs to run there.
+    QObject *context = nullptr;
+
+    // Everything below is only accessed from the pipeline thread.
+    QSize size;
+    QVector<VideoMonitor> monitorLayout;
+    std::map<quint64, EncodedPacketMetadata> pendingFrameMetadata;
+    QQueue<PendingEncodedPacket> pendingPackets;
+    std::optional<quint64> lastMetadataSequence;
+    // Damage of frames whose metadata was seen but whose packet never
+    // arrived, folded into the next frame.
+    QRegion carriedDamage;
+    // Without packet sequence numbers: packets that were sent before their
+    // metadata arrived, whose metadata must not be paired with a later packet.
+    int unpairedSentPackets = 0;
+    bool packetsCarrySequence = false;
+    int encoderQueueBound = 0;
+    // Without packet sequence numbers: a frame was dropped by the encoder
+    // after its metadata arrived, so the oldest metadata may belong to an
+    // earlier frame than the packet. Until pairing is certain again, frames
+    // get the damage of all waiting metadata.
+    bool pairingLost = false;
+    QTimer *flushTimer = nullptr;
+    bool metadataSignalAvailable = false;
+    bool metadataSeen = false;
+    std::chrono::steady_clock::time_point lastMetadataMissLog;
+
+    std::chrono::microseconds waitBudget = DefaultMetadataPairWaitBudget;
+    std::chrono::microseconds metadataDelayAverage = std::chrono::microseconds(0);
+    std::chrono::microseconds metadataDelayDeviation = std::chrono::microseconds(0);
+    std::chrono::steady_clock::time_point lastBudgetLog;
+
+    std::atomic<qint64> encodeTimeUs = 0;
+    qint64 announcedEncodeTimeUs = 0;
+    std::atomic<quint64> droppedEncoderInputFrames = 0;
+    quint64 metadataCount = 0;
+    quint64 packetCount = 0;
+    quint64 reportedMetadataCount = 0;
+    quint64 reportedPacketCount = 0;
+    quint64 reportedDroppedFrames = 0;
+    std::chrono::steady_clock::time_point lastDropReport;
+
+    // Tells apart the flight recorder events of different pipelines.
+    quint32 recorderId = s_nextRecorderId.fetch_add(1, std::memory_order_relaxed);
+    quint64 stallCheckId = 0;
+    // When the oldest frame without an encoded packet came in, zero when
+    // the encoder is caught up.
+    std::atomic<qint64> encoderWaitingSinceNs = 0;
+    std::atomic<qint64> lastMetadataNs = 0;
+};
+
+EncodedPacketPipeline::EncodedPacketPipeline()
+    : QObject(nullptr)
+    , d(std::make_unique<Private>())
+{
+    d->q = this;
+    d->context = new QObject();
+    d->context->moveToThread(&d->thread);
+    // Delete the context, and the flush timer with it, on its own thread.
+    connect(&d->thread, &QThread::finished, d->context, &QObject::deleteLater);
+    d->thread.setObjectName(QStringLiteral("krdp_media"));
+    d->thread.start();
+
+    // Frames go into the encoder but no packets come out.
+    d->stallCheckId = FlightRecorder::addStallCheck("encode", [d = d.get()](std::chrono::steady_clock::time_point now) {
+        const auto waitingSince = d->encoderWaitingSinceNs.load(std::memory_order_relaxed);
+        const auto lastMetadata = std::chrono::nanoseconds(d->lastMetadataNs.load(std::memory_order_relaxed));
+        if (waitingSince == 0 || now.time_since_epoch() - lastMetadata >= EncoderStallInputWindow) {
+            return std::chrono::steady_clock::duration::zero();
+        }
+        return std::chrono::duration_cast<std::chrono::steady_clock::duration>(now.time_since_epoch() - std::chrono::nanoseconds(waitingSince));
+    });
+}
+
+EncodedPacketPipeline::~EncodedPacketPipeline()
+{
+    FlightRecorder::removeStallCheck(d->stallCheckId);
+    d->thread.quit();
+    d->thread.wait();
+}
+
+bool EncodedPacketPipeline::attach(PipeWireEncodedStream *stream)
+{
+    // Both signals are emitted from KPipeWire's own threads, connecting them
+    // to the context object queues them on the pipeline thread instead of
+    // the main thread.
+    connect(stream, &PipeWireEncodedStream::newPacket, d->context, [this](const PipeWireEncodedStream::Packet &packet) {
+        d->enqueuePacket(packet);
+    });
+    // Marks when the encoder produced the packet, on the thread that did.
+    connect(
+        stream,
+        &PipeWireEncodedStream::newPacket,
+        stream,
+        [](const PipeWireEncodedStream::Packet &) {
+            Tracing::instant("encoder.packet");
+        },
+        Qt::DirectConnection);
+    connect(stream, &PipeWireEncodedStream::sizeChanged, d->context, [this](const QSize &size) {
+        d->size = size;
+    });
+
+    const bool metadataAvailable = connectFrameMetadataIfSupported(stream, d->context, [this](const auto &meta) {
+        FrameMetadata frameMetadata;
+        frameMetadata.size = meta.size;
+        if (meta.hasSequence) {
+            frameMetadata.sequence = meta.sequence;
+        }
+        if (meta.hasDamage) {
+            frameMetadata.damage = meta.damage;
+        }
+        if (meta.hasPts) {
+            frameMetadata.presentationTimeStamp = std::chrono::system_clock::time_point{std::chrono::nanoseconds(meta.ptsNs)};
+        }
+        d->enqueueFrameMetadata(frameMetadata);
+    });
+
+    QMetaObject::invokeMethod(d->context, [this, metadataAvailable]() {
+        d->metadataSignalAvailable = metadataAvailable;
+    });
+
+    return metadataAvailable;
+}
+
+void EncodedPacketPipeline::addFrameMetadata(const FrameMetadata &metadata)
+{
+    QMetaObject::invokeMethod(d->context, [this, metadata]() {
+        d->metadataSignalAvailable = true;
+        d->enqueueFrameMetadata(metadata);
+    });
+}
+
+void EncodedPacketPipeline::addPacket(const PipeWireEncodedStream::Packet &packet)
+{
+    QMetaObject::invokeMethod(d->context, [this, packet]() {
+        d->enqueuePacket(packet);
+    });
+}
+
+void EncodedPacketPipeline::setEncoderQueueBound(int frames)
+{
+    QMetaObject::invokeMethod(d->context, [this, frames]() {
+        d->encoderQueueBound = frames;
+    });
+}
+
+void EncodedPacketPipeline::reset()
+{
+    QMetaObject::invokeMethod(d->context, [this]() {
+        d->pendingFrameMetadata.clear();
+        d->pendingPackets.clear();
+        d->lastMetadataSequence.reset();
+        d->carriedDamage = QRegion();
+        d->unpairedSentPackets = 0;
+        d->pairingLost = false;
+        d->metadataSeen = false;
+        d->lastMetadataMissLog = {};
+        d->encoderWaitingSinceNs.store(0, std::memory_order_relaxed);
+        // Frames that were inside the encoder are gone, they are not drops.
+        d->reportedMetadataCount = d->metadataCount;
+        d->reportedPacketCount = d->packetCount;
+        if (d->flushTimer) {
+            d->flushTimer->stop();
+        }
+    });
+}
+
+void EncodedPacketPipeline::setFrameSize(const QSize &size)
+{
+    QMetaObject::invokeMethod(d->context, [this, size]() {
+        d->size = size;
+    });
+}
+
+void EncodedPacketPipeline::setMonitorLayout(const QVector<VideoMonitor> &layout)
+{
+    QMetaObject::invokeMethod(d->context, [this, layout]() {
+        d->monitorLayout = layout;
+    });
+}
+
+std::chrono::microseconds EncodedPacketPipeline::encodeTime() const
+{
+    return std::chrono::microseconds(d->encodeTimeUs.load(std::memory_order_relaxed));
+}
+
+quint64 EncodedPacketPipeline::droppedEncoderInputFrames() const
+{
+    return d->droppedEncoderInputFrames.load(std::memory_order_relaxed);
+}
+
+void EncodedPacketPipeline::Private::enqueueFrameMetadata(const FrameMetadata &metadata)
+{
+    EncodedPacketMetadata entry;
+    entry.size = metadata.size;
+    entry.hasSize = !metadata.size.isEmpty();
+    if (metadata.damage) {
+        entry.damage = *metadata.damage;
+        entry.hasDamage = true;
+    }
+    if (metadata.presentationTimeStamp) {
+        entry.presentationTimeStamp = *metadata.presentationTimeStamp;
+        entry.hasPresentationTimeStamp = true;
+    }
+    enqueueMetadata(metadata.sequence.value_or(lastMetadataSequence.value_or(0) + 1), entry);
+}
+
+void EncodedPacketPipeline::Private::enqueueMetadata(quint64 sequence, const EncodedPacketMetadata &metadata)
+{
+    KRDP_TRACE_SCOPE("pipeline.metadata", qint64(sequence));
+
+    // A sequence going backwards means the source stream was restarted.
+    if (lastMetadataSequence && sequence <= *lastMetadataSequence) {
+        pendingFrameMetadata.clear();
+    }
+    lastMetadataSequence = sequence;
+
+    FlightRecorder::record(FlightRecorder::Event::MetadataReceived, recorderId, qint64(sequence));
+    lastMetadataNs.store(steadyNs(std::chrono::steady_clock::now()), std::memory_order_relaxed);
+
+    metadataSeen = true;
+    ++metadataCount;
+    if (!packetsCarrySequence && unpairedSentPackets > 0) {
+        // This belongs to a packet that already went out with full damage.
+        --unpairedSentPackets;
+        return;
+    }
+
+    auto entry = metadata;
+    entry.receivedAt = std::chrono::steady_clock::now();
+    if (encoderWaitingSinceNs.load(std::memory_order_relaxed) == 0) {
+        encoderWaitingSinceNs.store(steadyNs(entry.receivedAt), std::memory_order_relaxed);
+    }
+    entry.framesAhead = int(pendingFrameMetadata.size());
+    pendingFrameMetadata.insert_or_assign(sequence, std::move(entry));
+    while (pendingFrameMetadata.size() > MaxPendingFrameMetadata) {
+        pendingFrameMetadata.erase(pendingFrameMetadata.begin());
+    }
+    processPendingPackets();
+}
+
+void EncodedPacketPipeline::Private::enqueuePacket(const PipeWireEncodedStream::Packet &packet)
+{
+    KRDP_TRACE_SCOPE("pipeline.packet");
+
+    const auto sequence = packetSequence(packet);
+    const auto now = std::chrono::steady_clock::now();
+    packetsCarrySequence = sequence.has_value();
+    ++packetCount;
+    FlightRecorder::record(FlightRecorder::Event::PacketReceived, recorderId, packet.data().size(), packet.isKeyFrame());
+    encoderWaitingSinceNs.store(0, std::memory_order_relaxed);
+    pendingPackets.enqueue(PendingEncodedPacket{
+        .packet = packet,
+        .queuedAt = now,
+        .sequence = sequence,
+    });
+    processPendingPackets();
+    reportEncoderDrops(now);
+}
+
+void EncodedPacketPipeline::Private::processPendingPackets()
+{
+    KRDP_TRACE_SCOPE("pipeline.pair", pendingPackets.size());
+
+    while (!pendingPackets.isEmpty()) {
+        const auto &head = pendingPackets.head();
+        const auto now = std::chrono::steady_clock::now();
+
+        auto metadataItr = pendingFrameMetadata.end();
+        if (head.sequence) {
+            // Metadata older than this packet belongs to frames that never
+            // made it through the encoder. Their damage still has to reach
+            // the client, so carry it over.
+            while (!pendingFrameMetadata.empty() && pendingFrameMetadata.begin()->first < *head.sequence) {
+                discardMetadata(pendingFrameMetadata.begin());
+                droppedEncoderInputFrames.fetch_add(1, std::memory_order_relaxed);
+            }
+            if (!pendingFrameMetadata.empty() && pendingFrameMetadata.begin()->first == *head.sequence) {
+                metadataItr = pendingFrameMetadata.begin();
+            }
+        } else if (!pendingFrameMetadata.empty()) {
+            // Without a packet sequence, packets and metadata arrive in the
+            // same order so the oldest metadata belongs to this packet,
+            // unless the encoder dropped frames after their metadata.
+            discardOrphanedMetadata(head.queuedAt);
+            if (!pendingFrameMetadata.empty()) {
+                metadataItr = pendingFrameMetadata.begin();
+            }
+        }
+
+        if (metadataItr != pendingFrameMetadata.end()) {
+            auto pendingPacket = pendingPackets.dequeue();
+            auto metadata = std::move(metadataItr->second);
+            pendingFrameMetadata.erase(metadataItr);
+            updateWaitBudget(now - pendingPacket.queuedAt);
+
+            // Packets never overtake their metadata, so once nothing else is
+            // waiting this was the packet's own metadata.
+            if (pairingLost && pendingFrameMetadata.empty()) {
+                qCDebug(KRDP) << "Encoded packets and damage metadata are paired again";
+                pairingLost = false;
+            }
+            if (pairingLost) {
+                // The packet belongs to this or a later frame whose metadata
+                // is still waiting, and frames dropped in between need their
+                // damage sent too. Covering all of them is a superset.
+                for (const auto &[sequence, entry] : pendingFrameMetadata) {
+                    if (!entry.hasDamage) {
+                        metadata.hasDamage = false;
+                        break;
+                    }
+                    carriedDamage += entry.damage;
+                }
+            } else {
+                updateEncodeTime(metadata, pendingPacket.queuedAt);
+            }
+            emitFrame(pendingPacket, &metadata);
+            continue;
+        }
+
+        const bool shouldSendWithoutMetadata = !metadataSignalAvailable || !metadataSeen || head.packet.isKeyFrame();
+        if (shouldSendWithoutMetadata) {
+            if (metadataSeen && !head.sequence) {
+                ++unpairedSentPackets;
+            }
+            emitFrame(pendingPackets.dequeue(), nullptr);
+            continue;
+        }
+
+        const auto deadline = head.queuedAt + waitBudget;
+        const bool waitedTooLong = now >= deadline;
+        const bool queueTooDeep = pendingPackets.size() > MaxPendingPacketsWithoutMetadata;
+        if (waitedTooLong || queueTooDeep) {
+            if (lastMetadataMissLog.time_since_epoch().count() == 0 || (now - lastMetadataMissLog) >= std::chrono::seconds(2)) {
+                qCDebug(KRDP) << "No matching damage metadata for encoded packet, using full-frame update";
+                lastMetadataMissLog = now;
+            }
+            // The metadata is late rather than absent, so the budget should
+            // grow to cover it.
+            updateWaitBudget(now - head.queuedAt);
+            if (!head.sequence) {
+                ++unpairedSentPackets;
+            }
+            emitFrame(pendingPackets.dequeue(), nullptr);
+            continue;
+        }
+
+        // Leave packet queued briefly so late metadata can still be paired,
+        // but do not wait for another event to notice the budget ran out.
+        scheduleFlush(deadline);
+        return;
+    }
+
+    if (flushTimer) {
+        flushTimer->stop();
+    }
+}
+
+void EncodedPacketPipeline::Private::discardMetadata(std::map<quint64, EncodedPacketMetadata>::iterator itr)
+{
+    // The frame's changes are part of the frames after it.
+    if (itr->second.hasDamage) {
+        carriedDamage += itr->second.damage;
+    } else if (!size.isEmpty()) {
+        carriedDamage = fullFrameDamage(size);
+    }
+    // Frames after it were not waiting behind it in the encoder.
+    for (auto later = std::next(itr); later != pendingFrameMetadata.end(); ++later) {
+        later->second.framesAhead = std::max(later->second.framesAhead - 1, 0);
+    }
+    pendingFrameMetadata.erase(itr);
+}
+
+void EncodedPacketPipeline::Private::discardOrphanedMetadata(std::chrono::steady_clock::time_point packetArrival)
+{
+    // KPipeWire reports a frame's metadata before its encoder input queue
+    // decides to drop the frame. At most encoderQueueBound frames are inside
+    // the encoder, plus this packet's own frame when frames queued behind it
+    // were reported before the packet got here. More than that means the
+    // metadata of dropped frames is waiting, and in-order pairing is off.
+    if (!pairingLost && encoderQueueBound > 0 && int(pendingFrameMetadata.size()) > encoderQueueBound + 1) {
+        qCDebug(KRDP) << "Encoder dropped frames after their damage metadata, merging damage until pairing recovers";
+        pairingLost = true;
+    }
+
+    // Metadata that waited this long has no packet coming, which is how
+    // pairing recovers when frames keep coming in.
+    while (!pendingFrameMetadata.empty() && packetArrival - pendingFrameMetadata.begin()->second.receivedAt > OrphanedMetadataAge) {
+        discardMetadata(pendingFrameMetadata.begin());
+        pairingLost = true;
+    }
+}
+
+void EncodedPacketPipeline::Private::scheduleFlush(std::chrono::steady_clock::time_point deadline)
+{
+    if (!flushTimer) {
+        flushTimer = new QTimer(context);
+        flushTimer->setSingleShot(true);
+        flushTimer->setTimerType(Qt::PreciseTimer);
+        QObject::connect(flushTimer, &QTimer::timeout, context, [this]() {
+            processPendingPackets();
+        });
+    }
+
+    const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+    flushTimer->start(std::max(remaining, std::chrono::milliseconds(0)));
+}
+
+void EncodedPacketPipeline::Private::updateWaitBudget(std::chrono::steady_clock::duration metadataDelay)
+{
+    using namespace std::chrono;
+
+    // Same smoothing as TCP's retransmission timeout (RFC 6298): follow the
+    // average delay and allow for four times its mean deviation.
+    const auto delay = duration_cast<microseconds>(metadataDelay);
+    const auto error = delay - metadataDelayAverage;
+    metadataDelayAverage += error / 8;
+    metadataDelayDeviation += (abs(error) - metadataDelayDeviation) / 4;
+
+    const auto budget = std::clamp(metadataDelayAverage + 4 * metadataDelayDeviation,
+                                   duration_cast<microseconds>(MinimumMetadataPairWaitBudget),
+                                   duration_cast<microseconds>(MaximumMetadataPairWaitBudget));
+    waitBudget = budget;
+
+    const auto now = steady_clock::now();
+    if (lastBudgetLog.time_since_epoch().count() == 0 || (now - lastBudgetLog) >= seconds(10)) {
+        qCDebug(KRDP) << "Metadata pairing wait budget" << waitBudget.count() << "us, average metadata delay" << metadataDelayAverage.count() << "us";
+        lastBudgetLog = now;
+    }
+}
+
+void EncodedPacketPipeline::Private::updateEncodeTime(const EncodedPacketMetadata &metadata, std::chrono::steady_clock::time_point packetArrival)
+{
+    using namespace std::chrono;
+
+    if (packetArrival < metadata.receivedAt) {
+        return;
+    }
+
+    // The time from metadata to packet includes waiting for the frames
+    // ahead of it, only count this frame's share.
+    const auto sample = duration_cast<microseconds>(packetArrival - metadata.receivedAt).count() / (metadata.framesAhead + 1);
+    auto average = encodeTimeUs.load(std::memory_order_relaxed);
+    average = average == 0 ? sample : average + (sample - average) / 8;
+    encodeTimeUs.store(average, std::memory_order_relaxed);
+
+    // Only announce changes that are big enough to matter.
+    if (announcedEncodeTimeUs == 0 || std::abs(average - announcedEncodeTimeUs) * 4 >= announcedEncodeTimeUs) {
+        announcedEncodeTimeUs = average;
+        Q_EMIT q->encodeTimeChanged();
+    }
+}
+
+void EncodedPacketPipeline::Private::reportEncoderDrops(std::chrono::steady_clock::time_point now)
+{
+    if (lastDropReport.time_since_epoch().count() == 0) {
+        lastDropReport = now;
+        return;
+    }
+    if (now - lastDropReport < EncoderDropReportInterval) {
+        return;
+    }
+
+    if (!packetsCarrySequence && metadataSignalAvailable) {
+        // Every captured frame produces metadata, so metadata without a packet
+        // is a frame the encoder did not take. Frames still inside the
+        // encoder even out over consecutive intervals.
+        const auto metadataDelta = metadataCount - reportedMetadataCount;
+        const auto packetDelta = packetCount - reportedPacketCount;
+        if (metadataDelta > packetDelta) {
+            droppedEncoderInputFrames.fetch_add(metadataDelta - packetDelta, std::memory_order_relaxed);
+            // Some of the waiting metadata may belong to those frames.
+            if (!pendingFrameMetadata.empty()) {
+                pairingLost = true;
+            }
+        }
+    }
+
+    const auto dropped = droppedEncoderInputFrames.load(std::memory_order_relaxed);
+    if (dropped > reportedDroppedFrames) {
+        qCDebug(KRDP) << "Encoder input dropped" << (dropped - reportedDroppedFrames) << "frames in the last"
+                      << std::chrono::duration_cast<std::chrono::seconds>(now - lastDropReport).count() << "seconds, total" << dropped;
+    }
+
+    reportedDroppedFrames = dropped;
+    reportedMetadataCount = metadataCount;
+    reportedPacketCount = packetCount;
+    lastDropReport = now;
+}
+
+void EncodedPacketPipeline::Private::emitFrame(const PendingEncodedPacket &pendingPacket, const EncodedPacketMetadata *metadata)
+{
+    const auto &packet = pendingPacket.packet;
+
+    VideoFrame frameData;
+    frameData.size = size;
+    frameData.data = packet.data();
+    frameData.isKeyFrame = packet.isKeyFrame();
+    frameData.monitors = monitorLayout;
+    frameData.damage = fullFrameDamage(frameData.size);
+    frameData.encodedTimeStamp = pendingPacket.queuedAt;
+
+    if (frameData.monitors.isEmpty() && !frameData.size.isEmpty()) {
+        frameData.monitors.push_back(VideoMonitor{
+            .geometry = QRect(QPoint(0, 0), frameData.size),
+            .primary = true,
+        });
+    }
+
+    const bool metadataApplied = metadata != nullptr;
+    if (metadata) {
+        if (metadata->hasSize && !metadata->size.isEmpty()) {
+            frameData.size = metadata->size;
+        }
+        if (metadata->hasPresentationTimeStamp) {
+            frameData.presentationTimeStamp = metadata->presentationTimeStamp;
+        }
+        if (metadata->hasDamage) {
+            frameData.damage = clippedDamage(metadata->damage, frameData.size);
+        }
+    }
+
+    if (!metadataApplied || frameData.isKeyFrame || frameData.damage.isEmpty()) {
+        frameData.damage = fullFrameDamage(frameData.size);
+    } else if (!carriedDamage.isEmpty()) {
+        frameData.damage = clippedDamage(frameData.damage.united(carriedDamage), frameData.size);
+    }
+    carriedDamage = QRegion();
+
+    const auto waited = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - pendingPacket.queuedAt);
+    FlightRecorder::record(FlightRecorder::Event::FrameEmitted, recorderId, waited.count(), metadataApplied);
+
+    Q_EMIT q->frameReady(frameData);
+}
+
+}
+
+#include "moc_EncodedPacketPipeline.cpp"
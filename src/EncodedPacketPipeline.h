@@ -0,0 +1,129 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <optional>
+
+#include <QObject>
+#include <QRegion>
+#include <QSize>
+#include <QVector>
+
+#include <PipeWireEncodedStream>
+
+#include "TestsExport_p.h"
+#include "VideoFrame.h"
+
+namespace KRdp
+{
+
+/**
+ * Turns the encoded packets of a PipeWireEncodedStream into VideoFrames.
+ *
+ * Encoded packets and the damage metadata belonging to them arrive through
+ * separate signals. The pipeline pairs them up and emits the resulting
+ * frames from its own thread, so the video path does not wait on the main
+ * thread while that is busy with DBus, Wayland or input handling.
+ *
+ * The methods of this class are meant to be called from the thread that
+ * created it, they forward to the pipeline thread.
+ */
+class KRDP_TESTS_EXPORT EncodedPacketPipeline : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * Metadata of one captured frame, reported by the stream before the
+     * frame goes into the encoder.
+     */
+    struct FrameMetadata {
+        std::optional<quint64> sequence;
+        QSize size;
+        std::optional<QRegion> damage;
+        std::optional<std::chrono::system_clock::time_point> presentationTimeStamp;
+    };
+
+    EncodedPacketPipeline();
+    ~EncodedPacketPipeline() override;
+
+    /**
+     * Start handling packets and damage metadata of \p stream.
+     *
+     * \return Whether the stream provides damage metadata.
+     */
+    bool attach(PipeWireEncodedStream *stream);
+
+    /**
+     * Hand the metadata of a captured frame, or an encoded packet, to the
+     * pipeline. attach() does this for the stream it is attached to.
+     */
+    void addFrameMetadata(const FrameMetadata &metadata);
+    void addPacket(const PipeWireEncodedStream::Packet &packet);
+
+    /**
+     * How many frames the encoder takes before it drops new ones, as set
+     * with PipeWireEncodedStream::setMaxPendingFrames().
+     *
+     * The encoder drops frames after their metadata was reported. Knowing
+     * the bound lets the pipeline notice when metadata was left behind by
+     * such a drop, if packets do not carry sequence numbers.
+     */
+    void setEncoderQueueBound(int frames);
+
+    /**
+     * Drop all packets and metadata that are still waiting to be paired.
+     *
+     * Call this whenever the stream is reconfigured.
+     */
+    void reset();
+
+    /**
+     * The frame size used for packets that arrive without metadata.
+     *
+     * This follows the size of the attached stream, it only needs to be set
+     * when the size is known before the stream reports it.
+     */
+    void setFrameSize(const QSize &size);
+
+    /**
+     * The monitor layout attached to every emitted frame.
+     */
+    void setMonitorLayout(const QVector<VideoMonitor> &layout);
+
+    /**
+     * The average time the encoder spends on a single frame.
+     *
+     * This is estimated from the time between a frame's metadata and its
+     * encoded packet, divided by the number of frames that were queued in
+     * front of it. This can be called from any thread.
+     */
+    std::chrono::microseconds encodeTime() const;
+    Q_SIGNAL void encodeTimeChanged();
+
+    /**
+     * The number of captured frames that never came out of the encoder.
+     *
+     * These are mostly frames dropped because the encoder input queue was
+     * full. This can be called from any thread.
+     */
+    quint64 droppedEncoderInputFrames() const;
+
+    /**
+     * Emitted for every complete frame.
+     *
+     * This is emitted from the pipeline thread. Receivers that are able to
+     * handle frames on any thread should use Qt::DirectConnection.
+     */
+    Q_SIGNAL void frameReady(const KRdp::VideoFrame &frame);
+
+private:
+    class Private;
+    const std::unique_ptr<Private> d;
+};
+
+}
@@ -0,0 +1,313 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "FlightRecorder.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+
+#include <QDateTime>
+#include <QDir>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include "krdp_logging.h"
+
+namespace KRdp
+{
+namespace FlightRecorder
+{
+
+namespace
+{
+namespace clk = std::chrono;
+
+// About 1.5 MiB, which holds well over ten seconds of events for a handful
+// of connections.
+constexpr std::size_t Capacity = 32768;
+constexpr auto DumpWindow = clk::seconds(10);
+constexpr auto WatchdogInterval = clk::milliseconds(250);
+constexpr auto DefaultStallThreshold = clk::milliseconds(2000);
+// Do not fill the disk with dumps of the same stall.
+constexpr auto MinimumTimeBetweenStallDumps = clk::seconds(60);
+constexpr int MaxDumpFiles = 10;
+
+// Every field is atomic so a slot can be read while it is rewritten, the
+// sequence tells whether the read slot is complete.
+struct Slot {
+    std::atomic<quint64> sequence = 0;
+    std::atomic<qint64> timestamp = 0;
+    std::atomic<quint32> type = 0;
+    std::atomic<quint32> session = 0;
+    std::atomic<qint64> a = 0;
+    std::atomic<qint64> b = 0;
+};
+
+struct Record {
+    qint64 timestamp;
+    Event type;
+    quint32 session;
+    qint64 a;
+    qint64 b;
+};
+
+std::array<Slot, Capacity> s_slots;
+std::atomic<quint64> s_next = 0;
+
+std::atomic<qint64> s_lastHeartbeat = 0;
+std::atomic_bool s_dumpRequested = false;
+static_assert(std::atomic_bool::is_always_lock_free);
+
+struct StallCheckEntry {
+    const char *stage;
+    StallCheck check;
+};
+std::mutex s_checksMutex;
+std::map<quint64, StallCheckEntry> s_checks;
+quint64 s_nextCheckId = 1;
+
+std::once_flag s_watchdogStarted;
+
+qint64 nowNs()
+{
+    return clk::duration_cast<clk::nanoseconds>(clk::steady_clock::now().time_since_epoch()).count();
+}
+
+clk::milliseconds stallThreshold()
+{
+    static const auto threshold = [] {
+        bool ok = false;
+        const int value = qEnvironmentVariableIntValue("KRDP_STALL_THRESHOLD_MS", &ok);
+        return ok && value > 0 ? clk::milliseconds(value) : DefaultStallThreshold;
+    }();
+    return threshold;
+}
+
+const char *eventName(Event event)
+{
+    switch (event) {
+    case Event::PacketReceived:
+        return "packet_received";
+    case Event::MetadataReceived:
+        return "metadata_received";
+    case Event::FrameEmitted:
+        return "frame_emitted";
+    case Event::FrameQueued:
+        return "frame_queued";
+    case Event::FrameDropped:
+        return "frame_dropped";
+    case Event::FrameSent:
+        return "frame_sent";
+    case Event::FrameAcknowledged:
+        return "frame_acknowledged";
+    case Event::RttSample:
+        return "rtt_sample";
+    case Event::EncoderState:
+        return "encoder_state";
+    case Event::EncoderError:
+        return "encoder_error";
+    case Event::EncoderFallback:
+        return "encoder_fallback";
+    }
+    return "unknown";
+}
+
+std::vector<Record> snapshot(qint64 since)
+{
+    std::vector<Record> records;
+
+    const auto end = s_next.load(std::memory_order_acquire);
+    const auto begin = end > Capacity ? end - Capacity : 0;
+    records.reserve(end - begin);
+    for (auto index = begin; index < end; ++index) {
+        const auto &slot = s_slots[index % Capacity];
+        if (slot.sequence.load(std::memory_order_acquire) != index + 1) {
+            continue;
+        }
+        Record record{
+            .timestamp = slot.timestamp.load(std::memory_order_relaxed),
+            .type = Event(slot.type.load(std::memory_order_relaxed)),
+            .session = slot.session.load(std::memory_order_relaxed),
+            .a = slot.a.load(std::memory_order_relaxed),
+            .b = slot.b.load(std::memory_order_relaxed),
+        };
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != index + 1 || record.timestamp < since) {
+            continue;
+        }
+        records.push_back(record);
+    }
+
+    std::stable_sort(records.begin(), records.end(), [](const Record &first, const Record &second) {
+        return first.timestamp < second.timestamp;
+    });
+    return records;
+}
+
+void removeOldDumps(const QDir &directory)
+{
+    const auto files = directory.entryList({QStringLiteral("flight-recorder-*.log")}, QDir::Files, QDir::Name | QDir::Reversed);
+    for (int i = MaxDumpFiles; i < files.size(); ++i) {
+        directory.remove(files.at(i));
+    }
+}
+
+void watchdog(std::stop_token token)
+{
+    pthread_setname_np(pthread_self(), "krdp_watchdog");
+
+    std::mutex mutex;
+    std::condition_variable_any condition;
+    clk::steady_clock::time_point lastStallDump;
+    bool stalled = false;
+
+    while (!token.stop_requested()) {
+        {
+            std::unique_lock lock(mutex);
+            condition.wait_for(lock, token, WatchdogInterval, [] {
+                return false;
+            });
+        }
+
+        if (s_dumpRequested.exchange(false)) {
+            dump(QStringLiteral("requested"));
+        }
+
+        const auto now = clk::steady_clock::now();
+        const auto threshold = stallThreshold();
+
+        QString stalledStage;
+        clk::steady_clock::duration stalledFor{0};
+
+        const auto heartbeat = s_lastHeartbeat.load(std::memory_order_relaxed);
+        if (heartbeat != 0) {
+            const auto sinceHeartbeat = now.time_since_epoch() - clk::nanoseconds(heartbeat);
+            if (sinceHeartbeat > threshold) {
+                stalledStage = QStringLiteral("main_thread");
+                stalledFor = sinceHeartbeat;
+            }
+        }
+
+        if (stalledStage.isEmpty()) {
+            std::lock_guard lock(s_checksMutex);
+            for (const auto &[id, entry] : s_checks) {
+                const auto duration = entry.check(now);
+                if (duration > threshold) {
+                    stalledStage = QString::fromLatin1(entry.stage);
+                    stalledFor = duration;
+                    break;
+                }
+            }
+        }
+
+        // Dump once per stall, when it crosses the threshold.
+        if (!stalledStage.isEmpty() && !stalled
+            && (lastStallDump.time_since_epoch().count() == 0 || now - lastStallDump >= MinimumTimeBetweenStallDumps)) {
+            lastStallDump = now;
+            const auto milliseconds = clk::duration_cast<clk::milliseconds>(stalledFor).count();
+            const auto path = dump(QStringLiteral("stall in %1 for %2 ms").arg(stalledStage).arg(milliseconds));
+            qCWarning(KRDP).noquote() << QStringLiteral("Pipeline stage %1 stalled for %2 ms, flight recorder written to %3").arg(stalledStage).arg(milliseconds).arg(path);
+        }
+        stalled = !stalledStage.isEmpty();
+    }
+}
+}
+
+void record(Event event, quint32 session, qint64 a, qint64 b)
+{
+    const auto index = s_next.fetch_add(1, std::memory_order_relaxed);
+    auto &slot = s_slots[index % Capacity];
+
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.timestamp.store(nowNs(), std::memory_order_relaxed);
+    slot.type.store(quint32(event), std::memory_order_relaxed);
+    slot.session.store(session, std::memory_order_relaxed);
+    slot.a.store(a, std::memory_order_relaxed);
+    slot.b.store(b, std::memory_order_relaxed);
+    slot.sequence.store(index + 1, std::memory_order_release);
+}
+
+quint64 addStallCheck(const char *stage, StallCheck check)
+{
+    std::lock_guard lock(s_checksMutex);
+    const auto id = s_nextCheckId++;
+    s_checks.emplace(id, StallCheckEntry{.stage = stage, .check = std::move(check)});
+    return id;
+}
+
+void removeStallCheck(quint64 id)
+{
+    std::lock_guard lock(s_checksMutex);
+    s_checks.erase(id);
+}
+
+void startWatchdog()
+{
+    std::call_once(s_watchdogStarted, [] {
+        static std::jthread thread(watchdog);
+    });
+}
+
+void heartbeat()
+{
+    s_lastHeartbeat.store(nowNs(), std::memory_order_relaxed);
+}
+
+void requestDump()
+{
+    s_dumpRequested.store(true, std::memory_order_relaxed);
+}
+
+QString dump(const QString &reason)
+{
+    const auto now = nowNs();
+    const auto records = snapshot(now - clk::duration_cast<clk::nanoseconds>(DumpWindow).count());
+
+    const QDir directory(QStandardPaths::writableLocation(QStandardPaths::GenericStateLocation) + QStringLiteral("/krdp"));
+    directory.mkpath(QStringLiteral("."));
+    const auto path = directory.filePath(QStringLiteral("flight-recorder-%1.log").arg(QDateTime::currentDateTime().toString(QStringLiteral("yyyyMMdd-hhmmss-zzz"))));
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        qCWarning(KRDP) << "Could not write flight recorder to" << path << file.errorString();
+        return QString();
+    }
+
+    file.write(QStringLiteral("# KRDP flight recorder: %1\n").arg(reason).toUtf8());
+    file.write(QStringLiteral("# %1 events from the last %2 s, times in ms relative to the dump\n")
+                   .arg(records.size())
+                   .arg(clk::duration_cast<clk::seconds>(DumpWindow).count())
+                   .toUtf8());
+    file.write("# time_ms event session a b\n");
+    for (const auto &entry : records) {
+        file.write(QStringLiteral("%1 %2 %3 %4 %5\n")
+                       .arg(double(entry.timestamp - now) / 1'000'000.0, 0, 'f', 3)
+                       .arg(QLatin1String(eventName(entry.type)))
+                       .arg(entry.session)
+                       .arg(entry.a)
+                       .arg(entry.b)
+                       .toUtf8());
+    }
+
+    if (!file.commit()) {
+        qCWarning(KRDP) << "Could not write flight recorder to" << path << file.errorString();
+        return QString();
+    }
+
+    removeOldDumps(directory);
+    qCInfo(KRDP) << "Flight recorder written to" << path;
+    return path;
+}
+
+}
+}
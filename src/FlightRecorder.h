@@ -0,0 +1,94 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+
+#include <QString>
+
+#include "krdp_export.h"
+
+namespace KRdp
+{
+
+/**
+ * Always-on recorder of recent pipeline events.
+ *
+ * Events are small fixed-size records written into a ring buffer of fixed
+ * size, without locks, from any thread. A watchdog thread checks the
+ * registered pipeline stages and writes the events of the last seconds to a
+ * file when a stage stalls beyond a threshold (KRDP_STALL_THRESHOLD_MS,
+ * 2000 ms by default), or when a dump is requested, for example from a
+ * SIGUSR2 handler.
+ *
+ * Files are written to the "krdp" directory in the user's state location.
+ */
+namespace FlightRecorder
+{
+
+enum class Event : quint16 {
+    PacketReceived, ///< a: bytes, b: key frame
+    MetadataReceived, ///< a: sequence
+    FrameEmitted, ///< a: wait for metadata in µs, b: paired with metadata
+    FrameQueued, ///< a: bytes, b: queue depth
+    FrameDropped, ///< a: 0 stale, 1 submission queue full
+    FrameSent, ///< a: frame id, b: bytes
+    FrameAcknowledged, ///< a: frame id, b: acknowledge latency in µs
+    RttSample, ///< a: RTT in µs
+    EncoderState, ///< a: PipeWireBaseEncodedStream::State, b: active
+    EncoderError,
+    EncoderFallback, ///< a: 1 software, 0 hardware retry
+};
+
+/**
+ * Record an event. \p session tells apart events of different connections.
+ */
+KRDP_EXPORT void record(Event event, quint32 session = 0, qint64 a = 0, qint64 b = 0);
+
+/**
+ * Returns for how long a stage has been waiting on work it did not finish,
+ * or zero when it is not stalled. Called from the watchdog thread.
+ */
+using StallCheck = std::function<std::chrono::steady_clock::duration(std::chrono::steady_clock::time_point now)>;
+
+/**
+ * Add a stage to watch. \p stage must be a string literal.
+ *
+ * \return An id to remove the check with.
+ */
+KRDP_EXPORT quint64 addStallCheck(const char *stage, StallCheck check);
+/**
+ * Remove a check. Once this returns the check is no longer called.
+ */
+KRDP_EXPORT void removeStallCheck(quint64 id);
+
+/**
+ * Start the watchdog thread. Does nothing when it is already running.
+ */
+KRDP_EXPORT void startWatchdog();
+
+/**
+ * Tell the watchdog that the main thread is responsive.
+ */
+KRDP_EXPORT void heartbeat();
+
+/**
+ * Ask the watchdog to write out the recorded events.
+ *
+ * This is safe to call from a signal handler.
+ */
+KRDP_EXPORT void requestDump();
+
+/**
+ * Write out the recorded events now.
+ *
+ * \return The path of the written file, or an empty string on failure.
+ */
+KRDP_EXPORT QString dump(const QString &reason);
+
+}
+
+}
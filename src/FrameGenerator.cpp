@@ -0,0 +1,235 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "FrameGenerator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <pthread.h>
+
+#include <freerdp/codec/color.h>
+#include <freerdp/codec/h264.h>
+
+#include "AbstractSession.h"
+#include "VideoFrame.h"
+#include "krdp_logging.h"
+
+namespace KRdp
+{
+
+namespace clk = std::chrono;
+
+namespace
+{
+// Roughly what a desktop encoder spends on a changing screen.
+constexpr double BitsPerPixel = 0.1;
+
+bool containsIdr(const QByteArray &data)
+{
+    for (qsizetype i = 0; i + 3 < data.size(); ++i) {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1 && (data[i + 3] & 0x1f) == 5) {
+            return true;
+        }
+    }
+    return false;
+}
+}
+
+class KRDP_NO_EXPORT FrameGenerator::Private
+{
+public:
+    void run(std::stop_token token);
+    bool createEncoder();
+    bool encode(const Image &image, clk::steady_clock::time_point renderedAt);
+
+    AbstractSession *session = nullptr;
+    const char *threadName = nullptr;
+    Renderer renderer;
+    FrameCallback emitted;
+    QSize size;
+
+    std::jthread thread;
+    std::atomic<quint32> frameRate = 60;
+    std::atomic_int quality = -1;
+    std::atomic<quint32> bitrate = 0;
+    std::atomic_bool resetEncoder = false;
+
+    // Only used by the generator thread while it runs.
+    std::unique_ptr<H264_CONTEXT, decltype(&h264_context_free)> encoder{nullptr, h264_context_free};
+};
+
+FrameGenerator::FrameGenerator(AbstractSession *session, const char *threadName, Renderer renderer, FrameCallback emitted)
+    : d(std::make_unique<Private>())
+{
+    d->session = session;
+    d->threadName = threadName;
+    d->renderer = std::move(renderer);
+    d->emitted = std::move(emitted);
+}
+
+FrameGenerator::~FrameGenerator()
+{
+    stop();
+}
+
+void FrameGenerator::setSize(const QSize &size)
+{
+    d->size = size;
+}
+
+void FrameGenerator::setFrameRate(quint32 frameRate)
+{
+    d->frameRate = std::max(frameRate, quint32(1));
+}
+
+void FrameGenerator::setQuality(int quality)
+{
+    d->quality = std::min(quality, 100);
+}
+
+void FrameGenerator::setBitrate(quint32 bitsPerSecond)
+{
+    d->bitrate = bitsPerSecond;
+    d->resetEncoder = true;
+}
+
+void FrameGenerator::start()
+{
+    if (d->thread.joinable()) {
+        return;
+    }
+
+    d->thread = std::jthread([this](std::stop_token token) {
+        d->run(token);
+    });
+    pthread_setname_np(d->thread.native_handle(), d->threadName);
+}
+
+void FrameGenerator::stop()
+{
+    if (d->thread.joinable()) {
+        d->thread.request_stop();
+        d->thread.join();
+    }
+    // Start over with a key frame next time.
+    d->encoder.reset();
+}
+
+void FrameGenerator::Private::run(std::stop_token token)
+{
+    std::mutex mutex;
+    std::condition_variable_any condition;
+
+    bool restarted = true;
+    auto nextFrame = clk::steady_clock::now();
+    while (!token.stop_requested()) {
+        const auto interval = clk::duration_cast<clk::steady_clock::duration>(clk::seconds(1)) / frameRate.load(std::memory_order_relaxed);
+        // Do not try to catch up on frames that were missed.
+        nextFrame = std::max(nextFrame + interval, clk::steady_clock::now() - interval);
+        {
+            std::unique_lock lock(mutex);
+            condition.wait_until(lock, token, nextFrame, [] {
+                return false;
+            });
+        }
+        if (token.stop_requested()) {
+            break;
+        }
+
+        const auto renderedAt = clk::steady_clock::now();
+        const auto image = renderer(interval, restarted);
+        restarted = false;
+        if (image.damage.isEmpty()) {
+            continue;
+        }
+
+        if (!encode(image, renderedAt)) {
+            QMetaObject::invokeMethod(session, [session = session]() {
+                Q_EMIT session->error();
+            });
+            return;
+        }
+    }
+}
+
+bool FrameGenerator::Private::createEncoder()
+{
+    encoder.reset(h264_context_new(TRUE));
+    if (!encoder || !h264_context_reset(encoder.get(), size.width(), size.height())) {
+        qCWarning(KRDP) << "Could not create an H.264 encoder for generated frames, FreeRDP needs to be built with OpenH264 or FFmpeg";
+        encoder.reset();
+        return false;
+    }
+
+    const auto rate = frameRate.load(std::memory_order_relaxed);
+    const auto currentQuality = quality.load(std::memory_order_relaxed);
+    const auto currentBitrate = bitrate.load(std::memory_order_relaxed);
+    h264_context_set_option(encoder.get(), H264_CONTEXT_OPTION_FRAMERATE, rate);
+    if (currentQuality >= 0) {
+        // Same direction as the encoder quality setting: 100 is best.
+        h264_context_set_option(encoder.get(), H264_CONTEXT_OPTION_RATECONTROL, H264_RATECONTROL_CQP);
+        h264_context_set_option(encoder.get(), H264_CONTEXT_OPTION_QP, UINT32(51 - currentQuality * 41 / 100));
+    } else {
+        h264_context_set_option(encoder.get(), H264_CONTEXT_OPTION_RATECONTROL, H264_RATECONTROL_VBR);
+        h264_context_set_option(encoder.get(),
+                                H264_CONTEXT_OPTION_BITRATE,
+                                currentBitrate > 0 ? currentBitrate : UINT32(size.width() * size.height() * rate * BitsPerPixel));
+    }
+    return true;
+}
+
+bool FrameGenerator::Private::encode(const Image &image, clk::steady_clock::time_point renderedAt)
+{
+    if (resetEncoder.exchange(false)) {
+        encoder.reset();
+    }
+    if (!encoder && !createEncoder()) {
+        return false;
+    }
+
+    const RECTANGLE_16 frameRect{0, 0, UINT16(size.width()), UINT16(size.height())};
+    BYTE *data = nullptr;
+    UINT32 dataSize = 0;
+    RDPGFX_H264_METABLOCK meta = {};
+    const auto status = avc420_compress(encoder.get(),
+                                        image.pixels,
+                                        PIXEL_FORMAT_BGRX32,
+                                        UINT32(image.stride),
+                                        size.width(),
+                                        size.height(),
+                                        &frameRect,
+                                        &data,
+                                        &dataSize,
+                                        &meta);
+    free_h264_metablock(&meta);
+    if (status < 0) {
+        qCWarning(KRDP) << "Encoding a generated frame failed";
+        return false;
+    }
+    if (dataSize == 0) {
+        return true;
+    }
+
+    VideoFrame frame;
+    frame.size = size;
+    frame.data = QByteArray(reinterpret_cast<const char *>(data), dataSize);
+    frame.isKeyFrame = containsIdr(frame.data);
+    frame.damage = frame.isKeyFrame ? QRegion(QRect(QPoint(0, 0), size)) : image.damage.intersected(QRect(QPoint(0, 0), size));
+    frame.monitors = {VideoMonitor{.geometry = QRect(QPoint(0, 0), size), .primary = true}};
+    // Capture timestamps are CLOCK_MONOTONIC, like the ones from the compositor.
+    frame.presentationTimeStamp = clk::system_clock::time_point(clk::duration_cast<clk::system_clock::duration>(renderedAt.time_since_epoch()));
+    frame.encodedTimeStamp = clk::steady_clock::now();
+
+    Q_EMIT session->frameReceived(frame);
+    if (emitted) {
+        emitted();
+    }
+    return true;
+}
+
+}
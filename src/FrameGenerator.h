@@ -0,0 +1,87 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+
+#include <QRegion>
+#include <QSize>
+
+#include "TestsExport_p.h"
+
+namespace KRdp
+{
+
+class AbstractSession;
+
+/**
+ * Renders and encodes frames on a thread of its own, for sessions that
+ * generate their content instead of capturing it.
+ *
+ * The renderer is called at the frame rate. Frames are encoded with FreeRDP's
+ * H.264 encoder and emitted as frameReceived() of the session, with the
+ * damage the renderer reported, like frames from a compositor. If encoding
+ * fails the generator stops and the session emits error().
+ */
+class KRDP_TESTS_EXPORT FrameGenerator
+{
+public:
+    /**
+     * A rendered frame. The pixels need to stay valid until the renderer is
+     * called again.
+     */
+    struct Image {
+        /// BGRX pixels of the whole frame, like QImage::Format_RGB32.
+        const uchar *pixels = nullptr;
+        int stride = 0;
+        /// What changed since the previous frame. Nothing is sent if empty.
+        QRegion damage;
+    };
+
+    /**
+     * Called on the generator thread for every frame with the current frame
+     * interval. \p restarted is set for the first frame after start(), that
+     * frame is sent in full.
+     */
+    using Renderer = std::function<Image(std::chrono::steady_clock::duration interval, bool restarted)>;
+    /**
+     * Called on the generator thread after a frame was emitted.
+     */
+    using FrameCallback = std::function<void()>;
+
+    FrameGenerator(AbstractSession *session, const char *threadName, Renderer renderer, FrameCallback emitted = {});
+    ~FrameGenerator();
+
+    /**
+     * The size of the frames. Needs to be set before start().
+     */
+    void setSize(const QSize &size);
+    void setFrameRate(quint32 frameRate);
+    /**
+     * Encode at a constant quality from 0 to 100, instead of a bitrate.
+     * Applies from the next key frame.
+     */
+    void setQuality(int quality);
+    /**
+     * Target bitrate in bits per second. Changing it starts over with a key
+     * frame. Without a bitrate or quality, a rate typical for a changing
+     * desktop is used.
+     */
+    void setBitrate(quint32 bitsPerSecond);
+
+    void start();
+    /**
+     * Stop the generator thread. The next start() begins with a key frame.
+     */
+    void stop();
+
+private:
+    class Private;
+    const std::unique_ptr<Private> d;
+};
+
+}
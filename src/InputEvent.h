@@ -0,0 +1,56 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+#include <QList>
+#include <QtCore/qnamespace.h>
+
+namespace KRdp
+{
+
+/**
+ * An input event received from the client, as passed from InputHandler to
+ * the session.
+ *
+ * This is a plain value type so events can be queued and batched without
+ * allocating.
+ */
+struct InputEvent {
+    enum class Type : uint8_t {
+        /// Pointer moved to x, y.
+        PointerMotion,
+        /// Mouse button code (a Qt::MouseButton) pressed or released at x, y.
+        PointerButton,
+        /// Wheel rotated at x, y by deltaX, deltaY, 120 per notch, positive towards the right and down.
+        PointerAxis,
+        /// Key with evdev keycode code pressed or released.
+        Key,
+        /// Key producing keysym code pressed or released, for Unicode input.
+        KeySym,
+    };
+
+    Type type = Type::PointerMotion;
+    bool pressed = false;
+    // Client coordinates, the size of the video stream.
+    uint16_t x = 0;
+    uint16_t y = 0;
+    uint32_t code = 0;
+    int32_t deltaX = 0;
+    int32_t deltaY = 0;
+
+    Qt::MouseButton button() const
+    {
+        return Qt::MouseButton(code);
+    }
+};
+
+static_assert(std::is_trivially_copyable_v<InputEvent>);
+
+using InputEvents = QList<InputEvent>;
+
+}
@@ -4,22 +4,34 @@
 
 #include "InputHandler.h"
 
-#include <QKeyEvent>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
 #include <QMetaObject>
-#include <QThread>
 
 #include <xkbcommon/xkbcommon.h>
 
 #include "PeerContext_p.h"
+#include "Probes_p.h"
 
 #include "krdp_logging.h"
 
 namespace KRdp
 {
 
+namespace
+{
+// Events queued between two wakeups of the handler's thread. A 1000 Hz mouse
+// fills about a tenth of it in a 100 ms stall.
+constexpr uint32_t QueueCapacity = 1024;
+}
+
 BOOL inputSynchronizeEvent(rdpInput *input, uint32_t flags)
 {
     auto context = reinterpret_cast<PeerContext *>(input->context);
+    KRDP_PROBE4(input_event, int(ProbeInputKind::Synchronize), flags, 0u, 0u);
 
     if (context->inputHandler->synchronizeEvent(flags)) {
         return TRUE;
@@ -31,6 +43,7 @@ BOOL inputSynchronizeEvent(rdpInput *input, uint32_t flags)
 BOOL inputMouseEvent(rdpInput *input, uint16_t flags, uint16_t x, uint16_t y)
 {
     auto context = reinterpret_cast<PeerContext *>(input->context);
+    KRDP_PROBE4(input_event, int(ProbeInputKind::Mouse), uint32_t(flags), uint32_t(x), uint32_t(y));
 
     if (context->inputHandler->mouseEvent(x, y, flags)) {
         return TRUE;
@@ -42,6 +55,7 @@ BOOL inputMouseEvent(rdpInput *input, uint16_t flags, uint16_t x, uint16_t y)
 BOOL inputExtendedMouseEvent(rdpInput *input, uint16_t flags, uint16_t x, uint16_t y)
 {
     auto context = reinterpret_cast<PeerContext *>(input->context);
+    KRDP_PROBE4(input_event, int(ProbeInputKind::ExtendedMouse), uint32_t(flags), uint32_t(x), uint32_t(y));
 
     if (context->inputHandler->extendedMouseEvent(x, y, flags)) {
         return TRUE;
@@ -53,6 +67,7 @@ BOOL inputExtendedMouseEvent(rdpInput *input, uint16_t flags, uint16_t x, uint16
 BOOL inputKeyboardEvent(rdpInput *input, uint16_t flags, uint8_t code)
 {
     auto context = reinterpret_cast<PeerContext *>(input->context);
+    KRDP_PROBE4(input_event, int(ProbeInputKind::Keyboard), uint32_t(flags), uint32_t(code), 0u);
 
     if (context->inputHandler->keyboardEvent(code, flags)) {
         return TRUE;
@@ -64,6 +79,7 @@ BOOL inputKeyboardEvent(rdpInput *input, uint16_t flags, uint8_t code)
 BOOL inputUnicodeKeyboardEvent(rdpInput *input, uint16_t flags, uint16_t code)
 {
     auto context = reinterpret_cast<PeerContext *>(input->context);
+    KRDP_PROBE4(input_event, int(ProbeInputKind::UnicodeKeyboard), uint32_t(flags), uint32_t(code), 0u);
 
     if (context->inputHandler->unicodeKeyboardEvent(code, flags)) {
         return TRUE;
@@ -75,15 +91,81 @@ BOOL inputUnicodeKeyboardEvent(rdpInput *input, uint16_t flags, uint16_t code)
 class KRDP_NO_EXPORT InputHandler::Private
 {
 public:
+    bool tryPush(const InputEvent &event);
+    void drainQueue();
+    void append(const InputEvent &event);
+
     RdpConnection *session;
     rdpInput *input;
+
+    // Single producer (the peer's thread), single consumer (the handler's
+    // thread). Both indices only grow, the slot is the index modulo capacity.
+    std::array<InputEvent, QueueCapacity> queue;
+    std::atomic<uint32_t> head = 0;
+    std::atomic<uint32_t> tail = 0;
+    // Whether a dispatchEvents() call is queued on the handler's thread.
+    std::atomic_bool dispatchPending = false;
+
+    // Only used while the queue is full, so a stalled handler thread neither
+    // loses events nor reorders them. While overflowing is set, the producer
+    // appends here instead of to the queue.
+    std::mutex overflowMutex;
+    std::atomic_bool overflowing = false;
+    std::vector<InputEvent> overflow;
+
+    // Reused for every dispatch, accessed from the handler's thread only.
+    InputEvents batch;
 };
 
+bool InputHandler::Private::tryPush(const InputEvent &event)
+{
+    const auto index = tail.load(std::memory_order_relaxed);
+    if (index - head.load(std::memory_order_acquire) == QueueCapacity) {
+        return false;
+    }
+
+    queue[index % QueueCapacity] = event;
+    tail.store(index + 1, std::memory_order_release);
+    return true;
+}
+
+void InputHandler::Private::drainQueue()
+{
+    const auto end = tail.load(std::memory_order_acquire);
+    auto index = head.load(std::memory_order_relaxed);
+    for (; index != end; ++index) {
+        append(queue[index % QueueCapacity]);
+    }
+    head.store(index, std::memory_order_release);
+}
+
+void InputHandler::Private::append(const InputEvent &event)
+{
+    if (!batch.isEmpty()) {
+        // Only the latest position of a run of motion matters, and a run of
+        // wheel events scrolls as far as their sum.
+        auto &last = batch.last();
+        if (event.type == InputEvent::Type::PointerMotion && last.type == InputEvent::Type::PointerMotion) {
+            last = event;
+            return;
+        }
+        if (event.type == InputEvent::Type::PointerAxis && last.type == InputEvent::Type::PointerAxis) {
+            last.x = event.x;
+            last.y = event.y;
+            last.deltaX += event.deltaX;
+            last.deltaY += event.deltaY;
+            return;
+        }
+    }
+    batch.append(event);
+}
+
 InputHandler::InputHandler(KRdp::RdpConnection *session)
     : QObject(nullptr)
     , d(std::make_unique<Private>())
 {
     d->session = session;
+    d->batch.reserve(QueueCapacity);
 }
 
 InputHandler::~InputHandler() noexcept
@@ -102,12 +184,7 @@ void InputHandler::initialize(rdpInput *input)
 
 bool InputHandler::synchronizeEvent(uint32_t flags)
 {
-    if (QThread::currentThread() != thread()) {
-        QMetaObject::invokeMethod(this, [this, flags]() {
-            synchronizeEvent(flags);
-        }, Qt::QueuedConnection);
-        return true;
-    }
+    Q_UNUSED(flags);
 
     // TODO: This syncs caps/num/scroll lock keys, do we actually want to?
     return true;
@@ -115,23 +192,7 @@ bool InputHandler::synchronizeEvent(uint32_t flags)
 
 bool InputHandler::mouseEvent(uint16_t x, uint16_t y, uint16_t flags)
 {
-    if (QThread::currentThread() != thread()) {
-        QMetaObject::invokeMethod(this, [this, x, y, flags]() {
-            mouseEvent(x, y, flags);
-        }, Qt::QueuedConnection);
-        return true;
-    }
-
-    QPointF position = QPointF(x, y);
-
-    Qt::MouseButton button = Qt::NoButton;
-    if (flags & PTR_FLAGS_BUTTON1) {
-        button = Qt::LeftButton;
-    } else if (flags & PTR_FLAGS_BUTTON2) {
-        button = Qt::RightButton;
-    } else if (flags & PTR_FLAGS_BUTTON3) {
-        button = Qt::MiddleButton;
-    }
+    InputEvent event{.x = x, .y = y};
 
     if (flags & PTR_FLAGS_WHEEL || flags & PTR_FLAGS_HWHEEL) {
         auto axis = flags & WheelRotationMask;
@@ -139,41 +200,39 @@ bool InputHandler::mouseEvent(uint16_t x, uint16_t y, uint16_t flags)
             axis = (~axis & WheelRotationMask) + 1;
         }
         axis *= flags & PTR_FLAGS_WHEEL_NEGATIVE ? 1 : -1;
+        event.type = InputEvent::Type::PointerAxis;
         if (flags & PTR_FLAGS_WHEEL) {
-            auto event =
-                std::make_shared<QWheelEvent>(position, QPointF{}, QPoint{}, QPoint{0, axis}, Qt::NoButton, Qt::KeyboardModifiers{}, Qt::NoScrollPhase, false);
-            Q_EMIT inputEvent(event);
+            event.deltaY = axis;
         }
         if (flags & PTR_FLAGS_HWHEEL) {
-            auto event =
-                std::make_shared<QWheelEvent>(position, QPointF{}, QPoint{}, QPoint{-axis, 0}, Qt::NoButton, Qt::KeyboardModifiers{}, Qt::NoScrollPhase, false);
-            Q_EMIT inputEvent(event);
+            event.deltaX = -axis;
         }
+        queueEvent(event);
         return true;
     }
 
-    std::shared_ptr<QMouseEvent> event;
-    if (flags & PTR_FLAGS_DOWN) {
-        event = std::make_shared<QMouseEvent>(QEvent::MouseButtonPress, position, QPointF{}, button, button, Qt::NoModifier);
-    } else if (flags & PTR_FLAGS_MOVE) {
-        event = std::make_shared<QMouseEvent>(QEvent::MouseMove, position, QPointF{}, button, button, Qt::NoModifier);
+    if (flags & PTR_FLAGS_DOWN || !(flags & PTR_FLAGS_MOVE)) {
+        Qt::MouseButton button = Qt::NoButton;
+        if (flags & PTR_FLAGS_BUTTON1) {
+            button = Qt::LeftButton;
+        } else if (flags & PTR_FLAGS_BUTTON2) {
+            button = Qt::RightButton;
+        } else if (flags & PTR_FLAGS_BUTTON3) {
+            button = Qt::MiddleButton;
+        }
+        event.type = InputEvent::Type::PointerButton;
+        event.pressed = flags & PTR_FLAGS_DOWN;
+        event.code = uint32_t(button);
     } else {
-        event = std::make_shared<QMouseEvent>(QEvent::MouseButtonRelease, position, QPointF{}, button, button, Qt::NoModifier);
+        event.type = InputEvent::Type::PointerMotion;
     }
-    Q_EMIT inputEvent(event);
+    queueEvent(event);
 
     return true;
 }
 
 bool InputHandler::extendedMouseEvent(uint16_t x, uint16_t y, uint16_t flags)
 {
-    if (QThread::currentThread() != thread()) {
-        QMetaObject::invokeMethod(this, [this, x, y, flags]() {
-            extendedMouseEvent(x, y, flags);
-        }, Qt::QueuedConnection);
-        return true;
-    }
-
     if (flags & PTR_FLAGS_MOVE) {
         return mouseEvent(x, y, PTR_FLAGS_MOVE);
     }
@@ -187,61 +246,94 @@ bool InputHandler::extendedMouseEvent(uint16_t x, uint16_t y, uint16_t flags)
         return false;
     }
 
-    std::shared_ptr<QMouseEvent> event;
-    if (flags & PTR_XFLAGS_DOWN) {
-        event = std::make_shared<QMouseEvent>(QEvent::MouseButtonPress, QPointF(x, y), QPointF{}, button, button, Qt::KeyboardModifiers{});
-
-    } else {
-        event = std::make_shared<QMouseEvent>(QEvent::MouseButtonRelease, QPointF(x, y), QPointF{}, button, button, Qt::KeyboardModifiers{});
-    }
-    Q_EMIT inputEvent(event);
+    queueEvent(InputEvent{
+        .type = InputEvent::Type::PointerButton,
+        .pressed = bool(flags & PTR_XFLAGS_DOWN),
+        .x = x,
+        .y = y,
+        .code = uint32_t(button),
+    });
 
     return true;
 }
 
 bool InputHandler::keyboardEvent(uint16_t code, uint16_t flags)
 {
-    if (QThread::currentThread() != thread()) {
-        QMetaObject::invokeMethod(this, [this, code, flags]() {
-            keyboardEvent(code, flags);
-        }, Qt::QueuedConnection);
-        return true;
-    }
-
     auto virtualCode = GetVirtualKeyCodeFromVirtualScanCode(flags & KBD_FLAGS_EXTENDED ? code | KBDEXT : code, 4);
     virtualCode = flags & KBD_FLAGS_EXTENDED ? virtualCode | KBDEXT : virtualCode;
 
     quint32 keycode = GetKeycodeFromVirtualKeyCode(virtualCode, WINPR_KEYCODE_TYPE_EVDEV);
+    if (!keycode) {
+        return true;
+    }
 
-    auto type = flags & KBD_FLAGS_RELEASE ? QEvent::KeyRelease : QEvent::KeyPress;
-
-    auto event = std::make_shared<QKeyEvent>(type, 0, Qt::KeyboardModifiers{}, keycode, 0, 0);
-    Q_EMIT inputEvent(event);
+    queueEvent(InputEvent{
+        .type = InputEvent::Type::Key,
+        .pressed = !(flags & KBD_FLAGS_RELEASE),
+        .code = keycode,
+    });
 
     return true;
 }
 
 bool InputHandler::unicodeKeyboardEvent(uint16_t code, uint16_t flags)
 {
-    if (QThread::currentThread() != thread()) {
-        QMetaObject::invokeMethod(this, [this, code, flags]() {
-            unicodeKeyboardEvent(code, flags);
-        }, Qt::QueuedConnection);
+    // A UTF-16 code unit, surrogates do not map to a keysym.
+    auto keysym = xkb_utf32_to_keysym(code);
+    if (!keysym) {
         return true;
     }
 
-    auto text = QString(QChar::fromUcs2(code));
-    auto keysym = xkb_utf32_to_keysym(text.toUcs4().first());
-    if (!keysym) {
-        return true;
+    queueEvent(InputEvent{
+        .type = InputEvent::Type::KeySym,
+        .pressed = !(flags & KBD_FLAGS_RELEASE),
+        .code = keysym,
+    });
+
+    return true;
+}
+
+void InputHandler::queueEvent(const InputEvent &event)
+{
+    if (d->overflowing.load(std::memory_order_acquire) || !d->tryPush(event)) {
+        std::lock_guard lock(d->overflowMutex);
+        // The handler's thread may have emptied the queue in the meantime.
+        if (d->overflowing.load(std::memory_order_relaxed) || !d->tryPush(event)) {
+            if (d->overflow.empty()) {
+                qCWarning(KRDP) << "Input queue full, the main thread is not keeping up";
+            }
+            d->overflow.push_back(event);
+            d->overflowing.store(true, std::memory_order_release);
+        }
     }
 
-    auto type = flags & KBD_FLAGS_RELEASE ? QEvent::KeyRelease : QEvent::KeyPress;
+    if (!d->dispatchPending.exchange(true, std::memory_order_acq_rel)) {
+        QMetaObject::invokeMethod(this, &InputHandler::dispatchEvents, Qt::QueuedConnection);
+    }
+}
 
-    auto event = std::make_shared<QKeyEvent>(type, 0, Qt::KeyboardModifiers{}, 0, keysym, 0);
-    Q_EMIT inputEvent(event);
+void InputHandler::dispatchEvents()
+{
+    // Cleared first, so events queued from here on get a dispatch of their own.
+    d->dispatchPending.store(false, std::memory_order_release);
+
+    d->batch.clear();
+    d->drainQueue();
+    if (d->overflowing.load(std::memory_order_acquire)) {
+        // While overflowing is set the producer leaves the queue alone, so
+        // what is in it now predates everything in overflow.
+        std::lock_guard lock(d->overflowMutex);
+        d->drainQueue();
+        for (const auto &event : d->overflow) {
+            d->append(event);
+        }
+        d->overflow.clear();
+        d->overflowing.store(false, std::memory_order_release);
+    }
 
-    return true;
+    if (!d->batch.isEmpty()) {
+        Q_EMIT inputEvents(d->batch);
+    }
 }
 
 }
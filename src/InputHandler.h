@@ -6,11 +6,11 @@
 
 #include <memory>
 
-#include <QInputEvent>
 #include <QObject>
 
 #include <freerdp/freerdp.h>
 
+#include "InputEvent.h"
 #include "krdp_export.h"
 
 namespace KRdp
@@ -19,7 +19,12 @@ namespace KRdp
 class RdpConnection;
 
 /**
- * This class processes RDP input events and converts them to Qt events.
+ * This class processes RDP input events and converts them to InputEvents.
+ *
+ * Events arrive on the peer's thread and are queued without locking. The
+ * handler's thread picks up everything queued since its last wakeup in one
+ * go, merging consecutive pointer motion and consecutive wheel events, and
+ * passes it on as a single batch.
  *
  * One input handler is created per session.
  */
@@ -37,12 +42,12 @@ public:
     void initialize(rdpInput *input);
 
     /**
-     * Emitted whenever a new input event was received from the client.
+     * Emitted with the input events received from the client since the last
+     * time, in the order they were received.
      *
-     * \param event The input event that was received.
+     * \param events The input events, only valid during the emission.
      */
-    // Note: Intentional pass-by-value to ensure lifetime of the shared_ptr is extended.
-    Q_SIGNAL void inputEvent(std::shared_ptr<QInputEvent> event);
+    Q_SIGNAL void inputEvents(const KRdp::InputEvents &events);
 
 private:
     // FreeRDP callbacks that need to call the event handler functions in the
@@ -71,6 +76,12 @@ private:
     bool keyboardEvent(uint16_t code, uint16_t flags);
     bool unicodeKeyboardEvent(uint16_t code, uint16_t flags);
 
+    /**
+     * Queue \p event for the next batch. Called from the peer's thread.
+     */
+    void queueEvent(const InputEvent &event);
+    void dispatchEvents();
+
     class Private;
     const std::unique_ptr<Private> d;
 };
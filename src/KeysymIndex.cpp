@@ -0,0 +1,56 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "KeysymIndex.h"
+
+namespace KRdp
+{
+
+namespace
+{
+// The offset between KEY_* numbering and keycodes in the XKB evdev dataset.
+constexpr uint32_t EvdevOffset = 8;
+}
+
+void KeysymIndex::rebuild(xkb_keymap *keymap, xkb_layout_index_t layout)
+{
+    m_codes.clear();
+    if (!keymap) {
+        return;
+    }
+
+    const auto max = xkb_keymap_max_keycode(keymap);
+    for (auto keycode = xkb_keymap_min_keycode(keymap); keycode <= max; keycode++) {
+        if (keycode < EvdevOffset) {
+            continue;
+        }
+        const auto levelCount = xkb_keymap_num_levels_for_key(keymap, keycode, layout);
+        for (xkb_level_index_t level = 0; level < levelCount; level++) {
+            const xkb_keysym_t *syms;
+            const auto count = xkb_keymap_key_get_syms_by_level(keymap, keycode, layout, level, &syms);
+            for (int i = 0; i < count; i++) {
+                // Keep the first key found, like a scan in keycode order.
+                if (!m_codes.contains(syms[i])) {
+                    m_codes.insert(syms[i], Code{.level = level, .code = keycode - EvdevOffset});
+                }
+            }
+        }
+    }
+}
+
+std::optional<KeysymIndex::Code> KeysymIndex::find(xkb_keysym_t keysym) const
+{
+    const auto it = m_codes.constFind(keysym);
+    if (it == m_codes.constEnd()) {
+        return std::nullopt;
+    }
+    return *it;
+}
+
+bool KeysymIndex::isEmpty() const
+{
+    return m_codes.isEmpty();
+}
+
+}
@@ -0,0 +1,51 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+
+#include <QHash>
+
+#include <xkbcommon/xkbcommon.h>
+
+#include "TestsExport_p.h"
+
+namespace KRdp
+{
+
+/**
+ * Finds the key that produces a keysym in one layout of an XKB keymap, for
+ * sending Unicode input as key presses.
+ *
+ * Built once per keymap, so a lookup is a hash lookup rather than a scan
+ * over every key and level of the keymap.
+ */
+class KRDP_TESTS_EXPORT KeysymIndex
+{
+public:
+    struct Code {
+        /// Shift level the keysym is on: 0 plain, 1 shift, 2 AltGr.
+        uint32_t level = 0;
+        /// Evdev keycode (KEY_*).
+        uint32_t code = 0;
+    };
+
+    /**
+     * Index \p layout of \p keymap, replacing what was indexed before. A
+     * keysym on several keys maps to the lowest keycode and level that
+     * produces it. A null \p keymap clears the index.
+     */
+    void rebuild(xkb_keymap *keymap, xkb_layout_index_t layout = 0);
+
+    std::optional<Code> find(xkb_keysym_t keysym) const;
+
+    bool isEmpty() const;
+
+private:
+    QHash<xkb_keysym_t, Code> m_codes;
+};
+
+}
@@ -0,0 +1,131 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace KRdp
+{
+
+namespace
+{
+QString formatMilliseconds(std::chrono::microseconds value)
+{
+    return QString::number(double(value.count()) / 1000.0, 'f', 1);
+}
+}
+
+int LatencyHistogram::bucketIndex(quint64 value)
+{
+    if (value < quint64(SubBucketCount)) {
+        return int(value);
+    }
+
+    const int exponent = std::min(int(std::bit_width(value)) - 1, MaxValueBits - 1);
+    const int shift = exponent - SubBucketBits;
+    const int subBucket = int(std::min(value >> shift, quint64(2 * SubBucketCount - 1)) & (SubBucketCount - 1));
+    return SubBucketCount + shift * SubBucketCount + subBucket;
+}
+
+quint64 LatencyHistogram::bucketValue(int index)
+{
+    if (index < SubBucketCount) {
+        return quint64(index);
+    }
+
+    const int shift = (index - SubBucketCount) / SubBucketCount;
+    const int subBucket = (index - SubBucketCount) % SubBucketCount;
+    // Report the highest value that ends up in this bucket.
+    return ((quint64(SubBucketCount + subBucket) + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(std::chrono::microseconds value)
+{
+    const auto microseconds = quint64(std::max<std::chrono::microseconds::rep>(value.count(), 0));
+
+    m_buckets[bucketIndex(microseconds)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(microseconds, std::memory_order_relaxed);
+
+    auto currentMax = m_max.load(std::memory_order_relaxed);
+    while (microseconds > currentMax && !m_max.compare_exchange_weak(currentMax, microseconds, std::memory_order_relaxed)) { }
+}
+
+void LatencyHistogram::reset()
+{
+    for (auto &bucket : m_buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+quint64 LatencyHistogram::count() const
+{
+    return m_count.load(std::memory_order_relaxed);
+}
+
+std::chrono::microseconds LatencyHistogram::sum() const
+{
+    return std::chrono::microseconds(m_sum.load(std::memory_order_relaxed));
+}
+
+std::chrono::microseconds LatencyHistogram::max() const
+{
+    return std::chrono::microseconds(m_max.load(std::memory_order_relaxed));
+}
+
+std::chrono::microseconds LatencyHistogram::mean() const
+{
+    const auto total = count();
+    if (total == 0) {
+        return std::chrono::microseconds(0);
+    }
+    return std::chrono::microseconds(m_sum.load(std::memory_order_relaxed) / total);
+}
+
+std::chrono::microseconds LatencyHistogram::percentile(double percentile) const
+{
+    const auto total = count();
+    if (total == 0) {
+        return std::chrono::microseconds(0);
+    }
+
+    const auto target = std::max<quint64>(1, quint64(std::ceil(std::clamp(percentile, 0.0, 100.0) / 100.0 * double(total))));
+    quint64 seen = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if (seen >= target) {
+            return std::chrono::microseconds(std::min(bucketValue(i), quint64(max().count())));
+        }
+    }
+    return max();
+}
+
+quint64 LatencyHistogram::countAtOrBelow(std::chrono::microseconds value) const
+{
+    if (value.count() < 0) {
+        return 0;
+    }
+
+    const int last = bucketIndex(quint64(value.count()));
+    quint64 result = 0;
+    for (int i = 0; i <= last; ++i) {
+        result += m_buckets[i].load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+QString LatencyHistogram::summary() const
+{
+    return QStringLiteral("count=%1 p50=%2ms p95=%3ms p99=%4ms max=%5ms")
+        .arg(count())
+        .arg(formatMilliseconds(percentile(50)), formatMilliseconds(percentile(95)), formatMilliseconds(percentile(99)), formatMilliseconds(max()));
+}
+
+}
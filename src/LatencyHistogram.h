@@ -0,0 +1,70 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+
+#include <QString>
+
+#include "krdp_export.h"
+
+namespace KRdp
+{
+
+/**
+ * A fixed-size histogram of latency values.
+ *
+ * Values are recorded in microseconds into log-linear buckets, similar to
+ * HdrHistogram: every power of two is split into 16 buckets, so reported
+ * values are within about 6% of the recorded ones, from 1 µs up to hours.
+ *
+ * Recording is lock-free and can happen from one thread while another reads.
+ */
+class KRDP_EXPORT LatencyHistogram
+{
+public:
+    void record(std::chrono::microseconds value);
+    void reset();
+
+    quint64 count() const;
+    std::chrono::microseconds sum() const;
+    std::chrono::microseconds max() const;
+    std::chrono::microseconds mean() const;
+
+    /**
+     * The number of recorded values up to \p value.
+     *
+     * This has the same precision as the buckets.
+     */
+    quint64 countAtOrBelow(std::chrono::microseconds value) const;
+
+    /**
+     * The value below which \p percentile percent of the recorded values lie.
+     */
+    std::chrono::microseconds percentile(double percentile) const;
+
+    /**
+     * A single line summary with count, p50, p95, p99 and max, for logging.
+     */
+    QString summary() const;
+
+private:
+    static constexpr int SubBucketBits = 4;
+    static constexpr int SubBucketCount = 1 << SubBucketBits;
+    static constexpr int MaxValueBits = 36;
+    static constexpr int BucketCount = SubBucketCount + (MaxValueBits - SubBucketBits) * SubBucketCount;
+
+    static int bucketIndex(quint64 value);
+    static quint64 bucketValue(int index);
+
+    std::array<std::atomic<quint64>, BucketCount> m_buckets = {};
+    std::atomic<quint64> m_count = 0;
+    std::atomic<quint64> m_sum = 0;
+    std::atomic<quint64> m_max = 0;
+};
+
+}
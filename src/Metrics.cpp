@@ -0,0 +1,159 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "Metrics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#include <QStringList>
+
+#include "LatencyHistogram.h"
+
+namespace KRdp
+{
+
+namespace
+{
+// Bucket bounds for exported latency histograms, in milliseconds.
+constexpr double HistogramBucketBounds[] = {1, 2.5, 5, 10, 25, 50, 100, 250, 500, 1000, 2500};
+
+QString escapeLabelValue(QString value)
+{
+    value.replace(u'\\', QStringLiteral("\\\\"));
+    value.replace(u'"', QStringLiteral("\\\""));
+    value.replace(u'\n', QStringLiteral("\\n"));
+    return value;
+}
+
+QString formatLabels(const MetricsWriter::Labels &labels)
+{
+    if (labels.isEmpty()) {
+        return QString();
+    }
+
+    QStringList parts;
+    parts.reserve(labels.size());
+    for (const auto &[name, value] : labels) {
+        parts.append(QStringLiteral("%1=\"%2\"").arg(name, escapeLabelValue(value)));
+    }
+    return u'{' + parts.join(u',') + u'}';
+}
+
+QString formatValue(double value)
+{
+    if (std::isinf(value)) {
+        return value > 0 ? QStringLiteral("+Inf") : QStringLiteral("-Inf");
+    }
+    return QString::number(value, 'g', 12);
+}
+
+double toSeconds(std::chrono::microseconds value)
+{
+    return double(value.count()) / 1'000'000.0;
+}
+}
+
+MetricsWriter::Family &MetricsWriter::family(const QString &name, const QString &help, const QString &type)
+{
+    auto itr = std::find_if(m_families.begin(), m_families.end(), [&name](const Family &family) {
+        return family.name == name;
+    });
+    if (itr != m_families.end()) {
+        return *itr;
+    }
+
+    m_families.push_back(Family{
+        .name = name,
+        .help = help,
+        .type = type,
+        .samples = {},
+    });
+    return m_families.back();
+}
+
+void MetricsWriter::counter(const QString &name, const QString &help, double value, const Labels &labels)
+{
+    family(name, help, QStringLiteral("counter")).samples.push_back(Sample{.suffix = QString(), .labels = labels, .value = value});
+}
+
+void MetricsWriter::gauge(const QString &name, const QString &help, double value, const Labels &labels)
+{
+    family(name, help, QStringLiteral("gauge")).samples.push_back(Sample{.suffix = QString(), .labels = labels, .value = value});
+}
+
+void MetricsWriter::histogram(const QString &name, const QString &help, const LatencyHistogram &histogram, const Labels &labels)
+{
+    auto &samples = family(name, help, QStringLiteral("histogram")).samples;
+
+    for (auto bound : HistogramBucketBounds) {
+        auto bucketLabels = labels;
+        bucketLabels.append({QStringLiteral("le"), formatValue(bound / 1000.0)});
+        const auto count = histogram.countAtOrBelow(std::chrono::microseconds(qint64(bound * 1000.0)));
+        samples.push_back(Sample{.suffix = QStringLiteral("_bucket"), .labels = bucketLabels, .value = double(count)});
+    }
+
+    auto infLabels = labels;
+    infLabels.append({QStringLiteral("le"), formatValue(std::numeric_limits<double>::infinity())});
+    const auto count = double(histogram.count());
+    samples.push_back(Sample{.suffix = QStringLiteral("_bucket"), .labels = infLabels, .value = count});
+    samples.push_back(Sample{.suffix = QStringLiteral("_sum"), .labels = labels, .value = toSeconds(histogram.sum())});
+    samples.push_back(Sample{.suffix = QStringLiteral("_count"), .labels = labels, .value = count});
+}
+
+QString MetricsWriter::toPrometheusText() const
+{
+    QString result;
+    for (const auto &family : m_families) {
+        result += QStringLiteral("# HELP %1 %2\n").arg(family.name, family.help);
+        result += QStringLiteral("# TYPE %1 %2\n").arg(family.name, family.type);
+        for (const auto &sample : family.samples) {
+            result += family.name + sample.suffix + formatLabels(sample.labels) + u' ' + formatValue(sample.value) + u'\n';
+        }
+    }
+    return result;
+}
+
+QVariantMap MetricsWriter::toVariantMap() const
+{
+    QVariantMap result;
+    for (const auto &family : m_families) {
+        for (const auto &sample : family.samples) {
+            result.insert(family.name + sample.suffix + formatLabels(sample.labels), sample.value);
+        }
+    }
+    return result;
+}
+
+MetricsRegistry *MetricsRegistry::instance()
+{
+    static MetricsRegistry registry;
+    return &registry;
+}
+
+quint64 MetricsRegistry::addCollector(Collector collector)
+{
+    std::lock_guard lock(m_mutex);
+    const auto id = m_nextId++;
+    m_collectors.emplace(id, std::move(collector));
+    return id;
+}
+
+void MetricsRegistry::removeCollector(quint64 id)
+{
+    std::lock_guard lock(m_mutex);
+    m_collectors.erase(id);
+}
+
+void MetricsRegistry::collect(MetricsWriter &writer) const
+{
+    std::lock_guard lock(m_mutex);
+    for (const auto &[id, collector] : m_collectors) {
+        collector(writer);
+    }
+}
+
+}
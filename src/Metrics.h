@@ -0,0 +1,108 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#pragma once
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <QList>
+#include <QString>
+#include <QVariantMap>
+
+#include "krdp_export.h"
+
+namespace KRdp
+{
+
+class LatencyHistogram;
+
+/**
+ * Receives the current values of metrics while collecting them.
+ *
+ * Samples with the same name form one metric family, each sample is told
+ * apart by its labels.
+ */
+class KRDP_EXPORT MetricsWriter
+{
+public:
+    using Labels = QList<std::pair<QString, QString>>;
+
+    void counter(const QString &name, const QString &help, double value, const Labels &labels = {});
+    void gauge(const QString &name, const QString &help, double value, const Labels &labels = {});
+    /**
+     * Add a latency histogram, exported in seconds.
+     */
+    void histogram(const QString &name, const QString &help, const LatencyHistogram &histogram, const Labels &labels = {});
+
+    /**
+     * The collected metrics in the Prometheus text exposition format.
+     */
+    QString toPrometheusText() const;
+
+    /**
+     * The collected metrics as a map from sample name including labels to
+     * value, for DBus.
+     */
+    QVariantMap toVariantMap() const;
+
+private:
+    struct Sample {
+        QString suffix;
+        Labels labels;
+        double value = 0.0;
+    };
+    struct Family {
+        QString name;
+        QString help;
+        QString type;
+        std::vector<Sample> samples;
+    };
+
+    Family &family(const QString &name, const QString &help, const QString &type);
+
+    std::vector<Family> m_families;
+};
+
+/**
+ * Process wide registry of metric collectors.
+ *
+ * Components that have something to report add a collector, which is called
+ * whenever the metrics are exported. Collectors are called from the thread
+ * that exports, so they should only read values that are safe to read from
+ * there.
+ */
+class KRDP_EXPORT MetricsRegistry
+{
+public:
+    using Collector = std::function<void(MetricsWriter &writer)>;
+
+    static MetricsRegistry *instance();
+
+    /**
+     * Add a collector.
+     *
+     * \return An id to remove the collector with.
+     */
+    quint64 addCollector(Collector collector);
+
+    /**
+     * Remove a collector.
+     *
+     * Once this returns, the collector is no longer called.
+     */
+    void removeCollector(quint64 id);
+
+    void collect(MetricsWriter &writer) const;
+
+private:
+    mutable std::mutex m_mutex;
+    std::map<quint64, Collector> m_collectors;
+    quint64 m_nextId = 1;
+};
+
+}
@@ -14,7 +14,9 @@
 #include <QQueue>
 #include <QTimer>
 
+#include "FlightRecorder.h"
 #include "PeerContext_p.h"
+#include "Probes_p.h"
 #include "RdpConnection.h"
 
 #include "krdp_logging.h"
@@ -154,6 +156,9 @@ bool NetworkDetection::onRttMeasureResponse(uint16_t sequence)
         return true;
     }
 
+    const auto rttUs = qint64(clk::duration_cast<clk::microseconds>(rtt.roundTripTime).count());
+    KRDP_PROBE1(rtt_sample, rttUs);
+    FlightRecorder::record(FlightRecorder::Event::RttSample, 0, rttUs);
     d->rttMeasurements.push_back(std::move(rtt));
 
     updateAverageRtt();
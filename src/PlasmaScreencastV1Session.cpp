@@ -5,9 +5,8 @@
 #include "PlasmaScreencastV1Session.h"
 
 #include <QGuiApplication>
-#include <QMouseEvent>
+#include <QPointF>
 #include <QPointer>
-#include <QQueue>
 #include <QRect>
 #include <QRegion>
 #include <QScreen>
@@ -16,6 +15,7 @@
 
 #include <linux/input-event-codes.h>
 #include <sys/mman.h>
+#include <wayland-client.h>
 #include <wayland-util.h>
 #include <xkbcommon/xkbcommon.h>
 #include <chrono>
@@ -27,6 +27,10 @@
 #include "qwayland-wayland.h"
 #include "screencasting_p.h"
 
+#include "EncodedPacketPipeline.h"
+#include "KeysymIndex.h"
+#include "LatencyHistogram.h"
+#include "Tracing.h"
 #include "VideoStream.h"
 #include "krdp_logging.h"
 
@@ -75,41 +79,6 @@ using ScopedXKBState = std::unique_ptr<struct xkb_state, XKBStateDeleter>;
 using ScopedXKBKeymap = std::unique_ptr<struct xkb_keymap, XKBKeymapDeleter>;
 using ScopedXKBContext = std::unique_ptr<struct xkb_context, XKBContextDeleter>;
 
-struct EncodedPacketMetadata {
-    QSize size;
-    QRegion damage;
-    std::chrono::system_clock::time_point presentationTimeStamp;
-    bool hasSize = false;
-    bool hasDamage = false;
-    bool hasPresentationTimeStamp = false;
-};
-
-struct PendingEncodedPacket {
-    PipeWireEncodedStream::Packet packet;
-    std::chrono::steady_clock::time_point queuedAt;
-};
-
-constexpr int MaxPendingFrameMetadata = 128;
-constexpr int MaxPendingPacketsWithoutMetadata = 8;
-constexpr auto MetadataPairWaitBudget = std::chrono::milliseconds(12);
-
-QRegion fullFrameDamage(const QSize &size)
-{
-    if (size.isEmpty()) {
-        return {};
-    }
-    return QRegion(QRect(QPoint(0, 0), size));
-}
-
-QRegion clippedDamage(const QRegion &damage, const QSize &size)
-{
-    if (size.isEmpty()) {
-        return {};
-    }
-    auto clipped = damage.intersected(QRect(QPoint(0, 0), size));
-    return clipped.isEmpty() ? fullFrameDamage(size) : clipped;
-}
-
 QRect logicalRectForStream(int streamIndex)
 {
     const auto screens = qGuiApp->screens();
@@ -203,47 +172,13 @@ void setPreferredH264Encoder(Stream *stream)
     stream->setEncoder(encoder);
     qCDebug(KRDP) << "Using PipeWire H264 encoder profile:" << (encoder == PipeWireEncodedStream::H264Main ? "Main" : "Baseline");
 }
-
-template<typename Stream, typename Receiver, typename Callback>
-bool connectFrameMetadataIfSupported(Stream *stream, Receiver *receiver, Callback &&callback)
-{
-    if constexpr (requires {
-                      &Stream::frameMetadata;
-                  }) {
-        const auto connection = QObject::connect(stream, &Stream::frameMetadata, receiver, std::forward<Callback>(callback));
-        return static_cast<bool>(connection);
-    }
-    return false;
-}
 }
 class Xkb : public QtWayland::wl_keyboard
 {
 public:
-    struct Code {
-        const uint32_t level;
-        const uint32_t code;
-    };
-    std::optional<Code> keycodeFromKeysym(xkb_keysym_t keysym)
+    std::optional<KeysymIndex::Code> keycodeFromKeysym(xkb_keysym_t keysym) const
     {
-        /* The offset between KEY_* numbering, and keycodes in the XKB evdev
-         * dataset. */
-        static const uint EVDEV_OFFSET = 8;
-
-        auto layout = xkb_state_serialize_layout(m_state.get(), XKB_STATE_LAYOUT_EFFECTIVE);
-        const xkb_keycode_t max = xkb_keymap_max_keycode(m_keymap.get());
-        for (xkb_keycode_t keycode = xkb_keymap_min_keycode(m_keymap.get()); keycode < max; keycode++) {
-            uint levelCount = xkb_keymap_num_levels_for_key(m_keymap.get(), keycode, layout);
-            for (uint currentLevel = 0; currentLevel < levelCount; currentLevel++) {
-                const xkb_keysym_t *syms;
-                uint num_syms = xkb_keymap_key_get_syms_by_level(m_keymap.get(), keycode, layout, currentLevel, &syms);
-                for (uint sym = 0; sym < num_syms; sym++) {
-                    if (syms[sym] == keysym) {
-                        return Code{currentLevel, keycode - EVDEV_OFFSET};
-                    }
-                }
-            }
-        }
-        return {};
+        return m_index.find(keysym);
     }
 
     static Xkb *self()
@@ -270,6 +205,7 @@ private:
             qCWarning(KRDP) << "Failed to create the xkb state";
             return;
         }
+        rebuildIndex();
 
         QPlatformNativeInterface *nativeInterface = qGuiApp->platformNativeInterface();
         auto seat = static_cast<wl_seat *>(nativeInterface->nativeResourceForIntegration("wl_seat"));
@@ -298,11 +234,54 @@ private:
             m_state.reset(xkb_state_new(m_keymap.get()));
         else
             m_state.reset(nullptr);
+        rebuildIndex();
+    }
+
+    void rebuildIndex()
+    {
+        if (!m_state) {
+            m_index.rebuild(nullptr);
+            return;
+        }
+        m_index.rebuild(m_keymap.get(), xkb_state_serialize_layout(m_state.get(), XKB_STATE_LAYOUT_EFFECTIVE));
     }
 
     ScopedXKBContext m_ctx;
     ScopedXKBKeymap m_keymap;
     ScopedXKBState m_state;
+    KeysymIndex m_index;
+};
+
+/**
+ * A wl_display.sync sent after a batch of fake input requests. The
+ * compositor handles requests in order, so its done event means the batch
+ * was handled.
+ */
+class InputSync : public QtWayland::wl_callback
+{
+public:
+    InputSync(struct ::wl_callback *callback, std::function<void()> done)
+        : QtWayland::wl_callback(callback)
+        , m_done(std::move(done))
+    {
+    }
+
+    ~InputSync() override
+    {
+        wl_callback_destroy(object());
+    }
+
+protected:
+    void callback_done(uint32_t callback_data) override
+    {
+        Q_UNUSED(callback_data);
+        // The handler may delete this.
+        const auto done = std::move(m_done);
+        done();
+    }
+
+private:
+    std::function<void()> m_done;
 };
 
 class KRDP_NO_EXPORT PlasmaScreencastV1Session::Private
@@ -324,14 +303,15 @@ public:
     QPointer<QScreen> outputScreen = nullptr;
     QRect logicalRect;
     QVector<VideoMonitor> monitorLayout;
-    QQueue<EncodedPacketMetadata> pendingFrameMetadata;
-    QQueue<PendingEncodedPacket> pendingPackets;
-    bool metadataSignalAvailable = false;
-    bool metadataSeen = false;
     bool streamConfigured = false;
     bool streamSignalsConnected = false;
     bool startedSignalEmitted = false;
-    std::chrono::steady_clock::time_point lastMetadataMissLog;
+
+    wl_display *display = nullptr;
+    // At most one measurement in flight, so measuring adds one round trip
+    // per batch at most and batches sent meanwhile are not measured.
+    std::unique_ptr<InputSync> inputSync;
+    LatencyHistogram inputDelivery;
 };
 
 PlasmaScreencastV1Session::PlasmaScreencastV1Session()
@@ -339,11 +319,16 @@ PlasmaScreencastV1Session::PlasmaScreencastV1Session()
     , d(std::make_unique<Private>())
 {
     d->remoteInterface = new FakeInput();
+    QPlatformNativeInterface *nativeInterface = qGuiApp->platformNativeInterface();
+    d->display = static_cast<wl_display *>(nativeInterface->nativeResourceForIntegration("wl_display"));
 }
 
 PlasmaScreencastV1Session::~PlasmaScreencastV1Session()
 {
     qCDebug(KRDP) << "Closing Plasma Remote Session";
+    if (d->inputDelivery.count()) {
+        qCDebug(KRDP).noquote() << "Input delivery" << d->inputDelivery.summary();
+    }
 }
 
 void PlasmaScreencastV1Session::start()
@@ -409,6 +394,7 @@ bool PlasmaScreencastV1Session::setupScreencastRequest()
     const bool requiresRecreate = !d->request || targetChanged || outputChanged || logicalRectChanged;
     d->logicalRect = targetLogicalRect;
     d->monitorLayout = targetMonitorLayout;
+    packetPipeline()->setMonitorLayout(d->monitorLayout);
     if (!d->logicalRect.isEmpty()) {
         setLogicalSize(d->logicalRect.size());
     }
@@ -440,6 +426,7 @@ bool PlasmaScreencastV1Session::setupScreencastRequest()
             d->outputScreen = nullptr;
             d->logicalRect = logicalRectForStream(-1);
             d->monitorLayout = monitorLayoutForStream(-1, d->logicalRect);
+            packetPipeline()->setMonitorLayout(d->monitorLayout);
             if (!d->logicalRect.isEmpty()) {
                 setLogicalSize(d->logicalRect.size());
             }
@@ -479,6 +466,7 @@ void PlasmaScreencastV1Session::onScreencastCreated(uint nodeId)
     }
     if (d->request && !d->request->size().isEmpty()) {
         setSize(d->request->size());
+        packetPipeline()->setFrameSize(d->request->size());
     }
     qCDebug(KRDP) << "Plasma stream sizes: request" << (d->request ? d->request->size() : QSize()) << "logical" << logicalSize();
 
@@ -489,10 +477,7 @@ void PlasmaScreencastV1Session::onScreencastCreated(uint nodeId)
         encodedStream->stop();
     }
 
-    d->pendingFrameMetadata.clear();
-    d->pendingPackets.clear();
-    d->metadataSeen = false;
-    d->lastMetadataMissLog = {};
+    packetPipeline()->reset();
 
     encodedStream->setNodeId(nodeId);
     encodedStream->setEncodingPreference(PipeWireBaseEncodedStream::EncodingPreference::Speed);
@@ -503,28 +488,9 @@ void PlasmaScreencastV1Session::onScreencastCreated(uint nodeId)
     }
 
     if (!d->streamSignalsConnected) {
-        connect(encodedStream, &PipeWireEncodedStream::newPacket, this, &PlasmaScreencastV1Session::onPacketReceived);
         connect(encodedStream, &PipeWireEncodedStream::sizeChanged, this, &PlasmaScreencastV1Session::setSize);
         connect(encodedStream, &PipeWireEncodedStream::cursorChanged, this, &PlasmaScreencastV1Session::cursorUpdate);
-        d->metadataSignalAvailable = connectFrameMetadataIfSupported(encodedStream, this, [this](const auto &meta) {
-            EncodedPacketMetadata frameMetadata;
-            frameMetadata.size = meta.size;
-            frameMetadata.hasSize = !meta.size.isEmpty();
-            if (meta.hasDamage) {
-                frameMetadata.damage = meta.damage;
-                frameMetadata.hasDamage = true;
-            }
-            if (meta.hasPts) {
-                frameMetadata.presentationTimeStamp = std::chrono::system_clock::time_point{std::chrono::nanoseconds(meta.ptsNs)};
-                frameMetadata.hasPresentationTimeStamp = true;
-            }
-            d->pendingFrameMetadata.enqueue(frameMetadata);
-            while (d->pendingFrameMetadata.size() > MaxPendingFrameMetadata) {
-                d->pendingFrameMetadata.dequeue();
-            }
-            d->metadataSeen = true;
-            processPendingPackets();
-        });
+        packetPipeline()->attach(encodedStream);
         d->streamSignalsConnected = true;
     }
 
@@ -543,74 +509,66 @@ void PlasmaScreencastV1Session::onScreencastCreated(uint nodeId)
     }
 }
 
-void PlasmaScreencastV1Session::sendEvent(const std::shared_ptr<QEvent> &event)
+void PlasmaScreencastV1Session::sendInputEvents(const InputEvents &events)
 {
     auto encodedStream = stream();
     if (!encodedStream || !encodedStream->isActive()) {
         return;
     }
 
-    switch (event->type()) {
-    case QEvent::MouseButtonPress:
-    case QEvent::MouseButtonRelease: {
-        auto me = std::static_pointer_cast<QMouseEvent>(event);
-        int button = 0;
-        if (me->button() == Qt::LeftButton) {
-            button = BTN_LEFT;
-        } else if (me->button() == Qt::MiddleButton) {
-            button = BTN_MIDDLE;
-        } else if (me->button() == Qt::RightButton) {
-            button = BTN_RIGHT;
-        } else {
-            qCWarning(KRDP) << "Unsupported mouse button" << me->button();
-            return;
-        }
-        uint state = me->type() == QEvent::MouseButtonPress ? 1 : 0;
-        d->remoteInterface->button(button, state);
-        break;
-    }
-    case QEvent::MouseMove: {
-        auto me = std::static_pointer_cast<QMouseEvent>(event);
-        auto position = me->position();
-        if (size().isEmpty() || logicalSize().isEmpty()) {
-            return;
-        }
-        const auto inputWidth = std::max(1, size().width() - 1);
-        const auto inputHeight = std::max(1, size().height() - 1);
-        const auto logicalWidth = std::max(1, logicalSize().width() - 1);
-        const auto logicalHeight = std::max(1, logicalSize().height() - 1);
-        const auto normalizedX = std::clamp(position.x() / double(inputWidth), 0.0, 1.0);
-        const auto normalizedY = std::clamp(position.y() / double(inputHeight), 0.0, 1.0);
-        auto logicalPosition = QPointF{normalizedX * logicalWidth + d->logicalRect.x(), normalizedY * logicalHeight + d->logicalRect.y()};
-        d->remoteInterface->pointer_motion_absolute(wl_fixed_from_double(logicalPosition.x()), wl_fixed_from_double(logicalPosition.y()));
-        break;
-    }
-    case QEvent::Wheel: {
-        auto we = std::static_pointer_cast<QWheelEvent>(event);
-        auto delta = we->angleDelta();
-        if (delta.y() != 0) {
-            d->remoteInterface->axis(WL_POINTER_AXIS_VERTICAL_SCROLL, wl_fixed_from_double(delta.y() / 120.0));
+    const auto start = std::chrono::steady_clock::now();
+    const auto traceStart = Tracing::enabled() ? Tracing::now() : std::chrono::nanoseconds(0);
+
+    for (const auto &event : events) {
+        switch (event.type) {
+        case InputEvent::Type::PointerButton: {
+            int button = 0;
+            if (event.button() == Qt::LeftButton) {
+                button = BTN_LEFT;
+            } else if (event.button() == Qt::MiddleButton) {
+                button = BTN_MIDDLE;
+            } else if (event.button() == Qt::RightButton) {
+                button = BTN_RIGHT;
+            } else {
+                qCWarning(KRDP) << "Unsupported mouse button" << event.button();
+                continue;
+            }
+            d->remoteInterface->button(button, event.pressed ? 1 : 0);
+            break;
         }
-        if (delta.x() != 0) {
-            d->remoteInterface->axis(WL_POINTER_AXIS_HORIZONTAL_SCROLL, wl_fixed_from_double(delta.x() / 120.0));
+        case InputEvent::Type::PointerMotion: {
+            if (size().isEmpty() || logicalSize().isEmpty()) {
+                continue;
+            }
+            const auto inputWidth = std::max(1, size().width() - 1);
+            const auto inputHeight = std::max(1, size().height() - 1);
+            const auto logicalWidth = std::max(1, logicalSize().width() - 1);
+            const auto logicalHeight = std::max(1, logicalSize().height() - 1);
+            const auto normalizedX = std::clamp(event.x / double(inputWidth), 0.0, 1.0);
+            const auto normalizedY = std::clamp(event.y / double(inputHeight), 0.0, 1.0);
+            auto logicalPosition = QPointF{normalizedX * logicalWidth + d->logicalRect.x(), normalizedY * logicalHeight + d->logicalRect.y()};
+            d->remoteInterface->pointer_motion_absolute(wl_fixed_from_double(logicalPosition.x()), wl_fixed_from_double(logicalPosition.y()));
+            break;
         }
-        break;
-    }
-    case QEvent::KeyPress:
-    case QEvent::KeyRelease: {
-        auto ke = std::static_pointer_cast<QKeyEvent>(event);
-        auto state = ke->type() == QEvent::KeyPress ? 1 : 0;
-
-        if (ke->nativeScanCode()) {
-            d->remoteInterface->keyboard_key(ke->nativeScanCode(), state);
-        } else {
-            auto keycode = Xkb::self()->keycodeFromKeysym(ke->nativeVirtualKey());
+        case InputEvent::Type::PointerAxis:
+            if (event.deltaY != 0) {
+                d->remoteInterface->axis(WL_POINTER_AXIS_VERTICAL_SCROLL, wl_fixed_from_double(event.deltaY / 120.0));
+            }
+            if (event.deltaX != 0) {
+                d->remoteInterface->axis(WL_POINTER_AXIS_HORIZONTAL_SCROLL, wl_fixed_from_double(event.deltaX / 120.0));
+            }
+            break;
+        case InputEvent::Type::Key:
+            d->remoteInterface->keyboard_key(event.code, event.pressed ? 1 : 0);
+            break;
+        case InputEvent::Type::KeySym: {
+            auto keycode = Xkb::self()->keycodeFromKeysym(event.code);
             if (!keycode) {
-                qCWarning(KRDP) << "Failed to convert keysym into keycode" << ke->nativeVirtualKey();
-                return;
+                qCWarning(KRDP) << "Failed to convert keysym into keycode" << event.code;
+                continue;
             }
 
-            auto sendKey = [this, state](int keycode) {
+            auto sendKey = [this, state = event.pressed ? 1 : 0](int keycode) {
                 d->remoteInterface->keyboard_key(keycode, state);
             };
             switch (keycode->level) {
@@ -627,97 +585,38 @@ void PlasmaScreencastV1Session::sendEvent(const std::shared_ptr<QEvent> &event)
                 break;
             }
             sendKey(keycode->code);
+            break;
+        }
         }
-        break;
-    }
-    default:
-        break;
     }
-}
-
-void PlasmaScreencastV1Session::setClipboardData(std::unique_ptr<QMimeData> data)
-{
-    Q_UNUSED(data);
-}
 
-void PlasmaScreencastV1Session::processPendingPackets()
-{
-    auto emitFrame = [this](const PipeWireEncodedStream::Packet &packet, const EncodedPacketMetadata *metadata) {
-        VideoFrame frameData;
-        frameData.size = size();
-        frameData.data = packet.data();
-        frameData.isKeyFrame = packet.isKeyFrame();
-        frameData.monitors = d->monitorLayout;
-        frameData.damage = fullFrameDamage(frameData.size);
-
-        if (frameData.monitors.isEmpty() && !frameData.size.isEmpty()) {
-            frameData.monitors.push_back(VideoMonitor{
-                .geometry = QRect(QPoint(0, 0), frameData.size),
-                .primary = true,
-            });
-        }
+    if (!d->display) {
+        return;
+    }
 
-        const bool metadataApplied = metadata != nullptr;
-        if (metadata) {
-            if (metadata->hasSize && !metadata->size.isEmpty()) {
-                frameData.size = metadata->size;
+    if (!d->inputSync) {
+        d->inputSync = std::make_unique<InputSync>(wl_display_sync(d->display), [this, start, traceStart]() {
+            d->inputDelivery.record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start));
+            if (Tracing::enabled() && traceStart.count()) {
+                Tracing::recordSlice("input.delivery", traceStart, Tracing::now(), -1);
             }
-            if (metadata->hasPresentationTimeStamp) {
-                frameData.presentationTimeStamp = metadata->presentationTimeStamp;
-            }
-            if (metadata->hasDamage) {
-                frameData.damage = clippedDamage(metadata->damage, frameData.size);
-            }
-        }
-
-        if (!metadataApplied || frameData.isKeyFrame || frameData.damage.isEmpty()) {
-            frameData.damage = fullFrameDamage(frameData.size);
-        }
-
-        Q_EMIT frameReceived(frameData);
-    };
-
-    while (!d->pendingPackets.isEmpty()) {
-        if (!d->pendingFrameMetadata.isEmpty()) {
-            auto packet = d->pendingPackets.dequeue().packet;
-            auto metadata = d->pendingFrameMetadata.dequeue();
-            emitFrame(packet, &metadata);
-            continue;
-        }
-
-        auto pendingPacket = d->pendingPackets.head();
-        const bool shouldSendWithoutMetadata = !d->metadataSignalAvailable || !d->metadataSeen || pendingPacket.packet.isKeyFrame();
-        if (shouldSendWithoutMetadata) {
-            d->pendingPackets.dequeue();
-            emitFrame(pendingPacket.packet, nullptr);
-            continue;
-        }
+            d->inputSync.reset();
+        });
+    }
 
-        const auto now = std::chrono::steady_clock::now();
-        const bool waitedTooLong = (now - pendingPacket.queuedAt) >= MetadataPairWaitBudget;
-        const bool queueTooDeep = d->pendingPackets.size() > MaxPendingPacketsWithoutMetadata;
-        if (waitedTooLong || queueTooDeep) {
-            if (d->lastMetadataMissLog.time_since_epoch().count() == 0 || (now - d->lastMetadataMissLog) >= std::chrono::seconds(2)) {
-                qCDebug(KRDP) << "No matching damage metadata for encoded packet, using full-frame update";
-                d->lastMetadataMissLog = now;
-            }
-            d->pendingPackets.dequeue();
-            emitFrame(pendingPacket.packet, nullptr);
-            continue;
-        }
+    // Requests otherwise wait in the client buffer until Qt flushes the
+    // display on its next event loop pass.
+    wl_display_flush(d->display);
+}
 
-        // Leave packet queued briefly so late metadata can still be paired.
-        break;
-    }
+const LatencyHistogram *PlasmaScreencastV1Session::inputDeliveryLatency() const
+{
+    return &d->inputDelivery;
 }
 
-void PlasmaScreencastV1Session::onPacketReceived(const PipeWireEncodedStream::Packet &data)
+void PlasmaScreencastV1Session::setClipboardData(std::unique_ptr<QMimeData> data)
 {
-    d->pendingPackets.enqueue(PendingEncodedPacket{
-        .packet = data,
-        .queuedAt = std::chrono::steady_clock::now(),
-    });
-    processPendingPackets();
+    Q_UNUSED(data);
 }
 
 }
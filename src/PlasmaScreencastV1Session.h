@@ -36,14 +36,13 @@ public:
     void start() override;
     void refreshDisplayConfiguration() override;
 
-    void sendEvent(const std::shared_ptr<QEvent> &event) override;
+    void sendInputEvents(const InputEvents &events) override;
+    const LatencyHistogram *inputDeliveryLatency() const override;
     void setClipboardData(std::unique_ptr<QMimeData> data) override;
 
 private:
     bool setupScreencastRequest();
     void onScreencastCreated(uint nodeId);
-    void processPendingPackets();
-    void onPacketReceived(const PipeWireEncodedStream::Packet &data);
 
     class Private;
     const std::unique_ptr<Private> d;
@@ -6,8 +6,7 @@
 
 #include <QGuiApplication>
 #include <QMimeData>
-#include <QMouseEvent>
-#include <QQueue>
+#include <QPointF>
 #include <QRect>
 
 #include <linux/input.h>
@@ -19,6 +18,10 @@
 #include <KSharedConfig>
 #include <KSystemClipboard>
 
+#include "EncodedPacketPipeline.h"
+#ifdef WITH_LIBEI
+#include "EisSender.h"
+#endif
 #include "PortalSession_p.h"
 #include "VideoFrame.h"
 #include "krdp_logging.h"
@@ -38,39 +41,20 @@ static const QString dbusSessionInterface = QStringLiteral("org.freedesktop.port
 
 namespace
 {
-struct EncodedPacketMetadata {
-    QSize size;
-    QRegion damage;
-    std::chrono::system_clock::time_point presentationTimeStamp;
-    bool hasSize = false;
-    bool hasDamage = false;
-    bool hasPresentationTimeStamp = false;
-};
-
-struct PendingEncodedPacket {
-    PipeWireEncodedStream::Packet packet;
-    std::chrono::steady_clock::time_point queuedAt;
-};
-
-constexpr int MaxPendingFrameMetadata = 128;
-constexpr int MaxPendingPacketsWithoutMetadata = 8;
-constexpr auto MetadataPairWaitBudget = std::chrono::milliseconds(12);
-
-QRegion fullFrameDamage(const QSize &size)
+QString storedRestoreToken()
 {
-    if (size.isEmpty()) {
-        return {};
-    }
-    return QRegion(QRect(QPoint(0, 0), size));
-}
+    // name is set explicitly as this is also used by the KCM
+    KConfigGroup restorationGroup = KSharedConfig::openStateConfig(QStringLiteral("krdp-serverstaterc"))->group(QStringLiteral("General"));
+    QString restoreToken = restorationGroup.readEntry(QStringLiteral("restorationToken"));
 
-QRegion clippedDamage(const QRegion &damage, const QSize &size)
-{
-    if (size.isEmpty()) {
-        return {};
-    }
-    auto clipped = damage.intersected(QRect(QPoint(0, 0), size));
-    return clipped.isEmpty() ? fullFrameDamage(size) : clipped;
+    // this is a compatibility path for krdp < 6.3 that used a different name and in .config
+    // in 6.4 onwards it can be killed
+    if (restoreToken.isEmpty()) {
+        KConfigGroup restorationGroup = KSharedConfig::openConfig(QStringLiteral("krdp-serverrc"))->group(QStringLiteral("General"));
+        restoreToken = restorationGroup.readEntry(QStringLiteral("restorationToken"));
+    } // end compat
+
+    return restoreToken;
 }
 
 template<typename Stream>
@@ -111,18 +95,6 @@ void setPreferredH264Encoder(Stream *stream)
     stream->setEncoder(encoder);
     qCDebug(KRDP) << "Using PipeWire H264 encoder profile:" << (encoder == PipeWireEncodedStream::H264Main ? "Main" : "Baseline");
 }
-
-template<typename Stream, typename Receiver, typename Callback>
-bool connectFrameMetadataIfSupported(Stream *stream, Receiver *receiver, Callback &&callback)
-{
-    if constexpr (requires {
-                      &Stream::frameMetadata;
-                  }) {
-        const auto connection = QObject::connect(stream, &Stream::frameMetadata, receiver, std::forward<Callback>(callback));
-        return static_cast<bool>(connection);
-    }
-    return false;
-}
 }
 
 const QDBusArgument &operator>>(const QDBusArgument &arg, PortalSessionStream &stream)
@@ -175,12 +147,13 @@ public:
     bool ignoreNextSystemClipboardChange = false;
 
     QDBusObjectPath sessionPath;
-    QQueue<EncodedPacketMetadata> pendingFrameMetadata;
-    QQueue<PendingEncodedPacket> pendingPackets;
-    bool metadataSignalAvailable = false;
-    bool metadataSeen = false;
-    std::chrono::steady_clock::time_point lastMetadataMissLog;
-    QVector<VideoMonitor> monitorLayout;
+
+#ifdef WITH_LIBEI
+    void connectToEis(PortalSession *session, const QString &mappingId);
+
+    // Input goes through EIS instead of the Notify* calls once this exists.
+    std::unique_ptr<EisSender> eis;
+#endif
 };
 
 QString createHandleToken()
@@ -228,9 +201,26 @@ PortalSession::~PortalSession()
 {
     // Make sure to clear any modifier keys that were pressed when the session closed, otherwise
     // we risk those keys getting stuck and the original session becoming unusable.
-    for (auto keycode : {KEY_LEFTCTRL, KEY_RIGHTCTRL, KEY_LEFTSHIFT, KEY_RIGHTSHIFT, KEY_LEFTALT, KEY_RIGHTALT, KEY_LEFTMETA, KEY_RIGHTMETA}) {
-        auto call = d->remoteInterface->NotifyKeyboardKeycode(d->sessionPath, QVariantMap{}, keycode, 0);
-        call.waitForFinished();
+    const auto modifiers = {KEY_LEFTCTRL, KEY_RIGHTCTRL, KEY_LEFTSHIFT, KEY_RIGHTSHIFT, KEY_LEFTALT, KEY_RIGHTALT, KEY_LEFTMETA, KEY_RIGHTMETA};
+    bool releasedModifiers = false;
+#ifdef WITH_LIBEI
+    if (d->eis) {
+        // The portal refuses NotifyKeyboard* calls once input goes through EIS.
+        InputEvents releases;
+        for (auto keycode : modifiers) {
+            releases.append(InputEvent{.type = InputEvent::Type::Key, .pressed = false, .code = uint32_t(keycode)});
+        }
+        d->eis->send(releases, size());
+        // Stops emulating on the devices before they are released.
+        d->eis.reset();
+        releasedModifiers = true;
+    }
+#endif
+    if (!releasedModifiers) {
+        for (auto keycode : modifiers) {
+            auto call = d->remoteInterface->NotifyKeyboardKeycode(d->sessionPath, QVariantMap{}, keycode, 0);
+            call.waitForFinished();
+        }
     }
 
     auto closeMessage = QDBusMessage::createMethodCall(dbusService, d->sessionPath.path(), dbusSessionInterface, QStringLiteral("Close"));
@@ -250,67 +240,66 @@ void PortalSession::start()
     new PortalRequest(d->remoteInterface->CreateSession(parameters), this, &PortalSession::onCreateSession);
 }
 
-void PortalSession::sendEvent(const std::shared_ptr<QEvent> &event)
+void PortalSession::sendInputEvents(const InputEvents &events)
 {
     auto encodedStream = stream();
     if (!encodedStream || !encodedStream->isActive()) {
         return;
     }
 
-    switch (event->type()) {
-    case QEvent::MouseButtonPress:
-    case QEvent::MouseButtonRelease: {
-        auto me = std::static_pointer_cast<QMouseEvent>(event);
-        int button = 0;
-        if (me->button() == Qt::LeftButton) {
-            button = BTN_LEFT;
-        } else if (me->button() == Qt::MiddleButton) {
-            button = BTN_MIDDLE;
-        } else if (me->button() == Qt::RightButton) {
-            button = BTN_RIGHT;
-        } else {
-            qCWarning(KRDP) << "Unsupported mouse button" << me->button();
-            return;
-        }
-        uint state = me->type() == QEvent::MouseButtonPress ? 1 : 0;
-        d->remoteInterface->NotifyPointerButton(d->sessionPath, QVariantMap{}, button, state);
-        break;
-    }
-    case QEvent::MouseMove: {
-        auto me = std::static_pointer_cast<QMouseEvent>(event);
-        auto position = me->position();
-        auto logicalPosition = QPointF{(position.x() / size().width()) * logicalSize().width(), (position.y() / size().height()) * logicalSize().height()};
-        d->remoteInterface->NotifyPointerMotionAbsolute(d->sessionPath, QVariantMap{}, encodedStream->nodeId(), logicalPosition.x(), logicalPosition.y());
-        break;
+#ifdef WITH_LIBEI
+    if (d->eis) {
+        d->eis->send(events, size());
+        return;
     }
-    case QEvent::Wheel: {
-        auto we = std::static_pointer_cast<QWheelEvent>(event);
-        auto delta = we->angleDelta();
-        if (delta.y() != 0) {
-            d->remoteInterface->NotifyPointerAxisDiscrete(d->sessionPath, QVariantMap{}, 0 /* Vertical */, delta.y() / 120);
+#endif
+
+    for (const auto &event : events) {
+        switch (event.type) {
+        case InputEvent::Type::PointerButton: {
+            int button = 0;
+            if (event.button() == Qt::LeftButton) {
+                button = BTN_LEFT;
+            } else if (event.button() == Qt::MiddleButton) {
+                button = BTN_MIDDLE;
+            } else if (event.button() == Qt::RightButton) {
+                button = BTN_RIGHT;
+            } else {
+                qCWarning(KRDP) << "Unsupported mouse button" << event.button();
+                continue;
+            }
+            d->remoteInterface->NotifyPointerButton(d->sessionPath, QVariantMap{}, button, event.pressed ? 1 : 0);
+            break;
         }
-        if (delta.x() != 0) {
-            d->remoteInterface->NotifyPointerAxisDiscrete(d->sessionPath, QVariantMap{}, 1 /* Horizontal */, delta.x() / 120);
+        case InputEvent::Type::PointerMotion: {
+            auto logicalPosition =
+                QPointF{(event.x / double(size().width())) * logicalSize().width(), (event.y / double(size().height())) * logicalSize().height()};
+            d->remoteInterface->NotifyPointerMotionAbsolute(d->sessionPath, QVariantMap{}, encodedStream->nodeId(), logicalPosition.x(), logicalPosition.y());
+            break;
         }
-        break;
-    }
-    case QEvent::KeyPress:
-    case QEvent::KeyRelease: {
-        auto ke = std::static_pointer_cast<QKeyEvent>(event);
-        auto state = ke->type() == QEvent::KeyPress ? 1 : 0;
-
-        if (ke->nativeScanCode()) {
-            d->remoteInterface->NotifyKeyboardKeycode(d->sessionPath, QVariantMap{}, ke->nativeScanCode(), state);
-        } else {
-            d->remoteInterface->NotifyKeyboardKeysym(d->sessionPath, QVariantMap{}, ke->nativeVirtualKey(), state);
+        case InputEvent::Type::PointerAxis:
+            if (event.deltaY / 120 != 0) {
+                d->remoteInterface->NotifyPointerAxisDiscrete(d->sessionPath, QVariantMap{}, 0 /* Vertical */, event.deltaY / 120);
+            }
+            if (event.deltaX / 120 != 0) {
+                d->remoteInterface->NotifyPointerAxisDiscrete(d->sessionPath, QVariantMap{}, 1 /* Horizontal */, event.deltaX / 120);
+            }
+            break;
+        case InputEvent::Type::Key:
+            d->remoteInterface->NotifyKeyboardKeycode(d->sessionPath, QVariantMap{}, event.code, event.pressed ? 1 : 0);
+            break;
+        case InputEvent::Type::KeySym:
+            d->remoteInterface->NotifyKeyboardKeysym(d->sessionPath, QVariantMap{}, event.code, event.pressed ? 1 : 0);
+            break;
         }
-        break;
-    }
-    default:
-        break;
     }
 }
 
+bool PortalSession::hasRestoreToken()
+{
+    return !storedRestoreToken().isEmpty();
+}
+
 void PortalSession::setClipboardData(std::unique_ptr<QMimeData> data)
 {
     // KSystemClipboard takes ownership
@@ -338,17 +327,7 @@ void PortalSession::onCreateSession(uint code, const QVariantMap &result)
         {QStringLiteral("handle_token"), createHandleToken()},
         {QStringLiteral("persist_mode"), PermissionsPersistUntilExplicitlyRevoked},
     };
-    // name is set explicitly as this is also used by the KCM
-    KConfigGroup restorationGroup = KSharedConfig::openStateConfig(QStringLiteral("krdp-serverstaterc"))->group(QStringLiteral("General"));
-    QString restoreToken = restorationGroup.readEntry(QStringLiteral("restorationToken"));
-
-    // this is a compatibility path for krdp < 6.3 that used a different name and in .config
-    // in 6.4 onwards it can be killed
-    if (restoreToken.isEmpty()) {
-        KConfigGroup restorationGroup = KSharedConfig::openConfig(QStringLiteral("krdp-serverrc"))->group(QStringLiteral("General"));
-        restoreToken = restorationGroup.readEntry(QStringLiteral("restorationToken"));
-    } // end compat
-
+    const QString restoreToken = storedRestoreToken();
     if (!restoreToken.isEmpty()) {
         parameters[QStringLiteral("restore_token")] = restoreToken;
     }
@@ -426,18 +405,16 @@ void KRdp::PortalSession::onSessionStarted(uint code, const QVariantMap &result)
             auto stream = streams.at(activeStream() >= 0 ? activeStream() : 0);
 
             setLogicalSize(qdbus_cast<QSize>(stream.map.value(u"size"_s)));
-            d->monitorLayout = {
+            auto pipeline = packetPipeline();
+            pipeline->setMonitorLayout({
                 VideoMonitor{
                     .geometry = QRect(QPoint(0, 0), logicalSize()),
                     .primary = true,
                 },
-            };
+            });
             auto fd = reply.value();
             auto encodedStream = this->stream();
-            d->pendingFrameMetadata.clear();
-            d->pendingPackets.clear();
-            d->metadataSeen = false;
-            d->lastMetadataMissLog = {};
+            pipeline->reset();
             encodedStream->setNodeId(stream.nodeId);
             encodedStream->setFd(fd.takeFileDescriptor());
             encodedStream->setEncodingPreference(PipeWireBaseEncodedStream::EncodingPreference::Speed);
@@ -445,28 +422,9 @@ void KRdp::PortalSession::onSessionStarted(uint code, const QVariantMap &result)
             setFullColorRangeIfSupported(encodedStream);
             setPreferredH264Encoder(encodedStream);
             enableDamageMetadataIfSupported(encodedStream);
-            connect(encodedStream, &PipeWireEncodedStream::newPacket, this, &PortalSession::onPacketReceived);
             connect(encodedStream, &PipeWireEncodedStream::sizeChanged, this, &PortalSession::setSize);
             connect(encodedStream, &PipeWireEncodedStream::cursorChanged, this, &PortalSession::cursorUpdate);
-            d->metadataSignalAvailable = connectFrameMetadataIfSupported(encodedStream, this, [this](const auto &meta) {
-                EncodedPacketMetadata frameMetadata;
-                frameMetadata.size = meta.size;
-                frameMetadata.hasSize = !meta.size.isEmpty();
-                if (meta.hasDamage) {
-                    frameMetadata.damage = meta.damage;
-                    frameMetadata.hasDamage = true;
-                }
-                if (meta.hasPts) {
-                    frameMetadata.presentationTimeStamp = std::chrono::system_clock::time_point{std::chrono::nanoseconds(meta.ptsNs)};
-                    frameMetadata.hasPresentationTimeStamp = true;
-                }
-                d->pendingFrameMetadata.enqueue(frameMetadata);
-                while (d->pendingFrameMetadata.size() > MaxPendingFrameMetadata) {
-                    d->pendingFrameMetadata.dequeue();
-                }
-                d->metadataSeen = true;
-                processPendingPackets();
-            });
+            pipeline->attach(encodedStream);
             QDBusConnection::sessionBus().connect(u"org.freedesktop.portal.Desktop"_s,
                                                   d->sessionPath.path(),
                                                   u"org.freedesktop.portal.Session"_s,
@@ -474,6 +432,10 @@ void KRdp::PortalSession::onSessionStarted(uint code, const QVariantMap &result)
                                                   this,
                                                   SLOT(onSessionClosed()));
 
+#ifdef WITH_LIBEI
+            d->connectToEis(this, stream.map.value(u"mapping_id"_s).toString());
+#endif
+
             setStarted(true);
         } else {
             qCWarning(KRDP) << "Could not open pipewire remote";
@@ -483,90 +445,49 @@ void KRdp::PortalSession::onSessionStarted(uint code, const QVariantMap &result)
     });
 }
 
-void PortalSession::onSessionClosed()
+#ifdef WITH_LIBEI
+void PortalSession::Private::connectToEis(PortalSession *session, const QString &mappingId)
 {
-    qCWarning(KRDP) << "Portal session was closed!";
-    Q_EMIT error();
-}
-
-void PortalSession::processPendingPackets()
-{
-    auto emitFrame = [this](const PipeWireEncodedStream::Packet &packet, const EncodedPacketMetadata *metadata) {
-        VideoFrame frameData;
-        frameData.size = size();
-        frameData.data = packet.data();
-        frameData.isKeyFrame = packet.isKeyFrame();
-        frameData.monitors = d->monitorLayout;
-        frameData.damage = fullFrameDamage(frameData.size);
-
-        if (frameData.monitors.isEmpty() && !frameData.size.isEmpty()) {
-            frameData.monitors.push_back(VideoMonitor{
-                .geometry = QRect(QPoint(0, 0), frameData.size),
-                .primary = true,
-            });
-        }
-
-        const bool metadataApplied = metadata != nullptr;
-        if (metadata) {
-            if (metadata->hasSize && !metadata->size.isEmpty()) {
-                frameData.size = metadata->size;
-            }
-            if (metadata->hasPresentationTimeStamp) {
-                frameData.presentationTimeStamp = metadata->presentationTimeStamp;
-            }
-            if (metadata->hasDamage) {
-                frameData.damage = clippedDamage(metadata->damage, frameData.size);
-            }
-        }
-
-        if (!metadataApplied || frameData.isKeyFrame || frameData.damage.isEmpty()) {
-            frameData.damage = fullFrameDamage(frameData.size);
-        }
-
-        Q_EMIT frameReceived(frameData);
-    };
-
-    while (!d->pendingPackets.isEmpty()) {
-        if (!d->pendingFrameMetadata.isEmpty()) {
-            auto packet = d->pendingPackets.dequeue().packet;
-            auto metadata = d->pendingFrameMetadata.dequeue();
-            emitFrame(packet, &metadata);
-            continue;
-        }
+    // KRDP_PORTAL_INPUT=dbus keeps the Notify* calls, for comparison.
+    if (qEnvironmentVariable("KRDP_PORTAL_INPUT") == u"dbus"_s) {
+        qCDebug(KRDP) << "Sending input over DBus, as requested by KRDP_PORTAL_INPUT";
+        return;
+    }
 
-        auto pendingPacket = d->pendingPackets.head();
-        const bool shouldSendWithoutMetadata = !d->metadataSignalAvailable || !d->metadataSeen || pendingPacket.packet.isKeyFrame();
-        if (shouldSendWithoutMetadata) {
-            d->pendingPackets.dequeue();
-            emitFrame(pendingPacket.packet, nullptr);
-            continue;
-        }
+    if (remoteInterface->version() < 2) {
+        qCDebug(KRDP) << "Remote desktop portal has no ConnectToEIS, sending input over DBus";
+        return;
+    }
 
-        const auto now = std::chrono::steady_clock::now();
-        const bool waitedTooLong = (now - pendingPacket.queuedAt) >= MetadataPairWaitBudget;
-        const bool queueTooDeep = d->pendingPackets.size() > MaxPendingPacketsWithoutMetadata;
-        if (waitedTooLong || queueTooDeep) {
-            if (d->lastMetadataMissLog.time_since_epoch().count() == 0 || (now - d->lastMetadataMissLog) >= std::chrono::seconds(2)) {
-                qCDebug(KRDP) << "No matching damage metadata for encoded packet, using full-frame update";
-                d->lastMetadataMissLog = now;
-            }
-            d->pendingPackets.dequeue();
-            emitFrame(pendingPacket.packet, nullptr);
-            continue;
-        }
+    // Synchronous, so no input is sent over DBus after the portal switched
+    // the session to EIS.
+    QDBusReply<QDBusUnixFileDescriptor> reply = remoteInterface->ConnectToEIS(sessionPath, QVariantMap{});
+    if (!reply.isValid()) {
+        qCDebug(KRDP) << "Could not connect to EIS, sending input over DBus:" << reply.error().message();
+        return;
+    }
 
-        // Leave packet queued briefly so late metadata can still be paired.
-        break;
+    auto sender = std::make_unique<EisSender>();
+    sender->setMappingId(mappingId);
+    if (!sender->connectToFd(reply.value().takeFileDescriptor())) {
+        qCWarning(KRDP) << "Could not set up libei, input is unavailable";
+        Q_EMIT session->error();
+        return;
     }
+
+    QObject::connect(sender.get(), &EisSender::ready, session, []() {
+        qCDebug(KRDP) << "Sending input through EIS";
+    });
+    // The portal expects the session to end with its EIS connection.
+    QObject::connect(sender.get(), &EisSender::disconnected, session, &PortalSession::error);
+    eis = std::move(sender);
 }
+#endif
 
-void PortalSession::onPacketReceived(const PipeWireEncodedStream::Packet &data)
+void PortalSession::onSessionClosed()
 {
-    d->pendingPackets.enqueue(PendingEncodedPacket{
-        .packet = data,
-        .queuedAt = std::chrono::steady_clock::now(),
-    });
-    processPendingPackets();
+    qCWarning(KRDP) << "Portal session was closed!";
+    Q_EMIT error();
 }
 
 }
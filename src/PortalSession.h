@@ -43,17 +43,23 @@ public:
      *
      * \param event The new event to send.
      */
-    void sendEvent(const std::shared_ptr<QEvent> &event) override;
+    void sendInputEvents(const InputEvents &events) override;
 
     void setClipboardData(std::unique_ptr<QMimeData> data) override;
 
+    /**
+     * Whether a restore token from a previous session is available.
+     *
+     * Without one, starting a session makes the portal ask the user for
+     * permission to share the screen.
+     */
+    static bool hasRestoreToken();
+
 private:
     void onCreateSession(uint code, const QVariantMap &result);
     void onDevicesSelected(uint code, const QVariantMap &result);
     void onSourcesSelected(uint code, const QVariantMap &result);
     void onSessionStarted(uint code, const QVariantMap &result);
-    void processPendingPackets();
-    void onPacketReceived(const PipeWireEncodedStream::Packet &data);
     Q_SLOT void onSessionClosed();
 
     class Private;
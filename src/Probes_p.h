@@ -0,0 +1,53 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#pragma once
+
+// Statically defined tracing (USDT) probes in the "krdp" provider.
+//
+// A probe is a single nop until a tracer attaches to it, for example:
+//
+//   bpftrace -e 'usdt:/usr/lib64/libKRdp.so.6:krdp:frame_send { @bytes = hist(arg1); }'
+//
+// Probes compile to nothing when sys/sdt.h was not available at build time.
+//
+// Probes and their arguments:
+//   frame_queue(uint64 bytes, int32 queue_depth)
+//   frame_drop(int32 reason) - 0: stale in the submission queue, 1: submission queue full
+//   frame_send(uint32 frame_id, uint64 bytes, int64 capture_age_us) - age is -1 when unknown
+//   frame_ack(uint32 frame_id, int64 ack_latency_us, uint32 client_queue_depth)
+//   frame_refinement(uint32 frame_id)
+//   rtt_sample(int64 rtt_us)
+//   input_event(int32 kind, uint32 flags, uint32 code_or_x, uint32 y) - kind: 0 mouse, 1 extended mouse, 2 keyboard, 3 unicode keyboard, 4 synchronize
+//   cursor_update(int32 width, int32 height, int32 hotspot_x, int32 hotspot_y)
+
+#ifdef KRDP_HAVE_SDT
+#include <sys/sdt.h>
+
+#define KRDP_PROBE1(name, a) STAP_PROBE1(krdp, name, a)
+#define KRDP_PROBE2(name, a, b) STAP_PROBE2(krdp, name, a, b)
+#define KRDP_PROBE3(name, a, b, c) STAP_PROBE3(krdp, name, a, b, c)
+#define KRDP_PROBE4(name, a, b, c, d) STAP_PROBE4(krdp, name, a, b, c, d)
+#else
+#define KRDP_PROBE1(name, a)
+#define KRDP_PROBE2(name, a, b)
+#define KRDP_PROBE3(name, a, b, c)
+#define KRDP_PROBE4(name, a, b, c, d)
+#endif
+
+namespace KRdp
+{
+enum class ProbeDropReason : int {
+    Stale = 0,
+    QueueFull = 1,
+};
+
+enum class ProbeInputKind : int {
+    Mouse = 0,
+    ExtendedMouse = 1,
+    Keyboard = 2,
+    UnicodeKeyboard = 3,
+    Synchronize = 4,
+};
+}
@@ -9,11 +9,18 @@
 
 #include "RdpConnection.h"
 
+#include <atomic>
+#include <condition_variable>
 #include <filesystem>
+#include <mutex>
 #include <optional>
+#include <thread>
+#include <utility>
 #include <vector>
 
+#include <QCryptographicHash>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QHostAddress>
 #include <QStandardPaths>
@@ -271,6 +278,44 @@ static int pamAuthenticate(const QString &user, const QString &password)
     return 1;
 }
 
+// PAM takes seconds to reject a wrong password, so it runs on a thread of its
+// own that nothing waits for when the client goes away. Only a hash of the
+// password is kept, to check the credentials did not change meanwhile.
+struct PamAuthentication {
+    QString userName;
+    QByteArray passwordHash;
+
+    std::mutex mutex;
+    std::condition_variable_any finished;
+    std::optional<bool> succeeded;
+};
+
+static QByteArray pamPasswordHash(const QString &password)
+{
+    return QCryptographicHash::hash(password.toUtf8(), QCryptographicHash::Sha256);
+}
+
+static std::shared_ptr<PamAuthentication> startPamWorker(const QString &userName, QString password)
+{
+    auto authentication = std::make_shared<PamAuthentication>();
+    authentication->userName = userName;
+    authentication->passwordHash = pamPasswordHash(password);
+
+    std::thread worker([authentication, password = std::move(password)]() mutable {
+        const bool succeeded = pamAuthenticate(authentication->userName, password) >= 0;
+        password.fill(QChar(0));
+        password.clear();
+        {
+            std::lock_guard lock(authentication->mutex);
+            authentication->succeeded = succeeded;
+        }
+        authentication->finished.notify_all();
+    });
+    pthread_setname_np(worker.native_handle(), "krdp_pam");
+    worker.detach();
+    return authentication;
+}
+
 /**
  * FreeRDP callback for the capabilities event.
  */
@@ -284,6 +329,22 @@ BOOL peerCapabilities(freerdp_peer *peer)
     return FALSE;
 }
 
+/**
+ * FreeRDP callback for the logon event.
+ *
+ * Without NLA this is called right after security negotiation, before the
+ * client sent its credentials in the Client Info PDU.
+ */
+BOOL peerLogon(freerdp_peer *peer, const SEC_WINNT_AUTH_IDENTITY *, BOOL)
+{
+    auto context = reinterpret_cast<PeerContext *>(peer->context);
+    if (context->connection->onLogon()) {
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
 /**
  * FreeRDP callback for the post connect event.
  */
@@ -325,7 +386,8 @@ class KRDP_NO_EXPORT RdpConnection::Private
 public:
     Server *server = nullptr;
 
-    State state = State::Initial;
+    // Read by the media threads queueing frames.
+    std::atomic<State> state = State::Initial;
 
     qintptr socketHandle;
 
@@ -337,6 +399,16 @@ public:
 
     freerdp_peer *peer = nullptr;
 
+    QString userName;
+
+    // PAM authentication started from onCapabilities().
+    std::shared_ptr<PamAuthentication> pamAuthentication;
+
+    std::mutex setupTimelineMutex;
+    QElapsedTimer setupTimer;
+    std::vector<std::pair<const char *, qint64>> setupTimeline;
+    bool setupTimelineCompleted = false;
+
     std::jthread thread;
 };
 
@@ -346,6 +418,7 @@ RdpConnection::RdpConnection(Server *server, qintptr socketHandle)
 {
     d->server = server;
     d->socketHandle = socketHandle;
+    d->setupTimer.start();
 
     d->inputHandler = std::make_unique<InputHandler>(this);
     d->videoStream = std::make_unique<VideoStream>(this);
@@ -433,6 +506,52 @@ NetworkDetection *RdpConnection::networkDetection() const
     return d->networkDetection.get();
 }
 
+QString RdpConnection::userName() const
+{
+    return d->userName;
+}
+
+void RdpConnection::markSetupStage(const char *stage)
+{
+    std::lock_guard lock(d->setupTimelineMutex);
+    if (d->setupTimelineCompleted) {
+        return;
+    }
+
+    auto itr = std::find_if(d->setupTimeline.cbegin(), d->setupTimeline.cend(), [stage](const auto &entry) {
+        return qstrcmp(entry.first, stage) == 0;
+    });
+    if (itr == d->setupTimeline.cend()) {
+        d->setupTimeline.emplace_back(stage, d->setupTimer.elapsed());
+    }
+}
+
+void RdpConnection::completeSetupTimeline()
+{
+    markSetupStage("first_frame_sent");
+
+    QStringList stages;
+    {
+        std::lock_guard lock(d->setupTimelineMutex);
+        if (d->setupTimelineCompleted) {
+            return;
+        }
+        d->setupTimelineCompleted = true;
+
+        // Stages are recorded from several threads, order them by time.
+        std::stable_sort(d->setupTimeline.begin(), d->setupTimeline.end(), [](const auto &first, const auto &second) {
+            return first.second < second.second;
+        });
+        stages.reserve(d->setupTimeline.size());
+        for (const auto &[stage, elapsed] : d->setupTimeline) {
+            stages.append(QStringLiteral("%1=%2ms").arg(QLatin1StringView(stage)).arg(elapsed));
+        }
+    }
+
+    qCInfo(KRDP).noquote() << QStringLiteral("Connection setup timeline: client=%1 user=%2 %3")
+                                  .arg(QString::fromUtf8(d->peer->hostname), d->userName, stages.join(QLatin1Char(' ')));
+}
+
 void RdpConnection::initialize()
 {
     setState(State::Starting);
@@ -461,19 +580,12 @@ void RdpConnection::initialize()
 
     auto settings = d->peer->context->settings;
 
-    auto certificate = freerdp_certificate_new_from_file(d->server->tlsCertificate().string().data());
-    if (!certificate) {
-        qCWarning(KRDP) << "Could not read certificate file" << d->server->tlsCertificate().string();
+    // The TLS certificate and key are parsed once by Server and copied into
+    // the settings of every peer along with the rest of its settings.
+    if (!freerdp_settings_get_pointer(settings, FreeRDP_RdpServerCertificate) || !freerdp_settings_get_pointer(settings, FreeRDP_RdpServerRsaKey)) {
+        qCWarning(KRDP) << "No TLS certificate or key available for connection";
         return;
     }
-    freerdp_settings_set_pointer_len(settings, FreeRDP_RdpServerCertificate, certificate, 1);
-
-    auto key = freerdp_key_new_from_file(d->server->tlsCertificateKey().string().data());
-    if (!key) {
-        qCWarning(KRDP) << "Could not read certificate file" << d->server->tlsCertificate().string();
-        return;
-    }
-    freerdp_settings_set_pointer_len(settings, FreeRDP_RdpServerRsaKey, key, 1);
 
     freerdp_settings_set_bool(settings, FreeRDP_RdpSecurity, false);
     freerdp_settings_set_bool(settings, FreeRDP_TlsSecurity, true);
@@ -524,6 +636,7 @@ void RdpConnection::initialize()
     freerdp_settings_set_bool(settings, FreeRDP_SurfaceFrameMarkerEnabled, true);
 
     d->peer->Capabilities = peerCapabilities;
+    d->peer->Logon = peerLogon;
     d->peer->Activate = peerActivate;
     d->peer->PostConnect = peerPostConnect;
 
@@ -540,6 +653,7 @@ void RdpConnection::initialize()
         return;
     }
 
+    markSetupStage("peer_initialized");
     qCDebug(KRDP) << "Session setup completed, start processing...";
 
     // Perform actual communication on a separate thread.
@@ -575,6 +689,9 @@ void RdpConnection::run(std::stop_token stopToken)
             auto state = WTSVirtualChannelManagerGetDrdynvcState(context->virtualChannelManager);
             // Dynamic channels can only be set up properly once the dynamic channel channel is properly setup.
             if (state == DRDYNVC_STATE_READY) {
+                if (d->state != State::Streaming) {
+                    markSetupStage("drdynvc_ready");
+                }
                 if (d->videoStream->initialize()) {
                     d->videoStream->setEnabled(true);
                     setState(State::Streaming);
@@ -607,6 +724,8 @@ void RdpConnection::run(std::stop_token stopToken)
 
 bool RdpConnection::onCapabilities()
 {
+    markSetupStage("capabilities");
+
     auto settings = d->peer->context->settings;
     // We only support GraphicsPipeline clients currently as that is required
     // for AVC streaming.
@@ -631,6 +750,35 @@ bool RdpConnection::onCapabilities()
         return false;
     }
 
+    startPamAuthentication();
+
+    return true;
+}
+
+void RdpConnection::startPamAuthentication()
+{
+    // Capabilities are exchanged after the Client Info PDU, so the client's
+    // credentials are known here. Authenticating now lets PAM run during the
+    // rest of the capability exchange instead of stalling onPostConnect().
+    // Reactivation exchanges capabilities again, but the client is
+    // authenticated by then.
+    if (!d->server->usePAMAuthentication() || d->pamAuthentication || !d->userName.isEmpty()) {
+        return;
+    }
+
+    rdpSettings *settings = d->peer->context->settings;
+    const QString username = QString::fromLatin1(freerdp_settings_get_string(settings, FreeRDP_Username));
+    const QString password = QString::fromLatin1(freerdp_settings_get_string(settings, FreeRDP_Password));
+    if (username.isEmpty() || username != KUser().loginName()) {
+        return;
+    }
+
+    d->pamAuthentication = startPamWorker(username, password);
+}
+
+bool RdpConnection::onLogon()
+{
+    markSetupStage("logon");
     return true;
 }
 
@@ -654,8 +802,24 @@ bool RdpConnection::onPostConnect()
 
     if (d->server->usePAMAuthentication()) {
         qCDebug(KRDP) << "Attempting authenticating user with PAM";
-        if (username == KUser().loginName() && pamAuthenticate(username, password) >= 0) {
+        bool pamSucceeded = false;
+        if (username == KUser().loginName()) {
+            auto authentication = std::exchange(d->pamAuthentication, nullptr);
+            if (!authentication || authentication->userName != username || authentication->passwordHash != pamPasswordHash(password)) {
+                authentication = startPamWorker(username, password);
+            }
+            // Closing the connection stops waiting, it joins this thread.
+            std::unique_lock lock(authentication->mutex);
+            authentication->finished.wait(lock, d->thread.get_stop_token(), [&authentication]() {
+                return authentication->succeeded.has_value();
+            });
+            pamSucceeded = authentication->succeeded.value_or(false);
+        }
+
+        if (pamSucceeded) {
             qCDebug(KRDP) << "PAM authentication succeeded for user" << username;
+            d->userName = username;
+            markSetupStage("authenticated");
             return true;
         }
     }
@@ -667,6 +831,8 @@ bool RdpConnection::onPostConnect()
         }
         if (user.name == username && user.password == password) {
             qCDebug(KRDP) << "User" << username << "authenticated successfully";
+            d->userName = username;
+            markSetupStage("authenticated");
             return true;
         }
     }
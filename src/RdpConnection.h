@@ -99,8 +99,28 @@ public:
 
     NetworkDetection *networkDetection() const;
 
+    /**
+     * The name of the user that authenticated this connection.
+     *
+     * This is empty until the client has successfully logged in.
+     */
+    QString userName() const;
+
+    /**
+     * Record that connection setup reached a certain stage.
+     *
+     * Stages are timed relative to the creation of the connection and are
+     * logged as a single line once the first frame has been sent, so it is
+     * visible where connection latency goes. Only the first time a stage is
+     * reached is recorded. This can be called from any thread.
+     *
+     * \param stage A short, static name of the stage.
+     */
+    void markSetupStage(const char *stage);
+
 private:
     friend BOOL peerCapabilities(freerdp_peer *);
+    friend BOOL peerLogon(freerdp_peer *, const SEC_WINNT_AUTH_IDENTITY *, BOOL);
     friend BOOL peerActivate(freerdp_peer *);
     friend BOOL peerPostConnect(freerdp_peer *);
     friend BOOL suppressOutput(rdpContext *, uint8_t, const RECTANGLE_16 *);
@@ -117,7 +137,11 @@ private:
     freerdp_peer *rdpPeer() const;
     rdpContext *rdpPeerContext() const;
 
+    void completeSetupTimeline();
+    void startPamAuthentication();
+
     bool onCapabilities();
+    bool onLogon();
     bool onActivate();
     bool onPostConnect();
     bool onClose();
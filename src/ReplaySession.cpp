@@ -0,0 +1,205 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "ReplaySession.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <pthread.h>
+
+#include <QMimeData>
+
+#include "StreamRecording.h"
+#include "VideoFrame.h"
+#include "krdp_logging.h"
+
+namespace KRdp
+{
+
+namespace clk = std::chrono;
+
+class KRDP_NO_EXPORT ReplaySession::Private
+{
+public:
+    Private(ReplaySession *session, const QString &fileName, Pacing replayPacing)
+        : q(session)
+        , recording(fileName)
+        , pacing(replayPacing)
+    {
+    }
+
+    void startPlayback();
+    void stopPlayback();
+    void run(std::stop_token token);
+
+    ReplaySession *const q;
+    StreamRecording recording;
+    const Pacing pacing;
+    std::atomic_bool loop = true;
+    bool started = false;
+
+    std::jthread player;
+    std::atomic<quint64> framesReplayed = 0;
+    // Only touched by the player thread, or while it is not running.
+    qsizetype position = 0;
+};
+
+ReplaySession::ReplaySession(const QString &fileName, Pacing pacing)
+    : AbstractSession()
+    , d(std::make_unique<Private>(this, fileName, pacing))
+{
+}
+
+ReplaySession::~ReplaySession()
+{
+    d->stopPlayback();
+}
+
+ReplaySession::Pacing ReplaySession::pacing() const
+{
+    return d->pacing;
+}
+
+bool ReplaySession::loop() const
+{
+    return d->loop;
+}
+
+void ReplaySession::setLoop(bool loop)
+{
+    d->loop = loop;
+}
+
+quint64 ReplaySession::framesReplayed() const
+{
+    return d->framesReplayed;
+}
+
+void ReplaySession::start()
+{
+    if (!d->recording.open()) {
+        Q_EMIT error();
+        return;
+    }
+
+    const auto first = d->recording.frame(0);
+    if (!first) {
+        Q_EMIT error();
+        return;
+    }
+
+    qCDebug(KRDP) << "Replaying" << d->recording.frameCount() << "frames of" << first->size << "over"
+                  << clk::duration_cast<clk::milliseconds>(d->recording.duration()).count() << "ms";
+
+    setSize(first->size);
+    setLogicalSize(first->size);
+    d->started = true;
+    setStarted(true);
+}
+
+void ReplaySession::setStreamingEnabled(bool enable)
+{
+    AbstractSession::setStreamingEnabled(enable);
+
+    if (enable && d->started) {
+        d->startPlayback();
+    } else if (!enable) {
+        d->stopPlayback();
+    }
+}
+
+void ReplaySession::sendInputEvents(const InputEvents &events)
+{
+    Q_UNUSED(events);
+}
+
+void ReplaySession::setClipboardData(std::unique_ptr<QMimeData> data)
+{
+    Q_UNUSED(data);
+}
+
+void ReplaySession::Private::startPlayback()
+{
+    if (player.joinable()) {
+        return;
+    }
+
+    // The client needs a key frame to start decoding from.
+    position = std::max(recording.keyFrameBefore(position), qsizetype(0));
+
+    player = std::jthread([this](std::stop_token token) {
+        run(token);
+    });
+    pthread_setname_np(player.native_handle(), "krdp_replay");
+}
+
+void ReplaySession::Private::stopPlayback()
+{
+    if (player.joinable()) {
+        player.request_stop();
+        player.join();
+    }
+}
+
+void ReplaySession::Private::run(std::stop_token token)
+{
+    std::mutex mutex;
+    std::condition_variable_any condition;
+
+    // Recorded time maps to replay time with this offset, shifted every time
+    // playback starts over.
+    auto offset = clk::steady_clock::now() - clk::steady_clock::time_point(clk::duration_cast<clk::steady_clock::duration>(recording.timeOf(position)));
+
+    while (!token.stop_requested()) {
+        if (position >= recording.frameCount()) {
+            if (!loop) {
+                QMetaObject::invokeMethod(q, &ReplaySession::finished);
+                return;
+            }
+            // Keep the gap between the last and first frame about one frame long.
+            const auto frameInterval = recording.frameCount() > 1 ? recording.duration() / (recording.frameCount() - 1) : clk::nanoseconds(0);
+            offset += clk::duration_cast<clk::steady_clock::duration>(recording.duration() + frameInterval);
+            position = 0;
+        }
+
+        auto frame = recording.frame(position);
+        if (!frame) {
+            QMetaObject::invokeMethod(q, &ReplaySession::error);
+            return;
+        }
+
+        const auto recordedAt = clk::steady_clock::time_point(clk::duration_cast<clk::steady_clock::duration>(frame->presentationTimeStamp.time_since_epoch()));
+        const auto encodeDelay = frame->encodedTimeStamp - recordedAt;
+        auto presentedAt = recordedAt + offset;
+
+        if (pacing == Pacing::RealTime) {
+            std::unique_lock lock(mutex);
+            condition.wait_until(lock, token, presentedAt, [] {
+                return false;
+            });
+            if (token.stop_requested()) {
+                break;
+            }
+        } else {
+            // Without pacing, frames are as fresh as when they were encoded.
+            presentedAt = clk::steady_clock::now() - encodeDelay;
+        }
+
+        frame->presentationTimeStamp = clk::system_clock::time_point(clk::duration_cast<clk::system_clock::duration>(presentedAt.time_since_epoch()));
+        frame->encodedTimeStamp = presentedAt + encodeDelay;
+
+        Q_EMIT q->frameReceived(*frame);
+        framesReplayed.fetch_add(1, std::memory_order_relaxed);
+        ++position;
+    }
+}
+
+}
+
+#include "moc_ReplaySession.cpp"
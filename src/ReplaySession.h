@@ -0,0 +1,74 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#pragma once
+
+#include <memory>
+
+#include <QObject>
+#include <QString>
+
+#include "AbstractSession.h"
+#include "krdp_export.h"
+
+namespace KRdp
+{
+
+/**
+ * A session that plays back a recording made with StreamRecorder.
+ *
+ * The recorded frames are emitted unchanged, with their damage, key frame
+ * flags and monitor layout, and with timestamps moved to the time they are
+ * replayed. This makes it possible to run the same real desktop trace
+ * through the server repeatedly, for example to compare changes to frame
+ * coalescing, quality or rate control.
+ *
+ * Whenever streaming is enabled, playback continues from the last key frame
+ * before the current position so the client can decode it.
+ */
+class KRDP_EXPORT ReplaySession : public AbstractSession
+{
+    Q_OBJECT
+
+public:
+    enum class Pacing {
+        RealTime, ///< Frames are emitted with the timing they were recorded with.
+        AsFastAsPossible, ///< Frames are emitted without waiting in between.
+    };
+    Q_ENUM(Pacing)
+
+    explicit ReplaySession(const QString &fileName, Pacing pacing = Pacing::RealTime);
+    ~ReplaySession() override;
+
+    Pacing pacing() const;
+
+    /**
+     * Whether to start over from the first frame at the end of the recording.
+     * When this is false, finished() is emitted instead. Defaults to true.
+     */
+    bool loop() const;
+    void setLoop(bool loop);
+
+    /**
+     * Number of frames emitted so far.
+     */
+    quint64 framesReplayed() const;
+
+    void start() override;
+    void setStreamingEnabled(bool enable) override;
+
+    void sendInputEvents(const InputEvents &events) override;
+    void setClipboardData(std::unique_ptr<QMimeData> data) override;
+
+    /**
+     * Emitted when the end of the recording is reached and loop() is false.
+     */
+    Q_SIGNAL void finished();
+
+private:
+    class Private;
+    const std::unique_ptr<Private> d;
+};
+
+}
@@ -7,11 +7,15 @@
 #include <vector>
 
 #include <QCoreApplication>
+#include <QTimer>
 
 #include <freerdp/channels/channels.h>
+#include <freerdp/crypto/certificate.h>
+#include <freerdp/crypto/privatekey.h>
 #include <freerdp/freerdp.h>
 #include <winpr/ssl.h>
 
+#include "FlightRecorder.h"
 #include "RdpConnection.h"
 
 #include "krdp_logging.h"
@@ -32,6 +36,9 @@ public:
 
     std::filesystem::path tlsCertificate;
     std::filesystem::path tlsCertificateKey;
+
+    // Lets the flight recorder notice when the main thread stops responding.
+    QTimer heartbeatTimer;
 };
 
 Server::Server(QObject *parent)
@@ -40,6 +47,9 @@ Server::Server(QObject *parent)
 {
     winpr_InitializeSSL(WINPR_SSL_INIT_DEFAULT);
     WTSRegisterWtsApiFunctionTable(FreeRDP_InitWtsApi());
+
+    d->heartbeatTimer.setInterval(std::chrono::milliseconds(250));
+    connect(&d->heartbeatTimer, &QTimer::timeout, this, &FlightRecorder::heartbeat);
 }
 
 Server::~Server()
@@ -55,18 +65,42 @@ bool Server::start()
         return false;
     }
 
+    // FreeRDP3 tries to use a global instance of the settings object when
+    // initializing a new peer. However, it seems to fail at actually creating a
+    // global default instance. So create one here and use that.
+    d->settings = freerdp_settings_new(FREERDP_SETTINGS_SERVER_MODE);
+
+    // Parse the certificate and key only once. Every new peer gets a copy of
+    // these settings, so connections do not need to touch the files again.
+    auto certificate = freerdp_certificate_new_from_file(d->tlsCertificate.string().data());
+    if (!certificate) {
+        qCCritical(KRDP) << "Could not read certificate file" << d->tlsCertificate.string();
+        stop();
+        return false;
+    }
+    freerdp_settings_set_pointer_len(d->settings, FreeRDP_RdpServerCertificate, certificate, 1);
+
+    auto key = freerdp_key_new_from_file(d->tlsCertificateKey.string().data());
+    if (!key) {
+        qCCritical(KRDP) << "Could not read certificate key file" << d->tlsCertificateKey.string();
+        stop();
+        return false;
+    }
+    freerdp_settings_set_pointer_len(d->settings, FreeRDP_RdpServerRsaKey, key, 1);
+
     if (!listen(d->address, d->port)) {
         // NOTE: We cannot use QTcpServer methods to get the server address and port because it won't initialize them if listen fails.
         qCCritical(KRDP) << "Unable to listen for connections on" << d->address << d->port;
+        stop();
         return false;
     }
 
-    // FreeRDP3 tries to use a global instance of the settings object when
-    // initializing a new peer. However, it seems to fail at actually creating a
-    // global default instance. So create one here and use that.
-    d->settings = freerdp_settings_new(FREERDP_SETTINGS_SERVER_MODE);
-
     qCDebug(KRDP) << "Listening for connections on" << serverAddress() << serverPort();
+
+    FlightRecorder::heartbeat();
+    FlightRecorder::startWatchdog();
+    d->heartbeatTimer.start();
+
     return true;
 }
 
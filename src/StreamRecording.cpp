@@ -0,0 +1,340 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "StreamRecording.h"
+
+#include <vector>
+
+#include <QDataStream>
+#include <QFile>
+
+#include "krdp_logging.h"
+
+namespace KRdp
+{
+
+namespace clk = std::chrono;
+
+// File layout, all through QDataStream:
+//
+//   header   Magic, Version
+//   frame    FrameMagic, presentation ns, encoded delay ns, size, key frame,
+//            damage, monitor count, (geometry, primary) per monitor, data
+//   ...
+//   index    IndexMagic, count, (offset, presentation ns, key frame) per frame
+//   trailer  index offset, TrailerMagic
+//
+// The index and trailer are only there when the recording was finished.
+namespace
+{
+constexpr quint32 Magic = 0x4b524543; // "KREC"
+constexpr quint32 Version = 1;
+constexpr quint32 FrameMagic = 0x46524d45; // "FRME"
+constexpr quint32 IndexMagic = 0x494e4458; // "INDX"
+constexpr quint32 TrailerMagic = 0x454e4421; // "END!"
+constexpr qint64 TrailerSize = sizeof(qint64) + sizeof(quint32);
+// Offset, time and key frame flag of an index entry as written to the file.
+constexpr qint64 IndexEntrySize = sizeof(qint64) + sizeof(qint64) + sizeof(quint8);
+constexpr auto StreamVersion = QDataStream::Qt_6_0;
+
+struct IndexEntry {
+    qint64 offset = 0;
+    qint64 timeNs = 0;
+    bool keyFrame = false;
+};
+
+qint64 nanoseconds(clk::system_clock::time_point time)
+{
+    return clk::duration_cast<clk::nanoseconds>(time.time_since_epoch()).count();
+}
+
+qint64 nanoseconds(clk::steady_clock::time_point time)
+{
+    return clk::duration_cast<clk::nanoseconds>(time.time_since_epoch()).count();
+}
+}
+
+class KRDP_NO_EXPORT StreamRecorder::Private
+{
+public:
+    QFile file;
+    QDataStream stream;
+    std::optional<qint64> firstFrameNs;
+    std::vector<IndexEntry> index;
+    bool finished = false;
+};
+
+StreamRecorder::StreamRecorder(const QString &fileName)
+    : d(std::make_unique<Private>())
+{
+    d->file.setFileName(fileName);
+}
+
+StreamRecorder::~StreamRecorder()
+{
+    finish();
+}
+
+bool StreamRecorder::open()
+{
+    if (!d->file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qCWarning(KRDP) << "Could not open recording" << d->file.fileName() << d->file.errorString();
+        return false;
+    }
+
+    d->stream.setDevice(&d->file);
+    d->stream.setVersion(StreamVersion);
+    d->stream << Magic << Version;
+    return d->stream.status() == QDataStream::Ok;
+}
+
+bool StreamRecorder::write(const VideoFrame &frame)
+{
+    if (!d->file.isOpen() || d->finished) {
+        return false;
+    }
+
+    const auto presentationNs = nanoseconds(frame.presentationTimeStamp);
+    if (!d->firstFrameNs) {
+        d->firstFrameNs = presentationNs;
+    }
+    const auto timeNs = presentationNs - *d->firstFrameNs;
+    const qint64 encodeDelayNs = frame.encodedTimeStamp.time_since_epoch().count() != 0 ? nanoseconds(frame.encodedTimeStamp) - presentationNs : 0;
+
+    d->index.push_back({d->file.pos(), timeNs, frame.isKeyFrame});
+
+    d->stream << FrameMagic << timeNs << encodeDelayNs << frame.size << frame.isKeyFrame << frame.damage << quint32(frame.monitors.size());
+    for (const auto &monitor : frame.monitors) {
+        d->stream << monitor.geometry << monitor.primary;
+    }
+    d->stream << frame.data;
+
+    if (d->stream.status() != QDataStream::Ok) {
+        qCWarning(KRDP) << "Writing to recording" << d->file.fileName() << "failed";
+        return false;
+    }
+    return true;
+}
+
+bool StreamRecorder::finish()
+{
+    if (!d->file.isOpen() || d->finished) {
+        return false;
+    }
+    d->finished = true;
+
+    const qint64 indexOffset = d->file.pos();
+    d->stream << IndexMagic << quint32(d->index.size());
+    for (const auto &entry : d->index) {
+        d->stream << entry.offset << entry.timeNs << entry.keyFrame;
+    }
+    d->stream << indexOffset << TrailerMagic;
+
+    const bool result = d->stream.status() == QDataStream::Ok && d->file.flush();
+    d->file.close();
+    return result;
+}
+
+qsizetype StreamRecorder::frameCount() const
+{
+    return qsizetype(d->index.size());
+}
+
+class KRDP_NO_EXPORT StreamRecording::Private
+{
+public:
+    bool readIndex();
+    void scan();
+
+    QFile file;
+    QDataStream stream;
+    std::vector<IndexEntry> index;
+};
+
+StreamRecording::StreamRecording(const QString &fileName)
+    : d(std::make_unique<Private>())
+{
+    d->file.setFileName(fileName);
+}
+
+StreamRecording::~StreamRecording() = default;
+
+bool StreamRecording::open()
+{
+    if (!d->file.open(QIODevice::ReadOnly)) {
+        qCWarning(KRDP) << "Could not open recording" << d->file.fileName() << d->file.errorString();
+        return false;
+    }
+
+    d->stream.setDevice(&d->file);
+    d->stream.setVersion(StreamVersion);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    d->stream >> magic >> version;
+    if (magic != Magic || version != Version) {
+        qCWarning(KRDP) << d->file.fileName() << "is not a recording this version can read";
+        return false;
+    }
+
+    if (!d->readIndex()) {
+        qCDebug(KRDP) << "Recording" << d->file.fileName() << "has no index, scanning it";
+        d->scan();
+    }
+
+    if (d->index.empty()) {
+        qCWarning(KRDP) << "Recording" << d->file.fileName() << "contains no frames";
+        return false;
+    }
+    return true;
+}
+
+bool StreamRecording::Private::readIndex()
+{
+    const auto size = file.size();
+    if (size < TrailerSize || !file.seek(size - TrailerSize)) {
+        return false;
+    }
+
+    qint64 indexOffset = 0;
+    quint32 trailerMagic = 0;
+    stream >> indexOffset >> trailerMagic;
+    if (trailerMagic != TrailerMagic || indexOffset <= 0 || indexOffset >= size || !file.seek(indexOffset)) {
+        return false;
+    }
+
+    quint32 indexMagic = 0;
+    quint32 count = 0;
+    stream >> indexMagic >> count;
+    if (indexMagic != IndexMagic) {
+        return false;
+    }
+    // A damaged trailer can point anywhere, do not trust the count further
+    // than the file goes.
+    if (qint64(count) * IndexEntrySize > size - TrailerSize - file.pos()) {
+        return false;
+    }
+
+    index.resize(count);
+    for (auto &entry : index) {
+        stream >> entry.offset >> entry.timeNs >> entry.keyFrame;
+    }
+    if (stream.status() != QDataStream::Ok) {
+        index.clear();
+        stream.resetStatus();
+        return false;
+    }
+    return true;
+}
+
+void StreamRecording::Private::scan()
+{
+    index.clear();
+    file.seek(sizeof(Magic) + sizeof(Version));
+
+    // A recording that was cut off ends in a partial frame, which is dropped.
+    while (!file.atEnd()) {
+        IndexEntry entry;
+        entry.offset = file.pos();
+
+        quint32 magic = 0;
+        qint64 encodeDelayNs = 0;
+        QSize size;
+        QRegion damage;
+        quint32 monitorCount = 0;
+        stream >> magic >> entry.timeNs >> encodeDelayNs >> size >> entry.keyFrame >> damage >> monitorCount;
+        if (magic != FrameMagic) {
+            break;
+        }
+        for (quint32 i = 0; i < monitorCount && stream.status() == QDataStream::Ok; ++i) {
+            QRect geometry;
+            bool primary = false;
+            stream >> geometry >> primary;
+        }
+        quint32 dataSize = 0;
+        stream >> dataSize;
+        // A null QByteArray is written as 0xffffffff without data.
+        if (dataSize == 0xffffffff) {
+            dataSize = 0;
+        }
+        if (stream.status() != QDataStream::Ok || stream.skipRawData(qint64(dataSize)) != qint64(dataSize)) {
+            break;
+        }
+
+        index.push_back(entry);
+    }
+
+    stream.resetStatus();
+}
+
+qsizetype StreamRecording::frameCount() const
+{
+    return qsizetype(d->index.size());
+}
+
+clk::nanoseconds StreamRecording::duration() const
+{
+    if (d->index.empty()) {
+        return {};
+    }
+    return clk::nanoseconds(d->index.back().timeNs - d->index.front().timeNs);
+}
+
+clk::nanoseconds StreamRecording::timeOf(qsizetype index) const
+{
+    return clk::nanoseconds(d->index.at(index).timeNs);
+}
+
+bool StreamRecording::isKeyFrame(qsizetype index) const
+{
+    return d->index.at(index).keyFrame;
+}
+
+qsizetype StreamRecording::keyFrameBefore(qsizetype index) const
+{
+    for (auto i = std::min(index, frameCount() - 1); i >= 0; --i) {
+        if (d->index.at(i).keyFrame) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+std::optional<VideoFrame> StreamRecording::frame(qsizetype index)
+{
+    if (index < 0 || index >= frameCount() || !d->file.seek(d->index.at(index).offset)) {
+        return std::nullopt;
+    }
+
+    VideoFrame frame;
+    quint32 magic = 0;
+    qint64 timeNs = 0;
+    qint64 encodeDelayNs = 0;
+    quint32 monitorCount = 0;
+    d->stream >> magic >> timeNs >> encodeDelayNs >> frame.size >> frame.isKeyFrame >> frame.damage >> monitorCount;
+    if (magic != FrameMagic) {
+        qCWarning(KRDP) << "Recording" << d->file.fileName() << "is corrupt at frame" << index;
+        return std::nullopt;
+    }
+
+    frame.monitors.reserve(monitorCount);
+    for (quint32 i = 0; i < monitorCount; ++i) {
+        VideoMonitor monitor;
+        d->stream >> monitor.geometry >> monitor.primary;
+        frame.monitors.append(monitor);
+    }
+    d->stream >> frame.data;
+
+    if (d->stream.status() != QDataStream::Ok) {
+        qCWarning(KRDP) << "Reading frame" << index << "from" << d->file.fileName() << "failed";
+        d->stream.resetStatus();
+        return std::nullopt;
+    }
+
+    frame.presentationTimeStamp = clk::system_clock::time_point(clk::duration_cast<clk::system_clock::duration>(clk::nanoseconds(timeNs)));
+    frame.encodedTimeStamp = clk::steady_clock::time_point(clk::duration_cast<clk::steady_clock::duration>(clk::nanoseconds(timeNs + encodeDelayNs)));
+    return frame;
+}
+
+}
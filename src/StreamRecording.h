@@ -0,0 +1,93 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <optional>
+
+#include <QString>
+
+#include "VideoFrame.h"
+#include "krdp_export.h"
+
+namespace KRdp
+{
+
+/**
+ * Writes encoded video frames to a recording.
+ *
+ * A recording keeps every field of VideoFrame per packet: size, H.264 data,
+ * key frame flag, damage, monitor layout and timestamps. Timestamps are
+ * stored relative to the first frame. An index of all frames is appended by
+ * finish(), a recording that was not finished can still be read, it is just
+ * scanned once when opened.
+ *
+ * Use StreamRecording to read a recording back.
+ */
+class KRDP_EXPORT StreamRecorder
+{
+public:
+    explicit StreamRecorder(const QString &fileName);
+    /**
+     * Finishes the recording if that did not happen yet.
+     */
+    ~StreamRecorder();
+
+    bool open();
+    bool write(const VideoFrame &frame);
+    /**
+     * Append the index and close the file.
+     */
+    bool finish();
+
+    qsizetype frameCount() const;
+
+private:
+    class Private;
+    const std::unique_ptr<Private> d;
+};
+
+/**
+ * Random access to the frames of a recording made by StreamRecorder.
+ */
+class KRDP_EXPORT StreamRecording
+{
+public:
+    explicit StreamRecording(const QString &fileName);
+    ~StreamRecording();
+
+    bool open();
+
+    qsizetype frameCount() const;
+    /**
+     * Time between the first and the last frame.
+     */
+    std::chrono::nanoseconds duration() const;
+    /**
+     * When frame \p index was presented, relative to the first frame.
+     */
+    std::chrono::nanoseconds timeOf(qsizetype index) const;
+    bool isKeyFrame(qsizetype index) const;
+    /**
+     * The index of the last key frame at or before \p index, or -1 if there is none.
+     */
+    qsizetype keyFrameBefore(qsizetype index) const;
+
+    /**
+     * Read frame \p index.
+     *
+     * The presentation timestamp of the returned frame is relative to the
+     * first frame, its encoded timestamp has the same offset from it as when
+     * it was recorded.
+     */
+    std::optional<VideoFrame> frame(qsizetype index);
+
+private:
+    class Private;
+    const std::unique_ptr<Private> d;
+};
+
+}
@@ -0,0 +1,372 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "SyntheticSession.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include <QHash>
+#include <QMimeData>
+#include <QRegion>
+
+#include "FrameGenerator.h"
+#include "LatencyHistogram.h"
+
+namespace KRdp
+{
+
+namespace clk = std::chrono;
+
+namespace
+{
+constexpr int GlyphWidth = 8;
+constexpr int GlyphHeight = 16;
+constexpr int TextMargin = 48;
+constexpr int ScrollStep = 4;
+constexpr double TypingRate = 10.0;
+constexpr QRect InputMarker = QRect(0, 0, 32, 32);
+constexpr uint32_t Background = 0xff202428;
+constexpr uint32_t Foreground = 0xffd0d4d8;
+
+qint64 steadyNs(clk::steady_clock::time_point time)
+{
+    return clk::duration_cast<clk::nanoseconds>(time.time_since_epoch()).count();
+}
+
+uint32_t hash(uint32_t value)
+{
+    value ^= value >> 16;
+    value *= 0x7feb352d;
+    value ^= value >> 15;
+    value *= 0x846ca68b;
+    value ^= value >> 16;
+    return value;
+}
+
+// Something that looks like text from a distance: a random bit pattern per
+// character, with some spacing around it.
+bool glyphPixel(uint32_t character, int x, int y)
+{
+    if (x < 1 || x >= GlyphWidth - 1 || y < 3 || y >= GlyphHeight - 2) {
+        return false;
+    }
+    return hash(character * 257 + uint32_t(y * GlyphWidth + x)) & 1;
+}
+}
+
+class KRDP_NO_EXPORT SyntheticSession::Private
+{
+public:
+    FrameGenerator::Image render(clk::steady_clock::duration interval, bool restarted);
+    void frameEmitted();
+
+    QRegion renderTyping(int characters);
+    QRegion renderScrolling();
+    QRegion renderVideo();
+    QRegion renderInputMarker();
+    void fill(const QRect &rect, uint32_t color);
+    void drawGlyph(const QPoint &position, uint32_t character);
+
+    SyntheticSession *q = nullptr;
+    Content content = Content::Typing;
+    QSize size;
+    bool started = false;
+
+    std::unique_ptr<FrameGenerator> generator;
+
+    std::atomic<quint64> inputEvents = 0;
+    std::atomic<quint32> pendingKeyPresses = 0;
+    // When the oldest press that is not visible yet arrived, zero if none.
+    std::atomic<qint64> pendingInputNs = 0;
+    LatencyHistogram inputLatency;
+
+    // Everything below is only used by the generator thread.
+    std::vector<uint32_t> pixels;
+    qint64 renderedInputNs = 0;
+    quint64 frameNumber = 0;
+    quint32 typedCharacters = 0;
+    QPoint textCursor;
+    double typingCredit = 0.0;
+    quint64 scrolledRows = 0;
+    bool markerOn = false;
+};
+
+SyntheticSession::SyntheticSession(Content content, const QSize &size)
+    : AbstractSession()
+    , d(std::make_unique<Private>())
+{
+    d->q = this;
+    d->content = content;
+    d->size = size;
+    d->generator = std::make_unique<FrameGenerator>(
+        this,
+        "krdp_synthetic",
+        [this](clk::steady_clock::duration interval, bool restarted) {
+            return d->render(interval, restarted);
+        },
+        [this]() {
+            d->frameEmitted();
+        });
+}
+
+SyntheticSession::~SyntheticSession()
+{
+    d->generator->stop();
+}
+
+std::optional<SyntheticSession::Content> SyntheticSession::contentFromString(const QString &name)
+{
+    static const QHash<QString, Content> contents = {
+        {QStringLiteral("idle"), Content::Idle},
+        {QStringLiteral("typing"), Content::Typing},
+        {QStringLiteral("scrolling"), Content::Scrolling},
+        {QStringLiteral("video"), Content::Video},
+    };
+    const auto itr = contents.constFind(name.toLower());
+    if (itr == contents.cend()) {
+        return std::nullopt;
+    }
+    return itr.value();
+}
+
+SyntheticSession::Content SyntheticSession::content() const
+{
+    return d->content;
+}
+
+void SyntheticSession::start()
+{
+    if (const auto monitor = virtualMonitor()) {
+        d->size = monitor->size;
+    }
+    // YUV420 subsamples chroma 2x2, so the encoder needs even dimensions.
+    d->size = QSize(d->size.width() & ~1, d->size.height() & ~1);
+
+    setSize(d->size);
+    setLogicalSize(d->size);
+    d->generator->setSize(d->size);
+    d->started = true;
+    setStarted(true);
+}
+
+void SyntheticSession::setStreamingEnabled(bool enable)
+{
+    AbstractSession::setStreamingEnabled(enable);
+
+    if (enable && d->started) {
+        d->generator->start();
+    } else if (!enable) {
+        d->generator->stop();
+    }
+}
+
+void SyntheticSession::setVideoFrameRate(quint32 framerate)
+{
+    AbstractSession::setVideoFrameRate(framerate);
+    d->generator->setFrameRate(framerate);
+}
+
+void SyntheticSession::setVideoQuality(quint8 quality)
+{
+    AbstractSession::setVideoQuality(quality);
+    d->generator->setQuality(quality);
+}
+
+void SyntheticSession::sendInputEvents(const InputEvents &events)
+{
+    d->inputEvents.fetch_add(events.size(), std::memory_order_relaxed);
+
+    for (const auto &event : events) {
+        if (!event.pressed) {
+            continue;
+        }
+
+        switch (event.type) {
+        case InputEvent::Type::Key:
+        case InputEvent::Type::KeySym:
+            d->pendingKeyPresses.fetch_add(1, std::memory_order_relaxed);
+            [[fallthrough]];
+        case InputEvent::Type::PointerButton: {
+            qint64 none = 0;
+            d->pendingInputNs.compare_exchange_strong(none, steadyNs(clk::steady_clock::now()), std::memory_order_relaxed);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+void SyntheticSession::setClipboardData(std::unique_ptr<QMimeData> data)
+{
+    Q_UNUSED(data);
+}
+
+quint64 SyntheticSession::inputEventCount() const
+{
+    return d->inputEvents;
+}
+
+const LatencyHistogram &SyntheticSession::inputToFrameLatency() const
+{
+    return d->inputLatency;
+}
+
+FrameGenerator::Image SyntheticSession::Private::render(clk::steady_clock::duration interval, bool restarted)
+{
+    QRegion damage;
+    if (restarted) {
+        pixels.assign(size_t(size.width()) * size.height(), Background);
+        textCursor = QPoint(TextMargin, TextMargin);
+        damage = QRect(QPoint(0, 0), size);
+    }
+
+    const auto keyPresses = int(pendingKeyPresses.exchange(0, std::memory_order_relaxed));
+    switch (content) {
+    case Content::Idle:
+        damage += renderTyping(keyPresses);
+        break;
+    case Content::Typing: {
+        typingCredit += TypingRate * clk::duration<double>(interval).count();
+        const int characters = int(typingCredit);
+        typingCredit -= characters;
+        damage += renderTyping(characters + keyPresses);
+        break;
+    }
+    case Content::Scrolling:
+        damage += renderScrolling();
+        break;
+    case Content::Video:
+        damage += renderVideo();
+        break;
+    }
+
+    const auto inputAt = pendingInputNs.exchange(0, std::memory_order_relaxed);
+    if (inputAt != 0 || (content == Content::Scrolling && !damage.isEmpty())) {
+        // Scrolling moves the marker away, so it is drawn on every frame.
+        markerOn = inputAt != 0 ? !markerOn : markerOn;
+        damage += renderInputMarker();
+    }
+    renderedInputNs = inputAt;
+    ++frameNumber;
+
+    return FrameGenerator::Image{
+        .pixels = reinterpret_cast<const uchar *>(pixels.data()),
+        .stride = size.width() * 4,
+        .damage = damage,
+    };
+}
+
+void SyntheticSession::Private::frameEmitted()
+{
+    if (renderedInputNs != 0) {
+        inputLatency.record(clk::duration_cast<clk::microseconds>(clk::steady_clock::now().time_since_epoch() - clk::nanoseconds(renderedInputNs)));
+    }
+}
+
+QRegion SyntheticSession::Private::renderTyping(int characters)
+{
+    QRegion damage;
+    for (int i = 0; i < characters; ++i) {
+        if (textCursor.y() + GlyphHeight > size.height() - TextMargin) {
+            // The page is full, start a new one.
+            fill(QRect(QPoint(0, TextMargin), QPoint(size.width() - 1, size.height() - 1)), Background);
+            damage += QRect(QPoint(0, TextMargin), QPoint(size.width() - 1, size.height() - 1));
+            textCursor = QPoint(TextMargin, TextMargin);
+        }
+
+        const auto character = typedCharacters++;
+        // Every few characters is a space.
+        if (hash(character) % 6 != 0) {
+            drawGlyph(textCursor, character);
+            damage += QRect(textCursor, QSize(GlyphWidth, GlyphHeight));
+        }
+
+        textCursor.rx() += GlyphWidth;
+        if (textCursor.x() + GlyphWidth > size.width() - TextMargin) {
+            textCursor = QPoint(TextMargin, textCursor.y() + GlyphHeight);
+        }
+    }
+    return damage;
+}
+
+QRegion SyntheticSession::Private::renderScrolling()
+{
+    const int width = size.width();
+    const int height = size.height();
+    if (height <= ScrollStep) {
+        return {};
+    }
+
+    std::memmove(pixels.data(), pixels.data() + size_t(ScrollStep) * width, size_t(height - ScrollStep) * width * sizeof(uint32_t));
+
+    // New rows of text come in at the bottom.
+    for (int y = height - ScrollStep; y < height; ++y) {
+        const auto row = scrolledRows++;
+        const auto line = uint32_t(row / GlyphHeight);
+        const int glyphY = int(row % GlyphHeight);
+        auto pixel = pixels.data() + size_t(y) * width;
+        for (int x = 0; x < width; ++x) {
+            const bool inText = x >= TextMargin && x < width - TextMargin && hash(line) % 8 != 0;
+            const auto character = line * 1024 + uint32_t(x / GlyphWidth);
+            pixel[x] = inText && glyphPixel(character, x % GlyphWidth, glyphY) ? Foreground : Background;
+        }
+    }
+
+    return QRect(QPoint(0, 0), size);
+}
+
+QRegion SyntheticSession::Private::renderVideo()
+{
+    const QRect area(size.width() / 6, size.height() / 6, size.width() * 2 / 3, size.height() * 2 / 3);
+    const int shift = int(frameNumber);
+
+    uint32_t noise = hash(uint32_t(frameNumber) + 1);
+    for (int y = area.top(); y <= area.bottom(); ++y) {
+        auto pixel = pixels.data() + size_t(y) * size.width();
+        for (int x = area.left(); x <= area.right(); ++x) {
+            noise ^= noise << 13;
+            noise ^= noise >> 17;
+            noise ^= noise << 5;
+            const auto red = uint32_t((x + shift * 3) & 0xff);
+            const auto green = uint32_t((y + shift * 2) & 0xff);
+            const auto blue = uint32_t(((x ^ y) + shift) & 0xff);
+            pixel[x] = 0xff000000 | ((red ^ (noise & 0x1f)) << 16) | (green << 8) | blue;
+        }
+    }
+    return area;
+}
+
+QRegion SyntheticSession::Private::renderInputMarker()
+{
+    const auto marker = InputMarker.intersected(QRect(QPoint(0, 0), size));
+    fill(marker, markerOn ? 0xffffffff : 0xff000000);
+    return marker;
+}
+
+void SyntheticSession::Private::fill(const QRect &rect, uint32_t color)
+{
+    for (int y = rect.top(); y <= rect.bottom(); ++y) {
+        auto row = pixels.data() + size_t(y) * size.width();
+        std::fill(row + rect.left(), row + rect.right() + 1, color);
+    }
+}
+
+void SyntheticSession::Private::drawGlyph(const QPoint &position, uint32_t character)
+{
+    for (int y = 0; y < GlyphHeight; ++y) {
+        auto row = pixels.data() + size_t(position.y() + y) * size.width() + position.x();
+        for (int x = 0; x < GlyphWidth; ++x) {
+            row[x] = glyphPixel(character, x, y) ? Foreground : Background;
+        }
+    }
+}
+
+}
+
+#include "moc_SyntheticSession.cpp"
@@ -0,0 +1,85 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#pragma once
+
+#include <memory>
+#include <optional>
+
+#include <QObject>
+#include <QSize>
+
+#include "AbstractSession.h"
+#include "krdp_export.h"
+
+namespace KRdp
+{
+
+class LatencyHistogram;
+
+/**
+ * A session that generates its own content.
+ *
+ * Instead of capturing a screen through the portal or the compositor, this
+ * renders a test pattern and encodes it in process with FreeRDP's H.264
+ * encoder, so the server can run without a compositor, for example for
+ * benchmarks and load tests. Frames carry the damage of what actually
+ * changed, like frames from a compositor do.
+ *
+ * Input events are counted. Key and button presses also flip a marker square
+ * in the top left corner, so the time from input to a changed frame on the
+ * client can be measured.
+ */
+class KRDP_EXPORT SyntheticSession : public AbstractSession
+{
+    Q_OBJECT
+
+public:
+    /**
+     * What the generated content looks like.
+     */
+    enum class Content {
+        Idle, ///< Nothing changes.
+        Typing, ///< Characters appear one at a time, about ten per second.
+        Scrolling, ///< The whole screen scrolls continuously.
+        Video, ///< A large area changes completely every frame.
+    };
+    Q_ENUM(Content)
+
+    explicit SyntheticSession(Content content = Content::Typing, const QSize &size = QSize(1920, 1080));
+    ~SyntheticSession() override;
+
+    /**
+     * Parse a content name as used on the command line, "idle", "typing",
+     * "scrolling" or "video".
+     */
+    static std::optional<Content> contentFromString(const QString &name);
+
+    Content content() const;
+
+    void start() override;
+    void setStreamingEnabled(bool enable) override;
+    void setVideoFrameRate(quint32 framerate) override;
+    void setVideoQuality(quint8 quality) override;
+
+    void sendInputEvents(const InputEvents &events) override;
+    void setClipboardData(std::unique_ptr<QMimeData> data) override;
+
+    /**
+     * Number of input events received, after InputHandler merged motion and
+     * wheel events.
+     */
+    quint64 inputEventCount() const;
+    /**
+     * Time from a key or button press to the frame showing the marker change
+     * being emitted.
+     */
+    const LatencyHistogram &inputToFrameLatency() const;
+
+private:
+    class Private;
+    const std::unique_ptr<Private> d;
+};
+
+}
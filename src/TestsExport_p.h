@@ -0,0 +1,15 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#pragma once
+
+#include "krdp_export.h"
+
+// Internal API the autotests and benchmarks use. Only exported when the
+// library is built together with its tests.
+#ifdef KRDP_BUILD_TESTS
+#define KRDP_TESTS_EXPORT KRDP_EXPORT
+#else
+#define KRDP_TESTS_EXPORT
+#endif
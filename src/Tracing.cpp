@@ -0,0 +1,454 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "Tracing.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+#include "krdp_logging.h"
+
+namespace KRdp
+{
+namespace Tracing
+{
+
+std::atomic_bool s_enabled = false;
+
+namespace
+{
+constexpr std::size_t EventsPerThread = 16384;
+
+struct Event {
+    const char *name = nullptr;
+    qint64 start = 0;
+    // Negative for instant events.
+    qint64 duration = -1;
+    qint64 argument = -1;
+};
+
+// A slot is overwritten while the trace may be written out, so its fields
+// are atomic and guarded by the index of the event in it, which is NoEvent
+// while the slot is being written.
+constexpr quint64 NoEvent = std::numeric_limits<quint64>::max();
+
+struct Slot {
+    std::atomic<quint64> index = NoEvent;
+    std::atomic<const char *> name = nullptr;
+    std::atomic<qint64> start = 0;
+    std::atomic<qint64> duration = -1;
+    std::atomic<qint64> argument = -1;
+};
+
+// Written only by its own thread, read when writing the trace.
+struct ThreadBuffer {
+    pid_t threadId = 0;
+    QByteArray threadName;
+    std::unique_ptr<Slot[]> events = std::make_unique<Slot[]>(EventsPerThread);
+    std::atomic<quint64> written = 0;
+    // Events before this index were recorded before the last restart.
+    std::atomic<quint64> discarded = 0;
+    // Guarded by s_buffersMutex.
+    bool exited = false;
+
+    bool hasEvents() const
+    {
+        return written.load(std::memory_order_acquire) > discarded.load(std::memory_order_relaxed);
+    }
+};
+
+std::mutex s_buffersMutex;
+std::vector<std::shared_ptr<ThreadBuffer>> s_buffers;
+
+// Buffers of exited threads are only kept while they hold events of the
+// current recording. Called with s_buffersMutex held.
+void pruneExitedBuffers()
+{
+    std::erase_if(s_buffers, [](const std::shared_ptr<ThreadBuffer> &buffer) {
+        return buffer->exited && !buffer->hasEvents();
+    });
+}
+
+// Registers the buffer of a thread and marks it exited when the thread ends,
+// session threads come and go with every connection.
+class ThreadBufferOwner
+{
+public:
+    ThreadBufferOwner()
+        : m_buffer(std::make_shared<ThreadBuffer>())
+    {
+        m_buffer->threadId = pid_t(syscall(SYS_gettid));
+        char name[16] = {};
+        pthread_getname_np(pthread_self(), name, sizeof(name));
+        m_buffer->threadName = QByteArray(name);
+
+        std::lock_guard lock(s_buffersMutex);
+        s_buffers.push_back(m_buffer);
+    }
+
+    ~ThreadBufferOwner()
+    {
+        std::lock_guard lock(s_buffersMutex);
+        m_buffer->exited = true;
+        pruneExitedBuffers();
+    }
+
+    ThreadBuffer *get() const
+    {
+        return m_buffer.get();
+    }
+
+private:
+    std::shared_ptr<ThreadBuffer> m_buffer;
+};
+
+ThreadBuffer *threadBuffer()
+{
+    thread_local ThreadBufferOwner owner;
+    return owner.get();
+}
+
+void append(const Event &event)
+{
+    auto buffer = threadBuffer();
+    const auto index = buffer->written.load(std::memory_order_relaxed);
+    auto &slot = buffer->events[index % EventsPerThread];
+    slot.index.store(NoEvent, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.name.store(event.name, std::memory_order_relaxed);
+    slot.start.store(event.start, std::memory_order_relaxed);
+    slot.duration.store(event.duration, std::memory_order_relaxed);
+    slot.argument.store(event.argument, std::memory_order_relaxed);
+    slot.index.store(index, std::memory_order_release);
+    buffer->written.store(index + 1, std::memory_order_release);
+}
+
+// Reads the event at \p index, unless its slot was overwritten meanwhile.
+std::optional<Event> readEvent(const ThreadBuffer &buffer, quint64 index)
+{
+    const auto &slot = buffer.events[index % EventsPerThread];
+    if (slot.index.load(std::memory_order_acquire) != index) {
+        return std::nullopt;
+    }
+    Event event{
+        .name = slot.name.load(std::memory_order_relaxed),
+        .start = slot.start.load(std::memory_order_relaxed),
+        .duration = slot.duration.load(std::memory_order_relaxed),
+        .argument = slot.argument.load(std::memory_order_relaxed),
+    };
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.index.load(std::memory_order_relaxed) != index) {
+        return std::nullopt;
+    }
+    return event;
+}
+
+struct ThreadEvents {
+    pid_t threadId = 0;
+    QByteArray threadName;
+    std::vector<Event> events;
+};
+
+std::vector<ThreadEvents> snapshot()
+{
+    std::vector<ThreadEvents> result;
+
+    std::lock_guard lock(s_buffersMutex);
+    for (const auto &buffer : s_buffers) {
+        const auto written = buffer->written.load(std::memory_order_acquire);
+        const auto first = std::max({buffer->discarded.load(std::memory_order_relaxed), written > EventsPerThread ? written - EventsPerThread : 0});
+
+        ThreadEvents threadEvents{.threadId = buffer->threadId, .threadName = buffer->threadName, .events = {}};
+        threadEvents.events.reserve(written - first);
+        for (auto i = first; i < written; ++i) {
+            if (const auto event = readEvent(*buffer, i)) {
+                threadEvents.events.push_back(*event);
+            }
+        }
+        if (!threadEvents.events.empty()) {
+            result.push_back(std::move(threadEvents));
+        }
+    }
+    return result;
+}
+
+QByteArray chromeJson(const std::vector<ThreadEvents> &threads)
+{
+    const auto pid = qint64(getpid());
+
+    QJsonArray events;
+    for (const auto &thread : threads) {
+        events.append(QJsonObject{
+            {QStringLiteral("name"), QStringLiteral("thread_name")},
+            {QStringLiteral("ph"), QStringLiteral("M")},
+            {QStringLiteral("pid"), pid},
+            {QStringLiteral("tid"), qint64(thread.threadId)},
+            {QStringLiteral("args"), QJsonObject{{QStringLiteral("name"), QString::fromUtf8(thread.threadName)}}},
+        });
+
+        for (const auto &event : thread.events) {
+            QJsonObject object{
+                {QStringLiteral("name"), QString::fromLatin1(event.name)},
+                {QStringLiteral("pid"), pid},
+                {QStringLiteral("tid"), qint64(thread.threadId)},
+                {QStringLiteral("ts"), double(event.start) / 1000.0},
+            };
+            if (event.duration >= 0) {
+                object.insert(QStringLiteral("ph"), QStringLiteral("X"));
+                object.insert(QStringLiteral("dur"), double(event.duration) / 1000.0);
+            } else {
+                object.insert(QStringLiteral("ph"), QStringLiteral("i"));
+                object.insert(QStringLiteral("s"), QStringLiteral("t"));
+            }
+            if (event.argument >= 0) {
+                object.insert(QStringLiteral("args"), QJsonObject{{QStringLiteral("value"), event.argument}});
+            }
+            events.append(object);
+        }
+    }
+
+    return QJsonDocument(QJsonObject{{QStringLiteral("traceEvents"), events}, {QStringLiteral("displayTimeUnit"), QStringLiteral("ms")}})
+        .toJson(QJsonDocument::Compact);
+}
+
+// Just enough of the protobuf wire format for perfetto.protos.Trace.
+class ProtoWriter
+{
+public:
+    void varint(quint32 field, quint64 value)
+    {
+        tag(field, 0);
+        rawVarint(value);
+    }
+
+    void bytes(quint32 field, const QByteArray &value)
+    {
+        tag(field, 2);
+        rawVarint(quint64(value.size()));
+        m_data.append(value);
+    }
+
+    void message(quint32 field, const ProtoWriter &value)
+    {
+        bytes(field, value.m_data);
+    }
+
+    const QByteArray &data() const
+    {
+        return m_data;
+    }
+
+private:
+    void tag(quint32 field, quint32 wireType)
+    {
+        rawVarint((quint64(field) << 3) | wireType);
+    }
+
+    void rawVarint(quint64 value)
+    {
+        while (value >= 0x80) {
+            m_data.append(char((value & 0x7f) | 0x80));
+            value >>= 7;
+        }
+        m_data.append(char(value));
+    }
+
+    QByteArray m_data;
+};
+
+QByteArray perfettoProtobuf(const std::vector<ThreadEvents> &threads)
+{
+    // Field numbers from perfetto/protos/perfetto/trace/.
+    constexpr quint32 TracePacketField = 1;
+    constexpr quint32 PacketTimestamp = 8;
+    constexpr quint32 PacketTimestampClockId = 58;
+    constexpr quint32 PacketSequenceId = 10;
+    constexpr quint32 PacketTrackEvent = 11;
+    constexpr quint32 PacketTrackDescriptor = 60;
+    constexpr quint32 TrackUuid = 1;
+    constexpr quint32 TrackName = 2;
+    constexpr quint32 TrackThread = 4;
+    constexpr quint32 ThreadPid = 1;
+    constexpr quint32 ThreadTid = 2;
+    constexpr quint32 ThreadName = 5;
+    constexpr quint32 EventType = 9;
+    constexpr quint32 EventTrackUuid = 11;
+    constexpr quint32 EventName = 23;
+    constexpr quint32 EventDebugAnnotations = 4;
+    constexpr quint32 AnnotationName = 10;
+    constexpr quint32 AnnotationIntValue = 4;
+    constexpr quint64 SliceBegin = 1;
+    constexpr quint64 SliceEnd = 2;
+    constexpr quint64 Instant = 3;
+    constexpr quint64 SequenceId = 1;
+    constexpr quint64 MonotonicClock = 3;
+
+    const auto pid = quint64(getpid());
+
+    ProtoWriter trace;
+    auto addPacket = [&trace](quint64 timestamp, quint32 field, const ProtoWriter &payload) {
+        ProtoWriter packet;
+        if (timestamp > 0) {
+            packet.varint(PacketTimestamp, timestamp);
+            packet.varint(PacketTimestampClockId, MonotonicClock);
+        }
+        packet.varint(PacketSequenceId, SequenceId);
+        packet.message(field, payload);
+        trace.message(TracePacketField, packet);
+    };
+
+    for (const auto &thread : threads) {
+        const auto uuid = quint64(thread.threadId);
+
+        ProtoWriter threadDescriptor;
+        threadDescriptor.varint(ThreadPid, pid);
+        threadDescriptor.varint(ThreadTid, quint64(thread.threadId));
+        threadDescriptor.bytes(ThreadName, thread.threadName);
+        ProtoWriter track;
+        track.varint(TrackUuid, uuid);
+        track.bytes(TrackName, thread.threadName);
+        track.message(TrackThread, threadDescriptor);
+        addPacket(0, PacketTrackDescriptor, track);
+
+        // Slices are recorded when they end, so nested slices come before
+        // the slices containing them. Begin/end pairs need to be ordered.
+        struct Boundary {
+            quint64 timestamp;
+            quint64 type;
+            const Event *event;
+        };
+        std::vector<Boundary> boundaries;
+        boundaries.reserve(thread.events.size() * 2);
+        for (const auto &event : thread.events) {
+            if (event.duration >= 0) {
+                boundaries.push_back({quint64(event.start), SliceBegin, &event});
+                boundaries.push_back({quint64(event.start + event.duration), SliceEnd, &event});
+            } else {
+                boundaries.push_back({quint64(event.start), Instant, &event});
+            }
+        }
+        // At equal timestamps slices are closed before new ones are opened,
+        // inner slices first, and opened outer slices first. Empty slices
+        // open innermost and close after everything else.
+        auto rank = [](const Boundary &boundary) {
+            switch (boundary.type) {
+            case SliceEnd:
+                return boundary.event->duration > 0 ? 0 : 3;
+            case Instant:
+                return 1;
+            default:
+                return 2;
+            }
+        };
+        std::stable_sort(boundaries.begin(), boundaries.end(), [&rank](const Boundary &a, const Boundary &b) {
+            if (a.timestamp != b.timestamp) {
+                return a.timestamp < b.timestamp;
+            }
+            if (rank(a) != rank(b)) {
+                return rank(a) < rank(b);
+            }
+            if (a.event->duration != b.event->duration) {
+                return a.type == SliceBegin ? a.event->duration > b.event->duration : a.event->duration < b.event->duration;
+            }
+            // Same span: the outer slice ended, so was recorded, last.
+            return a.type == SliceBegin && std::greater<const Event *>()(a.event, b.event);
+        });
+
+        for (const auto &boundary : boundaries) {
+            ProtoWriter trackEvent;
+            trackEvent.varint(EventType, boundary.type);
+            trackEvent.varint(EventTrackUuid, uuid);
+            if (boundary.type != SliceEnd) {
+                trackEvent.bytes(EventName, QByteArray(boundary.event->name));
+                if (boundary.event->argument >= 0) {
+                    ProtoWriter annotation;
+                    annotation.bytes(AnnotationName, QByteArrayLiteral("value"));
+                    annotation.varint(AnnotationIntValue, quint64(boundary.event->argument));
+                    trackEvent.message(EventDebugAnnotations, annotation);
+                }
+            }
+            addPacket(boundary.timestamp, PacketTrackEvent, trackEvent);
+        }
+    }
+
+    return trace.data();
+}
+}
+
+void setEnabled(bool enabled)
+{
+    {
+        std::lock_guard lock(s_buffersMutex);
+        if (enabled && !s_enabled) {
+            for (const auto &buffer : s_buffers) {
+                buffer->discarded.store(buffer->written.load(std::memory_order_acquire), std::memory_order_relaxed);
+            }
+        }
+        pruneExitedBuffers();
+    }
+    s_enabled = enabled;
+    qCInfo(KRDP) << "Tracing" << (enabled ? "enabled" : "disabled");
+}
+
+std::chrono::nanoseconds now()
+{
+    return std::chrono::steady_clock::now().time_since_epoch();
+}
+
+void recordSlice(const char *name, std::chrono::nanoseconds start, std::chrono::nanoseconds end, qint64 argument)
+{
+    append(Event{
+        .name = name,
+        .start = start.count(),
+        .duration = std::max<qint64>((end - start).count(), 0),
+        .argument = argument,
+    });
+}
+
+void recordInstant(const char *name, qint64 argument)
+{
+    append(Event{
+        .name = name,
+        .start = now().count(),
+        .duration = -1,
+        .argument = argument,
+    });
+}
+
+bool write(const QString &path)
+{
+    const auto threads = snapshot();
+    const bool perfetto = path.endsWith(QLatin1String(".pftrace")) || path.endsWith(QLatin1String(".perfetto-trace"));
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(KRDP) << "Could not write trace to" << path << file.errorString();
+        return false;
+    }
+    file.write(perfetto ? perfettoProtobuf(threads) : chromeJson(threads));
+    if (!file.commit()) {
+        qCWarning(KRDP) << "Could not write trace to" << path << file.errorString();
+        return false;
+    }
+
+    qCInfo(KRDP) << "Wrote trace to" << path;
+    return true;
+}
+
+}
+}
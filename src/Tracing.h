@@ -0,0 +1,103 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+#include <QString>
+
+#include "krdp_export.h"
+
+namespace KRdp
+{
+
+/**
+ * Opt-in timeline tracing of the video path.
+ *
+ * When enabled, scoped and instant events are recorded into a buffer per
+ * thread without taking locks, and can be written out as a Chrome JSON trace
+ * (chrome://tracing, ui.perfetto.dev) or a Perfetto protobuf trace. When
+ * disabled, recording an event costs a single relaxed atomic load.
+ *
+ * Event names must be string literals, only the pointer is stored.
+ */
+namespace Tracing
+{
+
+KRDP_EXPORT extern std::atomic_bool s_enabled;
+
+inline bool enabled()
+{
+    return s_enabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * Start or stop recording. Starting discards previously recorded events.
+ */
+KRDP_EXPORT void setEnabled(bool enabled);
+
+KRDP_EXPORT std::chrono::nanoseconds now();
+KRDP_EXPORT void recordSlice(const char *name, std::chrono::nanoseconds start, std::chrono::nanoseconds end, qint64 argument);
+KRDP_EXPORT void recordInstant(const char *name, qint64 argument);
+
+/**
+ * Write all recorded events to \p path.
+ *
+ * Paths ending in ".pftrace" or ".perfetto-trace" are written as Perfetto
+ * protobuf traces, everything else as Chrome JSON.
+ */
+KRDP_EXPORT bool write(const QString &path);
+
+inline void instant(const char *name, qint64 argument = -1)
+{
+    if (enabled()) {
+        recordInstant(name, argument);
+    }
+}
+
+/**
+ * Records a slice covering the lifetime of the object.
+ */
+class Scope
+{
+public:
+    explicit Scope(const char *name, qint64 argument = -1)
+        : m_name(enabled() ? name : nullptr)
+        , m_argument(argument)
+    {
+        if (m_name) {
+            m_start = now();
+        }
+    }
+
+    ~Scope()
+    {
+        if (m_name) {
+            recordSlice(m_name, m_start, now(), m_argument);
+        }
+    }
+
+    void setArgument(qint64 argument)
+    {
+        m_argument = argument;
+    }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+private:
+    const char *m_name;
+    qint64 m_argument;
+    std::chrono::nanoseconds m_start{0};
+};
+
+}
+
+}
+
+#define KRDP_TRACE_CONCAT_INNER(a, b) a##b
+#define KRDP_TRACE_CONCAT(a, b) KRDP_TRACE_CONCAT_INNER(a, b)
+#define KRDP_TRACE_SCOPE(...) KRdp::Tracing::Scope KRDP_TRACE_CONCAT(krdpTraceScope, __LINE__)(__VA_ARGS__)
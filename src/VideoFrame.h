@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <memory>
 
 #include <QObject>
@@ -59,6 +60,10 @@ struct VideoFrame {
      * When was this frame presented.
      */
     std::chrono::system_clock::time_point presentationTimeStamp;
+    /**
+     * When the encoded data of this frame arrived from the encoder.
+     */
+    std::chrono::steady_clock::time_point encodedTimeStamp;
 };
 
 }
@@ -10,12 +10,17 @@
 #include "VideoStream.h"
 
 #include <algorithm>
+#include <array>
 #include <cstdint>
 #include <condition_variable>
 #include <limits>
+#include <mutex>
+
+#include <pthread.h>
 #include <vector>
 
 #include <QDateTime>
+#include <QHash>
 #include <QQueue>
 #include <QRect>
 #include <QStringList>
@@ -23,10 +28,16 @@
 #include <freerdp/freerdp.h>
 #include <freerdp/peer.h>
 
+#include "FlightRecorder.h"
+#include "LatencyHistogram.h"
+#include "Metrics.h"
 #include "NetworkDetection.h"
 #include "PeerContext_p.h"
+#include "Probes_p.h"
 #include "RdpConnection.h"
+#include "Tracing.h"
 #include "VideoCodecSupport.h"
+#include "VideoStream_p.h"
 
 #include "krdp_logging.h"
 
@@ -36,14 +47,7 @@ namespace KRdp
 namespace clk = std::chrono;
 
 constexpr clk::system_clock::duration FrameRateEstimateAveragePeriod = clk::seconds(1);
-constexpr int MaxCoalescedDamageRects = 64;
-constexpr int MaxDamageRectCount = 128;
 constexpr int MaxQueuedFrames = 8;
-constexpr int ActivityTileSize = 64;
-constexpr uint8_t ActivityDecayPerFrame = 1;
-constexpr uint8_t ActivityBoostPerDamage = 6;
-constexpr int ActivityStaticThreshold = 2;
-constexpr int ActivityTransientThreshold = 8;
 constexpr int StableFramesBeforeRefinement = 3;
 constexpr auto RefinementCooldown = clk::milliseconds(600);
 constexpr int MaxCongestionQpBias = 8;
@@ -51,7 +55,61 @@ constexpr uint16_t MaxRdpCoordinate = std::numeric_limits<uint16_t>::max();
 constexpr int MinimumFrameRate = 5;
 constexpr int MaxFramesBetweenFullDamage = 8;
 constexpr double FullDamageCoverageThreshold = 0.15;
-constexpr int MaxMonitorLayoutCount = 16;
+constexpr auto DefaultFrameAgeBudget = clk::milliseconds(50);
+// Ages beyond this mean the timestamp is not from our monotonic clock.
+constexpr auto MaxPlausibleFrameAge = clk::seconds(10);
+constexpr auto LatencyLogInterval = clk::seconds(30);
+// Clients that suspend frame acknowledgement never ack the frames sent.
+constexpr int MaxUnacknowledgedFrames = 1024;
+constexpr qint64 MillisecondsPerDay = 24 * 60 * 60 * 1000;
+
+qint64 steadyNs(clk::steady_clock::time_point time)
+{
+    return clk::duration_cast<clk::nanoseconds>(time.time_since_epoch()).count();
+}
+
+clk::microseconds baseFrameAgeBudget()
+{
+    static const auto budget = [] {
+        bool ok = false;
+        const int value = qEnvironmentVariableIntValue("KRDP_FRAME_AGE_BUDGET_MS", &ok);
+        return clk::microseconds(ok && value > 0 ? clk::milliseconds(value) : DefaultFrameAgeBudget);
+    }();
+    return budget;
+}
+
+// Time between the frame's capture and \p now, if the frame has a usable
+// timestamp. Compositor timestamps are taken from CLOCK_MONOTONIC, which is
+// what steady_clock uses on Linux.
+std::optional<clk::microseconds> frameAge(const VideoFrame &frame, clk::steady_clock::time_point now)
+{
+    if (frame.presentationTimeStamp.time_since_epoch().count() == 0) {
+        return std::nullopt;
+    }
+
+    const auto age = clk::duration_cast<clk::microseconds>(now.time_since_epoch() - frame.presentationTimeStamp.time_since_epoch());
+    if (age.count() < 0 || age > MaxPlausibleFrameAge) {
+        return std::nullopt;
+    }
+    return age;
+}
+
+QString latencyStageName(VideoStream::LatencyStage stage)
+{
+    switch (stage) {
+    case VideoStream::LatencyStage::Encode:
+        return QStringLiteral("encode");
+    case VideoStream::LatencyStage::Queue:
+        return QStringLiteral("queue");
+    case VideoStream::LatencyStage::Acknowledge:
+        return QStringLiteral("ack");
+    case VideoStream::LatencyStage::CaptureToSend:
+        return QStringLiteral("capture_to_send");
+    case VideoStream::LatencyStage::EndToEnd:
+        return QStringLiteral("end_to_end");
+    }
+    return QString();
+}
 
 RECTANGLE_16 toRdpRect(const QRect &rect)
 {
@@ -136,11 +194,6 @@ QString monitorLayoutSummary(const QVector<VideoMonitor> &monitors)
     return parts.join(QStringLiteral("; "));
 }
 
-struct RectEncodingQuality {
-    uint8_t qp = 22;
-    uint8_t quality = 100;
-};
-
 RectEncodingQuality qualityForDamageRect(const RECTANGLE_16 &rect,
                                          const QSize &frameSize,
                                          bool isKeyFrame,
@@ -393,17 +446,29 @@ struct Surface {
     QSize size;
 };
 
+struct PendingFrame {
+    clk::steady_clock::time_point sentAt;
+    std::optional<clk::microseconds> ageAtSend;
+};
+
 struct FrameRateEstimate {
     clk::system_clock::time_point timeStamp;
     int estimate = 0;
 };
 
+// Shared with the functions returned by frameSink().
+struct FrameSinkTarget {
+    std::mutex mutex;
+    VideoStream *stream = nullptr;
+};
+
 class KRDP_NO_EXPORT VideoStream::Private
 {
 public:
     using RdpGfxContextPtr = std::unique_ptr<RdpgfxServerContext, decltype(&rdpgfx_server_context_free)>;
 
     RdpConnection *session;
+    std::shared_ptr<FrameSinkTarget> sinkTarget = std::make_shared<FrameSinkTarget>();
 
     RdpGfxContextPtr gfxContext = RdpGfxContextPtr(nullptr, rdpgfx_server_context_free);
 
@@ -414,7 +479,8 @@ public:
     Surface surface;
 
     bool pendingReset = true;
-    bool enabled = false;
+    // Read by queueFrame() on the session's media thread.
+    std::atomic_bool enabled = false;
     bool capsConfirmed = false;
     StreamCodec selectedCodec = StreamCodec::Avc420;
 
@@ -424,12 +490,38 @@ public:
 
     QQueue<VideoFrame> frameQueue;
     int droppedQueuedFrames = 0;
+    // When the oldest frame that was not submitted yet was queued, zero when
+    // the submission thread is caught up.
+    std::atomic<qint64> submitWaitingSinceNs = 0;
+    quint64 submitStallCheck = 0;
+    quint64 acknowledgeStallCheck = 0;
+
+    // Totals for metrics export.
+    quint64 metricsId = 0;
+    quint64 metricsCollector = 0;
+    std::atomic<quint64> framesSent = 0;
+    std::atomic<quint64> bytesSent = 0;
+    std::atomic<quint64> droppedFrames = 0;
+    std::atomic<quint64> fullDamageFrames = 0;
+    std::atomic<quint64> refinementFrames = 0;
+    std::atomic<qint64> averageRttUs = 0;
+    std::atomic<double> sentFrameRate = 0.0;
+    int framesInRateWindow = 0;
+    clk::steady_clock::time_point rateWindowStart;
+    // Written when the RTT changes, read by the submission thread.
+    std::atomic<clk::microseconds::rep> frameAgeBudget = baseFrameAgeBudget().count();
+    std::array<LatencyHistogram, size_t(LatencyStage::EndToEnd) + 1> latencies;
+    clk::steady_clock::time_point lastLatencyLog;
+    // Used to derive the wall-clock frame timestamps from the monotonic clock.
+    clk::steady_clock::time_point timestampBase;
+    qint64 timestampBaseMsecsOfDay = 0;
     clk::system_clock::time_point lastDropLogTime;
-    QSet<uint32_t> pendingFrames;
-    QSize activityFrameSize;
-    int activityTileColumns = 0;
-    int activityTileRows = 0;
-    QVector<uint8_t> activityTiles;
+    // Written by the submission thread, read when acknowledgements arrive.
+    std::mutex pendingFramesMutex;
+    QHash<uint32_t, PendingFrame> pendingFrames;
+    clk::steady_clock::time_point lastAcknowledgedAt;
+    std::atomic_bool acknowledgementSuspended = false;
+    ActivityGrid activity;
 
     int maximumFrameRate = 120;
     int requestedFrameRate = 60;
@@ -445,76 +537,87 @@ public:
     clk::system_clock::time_point lastRefinementFrameTime;
     bool avc444Intent = false;
     bool loggedAvc444WireTransport = false;
-    int congestionQpBias = 0;
+    bool firstFrameSent = false;
+    // Read by the submission thread and the metrics collector.
+    std::atomic_int congestionQpBias = 0;
     clk::milliseconds previousRtt = clk::milliseconds(0);
     QVector<VideoMonitor> monitorLayout;
 
-    void resetActivityGrid(const QSize &size)
+    LatencyHistogram &latency(LatencyStage stage)
     {
-        if (size == activityFrameSize && !activityTiles.isEmpty()) {
-            return;
-        }
-
-        activityFrameSize = size;
-        activityTileColumns = std::max(1, (size.width() + ActivityTileSize - 1) / ActivityTileSize);
-        activityTileRows = std::max(1, (size.height() + ActivityTileSize - 1) / ActivityTileSize);
-        activityTiles.fill(0, activityTileColumns * activityTileRows);
+        return latencies[size_t(stage)];
     }
 
-    void decayActivity()
+    // The RDPGFX timestamp of a frame, the UTC time of day packed as
+    // hour, minute, second and millisecond.
+    uint32_t frameTimestamp(clk::steady_clock::time_point now) const
     {
-        for (auto &activity : activityTiles) {
-            if (activity > ActivityDecayPerFrame) {
-                activity -= ActivityDecayPerFrame;
-            } else {
-                activity = 0;
-            }
-        }
-    }
-
-    template<typename TileFunc>
-    void forEachTileInRect(const RECTANGLE_16 &rect, TileFunc &&tileFunc) const
+        const auto elapsed = clk::duration_cast<clk::milliseconds>(now - timestampBase).count();
+        const auto msecsOfDay = (timestampBaseMsecsOfDay + elapsed) % MillisecondsPerDay;
+        const auto hour = uint32_t(msecsOfDay / (60 * 60 * 1000));
+        const auto minute = uint32_t(msecsOfDay / (60 * 1000) % 60);
+        const auto second = uint32_t(msecsOfDay / 1000 % 60);
+        const auto msec = uint32_t(msecsOfDay % 1000);
+        return hour << 22 | minute << 16 | second << 10 | msec;
+    }
+
+    // Takes the next frame to send from the queue. Frames that are older
+    // than the latency budget are not sent when something newer is queued,
+    // their damage is merged into the frame that follows them instead.
+    // Frames without a capture time are treated as stale, so only the newest
+    // of those is sent.
+    VideoFrame takeAdmittedFrame()
     {
-        if (activityTiles.isEmpty()) {
-            return;
-        }
+        const auto now = clk::steady_clock::now();
+        const auto budget = clk::microseconds(frameAgeBudget.load(std::memory_order_relaxed));
 
-        const auto left = std::clamp<int>(rect.left / ActivityTileSize, 0, activityTileColumns - 1);
-        const auto top = std::clamp<int>(rect.top / ActivityTileSize, 0, activityTileRows - 1);
-        const auto right = std::clamp<int>(std::max<int>(int(rect.right) - 1, int(rect.left)) / ActivityTileSize, 0, activityTileColumns - 1);
-        const auto bottom = std::clamp<int>(std::max<int>(int(rect.bottom) - 1, int(rect.top)) / ActivityTileSize, 0, activityTileRows - 1);
-
-        for (auto y = top; y <= bottom; ++y) {
-            for (auto x = left; x <= right; ++x) {
-                tileFunc(y * activityTileColumns + x);
+        auto frame = frameQueue.takeFirst();
+        while (!frameQueue.isEmpty() && !frame.isKeyFrame) {
+            const auto age = frameAge(frame, now);
+            if (age && *age <= budget) {
+                break;
             }
+
+            auto next = frameQueue.takeFirst();
+            next.damage += frame.damage;
+            frame = std::move(next);
+            droppedQueuedFrames++;
+            droppedFrames++;
+            Tracing::instant("video.frameDropped");
+            KRDP_PROBE1(frame_drop, int(ProbeDropReason::Stale));
+            FlightRecorder::record(FlightRecorder::Event::FrameDropped, quint32(metricsId), int(ProbeDropReason::Stale));
         }
+        return frame;
     }
 
-    int activityForRect(const RECTANGLE_16 &rect) const
+    clk::steady_clock::duration submitStall(clk::steady_clock::time_point now) const
     {
-        if (activityTiles.isEmpty()) {
-            return 0;
+        const auto waitingSince = submitWaitingSinceNs.load(std::memory_order_relaxed);
+        if (waitingSince == 0) {
+            return clk::steady_clock::duration::zero();
         }
-
-        int sum = 0;
-        int count = 0;
-        forEachTileInRect(rect, [this, &sum, &count](int index) {
-            sum += activityTiles[index];
-            count++;
-        });
-
-        return count > 0 ? (sum / count) : 0;
+        return clk::duration_cast<clk::steady_clock::duration>(now.time_since_epoch() - clk::nanoseconds(waitingSince));
     }
 
-    void markDamageActivity(const std::vector<RECTANGLE_16> &rects)
+    clk::steady_clock::duration acknowledgeStall(clk::steady_clock::time_point now)
     {
-        for (const auto &rect : rects) {
-            forEachTileInRect(rect, [this](int index) {
-                const auto boosted = int(activityTiles[index]) + int(ActivityBoostPerDamage);
-                activityTiles[index] = static_cast<uint8_t>(std::min(boosted, 255));
-            });
+        if (acknowledgementSuspended) {
+            return clk::steady_clock::duration::zero();
+        }
+
+        std::lock_guard lock(pendingFramesMutex);
+        if (pendingFrames.isEmpty()) {
+            return clk::steady_clock::duration::zero();
+        }
+        // A single lost acknowledgement is not a stall as long as later
+        // frames still get acknowledged.
+        auto waitingSince = lastAcknowledgedAt;
+        auto oldestSent = clk::steady_clock::time_point::max();
+        for (const auto &frame : std::as_const(pendingFrames)) {
+            oldestSent = std::min(oldestSent, frame.sentAt);
         }
+        waitingSince = std::max(waitingSince, oldestSent);
+        return now - waitingSince;
     }
 };
 
@@ -523,10 +626,30 @@ VideoStream::VideoStream(RdpConnection *session)
     , d(std::make_unique<Private>())
 {
     d->session = session;
+    d->sinkTarget->stream = this;
+
+    static std::atomic<quint64> nextMetricsId = 1;
+    d->metricsId = nextMetricsId++;
+    d->metricsCollector = MetricsRegistry::instance()->addCollector([this](MetricsWriter &writer) {
+        collectMetrics(writer);
+    });
+    d->submitStallCheck = FlightRecorder::addStallCheck("submit", [d = d.get()](clk::steady_clock::time_point now) {
+        return d->submitStall(now);
+    });
+    d->acknowledgeStallCheck = FlightRecorder::addStallCheck("acknowledge", [d = d.get()](clk::steady_clock::time_point now) {
+        return d->acknowledgeStall(now);
+    });
 }
 
 VideoStream::~VideoStream()
 {
+    {
+        std::lock_guard lock(d->sinkTarget->mutex);
+        d->sinkTarget->stream = nullptr;
+    }
+    FlightRecorder::removeStallCheck(d->acknowledgeStallCheck);
+    FlightRecorder::removeStallCheck(d->submitStallCheck);
+    MetricsRegistry::instance()->removeCollector(d->metricsCollector);
 }
 
 bool VideoStream::initialize()
@@ -558,7 +681,11 @@ bool VideoStream::initialize()
 
     connect(d->session->networkDetection(), &NetworkDetection::rttChanged, this, &VideoStream::updateRequestedFrameRate);
 
+    d->timestampBase = clk::steady_clock::now();
+    d->timestampBaseMsecsOfDay = QDateTime::currentDateTimeUtc().time().msecsSinceStartOfDay();
+
     d->frameSubmissionThread = std::jthread([this](std::stop_token token) {
+        pthread_setname_np(pthread_self(), "krdp_submit");
         while (!token.stop_requested()) {
             VideoFrame nextFrame;
             {
@@ -573,12 +700,7 @@ bool VideoStream::initialize()
                 if (d->frameQueue.isEmpty()) {
                     continue;
                 }
-                nextFrame = d->frameQueue.takeLast();
-                const auto staleFrames = d->frameQueue.size();
-                if (staleFrames > 0) {
-                    d->frameQueue.clear();
-                    d->droppedQueuedFrames += staleFrames;
-                }
+                nextFrame = d->takeAdmittedFrame();
 
                 auto now = clk::system_clock::now();
                 if (d->droppedQueuedFrames > 0
@@ -589,6 +711,9 @@ bool VideoStream::initialize()
                 }
             }
             sendFrame(nextFrame);
+
+            std::lock_guard lock(d->frameQueueMutex);
+            d->submitWaitingSinceNs.store(d->frameQueue.isEmpty() ? 0 : steadyNs(clk::steady_clock::now()), std::memory_order_relaxed);
         }
     });
 
@@ -616,6 +741,8 @@ void VideoStream::close()
 
 void VideoStream::queueFrame(const KRdp::VideoFrame &frame)
 {
+    KRDP_TRACE_SCOPE("video.queueFrame");
+
     if (d->session->state() != RdpConnection::State::Streaming || !d->enabled) {
         return;
     }
@@ -623,14 +750,33 @@ void VideoStream::queueFrame(const KRdp::VideoFrame &frame)
     {
         std::lock_guard lock(d->frameQueueMutex);
         while (d->frameQueue.size() >= MaxQueuedFrames) {
-            d->frameQueue.removeFirst();
+            const auto dropped = d->frameQueue.takeFirst();
+            d->frameQueue.first().damage += dropped.damage;
             d->droppedQueuedFrames++;
+            d->droppedFrames++;
+            KRDP_PROBE1(frame_drop, int(ProbeDropReason::QueueFull));
+            FlightRecorder::record(FlightRecorder::Event::FrameDropped, quint32(d->metricsId), int(ProbeDropReason::QueueFull));
         }
         d->frameQueue.append(frame);
+        KRDP_PROBE2(frame_queue, quint64(frame.data.size()), int(d->frameQueue.size()));
+        FlightRecorder::record(FlightRecorder::Event::FrameQueued, quint32(d->metricsId), frame.data.size(), d->frameQueue.size());
+        if (d->submitWaitingSinceNs.load(std::memory_order_relaxed) == 0) {
+            d->submitWaitingSinceNs.store(steadyNs(clk::steady_clock::now()), std::memory_order_relaxed);
+        }
     }
     d->frameQueueCondition.notify_one();
 }
 
+std::function<void(const VideoFrame &)> VideoStream::frameSink() const
+{
+    return [target = d->sinkTarget](const VideoFrame &frame) {
+        std::lock_guard lock(target->mutex);
+        if (target->stream) {
+            target->stream->queueFrame(frame);
+        }
+    };
+}
+
 void VideoStream::reset()
 {
     d->pendingReset = true;
@@ -651,6 +797,7 @@ void VideoStream::setEnabled(bool enabled)
     if (!enabled) {
         std::lock_guard lock(d->frameQueueMutex);
         d->frameQueue.clear();
+        d->submitWaitingSinceNs.store(0, std::memory_order_relaxed);
     }
     Q_EMIT enabledChanged();
 }
@@ -660,6 +807,11 @@ uint32_t VideoStream::requestedFrameRate() const
     return d->requestedFrameRate;
 }
 
+const LatencyHistogram &VideoStream::latency(LatencyStage stage) const
+{
+    return d->latencies[size_t(stage)];
+}
+
 bool VideoStream::onChannelIdAssigned(uint32_t channelId)
 {
     d->channelId = channelId;
@@ -790,6 +942,7 @@ uint32_t VideoStream::onCapsAdvertise(const RDPGFX_CAPS_ADVERTISE_PDU *capsAdver
     d->gfxContext->CapsConfirm(d->gfxContext.get(), &capsConfirmPdu);
 
     d->capsConfirmed = true;
+    d->session->markSetupStage("gfx_caps_confirmed");
 
     return CHANNEL_RC_OK;
 }
@@ -797,11 +950,29 @@ uint32_t VideoStream::onCapsAdvertise(const RDPGFX_CAPS_ADVERTISE_PDU *capsAdver
 uint32_t VideoStream::onFrameAcknowledge(const RDPGFX_FRAME_ACKNOWLEDGE_PDU *frameAcknowledge)
 {
     auto id = frameAcknowledge->frameId;
+    KRDP_TRACE_SCOPE("video.frameAcknowledge", id);
+
+    const auto acknowledgedAt = clk::steady_clock::now();
+    d->acknowledgementSuspended = frameAcknowledge->queueDepth == SUSPEND_FRAME_ACKNOWLEDGEMENT;
+    PendingFrame pendingFrame;
+    {
+        std::lock_guard lock(d->pendingFramesMutex);
+        auto itr = d->pendingFrames.constFind(id);
+        if (itr == d->pendingFrames.cend()) {
+            qCWarning(KRDP) << "Got frame acknowledge for an unknown frame";
+            return CHANNEL_RC_OK;
+        }
+        pendingFrame = itr.value();
+        d->pendingFrames.erase(itr);
+        d->lastAcknowledgedAt = acknowledgedAt;
+    }
 
-    auto itr = d->pendingFrames.constFind(id);
-    if (itr == d->pendingFrames.cend()) {
-        qCWarning(KRDP) << "Got frame acknowledge for an unknown frame";
-        return CHANNEL_RC_OK;
+    const auto acknowledgeTime = clk::duration_cast<clk::microseconds>(acknowledgedAt - pendingFrame.sentAt);
+    KRDP_PROBE3(frame_ack, id, qint64(acknowledgeTime.count()), frameAcknowledge->queueDepth);
+    FlightRecorder::record(FlightRecorder::Event::FrameAcknowledged, quint32(d->metricsId), id, acknowledgeTime.count());
+    d->latency(LatencyStage::Acknowledge).record(acknowledgeTime);
+    if (pendingFrame.ageAtSend) {
+        d->latency(LatencyStage::EndToEnd).record(*pendingFrame.ageAtSend + acknowledgeTime);
     }
 
     if (frameAcknowledge->queueDepth & SUSPEND_FRAME_ACKNOWLEDGEMENT) {
@@ -812,7 +983,6 @@ uint32_t VideoStream::onFrameAcknowledge(const RDPGFX_FRAME_ACKNOWLEDGE_PDU *fra
     }
 
     d->frameDelay = d->encodedFrames - frameAcknowledge->totalFramesDecoded;
-    d->pendingFrames.erase(itr);
 
     return CHANNEL_RC_OK;
 }
@@ -860,6 +1030,8 @@ void VideoStream::performReset(const QSize &size, const QVector<VideoMonitor> &m
 
 void VideoStream::sendFrame(const VideoFrame &frame)
 {
+    Tracing::Scope traceScope("video.sendFrame");
+
     if (!d->gfxContext || !d->capsConfirmed) {
         return;
     }
@@ -879,16 +1051,14 @@ void VideoStream::sendFrame(const VideoFrame &frame)
     d->session->networkDetection()->startBandwidthMeasure();
 
     auto frameId = d->frameId++;
+    traceScope.setArgument(frameId);
 
     d->encodedFrames++;
 
-    d->pendingFrames.insert(frameId);
-
     RDPGFX_START_FRAME_PDU startFramePdu;
     RDPGFX_END_FRAME_PDU endFramePdu;
 
-    auto now = QDateTime::currentDateTimeUtc().time();
-    startFramePdu.timestamp = now.hour() << 22 | now.minute() << 16 | now.second() << 10 | now.msec();
+    startFramePdu.timestamp = d->frameTimestamp(clk::steady_clock::now());
 
     startFramePdu.frameId = frameId;
     endFramePdu.frameId = frameId;
@@ -961,6 +1131,7 @@ void VideoStream::sendFrame(const VideoFrame &frame)
     const bool isRefinementFrame = shouldSendRefinement;
 
     if (useFullDamage) {
+        d->fullDamageFrames++;
         damageRects.clear();
         damageRects.push_back(fullRect);
         d->framesSinceFullDamage = 0;
@@ -987,12 +1158,12 @@ void VideoStream::sendFrame(const VideoFrame &frame)
 
     auto qualities = std::make_unique<RDPGFX_H264_QUANT_QUALITY[]>(damageRects.size());
     streamPayload->meta.quantQualityVals = qualities.get();
-    d->resetActivityGrid(frame.size);
-    d->decayActivity();
+    d->activity.reset(frame.size);
+    d->activity.decay();
     std::vector<int> rectActivityScores;
     rectActivityScores.reserve(damageRects.size());
     for (const auto &rect : damageRects) {
-        rectActivityScores.push_back(d->activityForRect(rect));
+        rectActivityScores.push_back(d->activity.activityForRect(rect));
     }
     for (size_t i = 0; i < damageRects.size(); ++i) {
         const auto quality =
@@ -1001,13 +1172,29 @@ void VideoStream::sendFrame(const VideoFrame &frame)
         qualities[i].p = 0;
         qualities[i].qualityVal = quality.quality;
     }
-    d->markDamageActivity(trackedDamageRects);
+    d->activity.markDamage(trackedDamageRects);
 
     if (isRefinementFrame) {
         d->refinementPending = false;
         d->stableFramesSinceMotion = 0;
         d->lastRefinementFrameTime = clk::system_clock::now();
-        qCDebug(KRDP) << "Sent progressive refinement frame";
+        KRDP_PROBE1(frame_refinement, frameId);
+    }
+
+    // The client may acknowledge the frame before EndFrame() returns, so it
+    // has to be known by then. Send time and age are refined afterwards.
+    {
+        const auto now = clk::steady_clock::now();
+        std::lock_guard lock(d->pendingFramesMutex);
+        if (d->pendingFrames.size() >= MaxUnacknowledgedFrames) {
+            // Acknowledgements for the oldest frame are the least likely to
+            // still arrive.
+            auto oldest = std::min_element(d->pendingFrames.begin(), d->pendingFrames.end(), [](const PendingFrame &first, const PendingFrame &second) {
+                return first.sentAt < second.sentAt;
+            });
+            d->pendingFrames.erase(oldest);
+        }
+        d->pendingFrames.insert(frameId, PendingFrame{.sentAt = now, .ageAtSend = frameAge(frame, now)});
     }
 
     d->gfxContext->StartFrame(d->gfxContext.get(), &startFramePdu);
@@ -1016,6 +1203,83 @@ void VideoStream::sendFrame(const VideoFrame &frame)
     d->gfxContext->EndFrame(d->gfxContext.get(), &endFramePdu);
 
     d->session->networkDetection()->stopBandwidthMeasure();
+
+    const auto sentAt = clk::steady_clock::now();
+    d->framesSent++;
+    d->bytesSent += quint64(frame.data.size());
+    if (isRefinementFrame) {
+        d->refinementFrames++;
+    }
+    d->framesInRateWindow++;
+    if (sentAt - d->rateWindowStart >= clk::seconds(1)) {
+        const auto window = clk::duration<double>(sentAt - d->rateWindowStart).count();
+        d->sentFrameRate = d->rateWindowStart.time_since_epoch().count() == 0 ? 0.0 : d->framesInRateWindow / window;
+        d->framesInRateWindow = 0;
+        d->rateWindowStart = sentAt;
+    }
+
+    const auto ageAtSend = frameAge(frame, sentAt);
+    KRDP_PROBE3(frame_send, frameId, quint64(frame.data.size()), qint64(ageAtSend ? ageAtSend->count() : -1));
+    FlightRecorder::record(FlightRecorder::Event::FrameSent, quint32(d->metricsId), frameId, frame.data.size());
+    if (ageAtSend) {
+        d->latency(LatencyStage::CaptureToSend).record(*ageAtSend);
+        if (frame.encodedTimeStamp.time_since_epoch().count() != 0) {
+            if (const auto encodeAge = frameAge(frame, frame.encodedTimeStamp)) {
+                d->latency(LatencyStage::Encode).record(*encodeAge);
+            }
+        }
+    }
+    if (frame.encodedTimeStamp.time_since_epoch().count() != 0) {
+        d->latency(LatencyStage::Queue).record(clk::duration_cast<clk::microseconds>(sentAt - frame.encodedTimeStamp));
+    }
+
+    {
+        std::lock_guard lock(d->pendingFramesMutex);
+        auto itr = d->pendingFrames.find(frameId);
+        if (itr != d->pendingFrames.end()) {
+            itr->sentAt = sentAt;
+            itr->ageAtSend = ageAtSend;
+        }
+    }
+
+    if (sentAt - d->lastLatencyLog >= LatencyLogInterval && d->latency(LatencyStage::CaptureToSend).count() > 0) {
+        d->lastLatencyLog = sentAt;
+        for (auto stage : {LatencyStage::Encode, LatencyStage::Queue, LatencyStage::Acknowledge, LatencyStage::CaptureToSend, LatencyStage::EndToEnd}) {
+            qCDebug(KRDP).noquote() << "Frame latency" << latencyStageName(stage) << d->latency(stage).summary();
+        }
+        qCDebug(KRDP) << "Frame age budget:" << clk::duration_cast<clk::milliseconds>(clk::microseconds(d->frameAgeBudget.load())).count() << "ms";
+    }
+
+    if (!d->firstFrameSent) {
+        d->firstFrameSent = true;
+        d->session->completeSetupTimeline();
+    }
+}
+
+void VideoStream::collectMetrics(MetricsWriter &writer) const
+{
+    const MetricsWriter::Labels labels = {{QStringLiteral("session"), QString::number(d->metricsId)}};
+
+    const auto framesSent = d->framesSent.load();
+    const auto fullDamageFrames = d->fullDamageFrames.load();
+    writer.counter(QStringLiteral("krdp_frames_sent_total"), QStringLiteral("Frames sent to the client."), double(framesSent), labels);
+    writer.gauge(QStringLiteral("krdp_frames_sent_per_second"), QStringLiteral("Frames sent to the client during the last second."), d->sentFrameRate.load(), labels);
+    writer.counter(QStringLiteral("krdp_bytes_sent_total"), QStringLiteral("Encoded video bytes sent to the client."), double(d->bytesSent.load()), labels);
+    writer.counter(QStringLiteral("krdp_frames_dropped_total"), QStringLiteral("Frames dropped before sending, their damage merged into a later frame."), double(d->droppedFrames.load()), labels);
+    writer.counter(QStringLiteral("krdp_full_damage_frames_total"), QStringLiteral("Frames sent with full-frame damage."), double(fullDamageFrames), labels);
+    writer.gauge(QStringLiteral("krdp_full_damage_ratio"), QStringLiteral("Share of sent frames that used full-frame damage."), framesSent > 0 ? double(fullDamageFrames) / double(framesSent) : 0.0, labels);
+    writer.counter(QStringLiteral("krdp_refinement_frames_total"), QStringLiteral("Progressive refinement frames sent."), double(d->refinementFrames.load()), labels);
+    writer.gauge(QStringLiteral("krdp_requested_frame_rate"), QStringLiteral("Frame rate requested from the capture session."), double(d->requestedFrameRate), labels);
+    writer.gauge(QStringLiteral("krdp_rtt_seconds"), QStringLiteral("Average round trip time to the client."), double(d->averageRttUs.load()) / 1'000'000.0, labels);
+    writer.gauge(QStringLiteral("krdp_decoder_queue_depth"), QStringLiteral("Decoder queue depth reported by the client."), double(d->decoderQueueDepth.load()), labels);
+    writer.gauge(QStringLiteral("krdp_unacknowledged_frames"), QStringLiteral("Frames sent but not yet decoded by the client."), double(std::max(d->frameDelay.load(), 0)), labels);
+    writer.gauge(QStringLiteral("krdp_congestion_qp_bias"), QStringLiteral("QP bias applied because of congestion."), double(d->congestionQpBias.load()), labels);
+
+    for (auto stage : {LatencyStage::Encode, LatencyStage::Queue, LatencyStage::Acknowledge, LatencyStage::CaptureToSend, LatencyStage::EndToEnd}) {
+        auto stageLabels = labels;
+        stageLabels.append({QStringLiteral("stage"), latencyStageName(stage)});
+        writer.histogram(QStringLiteral("krdp_frame_latency_seconds"), QStringLiteral("Frame latency per stage of the video path."), d->latencies[size_t(stage)], stageLabels);
+    }
 }
 
 void VideoStream::updateRequestedFrameRate()
@@ -1030,6 +1294,14 @@ void VideoStream::updateRequestedFrameRate()
         rttRiseMs = std::max(0, int((rtt - d->previousRtt).count()));
     }
     d->previousRtt = rtt;
+    d->averageRttUs = clk::duration_cast<clk::microseconds>(d->session->networkDetection()->averageRTT()).count();
+
+    // On slow links a frame that waited a little is still worth sending
+    // compared to the time it spends on the wire, so allow up to half the
+    // RTT on top of the base budget.
+    const auto baseBudget = baseFrameAgeBudget();
+    const auto frameAgeBudget = baseBudget + std::min(clk::duration_cast<clk::microseconds>(rtt) / 2, baseBudget);
+    d->frameAgeBudget.store(frameAgeBudget.count(), std::memory_order_relaxed);
 
     FrameRateEstimate estimate;
     estimate.timeStamp = now;
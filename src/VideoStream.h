@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <functional>
 #include <memory>
 #include <optional>
 
@@ -17,54 +18,16 @@
 
 #include <freerdp/server/rdpgfx.h>
 
+#include "VideoFrame.h"
 #include "krdp_export.h"
 
 namespace KRdp
 {
 
+class LatencyHistogram;
+class MetricsWriter;
 class RdpConnection;
 
-struct VideoMonitor {
-    QRect geometry;
-    bool primary = false;
-
-    bool operator==(const VideoMonitor &other) const
-    {
-        return geometry == other.geometry && primary == other.primary;
-    }
-};
-
-/**
- * A frame of compressed video data.
- */
-struct VideoFrame {
-    /**
-     * The size of the frame, in pixels.
-     */
-    QSize size;
-    /**
-     * h264 compressed data in YUV420 color space.
-     */
-    QByteArray data;
-    /**
-     * Area of the frame that was actually damaged.
-     * TODO: Actually use this information.
-     */
-    QRegion damage;
-    /**
-     * Whether the packet contains all the information
-     */
-    bool isKeyFrame;
-    /**
-     * Logical monitor layout mapped into this frame's coordinate space.
-     */
-    QVector<VideoMonitor> monitors;
-    /**
-     * When was this frame presented.
-     */
-    std::chrono::system_clock::time_point presentationTimeStamp;
-};
-
 /**
  * A class that encapsulates an RdpGfx video stream.
  *
@@ -102,6 +65,16 @@ public:
      */
     void queueFrame(const VideoFrame &frame);
 
+    /**
+     * A function that queues frames to this stream, like queueFrame().
+     *
+     * Unlike a connection to queueFrame(), producers on other threads can
+     * keep it past the lifetime of the stream. Frames are dropped once the
+     * stream is destroyed, and destruction waits for frames that are being
+     * queued at that moment.
+     */
+    std::function<void(const VideoFrame &)> frameSink() const;
+
     /**
      * Indicate that the video state should be reset.
      *
@@ -119,6 +92,26 @@ public:
     uint32_t requestedFrameRate() const;
     Q_SIGNAL void requestedFrameRateChanged();
 
+    /**
+     * Parts of the video path that latency is measured for.
+     */
+    enum class LatencyStage {
+        Encode, ///< From capture until the encoded frame arrived.
+        Queue, ///< From arrival of the encoded frame until it was sent.
+        Acknowledge, ///< From sending until the client acknowledged the frame.
+        CaptureToSend, ///< From capture until the frame was sent.
+        EndToEnd, ///< From capture until the client acknowledged the frame.
+    };
+    Q_ENUM(LatencyStage)
+
+    /**
+     * Latency histogram of a stage for the frames of this stream.
+     *
+     * Stages that start at capture only record frames with a capture
+     * timestamp.
+     */
+    const LatencyHistogram &latency(LatencyStage stage) const;
+
 private:
     friend BOOL gfxChannelIdAssigned(RdpgfxServerContext *, uint32_t);
     friend uint32_t gfxCapsAdvertise(RdpgfxServerContext *, const RDPGFX_CAPS_ADVERTISE_PDU *);
@@ -132,6 +125,7 @@ private:
     void sendFrame(const VideoFrame &frame);
 
     void updateRequestedFrameRate();
+    void collectMetrics(MetricsWriter &writer) const;
 
     class Private;
     const std::unique_ptr<Private> d;
@@ -0,0 +1,159 @@
+// SPDX-FileCopyrightText: 2026 KDE Contributors
+//
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#pragma once
+
+// Per-frame helpers of VideoStream, exposed for the benchmarks in autotests.
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <QRect>
+#include <QSize>
+#include <QVector>
+
+#include <freerdp/freerdp.h>
+
+#include "TestsExport_p.h"
+#include "VideoFrame.h"
+
+namespace KRdp
+{
+
+constexpr int ActivityTileSize = 64;
+constexpr uint8_t ActivityDecayPerFrame = 1;
+constexpr uint8_t ActivityBoostPerDamage = 6;
+constexpr int ActivityStaticThreshold = 2;
+constexpr int ActivityTransientThreshold = 8;
+constexpr int MaxCoalescedDamageRects = 64;
+constexpr int MaxDamageRectCount = 128;
+constexpr int MaxMonitorLayoutCount = 16;
+
+struct RectEncodingQuality {
+    uint8_t qp = 22;
+    uint8_t quality = 100;
+};
+
+/**
+ * Clamp \p rect to RDP's 16 bit coordinates. The result is never empty.
+ */
+KRDP_TESTS_EXPORT RECTANGLE_16 toRdpRect(const QRect &rect);
+
+/**
+ * The monitor layout to announce for \p frame: its monitors clipped to the
+ * frame, at most MaxMonitorLayoutCount, with exactly one primary. A single
+ * monitor covering the frame if it has none.
+ */
+KRDP_TESTS_EXPORT QVector<VideoMonitor> monitorLayoutForReset(const VideoFrame &frame);
+
+/**
+ * QP and quality for one damage rect, from its share of the frame, how much
+ * its area changed recently (\p activityScore) and congestion.
+ */
+KRDP_TESTS_EXPORT RectEncodingQuality qualityForDamageRect(const RECTANGLE_16 &rect,
+                                                           const QSize &frameSize,
+                                                           bool isKeyFrame,
+                                                           bool isRefinementFrame,
+                                                           bool avc444Intent,
+                                                           int activityScore,
+                                                           int congestionQpBias);
+
+/**
+ * The damage of \p frame as RDP rects, merging rects when there are more
+ * than MaxCoalescedDamageRects. The whole frame for key frames, frames
+ * without damage and frames with too many rects.
+ */
+KRDP_TESTS_EXPORT std::vector<RECTANGLE_16> toDamageRects(const VideoFrame &frame);
+
+/**
+ * How often areas of the frame changed recently, in tiles of
+ * ActivityTileSize. Damage raises the activity of the tiles it touches and
+ * every frame lets all tiles decay a little.
+ */
+class ActivityGrid
+{
+public:
+    /**
+     * Start over for frames of \p size, unless the size is unchanged.
+     */
+    void reset(const QSize &size)
+    {
+        if (size == m_frameSize && !m_tiles.isEmpty()) {
+            return;
+        }
+
+        m_frameSize = size;
+        m_columns = std::max(1, (size.width() + ActivityTileSize - 1) / ActivityTileSize);
+        m_rows = std::max(1, (size.height() + ActivityTileSize - 1) / ActivityTileSize);
+        m_tiles.fill(0, m_columns * m_rows);
+    }
+
+    void decay()
+    {
+        for (auto &activity : m_tiles) {
+            if (activity > ActivityDecayPerFrame) {
+                activity -= ActivityDecayPerFrame;
+            } else {
+                activity = 0;
+            }
+        }
+    }
+
+    /**
+     * Mean activity of the tiles \p rect touches.
+     */
+    int activityForRect(const RECTANGLE_16 &rect) const
+    {
+        if (m_tiles.isEmpty()) {
+            return 0;
+        }
+
+        int sum = 0;
+        int count = 0;
+        forEachTileInRect(rect, [this, &sum, &count](int index) {
+            sum += m_tiles[index];
+            count++;
+        });
+
+        return count > 0 ? (sum / count) : 0;
+    }
+
+    void markDamage(const std::vector<RECTANGLE_16> &rects)
+    {
+        for (const auto &rect : rects) {
+            forEachTileInRect(rect, [this](int index) {
+                const auto boosted = int(m_tiles[index]) + int(ActivityBoostPerDamage);
+                m_tiles[index] = static_cast<uint8_t>(std::min(boosted, 255));
+            });
+        }
+    }
+
+private:
+    template<typename TileFunc>
+    void forEachTileInRect(const RECTANGLE_16 &rect, TileFunc &&tileFunc) const
+    {
+        if (m_tiles.isEmpty()) {
+            return;
+        }
+
+        const auto left = std::clamp<int>(rect.left / ActivityTileSize, 0, m_columns - 1);
+        const auto top = std::clamp<int>(rect.top / ActivityTileSize, 0, m_rows - 1);
+        const auto right = std::clamp<int>(std::max<int>(int(rect.right) - 1, int(rect.left)) / ActivityTileSize, 0, m_columns - 1);
+        const auto bottom = std::clamp<int>(std::max<int>(int(rect.bottom) - 1, int(rect.top)) / ActivityTileSize, 0, m_rows - 1);
+
+        for (auto y = top; y <= bottom; ++y) {
+            for (auto x = left; x <= right; ++x) {
+                tileFunc(y * m_columns + x);
+            }
+        }
+    }
+
+    QSize m_frameSize;
+    int m_columns = 0;
+    int m_rows = 0;
+    QVector<uint8_t> m_tiles;
+};
+
+}